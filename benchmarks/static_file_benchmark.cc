@@ -0,0 +1,143 @@
+// Compares the ways `StaticHandler` can move a large file from disk to a
+// socket: throughput and CPU time (of the sending thread) per GiB served.
+//
+//   static_file_benchmark --file_mib=1024 --rounds=3 [--cold]
+//
+// The peer end of a socket pair is drained by another thread, so this
+// measures the server side only; it does not include proxygen's own framing
+// or the EventBase hops between windows.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/init/Init.h>
+#include <folly/portability/GFlags.h>
+#include <functional>
+#include <glog/logging.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+#include "url_shortener/file_window.h"
+
+DEFINE_uint64(file_mib, 1024, "Size of the file to serve, in MiB");
+DEFINE_int32(rounds, 3, "Times to serve the file with each strategy");
+DEFINE_string(dir, "/tmp", "Directory in which to create the test file");
+DEFINE_bool(cold, false, "Drop the file from the page cache before each run");
+
+namespace {
+
+using namespace ::ec_prv::url_shortener::web;
+
+using Strategy = std::function<void(const folly::File &file, std::size_t size,
+                                    int sock)>;
+
+// What `StaticHandler::read_file` did before: 4000 bytes per read.
+void serve_small_reads(const folly::File &file, std::size_t size, int sock) {
+  std::vector<uint8_t> buf(4000);
+  std::size_t offset = 0;
+  while (offset < size) {
+    auto rc = folly::preadNoInt(file.fd(), buf.data(), buf.size(), offset);
+    CHECK_GT(rc, 0);
+    CHECK_EQ(folly::writeFull(sock, buf.data(), rc), rc);
+    offset += rc;
+  }
+}
+
+// Positioned reads of the largest window, as `StaticHandler` streams large
+// files now.
+void serve_pread_windows(const folly::File &file, std::size_t size, int sock) {
+  for (std::size_t offset = 0; offset < size;) {
+    auto window = read_file_window(
+        file.fd(), offset, std::min(max_file_window_size, size - offset));
+    CHECK(window);
+    CHECK_EQ(folly::writeFull(sock, window->data(), window->length()),
+             window->length());
+    offset += window->length();
+  }
+}
+
+// Reference point: the kernel copies page cache to socket with no userspace
+// involvement. Not reachable through proxygen, which owns the socket.
+void serve_sendfile(const folly::File &file, std::size_t size, int sock) {
+  off_t offset = 0;
+  while (static_cast<std::size_t>(offset) < size) {
+    auto rc = sendfile(sock, file.fd(), &offset, size - offset);
+    CHECK_GT(rc, 0);
+  }
+}
+
+auto thread_cpu_seconds() -> double {
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+void run(const char *name, const Strategy &serve,
+         const std::filesystem::path &file_path, std::size_t size) {
+  double wall_seconds = 0;
+  double cpu_seconds = 0;
+  for (int round = 0; round < FLAGS_rounds; ++round) {
+    folly::File file{file_path.c_str()};
+    if (FLAGS_cold) {
+      posix_fadvise(file.fd(), 0, 0, POSIX_FADV_DONTNEED);
+    }
+    int socks[2];
+    PCHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, socks) == 0);
+    std::thread drain{[fd = socks[1]] {
+      std::vector<uint8_t> sink(1 << 20);
+      while (folly::readNoInt(fd, sink.data(), sink.size()) > 0) {
+      }
+    }};
+    auto cpu_before = thread_cpu_seconds();
+    auto wall_before = std::chrono::steady_clock::now();
+    serve(file, size, socks[0]);
+    wall_seconds += std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - wall_before)
+                        .count();
+    cpu_seconds += thread_cpu_seconds() - cpu_before;
+    close(socks[0]);
+    drain.join();
+    close(socks[1]);
+  }
+  const double gib = static_cast<double>(size) * FLAGS_rounds / (1ULL << 30);
+  std::printf("%-24s %10.1f MiB/s %10.3f CPU s/GiB\n", name,
+              gib * 1024 / wall_seconds, cpu_seconds / gib);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  folly::Init _folly_init{&argc, &argv, true};
+
+  const std::size_t size = FLAGS_file_mib << 20;
+  const auto file_path =
+      std::filesystem::path{FLAGS_dir} / "static_file_benchmark.bin";
+  {
+    folly::File out{file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC};
+    std::vector<uint8_t> block(1 << 20);
+    for (std::size_t i = 0; i < block.size(); ++i) {
+      block[i] = static_cast<uint8_t>(i * 2654435761U >> 24);
+    }
+    for (std::size_t written = 0; written < size; written += block.size()) {
+      CHECK_EQ(folly::writeFull(out.fd(), block.data(), block.size()),
+               block.size());
+    }
+  }
+
+  run("read 4000 B (before)", serve_small_reads, file_path, size);
+  run("pread windows (now)", serve_pread_windows, file_path, size);
+  run("sendfile (reference)", serve_sendfile, file_path, size);
+
+  std::filesystem::remove(file_path);
+  return 0;
+}
@@ -1,8 +1,11 @@
 import React from 'react';
 import ReCAPTCHA from 'react-google-recaptcha';
+import { solveProofOfWork } from './proofOfWork';
 
 const urlShortenerBaseUrl = process.env.NEXT_PUBLIC__EC_PRV_URL_SHORTENER__BASE_URL;
 const apiBaseUrl = process.env.NEXT_PUBLIC__EC_PRV_URL_SHORTENER__API_BASE_URL;
+// "recaptcha" or "proof_of_work", as the server's captcha_verifier
+const verifier = process.env.NEXT_PUBLIC__EC_PRV_URL_SHORTENER__VERIFIER ?? 'recaptcha';
 
 class UrlShortenerApiError extends Error {
     private statusCode: number;
@@ -45,7 +48,9 @@ export default function ShortenUrlBox() {
     const handleSubmit = async (e: React.FormEvent<HTMLFormElement>) => {
         e.preventDefault();
         setIsLoading(true);
-        if (recaptchaRef != null && recaptchaRef.current != null) {
+        if (verifier === 'proof_of_work') {
+            // the challenge is solved for the URL being submitted, below
+        } else if (recaptchaRef != null && recaptchaRef.current != null) {
             recaptchaRef.current.reset();
 	    setRecaptchaUserResponse('');
         } else {
@@ -53,12 +58,17 @@ export default function ShortenUrlBox() {
             setErrored(true);
         }
         try {
-            const shortUrl = await makeRequest(recaptchaUserResponse, urlToShorten);
+            const userCaptchaResponse = verifier === 'proof_of_work'
+                ? await solveProofOfWork(urlToShorten)
+                : recaptchaUserResponse;
+            const shortUrl = await makeRequest(userCaptchaResponse, urlToShorten);
             setShortenedUrlResult(`${urlShortenerBaseUrl}/${shortUrl}`);
         } catch (e) {
             if (e instanceof UrlShortenerApiError) {
                 if (e.getStatusCode() == 429) {
                     setWarned("You did that too much. Wait longer and try again later.");
+                } else if (e.getStatusCode() == 503) {
+                    setWarned("We could not check that you are human right now. Try again in a few seconds.");
                 } else {
                     console.error(e);
                     setErrored(true);
@@ -92,7 +102,7 @@ export default function ShortenUrlBox() {
         }
     }
     const recaptchaV2SiteKey = process.env.NEXT_PUBLIC__EC_PRV_URL_SHORTENER__RECAPTCHA_V2_SITE_KEY;
-    if (recaptchaV2SiteKey == null || recaptchaV2SiteKey.length === 0) {
+    if (verifier !== 'proof_of_work' && (recaptchaV2SiteKey == null || recaptchaV2SiteKey.length === 0)) {
         return (<>Missing reCaptcha V2 site key!</>)
     };
     return (
@@ -112,14 +122,14 @@ export default function ShortenUrlBox() {
                         required={true}
                         placeholder={`https://example.com/${new Date().getFullYear()}/${new Date().getMonth().toString().padStart(2, '0')}/${new Date().getDate().toString().padStart(2, '0')}/a-very-long-url.html`} />
                 </div>
-                <div className="py-2 flex mx-auto">
+                {verifier !== 'proof_of_work' && (<div className="py-2 flex mx-auto">
                     <ReCAPTCHA ref={e => { if (e != null) recaptchaRef.current = e; }}
-                        sitekey={recaptchaV2SiteKey}
+                        sitekey={recaptchaV2SiteKey!}
                         className="py-0"
                         onChange={handleRecaptchaV2Change} />
-                </div>
+                </div>)}
                 {isLoading ? (<span className="loading loading-spinner loading-lg mx-auto my-4"></span>) : (<button
-                    disabled={!(recaptchaUserResponse.length > 0 && urlToShorten.length > 0 && validUrl.test(urlToShorten.trim()))}
+                    disabled={!((verifier === 'proof_of_work' || recaptchaUserResponse.length > 0) && urlToShorten.length > 0 && validUrl.test(urlToShorten.trim()))}
                     className="btn btn-primary btn-wide my-4 mx-auto"
                     type="submit">Shorten URL</button>)}
                 {errored && (<div className="alert alert-error">
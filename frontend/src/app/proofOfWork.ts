@@ -0,0 +1,38 @@
+const apiBaseUrl = process.env.NEXT_PUBLIC__EC_PRV_URL_SHORTENER__API_BASE_URL;
+
+type Challenge = {
+    challenge: string;
+    difficulty: number;
+    expires: number;
+};
+
+const leadingZeroBits = (digest: Uint8Array): number => {
+    let bits = 0;
+    for (const byte of digest) {
+        if (byte === 0) {
+            bits += 8;
+            continue;
+        }
+        return bits + Math.clz32(byte) - 24;
+    }
+    return bits;
+}
+
+// Fetches a challenge and finds a counter for which the SHA-256 of
+// "<challenge>:<counter>:<longUrl>" has enough leading zero bits. The result is
+// sent as the user_captcha_response of /api/v1/create.
+export const solveProofOfWork = async (longUrl: string): Promise<string> => {
+    const response = await fetch(`${apiBaseUrl}/api/v1/challenge`, { cache: 'no-store' });
+    if (response.status != 200) {
+        throw new Error(response.status.toString());
+    }
+    const { challenge, difficulty }: Challenge = await response.json();
+    const encoder = new TextEncoder();
+    for (let counter = 0; ; counter++) {
+        const candidate = `${challenge}:${counter}`;
+        const digest = await crypto.subtle.digest('SHA-256', encoder.encode(`${candidate}:${longUrl}`));
+        if (leadingZeroBits(new Uint8Array(digest)) >= difficulty) {
+            return candidate;
+        }
+    }
+}
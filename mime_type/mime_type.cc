@@ -1,8 +1,120 @@
 #include "mime_type/mime_type.h"
-#include <filesystem>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 
 namespace ec_prv {
 namespace mime_type {
+namespace {
+
+struct KnownExtension {
+  std::string_view extension;
+  MimeType mime_type;
+};
+
+constexpr KnownExtension known_extensions[] = {
+    {"html", MimeType::HTML},
+    {"htm", MimeType::HTML},
+    {"js", MimeType::JS},
+    {"mjs", MimeType::JS},
+    {"css", MimeType::CSS},
+    {"woff2", MimeType::WOFF2},
+    {"woff", MimeType::WOFF},
+    {"jpeg", MimeType::JPEG},
+    {"jpg", MimeType::JPEG},
+    {"png", MimeType::PNG},
+    {"webp", MimeType::WEBP},
+    {"svg", MimeType::SVG},
+    {"ico", MimeType::ICO},
+    {"txt", MimeType::TEXT},
+    {"md", MimeType::TEXT},
+    {"rst", MimeType::TEXT},
+    {"json", MimeType::JSON},
+    {"map", MimeType::JSON},
+    {"jsonld", MimeType::JSON_LD},
+    {"otf", MimeType::OPENTYPE_FONT},
+    {"ogg", MimeType::OGG},
+    {"ogv", MimeType::OGG_VIDEO},
+    {"oga", MimeType::OGG_AUDIO},
+    {"opus", MimeType::OPUS},
+    {"pdf", MimeType::PDF},
+    {"mp3", MimeType::MP3},
+    {"mpeg", MimeType::MPEG},
+    {"mp4", MimeType::MP4},
+};
+
+constexpr std::size_t max_extension_length = 8;
+constexpr unsigned slot_bits = 7;
+constexpr std::size_t num_slots = std::size_t{1} << slot_bits;
+
+// FNV-1a, perturbed by a seed chosen at compile time
+constexpr auto hash(std::string_view s, uint32_t seed) -> uint32_t {
+  uint32_t h = 2166136261U ^ seed;
+  for (char c : s) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 16777619U;
+  }
+  return h;
+}
+
+// The low bits of an FNV hash only depend on the low bits of its input, so
+// take the high ones.
+constexpr auto slot_of(std::string_view s, uint32_t seed) -> std::size_t {
+  return hash(s, seed) >> (32 - slot_bits);
+}
+
+constexpr auto is_perfect(uint32_t seed) -> bool {
+  std::array<bool, num_slots> used{};
+  for (const auto &known : known_extensions) {
+    auto slot = slot_of(known.extension, seed);
+    if (used[slot]) {
+      return false;
+    }
+    used[slot] = true;
+  }
+  return true;
+}
+
+constexpr auto find_seed() -> uint32_t {
+  uint32_t seed = 0;
+  while (!is_perfect(seed)) {
+    ++seed;
+  }
+  return seed;
+}
+
+constexpr uint32_t seed = find_seed();
+
+// index into `known_extensions` for each slot, or -1
+constexpr auto build_slots() -> std::array<int8_t, num_slots> {
+  std::array<int8_t, num_slots> slots{};
+  slots.fill(-1);
+  for (std::size_t i = 0; i < std::size(known_extensions); ++i) {
+    slots[slot_of(known_extensions[i].extension, seed)] = i;
+  }
+  return slots;
+}
+
+constexpr auto slots = build_slots();
+
+static_assert(std::size(known_extensions) <
+              std::numeric_limits<int8_t>::max());
+
+auto ascii_lower(char c) -> char {
+  return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+auto lowercase(std::string_view s) -> std::string {
+  std::string dst{s};
+  for (char &c : dst) {
+    c = ascii_lower(c);
+  }
+  return dst;
+}
+
+} // namespace
 
 auto string(MimeType src) -> std::string_view {
   switch (src) {
@@ -40,6 +152,8 @@ auto string(MimeType src) -> std::string_view {
     return "video/ogg";
   case MimeType::OGG:
     return "application/ogg";
+  case MimeType::OPUS:
+    return "audio/opus";
   case MimeType::OPENTYPE_FONT:
     return "font/otf";
   case MimeType::MP3:
@@ -54,51 +168,53 @@ auto string(MimeType src) -> std::string_view {
   }
 }
 
+auto extension(std::string_view filename) -> std::string_view {
+  auto slash = filename.rfind('/');
+  std::string_view basename =
+      slash == std::string_view::npos ? filename : filename.substr(slash + 1);
+  auto dot = basename.rfind('.');
+  if (dot == std::string_view::npos || dot == 0) {
+    return {};
+  }
+  return basename.substr(dot + 1);
+}
+
 auto infer_mime_type(std::string_view filename) -> MimeType {
-  std::filesystem::path p{filename};
-  auto ext = p.extension();
-  if (ext == ".html" || ext == ".htm") {
-    return MimeType::HTML;
-  } else if (ext == ".js") {
-    return MimeType::JS;
-  } else if (ext == ".css") {
-    return MimeType::CSS;
-  } else if (ext == ".woff2") {
-    return MimeType::WOFF2;
-  } else if (ext == ".woff") {
-    return MimeType::WOFF;
-  } else if (ext == ".jpeg" || ext == ".jpg") {
-    return MimeType::JPEG;
-  } else if (ext == ".png") {
-    return MimeType::PNG;
-  } else if (ext == ".svg") {
-    return MimeType::SVG;
-  } else if (ext == ".ico") {
-    return MimeType::ICO;
-  } else if (ext == ".txt" || ext == ".md" || ext == ".rst") {
-    return MimeType::TEXT;
-  } else if (ext == ".json") {
-    return MimeType::JSON;
-  } else if (ext == ".jsonld") {
-    return MimeType::JSON_LD;
-  } else if (ext == ".otf") {
-    return MimeType::OPENTYPE_FONT;
-  } else if (ext == ".ogg") {
-    return MimeType::OGG;
-  } else if (ext == ".ogv") {
-    return MimeType::OGG_VIDEO;
-  } else if (ext == "oga") {
-    return MimeType::OGG_AUDIO;
-  } else if (ext == ".png") {
-    return MimeType::PDF;
-  } else if (ext == ".mp3") {
-    return MimeType::MP3;
-  } else if (ext == ".mpeg") {
-    return MimeType::MPEG;
-  } else if (ext == ".mp4") {
-    return MimeType::MP4;
+  auto ext = extension(filename);
+  if (ext.empty() || ext.size() > max_extension_length) {
+    return MimeType::OCTET_STREAM;
+  }
+  char buf[max_extension_length];
+  for (std::size_t i = 0; i < ext.size(); ++i) {
+    buf[i] = ascii_lower(ext[i]);
+  }
+  std::string_view key{buf, ext.size()};
+  auto i = slots[slot_of(key, seed)];
+  if (i < 0 || known_extensions[i].extension != key) {
+    return MimeType::OCTET_STREAM;
+  }
+  return known_extensions[i].mime_type;
+}
+
+ContentTypes::ContentTypes(
+    const std::map<std::string, std::string> &overrides) {
+  for (const auto &[ext, media_type] : overrides) {
+    std::string_view key{ext};
+    if (key.starts_with('.')) {
+      key.remove_prefix(1);
+    }
+    overrides_.insert_or_assign(lowercase(key), media_type);
+  }
+}
+
+auto ContentTypes::of(std::string_view filename) const -> std::string_view {
+  if (!overrides_.empty()) {
+    auto it = overrides_.find(lowercase(extension(filename)));
+    if (it != overrides_.end()) {
+      return it->second;
+    }
   }
-  return MimeType::OCTET_STREAM;
+  return string(infer_mime_type(filename));
 }
 
 } // namespace mime_type
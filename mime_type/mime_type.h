@@ -1,8 +1,10 @@
 #ifndef _INCLUDE_EC_PRV_MIME_TYPE_MIME_TYPE_H
 #define _INCLUDE_EC_PRV_MIME_TYPE_MIME_TYPE_H
 
+#include <map>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 
 namespace ec_prv {
 namespace mime_type {
@@ -35,8 +37,33 @@ enum struct MimeType {
 
 auto string(MimeType src) -> std::string_view;
 
+// Extension of the last component of a path, without the dot, e.g., "css"
+// for "_next/static/css/app.css". Empty for "README" and ".gitignore".
+auto extension(std::string_view filename) -> std::string_view;
+
+// Looks the (case-insensitive) extension up in a compile-time perfect hash
+// table: one hash, one comparison, no allocation.
 auto infer_mime_type(std::string_view filename) -> MimeType;
 
+// Media types of files: the built-in table, plus per-deployment additions and
+// overrides keyed by extension (the "mime_types" configuration entry). Meant
+// to be consulted once per file, when its response metadata is computed, not
+// per request.
+class ContentTypes {
+public:
+  ContentTypes() = default;
+
+  // Keys are extensions, with or without the leading dot; values are media
+  // types, e.g., {"wasm", "application/wasm"}.
+  explicit ContentTypes(const std::map<std::string, std::string> &overrides);
+
+  auto of(std::string_view filename) const -> std::string_view;
+
+private:
+  // keyed by lowercase extension without the dot
+  std::unordered_map<std::string, std::string> overrides_;
+};
+
 } // namespace mime_type
 } // namespace ec_prv
 
@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <chrono>
+#include <folly/SocketAddress.h>
+#include <folly/Try.h>
+#include <folly/futures/Future.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <folly/ssl/OpenSSLPtrTypes.h>
+#include <folly/synchronization/Baton.h>
+#include <folly/testing/TestUtil.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <mutex>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+#include <proxygen/httpserver/HTTPServer.h>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <proxygen/httpserver/RequestHandlerFactory.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <wangle/acceptor/TransportInfo.h>
+#include <wangle/ssl/SSLContextConfig.h>
+#include <wangle/ssl/TLSTicketKeySeeds.h>
+
+#include "url_shortener/app_config.h"
+#include "url_shortener/captcha_client.h"
+#include "url_shortener/captcha_health.h"
+#include "url_shortener/dns_cache.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+using namespace std::chrono_literals;
+
+// how long the stand-in takes to answer a "slow" verification
+constexpr std::chrono::milliseconds slow_answer{1000};
+
+// Writes a self-signed certificate for 127.0.0.1, and its key, as PEM.
+void write_certificate(const std::string &cert_path,
+                       const std::string &key_path) {
+  folly::ssl::EvpPkeyCtxUniquePtr key_ctx{
+      EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr)};
+  EVP_PKEY *raw_key = nullptr;
+  if (key_ctx == nullptr || EVP_PKEY_keygen_init(key_ctx.get()) <= 0 ||
+      EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx.get(),
+                                             NID_X9_62_prime256v1) <= 0 ||
+      EVP_PKEY_keygen(key_ctx.get(), &raw_key) <= 0) {
+    throw std::runtime_error{"cannot generate a key"};
+  }
+  folly::ssl::EvpPkeyUniquePtr key{raw_key};
+  folly::ssl::X509UniquePtr cert{X509_new()};
+  X509_set_version(cert.get(), 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert.get()), -3600);
+  X509_gmtime_adj(X509_getm_notAfter(cert.get()), 24 * 3600);
+  X509_set_pubkey(cert.get(), key.get());
+  X509_NAME *name = X509_get_subject_name(cert.get());
+  X509_NAME_add_entry_by_txt(
+      name, "CN", MBSTRING_ASC,
+      reinterpret_cast<const unsigned char *>("127.0.0.1"), -1, -1, 0);
+  X509_set_issuer_name(cert.get(), name);
+  for (const auto &[nid, value] :
+       {std::pair{NID_basic_constraints, "critical,CA:TRUE"},
+        std::pair{NID_subject_alt_name, "IP:127.0.0.1"}}) {
+    X509V3_CTX ctx;
+    X509V3_set_ctx(&ctx, cert.get(), cert.get(), nullptr, nullptr, 0);
+    folly::ssl::X509ExtensionUniquePtr ext{
+        X509V3_EXT_conf_nid(nullptr, &ctx, nid, value)};
+    if (ext == nullptr || X509_add_ext(cert.get(), ext.get(), -1) != 1) {
+      throw std::runtime_error{"cannot add a certificate extension"};
+    }
+  }
+  if (X509_sign(cert.get(), key.get(), EVP_sha256()) <= 0) {
+    throw std::runtime_error{"cannot sign the certificate"};
+  }
+  folly::ssl::BioUniquePtr cert_file{BIO_new_file(cert_path.c_str(), "w")};
+  folly::ssl::BioUniquePtr key_file{BIO_new_file(key_path.c_str(), "w")};
+  if (cert_file == nullptr || key_file == nullptr ||
+      PEM_write_bio_X509(cert_file.get(), cert.get()) != 1 ||
+      PEM_write_bio_PrivateKey(key_file.get(), key.get(), nullptr, nullptr,
+                               0, nullptr, nullptr) != 1) {
+    throw std::runtime_error{"cannot write the certificate"};
+  }
+}
+
+// One request to the stand-in verifier
+struct Seen {
+  std::string response;
+  // tells connections apart
+  uint16_t client_port;
+  wangle::SSLResumeEnum resume;
+};
+
+struct SeenLog {
+  std::mutex mutex;
+  std::vector<Seen> seen;
+};
+
+// Answers by the captcha response it is sent:
+//   "fail": 500
+//   "close": approves, then closes the connection
+//   "slow": approves after `slow_answer`
+//   "hedge": as "slow" the first time it arrives, and at once after that
+//   anything else: approves
+class StandInHandler : public proxygen::RequestHandler {
+public:
+  explicit StandInHandler(std::shared_ptr<SeenLog> log)
+      : log_(std::move(log)) {}
+
+  void
+  onRequest(std::unique_ptr<proxygen::HTTPMessage> request) noexcept override {
+    client_port_ = request->getClientAddress().getPort();
+  }
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override {
+    body_.append(std::move(body));
+  }
+
+  void onEOM() noexcept override {
+    std::string form;
+    if (!body_.empty()) {
+      form = body_.move()->moveToFbString().toStdString();
+    }
+    constexpr std::string_view field = "&response=";
+    const auto at = form.find(field);
+    response_ = at == std::string::npos ? "" : form.substr(at + field.size());
+    bool first_of_response;
+    {
+      std::lock_guard<std::mutex> lock{log_->mutex};
+      first_of_response = std::none_of(
+          log_->seen.begin(), log_->seen.end(),
+          [this](const Seen &seen) { return seen.response == response_; });
+      log_->seen.push_back(Seen{
+          .response = response_,
+          .client_port = client_port_,
+          .resume = downstream_->getSetupTransportInfo().sslResume,
+      });
+    }
+    if (response_ == "slow" || (response_ == "hedge" && first_of_response)) {
+      delay_ = folly::AsyncTimeout::make(
+          *folly::EventBaseManager::get()->getEventBase(),
+          [this]() noexcept { respond(); });
+      delay_->scheduleTimeout(slow_answer);
+      return;
+    }
+    respond();
+  }
+
+  void onUpgrade(proxygen::UpgradeProtocol) noexcept override {}
+
+  void requestComplete() noexcept override { delete this; }
+
+  void onError(proxygen::ProxygenError) noexcept override { delete this; }
+
+private:
+  void respond() {
+    if (response_ == "fail") {
+      proxygen::ResponseBuilder(downstream_)
+          .status(500, "Internal Server Error")
+          .sendWithEOM();
+      return;
+    }
+    proxygen::ResponseBuilder response(downstream_);
+    response.status(200, "OK");
+    if (response_ == "close") {
+      response.header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONNECTION,
+                      "close");
+    }
+    response.body(R"({"success": true})").sendWithEOM();
+  }
+
+  const std::shared_ptr<SeenLog> log_;
+  uint16_t client_port_{0};
+  folly::IOBufQueue body_{folly::IOBufQueue::cacheChainLength()};
+  std::string response_;
+  std::unique_ptr<folly::AsyncTimeout> delay_;
+};
+
+class StandInFactory : public proxygen::RequestHandlerFactory {
+public:
+  explicit StandInFactory(std::shared_ptr<SeenLog> log)
+      : log_(std::move(log)) {}
+
+  void onServerStart(folly::EventBase *) noexcept override {}
+
+  void onServerStop() noexcept override {}
+
+  proxygen::RequestHandler *
+  onRequest(proxygen::RequestHandler *,
+            proxygen::HTTPMessage *) noexcept override {
+    return new StandInHandler(log_);
+  }
+
+private:
+  const std::shared_ptr<SeenLog> log_;
+};
+
+// A local HTTPS verifier, with a certificate of its own and TLS session
+// tickets, standing in for reCAPTCHA.
+class StandInVerifier {
+public:
+  StandInVerifier() {
+    write_certificate(cert_path(), key_path());
+    proxygen::HTTPServerOptions options;
+    options.threads = 1;
+    options.idleTimeout = 60s;
+    options.handlerFactories =
+        proxygen::RequestHandlerChain().addThen<StandInFactory>(log_).build();
+    proxygen::HTTPServer::IPConfig ip{folly::SocketAddress{"127.0.0.1", 0},
+                                      proxygen::HTTPServer::Protocol::HTTP};
+    wangle::SSLContextConfig tls;
+    tls.isDefault = true;
+    tls.setCertificate(cert_path(), key_path(), "");
+    ip.sslConfigs.push_back(std::move(tls));
+    ip.ticketSeeds = wangle::TLSTicketKeySeeds{
+        .oldSeeds = {std::string(64, '1')},
+        .currentSeeds = {std::string(64, '2')},
+        .newSeeds = {std::string(64, '3')},
+    };
+    server_ = std::make_unique<proxygen::HTTPServer>(std::move(options));
+    server_->bind({ip});
+    folly::Baton<> started;
+    thread_ = std::thread{[this, &started] {
+      server_->start([&started] { started.post(); });
+    }};
+    started.wait();
+    port_ = server_->addresses().front().address.getPort();
+  }
+
+  ~StandInVerifier() {
+    server_->stop();
+    thread_.join();
+  }
+
+  auto url() const -> std::string {
+    return "https://127.0.0.1:" + std::to_string(port_) + "/siteverify";
+  }
+
+  auto cert_path() const -> std::string {
+    return (dir_.path() / "cert.pem").string();
+  }
+
+  auto key_path() const -> std::string {
+    return (dir_.path() / "key.pem").string();
+  }
+
+  auto seen() const -> std::vector<Seen> {
+    std::lock_guard<std::mutex> lock{log_->mutex};
+    return log_->seen;
+  }
+
+private:
+  folly::test::TemporaryDirectory dir_{"captcha_client_test"};
+  const std::shared_ptr<SeenLog> log_{std::make_shared<SeenLog>()};
+  std::unique_ptr<proxygen::HTTPServer> server_;
+  std::thread thread_;
+  uint16_t port_{0};
+};
+
+class CaptchaClientTest : public ::testing::Test {
+protected:
+  CaptchaClientTest() {
+    config_.captcha_service_url = verifier_.url();
+    config_.trusted_certificates_path = verifier_.cert_path();
+    config_.captcha_timeout_ms = 3000;
+    config_.captcha_hedge_after_ms = 0;
+    config_.captcha_breaker_failures = 0;
+  }
+
+  ~CaptchaClientTest() override {
+    evb_.getEventBase()->runInEventBaseThreadAndWait(
+        [this] { client_.reset(); });
+  }
+
+  // once `config_` is as the test wants it
+  void start_client() {
+    health_ = std::make_shared<CaptchaHealth>(config_);
+    auto ssl_context = CaptchaClient::make_ssl_context(config_);
+    auto dns = std::make_shared<DnsCache>(config_);
+    evb_.getEventBase()->runInEventBaseThreadAndWait([&] {
+      client_ = std::make_unique<CaptchaClient>(
+          evb_.getEventBase(), &config_, ssl_context, dns, health_);
+    });
+  }
+
+  auto verify(std::string response) -> folly::Try<std::string> {
+    return folly::via(evb_.getEventBase(),
+                      [this, response] { return client_->verify(response); })
+        .getTry();
+  }
+
+  StandInVerifier verifier_;
+  ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig config_;
+  folly::ScopedEventBaseThread evb_{"CaptchaClientTest"};
+  std::shared_ptr<CaptchaHealth> health_;
+  // only touched on `evb_`
+  std::unique_ptr<CaptchaClient> client_;
+};
+
+TEST_F(CaptchaClientTest, ReusesWarmConnection) {
+  start_client();
+  for (int i = 0; i < 3; ++i) {
+    const auto answer = verify("ok");
+    ASSERT_TRUE(answer.hasValue()) << answer.exception().what();
+    EXPECT_EQ(*answer, R"({"success": true})");
+  }
+  const auto seen = verifier_.seen();
+  ASSERT_EQ(seen.size(), 3u);
+  EXPECT_EQ(seen[1].client_port, seen[0].client_port);
+  EXPECT_EQ(seen[2].client_port, seen[0].client_port);
+}
+
+TEST_F(CaptchaClientTest, ResumesTlsSessionAfterReconnect) {
+  start_client();
+  ASSERT_TRUE(verify("close").hasValue());
+  const auto answer = verify("ok");
+  ASSERT_TRUE(answer.hasValue()) << answer.exception().what();
+  const auto seen = verifier_.seen();
+  ASSERT_EQ(seen.size(), 2u);
+  EXPECT_NE(seen[1].client_port, seen[0].client_port);
+  EXPECT_EQ(seen[0].resume, wangle::SSLResumeEnum::HANDSHAKE);
+  EXPECT_TRUE(seen[1].resume == wangle::SSLResumeEnum::RESUME_TICKET ||
+              seen[1].resume == wangle::SSLResumeEnum::RESUME_SESSION_ID);
+}
+
+TEST_F(CaptchaClientTest, FailsVerificationPastItsDeadline) {
+  config_.captcha_timeout_ms = 100;
+  start_client();
+  const auto started = std::chrono::steady_clock::now();
+  const auto answer = verify("slow");
+  ASSERT_TRUE(answer.hasException());
+  EXPECT_TRUE(
+      answer.exception().is_compatible_with<CaptchaServiceUnavailable>());
+  EXPECT_LT(std::chrono::steady_clock::now() - started, slow_answer);
+  EXPECT_EQ(health_->stats().failed, 1u);
+}
+
+TEST_F(CaptchaClientTest, BreakerOpensOnFailuresAndClosesOnSuccess) {
+  config_.captcha_breaker_failures = 2;
+  config_.captcha_breaker_open_ms = 300;
+  start_client();
+  EXPECT_TRUE(verify("fail").hasException());
+  EXPECT_TRUE(verify("fail").hasException());
+
+  // refused without asking the service
+  const auto refused = verify("ok");
+  ASSERT_TRUE(refused.hasException());
+  EXPECT_TRUE(
+      refused.exception().is_compatible_with<CaptchaServiceUnavailable>());
+  EXPECT_EQ(verifier_.seen().size(), 2u);
+  EXPECT_EQ(health_->stats().short_circuited, 1u);
+  EXPECT_EQ(health_->breaker().state(CircuitBreaker::Clock::now()),
+            CircuitBreaker::State::open);
+
+  // the probe once it has been open long enough
+  std::this_thread::sleep_for(400ms);
+  const auto probe = verify("ok");
+  ASSERT_TRUE(probe.hasValue()) << probe.exception().what();
+  EXPECT_EQ(verifier_.seen().size(), 3u);
+  EXPECT_EQ(health_->breaker().state(CircuitBreaker::Clock::now()),
+            CircuitBreaker::State::closed);
+}
+
+TEST_F(CaptchaClientTest, HedgeOnAnotherConnectionAnswersFirst) {
+  config_.captcha_hedge_after_ms = 50;
+  start_client();
+  const auto started = std::chrono::steady_clock::now();
+  const auto answer = verify("hedge");
+  ASSERT_TRUE(answer.hasValue()) << answer.exception().what();
+  EXPECT_LT(std::chrono::steady_clock::now() - started, slow_answer);
+  const auto seen = verifier_.seen();
+  ASSERT_EQ(seen.size(), 2u);
+  EXPECT_NE(seen[1].client_port, seen[0].client_port);
+  const CaptchaStats stats = health_->stats();
+  EXPECT_EQ(stats.hedged, 1u);
+  EXPECT_EQ(stats.hedges_won, 1u);
+}
+
+} // namespace
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,104 @@
+#include <folly/IPAddress.h>
+#include <gtest/gtest.h>
+#include <string_view>
+#include <vector>
+
+#include "url_shortener/cidr_set.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace app_config {
+namespace {
+
+auto networks(std::initializer_list<std::string_view> cidrs)
+    -> std::vector<folly::CIDRNetwork> {
+  std::vector<folly::CIDRNetwork> dst;
+  for (std::string_view cidr : cidrs) {
+    dst.push_back(folly::IPAddress::createNetwork(cidr));
+  }
+  return dst;
+}
+
+auto contains(const CidrSet &set, std::string_view ip) -> bool {
+  return set.contains(folly::IPAddress{ip});
+}
+
+TEST(CidrSetTest, EmptySetContainsNothing) {
+  const CidrSet set;
+  EXPECT_TRUE(set.empty());
+  EXPECT_FALSE(contains(set, "0.0.0.0"));
+  EXPECT_FALSE(contains(set, "::"));
+}
+
+TEST(CidrSetTest, MatchesIPv4Prefixes) {
+  const CidrSet set{networks({"10.0.0.0/8", "172.16.0.0/12",
+                              "192.168.1.0/24", "203.0.113.7/32"})};
+  EXPECT_FALSE(set.empty());
+  EXPECT_TRUE(contains(set, "10.0.0.0"));
+  EXPECT_TRUE(contains(set, "10.255.255.255"));
+  EXPECT_FALSE(contains(set, "11.0.0.0"));
+  EXPECT_TRUE(contains(set, "172.16.0.1"));
+  EXPECT_TRUE(contains(set, "172.31.255.255"));
+  EXPECT_FALSE(contains(set, "172.32.0.0"));
+  EXPECT_FALSE(contains(set, "172.15.255.255"));
+  EXPECT_TRUE(contains(set, "192.168.1.42"));
+  EXPECT_FALSE(contains(set, "192.168.2.42"));
+  EXPECT_TRUE(contains(set, "203.0.113.7"));
+  EXPECT_FALSE(contains(set, "203.0.113.6"));
+  EXPECT_FALSE(contains(set, "203.0.113.8"));
+}
+
+TEST(CidrSetTest, MatchesPrefixesShorterThanAByte) {
+  const CidrSet set{networks({"128.0.0.0/2"})};
+  EXPECT_FALSE(contains(set, "127.255.255.255"));
+  EXPECT_TRUE(contains(set, "128.0.0.0"));
+  EXPECT_TRUE(contains(set, "191.255.255.255"));
+  EXPECT_FALSE(contains(set, "192.0.0.0"));
+  const CidrSet everything{networks({"0.0.0.0/0"})};
+  EXPECT_TRUE(contains(everything, "255.255.255.255"));
+  EXPECT_FALSE(contains(everything, "2001:db8::1"));
+}
+
+TEST(CidrSetTest, NestedNetworksInEitherOrder) {
+  for (const auto &order : {networks({"10.1.2.0/24", "10.0.0.0/8"}),
+                            networks({"10.0.0.0/8", "10.1.2.0/24"})}) {
+    const CidrSet set{order};
+    EXPECT_TRUE(contains(set, "10.1.2.3"));
+    EXPECT_TRUE(contains(set, "10.9.9.9"));
+    EXPECT_FALSE(contains(set, "11.1.2.3"));
+  }
+}
+
+TEST(CidrSetTest, MatchesIPv6Prefixes) {
+  const CidrSet set{networks({"2001:db8::/32", "fd00:1:2:3::/64",
+                              "2606:4700::6810:85e5/128"})};
+  EXPECT_TRUE(contains(set, "2001:db8::1"));
+  EXPECT_TRUE(contains(set, "2001:db8:ffff:ffff:ffff:ffff:ffff:ffff"));
+  EXPECT_FALSE(contains(set, "2001:db9::"));
+  EXPECT_TRUE(contains(set, "fd00:1:2:3:4:5:6:7"));
+  EXPECT_FALSE(contains(set, "fd00:1:2:4::"));
+  EXPECT_TRUE(contains(set, "2606:4700::6810:85e5"));
+  EXPECT_FALSE(contains(set, "2606:4700::6810:85e6"));
+  // IPv4 networks are not IPv6 prefixes
+  EXPECT_FALSE(contains(set, "32.1.13.184"));
+}
+
+TEST(CidrSetTest, MatchesIPv4MappedAddressesAsIPv4) {
+  const CidrSet set{networks({"192.0.2.0/24"})};
+  EXPECT_TRUE(contains(set, "::ffff:192.0.2.1"));
+  EXPECT_FALSE(contains(set, "::ffff:192.0.3.1"));
+  // nor are IPv4 networks prefixes of other IPv6 addresses with the same bits
+  EXPECT_FALSE(contains(set, "c000:200::"));
+}
+
+TEST(CidrSetTest, MatchesIPv4MappedNetworksAsIPv4) {
+  const CidrSet set{networks({"::ffff:198.51.100.0/120"})};
+  EXPECT_TRUE(contains(set, "198.51.100.1"));
+  EXPECT_TRUE(contains(set, "::ffff:198.51.100.1"));
+  EXPECT_FALSE(contains(set, "198.51.101.1"));
+}
+
+} // namespace
+} // namespace app_config
+} // namespace url_shortener
+} // namespace ec_prv
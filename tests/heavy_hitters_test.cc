@@ -0,0 +1,104 @@
+#include <chrono>
+#include <cstddef>
+#include <folly/IPAddress.h>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "url_shortener/heavy_hitters.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+using namespace std::chrono_literals;
+
+// well past the clock's epoch, which windows start out at
+constexpr RateLimitClock::time_point t0 = RateLimitClock::time_point{} + 1h;
+
+// big enough that a few keys never share counters
+constexpr std::size_t max_bytes = 1 << 20;
+
+const folly::IPAddress client{"192.0.2.1"};
+
+TEST(HeavyHitterLimiterTest, LimitsEachAddress) {
+  HeavyHitterLimiter limiter{5, 100, 1s, max_bytes, 0};
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(limiter.admit(client, t0)) << i;
+  }
+  EXPECT_FALSE(limiter.admit(client, t0));
+  EXPECT_TRUE(limiter.admit(folly::IPAddress{"198.51.100.1"}, t0));
+}
+
+TEST(HeavyHitterLimiterTest, LimitsEachNetwork) {
+  HeavyHitterLimiter limiter{100, 10, 1s, max_bytes, 0};
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(limiter.admit(
+        folly::IPAddress{"192.0.2." + std::to_string(i + 1)}, t0))
+        << i;
+  }
+  // another address of the same /24, then of the same /64
+  EXPECT_FALSE(limiter.admit(folly::IPAddress{"192.0.2.200"}, t0));
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(limiter.admit(
+        folly::IPAddress{"2001:db8:0:1::" + std::to_string(i + 1)}, t0));
+  }
+  EXPECT_FALSE(limiter.admit(folly::IPAddress{"2001:db8:0:1:ffff::1"}, t0));
+  // other networks are not
+  EXPECT_TRUE(limiter.admit(folly::IPAddress{"192.0.3.1"}, t0));
+  EXPECT_TRUE(limiter.admit(folly::IPAddress{"2001:db8:0:2::1"}, t0));
+}
+
+TEST(HeavyHitterLimiterTest, CountsRequestsOverTheLimitToo) {
+  HeavyHitterLimiter limiter{10, 100, 1s, max_bytes, 0};
+  for (int i = 0; i < 20; ++i) {
+    limiter.admit(client, t0);
+  }
+  // Halfway through the next window, half of the last one still counts:
+  // 10 of its 20 requests, and 2 of this one.
+  EXPECT_FALSE(limiter.admit(client, t0 + 1s));
+  EXPECT_FALSE(limiter.admit(client, t0 + 1500ms));
+}
+
+TEST(HeavyHitterLimiterTest, ForgetsRequestsTwoWindowsBack) {
+  HeavyHitterLimiter limiter{5, 100, 1s, max_bytes, 0};
+  for (int i = 0; i < 10; ++i) {
+    limiter.admit(client, t0);
+  }
+  EXPECT_TRUE(limiter.admit(client, t0 + 2s));
+}
+
+TEST(HeavyHitterLimiterTest, ReportsTheHeaviestOfTheLastWindow) {
+  HeavyHitterLimiter limiter{1000, 1000, 1s, max_bytes, 64};
+  for (int i = 0; i < 20; ++i) {
+    limiter.admit(client, t0);
+  }
+  for (int i = 0; i < 3; ++i) {
+    limiter.admit(folly::IPAddress{"192.0.2.2"}, t0);
+  }
+  // Reported once the window is over, which each shard only notices on its
+  // next request; enough other addresses come by every shard.
+  for (int i = 0; i < 1000; ++i) {
+    limiter.admit(folly::IPAddress{"10.0." + std::to_string(i / 256) + "." +
+                                   std::to_string(i % 256)},
+                  t0 + 1s);
+  }
+  const HeavyHitterStats stats = limiter.stats();
+  ASSERT_GE(stats.top.size(), 3u);
+  EXPECT_EQ(stats.top[0].network,
+            folly::IPAddress::createNetwork("192.0.2.0/24"));
+  EXPECT_EQ(stats.top[0].requests, 23u);
+  EXPECT_EQ(stats.top[1].network,
+            folly::IPAddress::createNetwork("192.0.2.1/32"));
+  EXPECT_EQ(stats.top[1].requests, 20u);
+  EXPECT_EQ(stats.top[2].network,
+            folly::IPAddress::createNetwork("192.0.2.2/32"));
+  EXPECT_EQ(stats.top[2].requests, 3u);
+  EXPECT_GT(stats.saturation, 0.0);
+  EXPECT_LT(stats.saturation, 0.1);
+}
+
+} // namespace
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,62 @@
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+#include "url_shortener/http_caching.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+TEST(StrongEtagTest, SameForContiguousAndChainedContent) {
+  const std::string content = "0123456789abcdef";
+  auto chain = folly::IOBuf::copyBuffer(content.substr(0, 5));
+  chain->appendToChain(folly::IOBuf::copyBuffer(content.substr(5)));
+  const std::string etag =
+      strong_etag(folly::ByteRange{folly::StringPiece{content}});
+  EXPECT_EQ(strong_etag(*chain), etag);
+  EXPECT_NE(
+      strong_etag(folly::ByteRange{folly::StringPiece{"0123456789abcdeF"}}),
+      etag);
+  // quoted, and strong
+  EXPECT_EQ(etag.size(), 34u);
+  EXPECT_EQ(etag.front(), '"');
+  EXPECT_EQ(etag.back(), '"');
+}
+
+TEST(IfNoneMatchTest, UsesWeakComparison) {
+  EXPECT_TRUE(if_none_match("\"abc\"", "\"abc\""));
+  EXPECT_TRUE(if_none_match("W/\"abc\"", "\"abc\""));
+  EXPECT_TRUE(if_none_match("\"x\", \"abc\"", "\"abc\""));
+  EXPECT_TRUE(if_none_match("*", "\"abc\""));
+  EXPECT_FALSE(if_none_match("\"abd\"", "\"abc\""));
+  EXPECT_FALSE(if_none_match("", "\"abc\""));
+  EXPECT_FALSE(if_none_match("*", ""));
+}
+
+TEST(IfRangeTest, HonorsRangeWithoutIfRange) {
+  EXPECT_TRUE(if_range("", "\"abc\""));
+  EXPECT_TRUE(if_range(" \t", "\"abc\""));
+}
+
+TEST(IfRangeTest, HonorsRangeOnlyForTheCurrentStrongTag) {
+  EXPECT_TRUE(if_range("\"abc\"", "\"abc\""));
+  EXPECT_TRUE(if_range(" \"abc\" ", "\"abc\""));
+  EXPECT_FALSE(if_range("\"abd\"", "\"abc\""));
+  // strong comparison: weak tags never match
+  EXPECT_FALSE(if_range("W/\"abc\"", "\"abc\""));
+  EXPECT_FALSE(if_range("W/\"abc\"", "W/\"abc\""));
+  EXPECT_FALSE(if_range("\"abc\"", ""));
+}
+
+TEST(IfRangeTest, DatesNeverMatch) {
+  EXPECT_FALSE(if_range("Wed, 21 Oct 2015 07:28:00 GMT", "\"abc\""));
+}
+
+} // namespace
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
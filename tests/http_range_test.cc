@@ -0,0 +1,115 @@
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "url_shortener/http_range.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// found by argument-dependent lookup, so not in the anonymous namespace
+auto operator==(const ContentRange &a, const ContentRange &b) -> bool {
+  return a.offset == b.offset && a.length == b.length;
+}
+
+namespace {
+
+auto ranges(std::vector<ContentRange> v)
+    -> std::optional<std::vector<ContentRange>> {
+  return v;
+}
+
+TEST(ParseRangeHeaderTest, ClosedAndOpenRanges) {
+  EXPECT_EQ(parse_range_header("bytes=0-99", 1000), ranges({{0, 100}}));
+  EXPECT_EQ(parse_range_header("bytes=900-", 1000), ranges({{900, 100}}));
+  // a last position past the end is cut short, not refused
+  EXPECT_EQ(parse_range_header("bytes=900-5000", 1000), ranges({{900, 100}}));
+}
+
+TEST(ParseRangeHeaderTest, SuffixRanges) {
+  EXPECT_EQ(parse_range_header("bytes=-100", 1000), ranges({{900, 100}}));
+  // longer than the representation: all of it
+  EXPECT_EQ(parse_range_header("bytes=-5000", 1000), ranges({{0, 1000}}));
+  EXPECT_EQ(parse_range_header("bytes=-0", 1000), ranges({}));
+  EXPECT_EQ(parse_range_header("bytes=-10", 0), ranges({}));
+}
+
+TEST(ParseRangeHeaderTest, MergesOverlappingAndAdjacentRangesInOrder) {
+  EXPECT_EQ(parse_range_header("bytes=500-599, 0-99, 50-149", 1000),
+            ranges({{0, 150}, {500, 100}}));
+  EXPECT_EQ(parse_range_header("bytes=0-99,100-199", 1000),
+            ranges({{0, 200}}));
+  EXPECT_EQ(parse_range_header("bytes=-100,0-0,850-", 1000),
+            ranges({{0, 1}, {850, 150}}));
+}
+
+TEST(ParseRangeHeaderTest, UnsatisfiableRanges) {
+  EXPECT_EQ(parse_range_header("bytes=1000-", 1000), ranges({}));
+  EXPECT_EQ(parse_range_header("bytes=1000-1999", 1000), ranges({}));
+  // the satisfiable ones are still served
+  EXPECT_EQ(parse_range_header("bytes=2000-,0-9", 1000), ranges({{0, 10}}));
+}
+
+TEST(ParseRangeHeaderTest, PositionsTooLargeToRepresent) {
+  EXPECT_EQ(parse_range_header("bytes=99999999999999999999999-", 1000),
+            ranges({}));
+  EXPECT_EQ(parse_range_header("bytes=0-99999999999999999999999", 1000),
+            ranges({{0, 1000}}));
+  EXPECT_EQ(parse_range_header("bytes=-99999999999999999999999", 1000),
+            ranges({{0, 1000}}));
+}
+
+TEST(ParseRangeHeaderTest, IgnoresMalformedHeaders) {
+  EXPECT_EQ(parse_range_header("", 1000), std::nullopt);
+  EXPECT_EQ(parse_range_header("items=0-9", 1000), std::nullopt);
+  EXPECT_EQ(parse_range_header("bytes=", 1000), std::nullopt);
+  EXPECT_EQ(parse_range_header("bytes=9-0", 1000), std::nullopt);
+  EXPECT_EQ(parse_range_header("bytes=a-9", 1000), std::nullopt);
+  EXPECT_EQ(parse_range_header("bytes=0-9x", 1000), std::nullopt);
+  EXPECT_EQ(parse_range_header("bytes=+1-9", 1000), std::nullopt);
+  EXPECT_EQ(parse_range_header("bytes=10", 1000), std::nullopt);
+}
+
+TEST(ParseRangeHeaderTest, IgnoresTooManyRanges) {
+  std::string header = "bytes=0-0";
+  for (std::size_t i = 1; i < max_ranges_per_request; ++i) {
+    header += "," + std::to_string(2 * i) + "-" + std::to_string(2 * i);
+  }
+  EXPECT_EQ(parse_range_header(header, 1000)->size(), max_ranges_per_request);
+  header += ",999-999";
+  EXPECT_EQ(parse_range_header(header, 1000), std::nullopt);
+}
+
+TEST(ContentRangeTest, Values) {
+  EXPECT_EQ(content_range({0, 100}, 1000), "bytes 0-99/1000");
+  EXPECT_EQ(content_range({999, 1}, 1000), "bytes 999-999/1000");
+  EXPECT_EQ(unsatisfied_content_range(1000), "bytes */1000");
+}
+
+TEST(MultipartByterangesTest, LengthMatchesWhatIsSent) {
+  const std::vector<ContentRange> parts{{0, 10}, {500, 100}};
+  std::string body;
+  for (const ContentRange &part : parts) {
+    body += multipart_part_header("b0undary", "text/plain", part, 1000);
+    body.append(part.length, 'x');
+  }
+  body += multipart_closing_delimiter("b0undary");
+  EXPECT_EQ(multipart_length("b0undary", "text/plain", parts, 1000),
+            body.size());
+  EXPECT_TRUE(body.starts_with("\r\n--b0undary\r\nContent-Type: text/plain"
+                               "\r\nContent-Range: bytes 0-9/1000\r\n\r\n"
+                               "xxxxxxxxxx\r\n--b0undary\r\n"));
+}
+
+TEST(MultipartByterangesTest, PartsHaveNoContentTypeIfUnknown) {
+  EXPECT_EQ(multipart_part_header("b", "", {0, 1}, 2),
+            "\r\n--b\r\nContent-Range: bytes 0-0/2\r\n\r\n");
+}
+
+} // namespace
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
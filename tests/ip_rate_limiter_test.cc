@@ -0,0 +1,95 @@
+#include <chrono>
+#include <cstddef>
+#include <folly/IPAddress.h>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "url_shortener/ip_rate_limiter.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+using namespace std::chrono_literals;
+
+// well past the clock's epoch, which shards start out rotated at
+constexpr RateLimitClock::time_point t0 = RateLimitClock::time_point{} + 1h;
+
+const folly::IPAddress client{"192.0.2.1"};
+
+TEST(IPRateLimiterTest, AdmitsABurstThenTheSustainedRate) {
+  // 10 a second, in bursts of up to 5
+  IPRateLimiter limiter{10, 1s, 5};
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(limiter.admit(client, t0)) << i;
+  }
+  EXPECT_FALSE(limiter.admit(client, t0));
+  // then one every 100ms, and no sooner
+  EXPECT_FALSE(limiter.admit(client, t0 + 99ms));
+  EXPECT_TRUE(limiter.admit(client, t0 + 100ms));
+  EXPECT_FALSE(limiter.admit(client, t0 + 100ms));
+  EXPECT_TRUE(limiter.admit(client, t0 + 200ms));
+}
+
+TEST(IPRateLimiterTest, RejectedRequestsAreNotCounted) {
+  IPRateLimiter limiter{10, 1s, 1};
+  EXPECT_TRUE(limiter.admit(client, t0));
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_FALSE(limiter.admit(client, t0 + 50ms));
+  }
+  EXPECT_TRUE(limiter.admit(client, t0 + 100ms));
+}
+
+TEST(IPRateLimiterTest, IdleClientsGetTheirWholeBurstBack) {
+  IPRateLimiter limiter{10, 1s, 5};
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(limiter.admit(client, t0));
+  }
+  // the last of the burst was due at t0 + 400ms, so free at t0 + 500ms
+  const auto later = t0 + 500ms;
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(limiter.admit(client, later)) << i;
+  }
+  EXPECT_FALSE(limiter.admit(client, later));
+}
+
+TEST(IPRateLimiterTest, LimitsEachClientOnItsOwn) {
+  IPRateLimiter limiter{10, 1s, 1};
+  EXPECT_TRUE(limiter.admit(client, t0));
+  EXPECT_FALSE(limiter.admit(client, t0));
+  EXPECT_TRUE(limiter.admit(folly::IPAddress{"192.0.2.2"}, t0));
+  EXPECT_TRUE(limiter.admit(folly::IPAddress{"2001:db8::1"}, t0));
+}
+
+TEST(IPRateLimiterTest, IPv4MappedAddressesAreTheSameClient) {
+  IPRateLimiter limiter{10, 1s, 1};
+  EXPECT_EQ(IPKey::of(client), IPKey::of(folly::IPAddress{"::ffff:192.0.2.1"}));
+  EXPECT_TRUE(limiter.admit(client, t0));
+  EXPECT_FALSE(limiter.admit(folly::IPAddress{"::ffff:192.0.2.1"}, t0));
+}
+
+TEST(IPRateLimiterTest, DropsEntriesOfIdleClients) {
+  IPRateLimiter limiter{10, 1s, 5};
+  auto ip = [](std::size_t i, int net) {
+    return folly::IPAddress{"10." + std::to_string(net) + "." +
+                            std::to_string(i / 256) + "." +
+                            std::to_string(i % 256)};
+  };
+  constexpr std::size_t clients = 1000;
+  for (std::size_t i = 0; i < clients; ++i) {
+    limiter.admit(ip(i, 0), t0);
+  }
+  EXPECT_EQ(limiter.size(), clients);
+  // Long after all of them have their burst back, as many other clients
+  // come by every shard, which drops the entries of the first ones.
+  for (std::size_t i = 0; i < clients; ++i) {
+    limiter.admit(ip(i, 1), t0 + 10s);
+  }
+  EXPECT_EQ(limiter.size(), clients);
+}
+
+} // namespace
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,158 @@
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+
+#include "url_shortener/json_fields.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+using Status = JsonFieldExtractor::Status;
+
+// as `MakeUrlRequestHandler` reads a create request
+auto create_fields(std::size_t max_value_length = 1024)
+    -> JsonFieldExtractor {
+  return JsonFieldExtractor{{"user_captcha_response", "long_url"},
+                            max_value_length};
+}
+
+// Feeds `document` in pieces of `piece` bytes, then finishes it.
+auto parse(JsonFieldExtractor &fields, std::string_view document,
+           std::size_t piece) -> Status {
+  for (std::size_t i = 0; i < document.size(); i += piece) {
+    const Status status = fields.feed(document.substr(i, piece));
+    if (status == Status::invalid || status == Status::too_long) {
+      return status;
+    }
+  }
+  return fields.finish();
+}
+
+TEST(JsonFieldExtractorTest, KeepsTheFieldsWhateverTheyAreFedIn) {
+  constexpr std::string_view document =
+      R"({"long_url": "https://example.com/a?b=c",)"
+      R"( "ignored": {"long_url": "nested", "list": [1, -2.5e+3, true, null]},)"
+      R"( "user_captcha_response": "token"})";
+  for (std::size_t piece : {document.size(), std::size_t{7}, std::size_t{1}}) {
+    JsonFieldExtractor fields = create_fields();
+    EXPECT_EQ(parse(fields, document, piece), Status::done) << piece;
+    EXPECT_EQ(fields.value(0), "token");
+    // only members of the top-level object count
+    EXPECT_EQ(fields.value(1), "https://example.com/a?b=c");
+  }
+}
+
+TEST(JsonFieldExtractorTest, MissingOrNonStringFieldsHaveNoValue) {
+  JsonFieldExtractor fields = create_fields();
+  EXPECT_EQ(parse(fields, R"({"long_url": 42})", 1), Status::done);
+  EXPECT_EQ(fields.value(0), std::nullopt);
+  EXPECT_EQ(fields.value(1), std::nullopt);
+}
+
+TEST(JsonFieldExtractorTest, LastRepeatedFieldWins) {
+  JsonFieldExtractor fields = create_fields();
+  EXPECT_EQ(parse(fields, R"({"long_url": "a", "long_url": "b"})", 1),
+            Status::done);
+  EXPECT_EQ(fields.value(1), "b");
+}
+
+TEST(JsonFieldExtractorTest, Unescapes) {
+  JsonFieldExtractor fields = create_fields();
+  EXPECT_EQ(parse(fields,
+                  R"({"long_url": "a\"\\\/\n\u00e9\ud83d\ude00é", "x": 1})",
+                  1),
+            Status::done);
+  // UTF-8 as sent, and escapes of it
+  EXPECT_EQ(fields.value(1),
+            "a\"\\/\n\xc3\xa9\xf0\x9f\x98\x80\xc3\xa9");
+}
+
+TEST(JsonFieldExtractorTest, RejectsInvalidDocuments) {
+  for (std::string_view document : {
+           R"()",
+           R"([])",
+           R"({"long_url": "a")",
+           R"({"long_url": "a",})",
+           R"({"long_url" "a"})",
+           R"({"long_url": 'a'})",
+           R"({"x": 01})",
+           R"({"x": 1.})",
+           R"({"x": tru})",
+           R"({"x": [1, 2}})",
+           R"({"x": "\q"})",
+           R"({"x": "\ud83d"})",
+           R"({"x": "\ude00"})",
+           "{\"x\": \"\x01\"}",
+           R"({} {})",
+       }) {
+    JsonFieldExtractor fields = create_fields();
+    EXPECT_EQ(parse(fields, document, 1), Status::invalid) << document;
+  }
+}
+
+TEST(JsonFieldExtractorTest, AllowsWhitespaceAfterTheObject) {
+  JsonFieldExtractor fields = create_fields();
+  EXPECT_EQ(fields.feed("{}"), Status::done);
+  EXPECT_EQ(fields.feed(" \r\n"), Status::done);
+  EXPECT_EQ(fields.finish(), Status::done);
+}
+
+TEST(JsonFieldExtractorTest, RejectsDocumentsNestedTooDeep) {
+  std::string deep_enough = R"({"x": )";
+  std::string too_deep = deep_enough;
+  for (std::size_t i = 1; i < JsonFieldExtractor::max_depth; ++i) {
+    deep_enough += '[';
+  }
+  deep_enough.append(JsonFieldExtractor::max_depth - 1, ']');
+  deep_enough += '}';
+  for (std::size_t i = 0; i < JsonFieldExtractor::max_depth; ++i) {
+    too_deep += '[';
+  }
+  JsonFieldExtractor fields = create_fields();
+  EXPECT_EQ(parse(fields, deep_enough, 1), Status::done);
+  JsonFieldExtractor too_deep_fields = create_fields();
+  EXPECT_EQ(too_deep_fields.feed(too_deep), Status::invalid);
+}
+
+// What has `MakeUrlRequestHandler` answer 413 before the body is all in.
+TEST(JsonFieldExtractorTest, KeptValueLongerThanTheLimitIsTooLong) {
+  const std::string at_limit(16, 'a');
+  JsonFieldExtractor fields = create_fields(16);
+  EXPECT_EQ(parse(fields, R"({"long_url": ")" + at_limit + R"("})", 1),
+            Status::done);
+  EXPECT_EQ(fields.value(1), at_limit);
+
+  JsonFieldExtractor too_long = create_fields(16);
+  EXPECT_EQ(too_long.feed(R"({"long_url": ")" + at_limit + "a"),
+            Status::too_long);
+  // and stays so
+  EXPECT_EQ(too_long.feed(R"("})"), Status::too_long);
+  EXPECT_EQ(too_long.finish(), Status::too_long);
+
+  // escapes count once unescaped
+  JsonFieldExtractor escaped = create_fields(16);
+  EXPECT_EQ(parse(escaped,
+                  R"({"long_url": ")" + std::string(10, 'a') +
+                      R"(\u0041\u0041\u0041\u0041\u0041\u0041"})",
+                  1),
+            Status::done);
+  EXPECT_EQ(escaped.value(1), "aaaaaaaaaaAAAAAA");
+}
+
+TEST(JsonFieldExtractorTest, SkippedValuesAreNotLimited) {
+  JsonFieldExtractor fields = create_fields(16);
+  EXPECT_EQ(parse(fields,
+                  R"({"other": ")" + std::string(1000, 'a') +
+                      R"(", "long_url": "short"})",
+                  1),
+            Status::done);
+  EXPECT_EQ(fields.value(1), "short");
+}
+
+} // namespace
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,143 @@
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <folly/IPAddress.h>
+#include <folly/ssl/OpenSSLHash.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+
+#include "url_shortener/app_config.h"
+#include "url_shortener/proof_of_work.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+constexpr uint32_t difficulty = 8;
+constexpr std::string_view long_url = "https://example.com/";
+
+const folly::IPAddress client{"192.0.2.1"};
+
+auto verifier() -> ProofOfWorkVerifier {
+  ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig config;
+  config.proof_of_work_secret = std::string(64, 'a');
+  config.proof_of_work_difficulty = difficulty;
+  config.proof_of_work_max_difficulty = difficulty;
+  config.proof_of_work_ttl_seconds = 60;
+  return ProofOfWorkVerifier{config, nullptr};
+}
+
+// Whether "<challenge>:<counter>" solves `challenge` for `url`, computed
+// independently of `ProofOfWorkVerifier`.
+auto solves(std::string_view response, std::string_view url, uint32_t bits)
+    -> bool {
+  std::string solution{response};
+  solution += ':';
+  solution += url;
+  std::array<uint8_t, 32> digest;
+  folly::ssl::OpenSSLHash::sha256(
+      folly::MutableByteRange{digest.data(), digest.size()},
+      folly::ByteRange{folly::StringPiece{solution}});
+  uint32_t zeros = 0;
+  for (uint8_t byte : digest) {
+    zeros += std::countl_zero(byte);
+    if (byte != 0) {
+      break;
+    }
+  }
+  return zeros >= bits;
+}
+
+// The first response that solves `challenge` for `url`.
+auto solve(const ProofOfWorkChallenge &challenge, std::string_view url)
+    -> std::string {
+  for (uint64_t counter = 0;; ++counter) {
+    std::string response = challenge.challenge + ':' + std::to_string(counter);
+    if (solves(response, url, challenge.difficulty)) {
+      return response;
+    }
+  }
+}
+
+TEST(ProofOfWorkVerifierTest, AcceptsSolutions) {
+  ProofOfWorkVerifier pow = verifier();
+  const ProofOfWorkChallenge challenge = pow.issue(client);
+  EXPECT_EQ(challenge.difficulty, difficulty);
+  const std::string response = solve(challenge, long_url);
+  EXPECT_TRUE(pow.check(response, long_url, client, challenge.expires - 60));
+}
+
+TEST(ProofOfWorkVerifierTest, RejectsCountersThatDoNotSolveIt) {
+  ProofOfWorkVerifier pow = verifier();
+  const ProofOfWorkChallenge challenge = pow.issue(client);
+  for (uint64_t counter = 0; counter < 64; ++counter) {
+    const std::string response =
+        challenge.challenge + ':' + std::to_string(counter);
+    EXPECT_EQ(pow.check(response, long_url, client, challenge.expires),
+              solves(response, long_url, difficulty))
+        << counter;
+  }
+}
+
+TEST(ProofOfWorkVerifierTest, SolutionsAreOnlyGoodForTheirUrl) {
+  ProofOfWorkVerifier pow = verifier();
+  const ProofOfWorkChallenge challenge = pow.issue(client);
+  const std::string response = solve(challenge, long_url);
+  constexpr std::string_view other_url = "https://example.org/";
+  EXPECT_EQ(pow.check(response, other_url, client, challenge.expires),
+            solves(response, other_url, difficulty));
+}
+
+TEST(ProofOfWorkVerifierTest, RejectsALoweredDifficulty) {
+  ProofOfWorkVerifier pow = verifier();
+  const ProofOfWorkChallenge challenge = pow.issue(client);
+  // any counter solves a challenge of no difficulty, were it signed
+  std::string lowered = challenge.challenge;
+  const std::string field = '.' + std::to_string(difficulty) + '.';
+  ASSERT_EQ(lowered.find(field), 2u);
+  lowered.replace(2, field.size(), ".0.");
+  EXPECT_FALSE(pow.check(lowered + ":0", long_url, client, challenge.expires));
+}
+
+TEST(ProofOfWorkVerifierTest, RejectsExpiredChallenges) {
+  ProofOfWorkVerifier pow = verifier();
+  const ProofOfWorkChallenge challenge = pow.issue(client);
+  const std::string response = solve(challenge, long_url);
+  EXPECT_TRUE(pow.check(response, long_url, client, challenge.expires));
+  EXPECT_FALSE(pow.check(response, long_url, client, challenge.expires + 1));
+}
+
+TEST(ProofOfWorkVerifierTest, RejectsChallengesIssuedToOtherClients) {
+  ProofOfWorkVerifier pow = verifier();
+  const ProofOfWorkChallenge challenge = pow.issue(client);
+  const std::string response = solve(challenge, long_url);
+  EXPECT_FALSE(pow.check(response, long_url, folly::IPAddress{"192.0.2.2"},
+                         challenge.expires));
+  // but not to the same client arriving over IPv6
+  EXPECT_TRUE(pow.check(response, long_url,
+                        folly::IPAddress{"::ffff:192.0.2.1"},
+                        challenge.expires));
+}
+
+TEST(ProofOfWorkVerifierTest, RejectsMalformedResponses) {
+  ProofOfWorkVerifier pow = verifier();
+  const ProofOfWorkChallenge challenge = pow.issue(client);
+  for (const std::string &response : {
+           std::string{},
+           challenge.challenge,
+           challenge.challenge + ':',
+           challenge.challenge + ":x",
+           challenge.challenge + ":-1",
+           challenge.challenge + ":1" + std::string(300, '0'),
+       }) {
+    EXPECT_FALSE(pow.check(response, long_url, client, challenge.expires))
+        << response;
+  }
+}
+
+} // namespace
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
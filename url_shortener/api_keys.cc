@@ -0,0 +1,194 @@
+#include "api_keys.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <folly/Range.h>
+#include <folly/String.h>
+#include <folly/ssl/OpenSSLHash.h>
+#include <glog/logging.h>
+#include <openssl/crypto.h>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+constexpr std::string_view bearer = "Bearer ";
+// longer tokens cannot be keys, so are not worth hashing
+constexpr std::size_t max_token_length = 256;
+
+auto usage(const ApiKey &key, RateLimitClock::time_point now) -> double {
+  const auto window = key.burst_tolerance + key.emission_interval;
+  if (window.count() == 0) {
+    return 0.0;
+  }
+  const auto ahead =
+      key.theoretical_arrival.load(std::memory_order_relaxed) -
+      now.time_since_epoch().count();
+  return std::clamp(static_cast<double>(ahead) / window.count(), 0.0, 1.0);
+}
+
+} // namespace
+
+auto api_key_token(const proxygen::HTTPMessage &msg) -> std::string_view {
+  if (msg.getPathAsStringPiece() != "/api/v1/create") {
+    return {};
+  }
+  const std::string &authorization = msg.getHeaders().getSingleOrEmpty(
+      proxygen::HTTPHeaderCode::HTTP_HEADER_AUTHORIZATION);
+  if (!folly::StringPiece{authorization}.startsWith(
+          folly::StringPiece{bearer.data(), bearer.size()},
+          folly::AsciiCaseInsensitive{})) {
+    return {};
+  }
+  const folly::StringPiece token =
+      folly::trimWhitespace(folly::StringPiece{authorization}.subpiece(
+          bearer.size()));
+  return {token.data(), token.size()};
+}
+
+ApiKeyring::ApiKeyring(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config) {
+  std::string secret;
+  CHECK(folly::unhexlify(config.api_key_secret, secret) &&
+        secret.size() == secret_.size())
+      << "Fix the configuration entry \"api_key_secret\". Expected 64 hex "
+         "digits; generate it with `openssl rand -hex 32`";
+  std::memcpy(secret_.data(), secret.data(), secret_.size());
+  for (const auto &key_config : config.api_keys) {
+    CHECK(!key_config.name.empty() &&
+          key_config.name.find('.') == std::string::npos)
+        << "Fix the configuration entry \"api_keys\". Key names must not be "
+           "empty or contain \".\"";
+    std::string hmac;
+    auto key = std::make_unique<ApiKey>();
+    CHECK(folly::unhexlify(key_config.hmac, hmac) &&
+          hmac.size() == key->hmac.size())
+        << "Fix the configuration entry \"api_keys\". Expected the hmac of key "
+           "\""
+        << key_config.name << "\" to be 64 hex digits";
+    key->name = key_config.name;
+    std::memcpy(key->hmac.data(), hmac.data(), key->hmac.size());
+    if (key_config.per_minute > 0) {
+      key->emission_interval =
+          std::chrono::duration_cast<RateLimitClock::duration>(
+              std::chrono::minutes{1}) /
+          key_config.per_minute;
+      const uint32_t burst =
+          key_config.burst != 0 ? key_config.burst : key_config.per_minute;
+      key->burst_tolerance = key->emission_interval * (burst - 1);
+    } else {
+      key->emission_interval = RateLimitClock::duration::zero();
+      key->burst_tolerance = RateLimitClock::duration::zero();
+    }
+    LOG(INFO) << "API key " << key_config.name << " may create "
+              << (key_config.per_minute > 0
+                      ? std::to_string(key_config.per_minute)
+                      : std::string{"unlimited"})
+              << " URLs per minute";
+    CHECK(keys_.emplace(key_config.name, std::move(key)).second)
+        << "Fix the configuration entry \"api_keys\". Key \""
+        << key_config.name << "\" is configured twice";
+  }
+  reporter_.addFunction([this] { report(); }, std::chrono::minutes{1},
+                        "api keys");
+  reporter_.start();
+}
+
+ApiKeyring::~ApiKeyring() { reporter_.shutdown(); }
+
+auto ApiKeyring::find(std::string_view token) -> ApiKey * {
+  if (token.size() > max_token_length) {
+    unknown_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  ApiKey *key = nullptr;
+  if (const auto dot = token.find('.'); dot != std::string_view::npos) {
+    if (auto it = keys_.find(token.substr(0, dot)); it != keys_.end()) {
+      key = it->second.get();
+    }
+  }
+  std::array<uint8_t, 32> mac;
+  folly::ssl::OpenSSLHash::hmac_sha256(
+      folly::MutableByteRange{mac.data(), mac.size()},
+      folly::ByteRange{secret_.data(), secret_.size()},
+      folly::ByteRange{folly::StringPiece{token.data(), token.size()}});
+  // compared whether or not there is such a key, so that how long it takes
+  // says nothing about the secret
+  static const std::array<uint8_t, 32> no_key{};
+  const std::array<uint8_t, 32> &expected = key != nullptr ? key->hmac : no_key;
+  const bool matches =
+      CRYPTO_memcmp(mac.data(), expected.data(), mac.size()) == 0;
+  if (!matches || key == nullptr) {
+    unknown_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  return key;
+}
+
+auto ApiKeyring::admit(ApiKey &key, RateLimitClock::time_point now) -> bool {
+  if (key.emission_interval.count() != 0) {
+    // GCRA, as in `IPRateLimiter`, on one atomic timestamp
+    const RateLimitClock::rep at = now.time_since_epoch().count();
+    RateLimitClock::rep tat =
+        key.theoretical_arrival.load(std::memory_order_relaxed);
+    for (;;) {
+      const RateLimitClock::rep arrival = std::max(tat, at);
+      if (arrival - at > key.burst_tolerance.count()) {
+        key.over_quota.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      if (key.theoretical_arrival.compare_exchange_weak(
+              tat, arrival + key.emission_interval.count(),
+              std::memory_order_relaxed)) {
+        break;
+      }
+    }
+  }
+  key.admitted.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+auto ApiKeyring::stats(RateLimitClock::time_point now) const
+    -> std::vector<ApiKeyStats> {
+  std::vector<ApiKeyStats> dst;
+  dst.reserve(keys_.size());
+  for (const auto &[name, key] : keys_) {
+    dst.push_back(ApiKeyStats{
+        .name = name,
+        .admitted = key->admitted.load(std::memory_order_relaxed),
+        .over_quota = key->over_quota.load(std::memory_order_relaxed),
+        .created = key->created.load(std::memory_order_relaxed),
+        .usage = usage(*key, now),
+    });
+  }
+  return dst;
+}
+
+void ApiKeyring::report() {
+  const auto now = RateLimitClock::now();
+  const uint64_t unknown = unknown_.exchange(0, std::memory_order_relaxed);
+  LOG_IF(WARNING, unknown > 0)
+      << unknown << " requests to create a URL with an unknown API key last "
+                    "minute";
+  for (const auto &[name, key] : keys_) {
+    const uint64_t admitted =
+        key->admitted.exchange(0, std::memory_order_relaxed);
+    const uint64_t over_quota =
+        key->over_quota.exchange(0, std::memory_order_relaxed);
+    const uint64_t created =
+        key->created.exchange(0, std::memory_order_relaxed);
+    if (admitted == 0 && over_quota == 0) {
+      continue;
+    }
+    LOG(INFO) << "API key " << name << " last minute: " << admitted
+              << " admitted, " << created << " URLs created, " << over_quota
+              << " over quota; " << static_cast<int>(usage(*key, now) * 100)
+              << "% of its burst in use";
+  }
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,96 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_API_KEYS_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_API_KEYS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <folly/container/F14Map.h>
+#include <folly/experimental/FunctionScheduler.h>
+#include <memory>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "app_config.h"
+#include "ip_rate_limiter.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// The API key a request to create a URL authenticates with, from its
+// `Authorization: Bearer` header; empty if there is none, or if the request
+// is not for /api/v1/create, the only route keys are good for.
+auto api_key_token(const proxygen::HTTPMessage &msg) -> std::string_view;
+
+// One key of an `ApiKeyring`, with its quota and what it has been used for.
+struct ApiKey {
+  std::string name;
+  std::array<uint8_t, 32> hmac;
+  // of the key's quota, as in `IPRateLimiter`; zero for no limit
+  RateLimitClock::duration emission_interval;
+  RateLimitClock::duration burst_tolerance;
+  // in `RateLimitClock` ticks
+  std::atomic<RateLimitClock::rep> theoretical_arrival{0};
+  // since the last report
+  std::atomic<uint64_t> admitted{0};
+  std::atomic<uint64_t> over_quota{0};
+  std::atomic<uint64_t> created{0};
+
+  // a URL created with the key
+  void record_created() { created.fetch_add(1, std::memory_order_relaxed); }
+};
+
+// What a key has been used for since the last report.
+struct ApiKeyStats {
+  std::string name;
+  uint64_t admitted;
+  uint64_t over_quota;
+  uint64_t created;
+  // of the key's burst, from 0 (all of it left) to 1 (none)
+  double usage;
+};
+
+// The keys of `api_keys`, with which trusted servers create URLs without a
+// captcha. A key is "<name>.<secret>"; the configuration only holds an HMAC
+// of each under `api_key_secret`, which a key must match, compared in
+// constant time. Each key has a token bucket of its own, kept lock-free so
+// that every IO thread can share the keyring, and its counters are logged
+// every minute.
+class ApiKeyring {
+public:
+  // Fails a CHECK on a malformed secret or key.
+  explicit ApiKeyring(
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config);
+
+  ~ApiKeyring();
+
+  ApiKeyring(const ApiKeyring &) = delete;
+  ApiKeyring &operator=(const ApiKeyring &) = delete;
+
+  // The key `token` is, or nullptr if it is none.
+  auto find(std::string_view token) -> ApiKey *;
+
+  // Counts a request made with `key` at `now` against its quota; false if it
+  // is over, in which case it is not counted.
+  auto admit(ApiKey &key, RateLimitClock::time_point now) -> bool;
+
+  // Since the last report
+  auto stats(RateLimitClock::time_point now) const -> std::vector<ApiKeyStats>;
+
+private:
+  void report();
+
+  std::array<uint8_t, 32> secret_;
+  // not changed once constructed
+  folly::F14FastMap<std::string, std::unique_ptr<ApiKey>> keys_;
+  // requests with tokens that are not keys, since the last report
+  std::atomic<uint64_t> unknown_{0};
+  folly::FunctionScheduler reporter_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_API_KEYS_H
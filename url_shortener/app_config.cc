@@ -50,6 +50,24 @@ auto split_csv_string(std::string_view csv_string,
   return dst;
 }
 
+// `purpose` completes "Unable to parse IP CIDR supplied in configuration".
+auto parse_cidrs(const std::vector<std::string> &cidr_strs,
+                 std::string_view purpose) -> std::vector<folly::CIDRNetwork> {
+  std::vector<folly::CIDRNetwork> dst;
+  for (const auto &cidr_str : cidr_strs) {
+    auto r = folly::IPAddress::tryCreateNetwork(cidr_str);
+    if (r.hasValue()) {
+      dst.push_back(r.value());
+    } else {
+      LOG(ERROR) << "Unable to parse IP CIDR supplied in configuration "
+                 << purpose << ": " << cidr_str << std::endl
+                 << "This must be a CIDR like \"2400:cb00::/32\" or "
+                    "\"172.64.0.0/13\".";
+    }
+  }
+  return dst;
+}
+
 auto can_write_to_dir(std::filesystem::path directory) -> bool {
   try {
     std::filesystem::file_status status = std::filesystem::status(directory);
@@ -93,17 +111,128 @@ auto ReadOnlyAppConfig::new_from_yaml(std::filesystem::path yaml_filename)
       << urls_db_path.parent_path() << "\"";
   dst->urls_db_path = std::move(urls_db_path);
   dst->static_file_doc_root = static_file_doc_root;
-  dst->frontend_doc_root = config["frontend_doc_root"].as<std::string>();
+  dst->static_file_cache_max_bytes =
+      config["static_file_cache_max_bytes"].as<uint64_t>(
+          dst->static_file_cache_max_bytes);
+  dst->static_file_cache_max_file_bytes =
+      config["static_file_cache_max_file_bytes"].as<uint64_t>(
+          dst->static_file_cache_max_file_bytes);
+  dst->frontend_doc_root = config["frontend_doc_root"].as<std::string>("");
+  dst->frontend_bundle_path =
+      config["frontend_bundle_path"].as<std::string>("");
+  CHECK(dst->frontend_bundle_path.empty() ||
+        std::filesystem::exists(dst->frontend_bundle_path))
+      << "Fix the configuration entry \"frontend_bundle_path\". "
+      << dst->frontend_bundle_path << " does not exist";
+  dst->frontend_watch = config["frontend_watch"].as<bool>(dst->frontend_watch);
+  dst->frontend_early_hints =
+      config["frontend_early_hints"].as<bool>(dst->frontend_early_hints);
+  dst->frontend_server_push =
+      config["frontend_server_push"].as<bool>(dst->frontend_server_push);
+  if (config["mime_types"]) {
+    dst->mime_types =
+        config["mime_types"].as<std::map<std::string, std::string>>();
+  }
   dst->web_server_bind_host = config["web_server_bind_host"].as<std::string>();
   dst->url_shortener_service_base_url =
       config["public_base_url"].as<std::string>();
   dst->slug_length = config["slug_length"].as<uint8_t>();
   dst->alphabet = config["alphabet"].as<std::string>();
   dst->rate_limit_per_minute = config["rate_limit_per_minute"].as<uint32_t>();
-  dst->ip_rate_limiter_seconds_ttl =
-      config["rate_limiter_ttl_seconds"].as<uint32_t>();
+  dst->rate_limit_burst =
+      config["rate_limit_burst"].as<uint32_t>(dst->rate_limit_burst);
+  dst->rate_limit_sketch =
+      config["rate_limit_sketch"].as<bool>(dst->rate_limit_sketch);
+  dst->rate_limit_sketch_bytes = config["rate_limit_sketch_bytes"].as<uint64_t>(
+      dst->rate_limit_sketch_bytes);
+  dst->rate_limit_top_k =
+      config["rate_limit_top_k"].as<uint32_t>(dst->rate_limit_top_k);
+  dst->rate_limit_network_multiplier =
+      config["rate_limit_network_multiplier"].as<uint32_t>(
+          dst->rate_limit_network_multiplier);
+  dst->redirect_cost_per_minute =
+      config["redirect_cost_per_minute"].as<uint32_t>(
+          dst->redirect_cost_per_minute);
+  dst->redirect_cost_burst =
+      config["redirect_cost_burst"].as<uint32_t>(dst->redirect_cost_burst);
+  dst->redirect_hit_cost =
+      config["redirect_hit_cost"].as<uint32_t>(dst->redirect_hit_cost);
+  dst->redirect_miss_cost =
+      config["redirect_miss_cost"].as<uint32_t>(dst->redirect_miss_cost);
+  dst->ban_after_rejections =
+      config["ban_after_rejections"].as<uint32_t>(dst->ban_after_rejections);
+  dst->ban_seconds = config["ban_seconds"].as<uint32_t>(dst->ban_seconds);
+  dst->ban_max_seconds =
+      config["ban_max_seconds"].as<uint32_t>(dst->ban_max_seconds);
+  dst->max_connections_per_ip = config["max_connections_per_ip"].as<uint32_t>(
+      dst->max_connections_per_ip);
+  dst->request_header_timeout_ms =
+      config["request_header_timeout_ms"].as<uint32_t>(
+          dst->request_header_timeout_ms);
+  if (config["rate_limits"]) {
+    for (const auto &policy : config["rate_limits"]) {
+      dst->rate_limits.push_back({
+          .route = policy["route"].as<std::string>(),
+          .per_minute = policy["per_minute"].as<uint32_t>(),
+          .burst = policy["burst"].as<uint32_t>(0),
+          .cidrs = parse_cidrs(policy["cidrs"].as<std::vector<std::string>>(
+                                   std::vector<std::string>{}),
+                               "for a rate limit"),
+      });
+    }
+  }
+  dst->captcha_verifier =
+      config["captcha_verifier"].as<std::string>(dst->captcha_verifier);
   dst->captcha_service_api_key =
-      config["captcha_service_api_key"].as<std::string>();
+      config["captcha_service_api_key"].as<std::string>("");
+  dst->proof_of_work_secret = config["proof_of_work_secret"].as<std::string>(
+      dst->proof_of_work_secret);
+  dst->proof_of_work_difficulty =
+      config["proof_of_work_difficulty"].as<uint32_t>(
+          dst->proof_of_work_difficulty);
+  dst->proof_of_work_max_difficulty =
+      config["proof_of_work_max_difficulty"].as<uint32_t>(
+          dst->proof_of_work_max_difficulty);
+  dst->proof_of_work_ttl_seconds =
+      config["proof_of_work_ttl_seconds"].as<uint32_t>(
+          dst->proof_of_work_ttl_seconds);
+  dst->api_key_secret =
+      config["api_key_secret"].as<std::string>(dst->api_key_secret);
+  if (config["api_keys"]) {
+    for (const auto &key : config["api_keys"]) {
+      dst->api_keys.push_back({
+          .name = key["name"].as<std::string>(),
+          .hmac = key["hmac"].as<std::string>(),
+          .per_minute = key["per_minute"].as<uint32_t>(0),
+          .burst = key["burst"].as<uint32_t>(0),
+      });
+    }
+  }
+  dst->captcha_service_url =
+      config["captcha_service_url"].as<std::string>(dst->captcha_service_url);
+  dst->captcha_timeout_ms =
+      config["captcha_timeout_ms"].as<uint32_t>(dst->captcha_timeout_ms);
+  dst->captcha_hedge_after_ms = config["captcha_hedge_after_ms"].as<uint32_t>(
+      dst->captcha_hedge_after_ms);
+  dst->captcha_breaker_failures =
+      config["captcha_breaker_failures"].as<uint32_t>(
+          dst->captcha_breaker_failures);
+  dst->captcha_breaker_open_ms = config["captcha_breaker_open_ms"].as<uint32_t>(
+      dst->captcha_breaker_open_ms);
+  dst->captcha_fail_open =
+      config["captcha_fail_open"].as<bool>(dst->captcha_fail_open);
+  dst->create_deadline_ms =
+      config["create_deadline_ms"].as<uint32_t>(dst->create_deadline_ms);
+  dst->create_max_body_bytes = config["create_max_body_bytes"].as<uint32_t>(
+      dst->create_max_body_bytes);
+  dst->create_batch_max_urls = config["create_batch_max_urls"].as<uint32_t>(
+      dst->create_batch_max_urls);
+  dst->dns_cache_ttl_seconds = config["dns_cache_ttl_seconds"].as<uint32_t>(
+      dst->dns_cache_ttl_seconds);
+  if (config["host_overrides"]) {
+    dst->host_overrides =
+        config["host_overrides"].as<std::map<std::string, std::string>>();
+  }
   dst->trusted_certificates_path =
       config["trusted_certificates_path"].as<std::string>();
   auto hk = config["url_generator_salt"].as<std::string>();
@@ -139,6 +268,17 @@ auto ReadOnlyAppConfig::new_from_yaml(std::filesystem::path yaml_filename)
     }
   }
 
+  dst->ip_allow_list = CidrSet{
+      parse_cidrs(config["allowed_ip_ranges"].as<std::vector<std::string>>(
+                      std::vector<std::string>{}),
+                  "as an allowed IP range")};
+  dst->ip_deny_list = CidrSet{
+      parse_cidrs(config["denied_ip_ranges"].as<std::vector<std::string>>(
+                      std::vector<std::string>{}),
+                  "as a denied IP range")};
+  dst->cf_networks = CidrSet{dst->cf_cidrs};
+  dst->reverse_proxy_networks = CidrSet{dst->reverse_proxy_cidrs};
+
   return dst;
 }
 
@@ -161,11 +301,116 @@ auto ReadOnlyAppConfig::new_from_env()
     dst->grpc_service_port = static_cast<uint16_t>(std::atoi(rpc_port_s));
   }
 
-  const char *ip_rate_limiter_ttl_seconds_inp =
-      std::getenv("EC_PRV_URL_SHORTENER__IP_RATE_LIMITER_TTL_SECONDS");
-  if (ip_rate_limiter_ttl_seconds_inp != nullptr) {
-    dst->ip_rate_limiter_seconds_ttl =
-        std::atoi(ip_rate_limiter_ttl_seconds_inp);
+  const char *rate_limit_burst_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__RATE_LIMIT_BURST");
+  if (rate_limit_burst_inp != nullptr) {
+    dst->rate_limit_burst = std::atoi(rate_limit_burst_inp);
+  }
+
+  const char *rate_limit_sketch_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__RATE_LIMIT_SKETCH");
+  if (rate_limit_sketch_inp != nullptr) {
+    dst->rate_limit_sketch = strcmp(rate_limit_sketch_inp, "0") != 0 &&
+                             strcmp(rate_limit_sketch_inp, "false") != 0;
+  }
+
+  const char *rate_limit_sketch_bytes_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__RATE_LIMIT_SKETCH_BYTES");
+  if (rate_limit_sketch_bytes_inp != nullptr) {
+    dst->rate_limit_sketch_bytes =
+        std::strtoull(rate_limit_sketch_bytes_inp, nullptr, 10);
+  }
+
+  const char *rate_limit_top_k_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__RATE_LIMIT_TOP_K");
+  if (rate_limit_top_k_inp != nullptr) {
+    dst->rate_limit_top_k = std::atoi(rate_limit_top_k_inp);
+  }
+
+  const char *rate_limit_network_multiplier_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__RATE_LIMIT_NETWORK_MULTIPLIER");
+  if (rate_limit_network_multiplier_inp != nullptr) {
+    dst->rate_limit_network_multiplier =
+        std::atoi(rate_limit_network_multiplier_inp);
+  }
+
+  const char *redirect_cost_per_minute_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__REDIRECT_COST_PER_MINUTE");
+  if (redirect_cost_per_minute_inp != nullptr) {
+    dst->redirect_cost_per_minute = std::atoi(redirect_cost_per_minute_inp);
+  }
+
+  const char *redirect_cost_burst_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__REDIRECT_COST_BURST");
+  if (redirect_cost_burst_inp != nullptr) {
+    dst->redirect_cost_burst = std::atoi(redirect_cost_burst_inp);
+  }
+
+  const char *redirect_hit_cost_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__REDIRECT_HIT_COST");
+  if (redirect_hit_cost_inp != nullptr) {
+    dst->redirect_hit_cost = std::atoi(redirect_hit_cost_inp);
+  }
+
+  const char *redirect_miss_cost_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__REDIRECT_MISS_COST");
+  if (redirect_miss_cost_inp != nullptr) {
+    dst->redirect_miss_cost = std::atoi(redirect_miss_cost_inp);
+  }
+
+  const char *ban_after_rejections_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__BAN_AFTER_REJECTIONS");
+  if (ban_after_rejections_inp != nullptr) {
+    dst->ban_after_rejections = std::atoi(ban_after_rejections_inp);
+  }
+
+  const char *ban_seconds_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__BAN_SECONDS");
+  if (ban_seconds_inp != nullptr) {
+    dst->ban_seconds = std::atoi(ban_seconds_inp);
+  }
+
+  const char *ban_max_seconds_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__BAN_MAX_SECONDS");
+  if (ban_max_seconds_inp != nullptr) {
+    dst->ban_max_seconds = std::atoi(ban_max_seconds_inp);
+  }
+
+  const char *max_connections_per_ip_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__MAX_CONNECTIONS_PER_IP");
+  if (max_connections_per_ip_inp != nullptr) {
+    dst->max_connections_per_ip = std::atoi(max_connections_per_ip_inp);
+  }
+
+  const char *request_header_timeout_ms_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__REQUEST_HEADER_TIMEOUT_MS");
+  if (request_header_timeout_ms_inp != nullptr) {
+    dst->request_header_timeout_ms = std::atoi(request_header_timeout_ms_inp);
+  }
+
+  // e.g., "create:5,redirect:600:100,create:0::10.0.0.0/8|192.168.0.0/16"
+  const char *rate_limits_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__RATE_LIMITS");
+  if (rate_limits_inp != nullptr) {
+    for (const auto &policy_str : split_csv_string(rate_limits_inp)) {
+      auto fields = split_csv_string(policy_str, ":"sv);
+      if (fields.size() < 2) {
+        LOG(ERROR) << "Ignoring rate limit \"" << policy_str
+                   << "\"; expected \"route:per_minute[:burst[:cidr|...]]\"";
+        continue;
+      }
+      dst->rate_limits.push_back({
+          .route = fields[0],
+          .per_minute = static_cast<uint32_t>(std::atoi(fields[1].c_str())),
+          .burst = fields.size() > 2
+                       ? static_cast<uint32_t>(std::atoi(fields[2].c_str()))
+                       : 0,
+          .cidrs = fields.size() > 3
+                       ? parse_cidrs(split_csv_string(fields[3], "|"sv),
+                                     "for a rate limit")
+                       : std::vector<folly::CIDRNetwork>{},
+      });
+    }
   }
 
   const char *web_server_port_s =
@@ -190,11 +435,72 @@ auto ReadOnlyAppConfig::new_from_env()
            "exist";
   }
 
-  CHECK(std::getenv("EC_PRV_URL_SHORTENER__FRONTEND_DOC_ROOT") != nullptr);
-  dst->frontend_doc_root = std::filesystem::path{
-      std::getenv("EC_PRV_URL_SHORTENER__FRONTEND_DOC_ROOT")};
-  CHECK(std::filesystem::exists(dst->frontend_doc_root))
-      << "Missing environment variable for frontend doc root";
+  const char *static_file_cache_max_bytes_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__STATIC_FILE_CACHE_MAX_BYTES");
+  if (static_file_cache_max_bytes_inp != nullptr) {
+    dst->static_file_cache_max_bytes =
+        std::strtoull(static_file_cache_max_bytes_inp, nullptr, 10);
+  }
+
+  const char *static_file_cache_max_file_bytes_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__STATIC_FILE_CACHE_MAX_FILE_BYTES");
+  if (static_file_cache_max_file_bytes_inp != nullptr) {
+    dst->static_file_cache_max_file_bytes =
+        std::strtoull(static_file_cache_max_file_bytes_inp, nullptr, 10);
+  }
+
+  const char *frontend_bundle_path_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__FRONTEND_BUNDLE_PATH");
+  if (frontend_bundle_path_inp != nullptr &&
+      strlen(frontend_bundle_path_inp) > 0) {
+    dst->frontend_bundle_path = std::filesystem::path{frontend_bundle_path_inp};
+    CHECK(std::filesystem::exists(dst->frontend_bundle_path))
+        << "Frontend bundle provided via environment variables does not exist";
+  }
+
+  const char *frontend_watch_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__FRONTEND_WATCH");
+  if (frontend_watch_inp != nullptr) {
+    dst->frontend_watch = strcmp(frontend_watch_inp, "0") != 0 &&
+                          strcmp(frontend_watch_inp, "false") != 0;
+  }
+
+  const char *frontend_early_hints_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__FRONTEND_EARLY_HINTS");
+  if (frontend_early_hints_inp != nullptr) {
+    dst->frontend_early_hints = strcmp(frontend_early_hints_inp, "0") != 0 &&
+                                strcmp(frontend_early_hints_inp, "false") != 0;
+  }
+
+  const char *frontend_server_push_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__FRONTEND_SERVER_PUSH");
+  if (frontend_server_push_inp != nullptr) {
+    dst->frontend_server_push = strcmp(frontend_server_push_inp, "0") != 0 &&
+                                strcmp(frontend_server_push_inp, "false") != 0;
+  }
+
+  const char *frontend_doc_root_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__FRONTEND_DOC_ROOT");
+  if (frontend_doc_root_inp != nullptr) {
+    dst->frontend_doc_root = std::filesystem::path{frontend_doc_root_inp};
+    CHECK(std::filesystem::exists(dst->frontend_doc_root))
+        << "Frontend doc root provided via environment variables does not "
+           "exist";
+  }
+
+  // e.g., "wasm=application/wasm,avif=image/avif"
+  const char *mime_types_inp = std::getenv("EC_PRV_URL_SHORTENER__MIME_TYPES");
+  if (mime_types_inp != nullptr) {
+    for (const auto &mapping : split_csv_string(mime_types_inp)) {
+      auto eq = mapping.find('=');
+      if (eq == std::string::npos) {
+        LOG(ERROR) << "Ignoring MIME type mapping \"" << mapping
+                   << "\"; expected \"extension=media/type\"";
+        continue;
+      }
+      dst->mime_types[mapping.substr(0, eq)] = mapping.substr(eq + 1);
+    }
+  }
 
   const char *static_file_request_path_prefix_inp =
       std::getenv("EC_PRV_URL_SHORTENER__STATIC_FILE_REQUEST_PATH_PREFIX");
@@ -215,10 +521,150 @@ auto ReadOnlyAppConfig::new_from_env()
     CHECK(std::filesystem::exists(dst->trusted_certificates_path));
   }
 
-  dst->captcha_service_api_key =
-      std::getenv("EC_PRV_URL_SHORTENER__CAPTCHA_SERVICE_API_KEY");
-  CHECK(dst->captcha_service_api_key.length() > 0)
-      << "Missing environment variable for reCAPTCHA API key";
+  const char *captcha_verifier_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__CAPTCHA_VERIFIER");
+  if (captcha_verifier_inp != nullptr) {
+    dst->captcha_verifier = captcha_verifier_inp;
+  }
+
+  if (dst->captcha_verifier == "recaptcha") {
+    const char *captcha_service_api_key_inp =
+        std::getenv("EC_PRV_URL_SHORTENER__CAPTCHA_SERVICE_API_KEY");
+    CHECK(captcha_service_api_key_inp != nullptr &&
+          strlen(captcha_service_api_key_inp) > 0)
+        << "Missing environment variable for reCAPTCHA API key";
+    dst->captcha_service_api_key = captcha_service_api_key_inp;
+  }
+
+  const char *proof_of_work_secret_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__PROOF_OF_WORK_SECRET");
+  if (proof_of_work_secret_inp != nullptr) {
+    dst->proof_of_work_secret = proof_of_work_secret_inp;
+  }
+
+  const char *proof_of_work_difficulty_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__PROOF_OF_WORK_DIFFICULTY");
+  if (proof_of_work_difficulty_inp != nullptr) {
+    dst->proof_of_work_difficulty = std::atoi(proof_of_work_difficulty_inp);
+  }
+
+  const char *proof_of_work_max_difficulty_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__PROOF_OF_WORK_MAX_DIFFICULTY");
+  if (proof_of_work_max_difficulty_inp != nullptr) {
+    dst->proof_of_work_max_difficulty =
+        std::atoi(proof_of_work_max_difficulty_inp);
+  }
+
+  const char *proof_of_work_ttl_seconds_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__PROOF_OF_WORK_TTL_SECONDS");
+  if (proof_of_work_ttl_seconds_inp != nullptr) {
+    dst->proof_of_work_ttl_seconds = std::atoi(proof_of_work_ttl_seconds_inp);
+  }
+
+  const char *api_key_secret_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__API_KEY_SECRET");
+  if (api_key_secret_inp != nullptr) {
+    dst->api_key_secret = api_key_secret_inp;
+  }
+
+  const char *api_keys_inp = std::getenv("EC_PRV_URL_SHORTENER__API_KEYS");
+  if (api_keys_inp != nullptr) {
+    for (const auto &key_str : split_csv_string(api_keys_inp)) {
+      auto fields = split_csv_string(key_str, ":"sv);
+      if (fields.size() < 2) {
+        LOG(ERROR) << "Ignoring API key \"" << key_str
+                   << "\"; expected \"name:hmac[:per_minute[:burst]]\"";
+        continue;
+      }
+      dst->api_keys.push_back({
+          .name = fields[0],
+          .hmac = fields[1],
+          .per_minute =
+              fields.size() > 2
+                  ? static_cast<uint32_t>(std::atoi(fields[2].c_str()))
+                  : 0,
+          .burst = fields.size() > 3
+                       ? static_cast<uint32_t>(std::atoi(fields[3].c_str()))
+                       : 0,
+      });
+    }
+  }
+
+  const char *captcha_service_url_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__CAPTCHA_SERVICE_URL");
+  if (captcha_service_url_inp != nullptr) {
+    dst->captcha_service_url = captcha_service_url_inp;
+  }
+
+  const char *captcha_timeout_ms_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__CAPTCHA_TIMEOUT_MS");
+  if (captcha_timeout_ms_inp != nullptr) {
+    dst->captcha_timeout_ms = std::atoi(captcha_timeout_ms_inp);
+  }
+
+  const char *captcha_hedge_after_ms_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__CAPTCHA_HEDGE_AFTER_MS");
+  if (captcha_hedge_after_ms_inp != nullptr) {
+    dst->captcha_hedge_after_ms = std::atoi(captcha_hedge_after_ms_inp);
+  }
+
+  const char *captcha_breaker_failures_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__CAPTCHA_BREAKER_FAILURES");
+  if (captcha_breaker_failures_inp != nullptr) {
+    dst->captcha_breaker_failures = std::atoi(captcha_breaker_failures_inp);
+  }
+
+  const char *captcha_breaker_open_ms_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__CAPTCHA_BREAKER_OPEN_MS");
+  if (captcha_breaker_open_ms_inp != nullptr) {
+    dst->captcha_breaker_open_ms = std::atoi(captcha_breaker_open_ms_inp);
+  }
+
+  const char *captcha_fail_open_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__CAPTCHA_FAIL_OPEN");
+  if (captcha_fail_open_inp != nullptr) {
+    dst->captcha_fail_open = strcmp(captcha_fail_open_inp, "0") != 0 &&
+                             strcmp(captcha_fail_open_inp, "false") != 0;
+  }
+
+  const char *create_deadline_ms_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__CREATE_DEADLINE_MS");
+  if (create_deadline_ms_inp != nullptr) {
+    dst->create_deadline_ms = std::atoi(create_deadline_ms_inp);
+  }
+
+  const char *create_max_body_bytes_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__CREATE_MAX_BODY_BYTES");
+  if (create_max_body_bytes_inp != nullptr) {
+    dst->create_max_body_bytes = std::atoi(create_max_body_bytes_inp);
+  }
+
+  const char *create_batch_max_urls_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__CREATE_BATCH_MAX_URLS");
+  if (create_batch_max_urls_inp != nullptr) {
+    dst->create_batch_max_urls = std::atoi(create_batch_max_urls_inp);
+  }
+
+  const char *dns_cache_ttl_seconds_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__DNS_CACHE_TTL_SECONDS");
+  if (dns_cache_ttl_seconds_inp != nullptr) {
+    dst->dns_cache_ttl_seconds = std::atoi(dns_cache_ttl_seconds_inp);
+  }
+
+  // e.g., "www.google.com=127.0.0.1:8443"
+  const char *host_overrides_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__HOST_OVERRIDES");
+  if (host_overrides_inp != nullptr) {
+    for (const auto &mapping : split_csv_string(host_overrides_inp)) {
+      auto eq = mapping.find('=');
+      if (eq == std::string::npos) {
+        LOG(ERROR) << "Ignoring host override \"" << mapping
+                   << "\"; expected \"host=ip[:port]\"";
+        continue;
+      }
+      dst->host_overrides[mapping.substr(0, eq)] = mapping.substr(eq + 1);
+    }
+  }
 
   CHECK(std::getenv("EC_PRV_URL_SHORTENER__KNOWN_CLOUDFLARE_CIDRS") != nullptr);
   dst->known_cloudflare_cidrs = split_csv_string(
@@ -278,6 +724,23 @@ auto ReadOnlyAppConfig::new_from_env()
   CHECK(dst->alphabet.length() > 0)
       << "Invalid \"alphabet\" app configuration parameter";
 
+  const char *allowed_ip_ranges_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__ALLOWED_IP_RANGES");
+  if (allowed_ip_ranges_inp != nullptr) {
+    dst->ip_allow_list = CidrSet{parse_cidrs(
+        split_csv_string(allowed_ip_ranges_inp), "as an allowed IP range")};
+  }
+
+  const char *denied_ip_ranges_inp =
+      std::getenv("EC_PRV_URL_SHORTENER__DENIED_IP_RANGES");
+  if (denied_ip_ranges_inp != nullptr) {
+    dst->ip_deny_list = CidrSet{parse_cidrs(
+        split_csv_string(denied_ip_ranges_inp), "as a denied IP range")};
+  }
+
+  dst->cf_networks = CidrSet{dst->cf_cidrs};
+  dst->reverse_proxy_networks = CidrSet{dst->reverse_proxy_cidrs};
+
   return dst;
 }
 
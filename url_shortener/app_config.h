@@ -4,14 +4,43 @@
 #include <cstdint>
 #include <filesystem>
 #include <folly/IPAddress.h>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "cidr_set.h"
+
 namespace ec_prv {
 namespace url_shortener {
 namespace app_config {
 
+// A rate limit for one class of routes (see `RouteClass`), optionally only for
+// clients in some networks.
+struct RateLimitPolicyConfig {
+  // "frontend", "static", "create", "redirect", "challenge" or "other"
+  std::string route;
+  // 0 for no limit
+  uint32_t per_minute{0};
+  // 0 for the same as `per_minute`
+  uint32_t burst{0};
+  // empty for every client not covered by a more specific policy
+  std::vector<folly::CIDRNetwork> cidrs;
+};
+
+// A key with which a trusted server may create URLs without a captcha, sent
+// as `Authorization: Bearer <name>.<secret>`.
+struct ApiKeyConfig {
+  std::string name;
+  // hex HMAC-SHA256 of the whole key under `api_key_secret`, so that the
+  // configuration does not hold the keys themselves
+  std::string hmac;
+  // 0 for no limit
+  uint32_t per_minute{0};
+  // 0 for the same as `per_minute`
+  uint32_t burst{0};
+};
+
 struct ReadOnlyAppConfig {
   // Random 256-bit key with which to hash input long URLs into short slugs.
   const uint64_t *highwayhash_key{nullptr};
@@ -29,14 +58,88 @@ struct ReadOnlyAppConfig {
 
   std::filesystem::path static_file_doc_root;
 
+  // Directory of the Next.js static export. Only read if there is no frontend
+  // bundle, which is then packed from it at startup.
   std::filesystem::path frontend_doc_root;
 
+  // Frontend bundle built by the `frontend_bundle` CMake target
+  std::filesystem::path frontend_bundle_path;
+
+  // Reload the frontend when `frontend_bundle_path` (or `frontend_doc_root`)
+  // changes on disk. It is always reloaded on SIGHUP.
+  bool frontend_watch{true};
+
+  // Send `103 Early Hints` with preload links for the stylesheets, scripts
+  // and fonts of an HTML page before the page itself.
+  bool frontend_early_hints{true};
+
+  // Push those subresources instead, to HTTP/2 clients that allow it. Most
+  // browsers have dropped support for server push, and it wastes bandwidth
+  // on clients that have them cached already.
+  bool frontend_server_push{false};
+
   const char *static_file_request_path_prefix{"/static/"};
 
+  // Memory budget for caching files under `static_file_doc_root`
+  uint64_t static_file_cache_max_bytes{64 << 20};
+
+  // Files larger than this are streamed from disk instead of being cached
+  uint64_t static_file_cache_max_file_bytes{1 << 20};
+
+  // Media types by file extension, added to or overriding the built-in table
+  // for the frontend and static files, e.g., {"wasm": "application/wasm"}
+  std::map<std::string, std::string> mime_types;
+
   // How many times per minute can an IP hit a protected route
   uint32_t rate_limit_per_minute{60};
 
-  uint32_t ip_rate_limiter_seconds_ttl{86400};
+  // How many requests an IP can make at once before being held to
+  // `rate_limit_per_minute`; 0 means the same as `rate_limit_per_minute`
+  uint32_t rate_limit_burst{0};
+
+  // Rate limits per class of routes. If empty, only URL creation is limited,
+  // per `rate_limit_per_minute` and `rate_limit_burst`.
+  std::vector<RateLimitPolicyConfig> rate_limits;
+
+  // Count requests in a fixed amount of memory instead of per address, for
+  // floods from more addresses than could be tracked one by one. Also limits
+  // each /64 (IPv6) or /24 (IPv4) to `rate_limit_network_multiplier` times
+  // an address's limit. Limits are then per sliding minute, without bursts.
+  bool rate_limit_sketch{false};
+
+  // Memory shared by the sketches of all rate limits
+  uint64_t rate_limit_sketch_bytes{4 << 20};
+
+  // How many of the heaviest addresses and networks are logged every minute
+  uint32_t rate_limit_top_k{32};
+
+  uint32_t rate_limit_network_multiplier{16};
+
+  // Budget for each client's redirect lookups, per minute, in which a lookup
+  // of a slug that exists costs `redirect_hit_cost` and one of a slug that
+  // does not `redirect_miss_cost`. Clients out of budget get 429 Too Many
+  // Requests without a lookup. 0 for no limit.
+  uint32_t redirect_cost_per_minute{300};
+  // How much a client can spend at once; 0 for `redirect_cost_per_minute`
+  uint32_t redirect_cost_burst{0};
+  uint32_t redirect_hit_cost{1};
+  uint32_t redirect_miss_cost{10};
+
+  // Ban a client for `ban_seconds` once it is rate limited this many times
+  // within a minute, refusing its connections outright. Each ban is twice as
+  // long as the one before, up to `ban_max_seconds`, and a client is forgiven
+  // one doubling per `ban_max_seconds` without one. 0 disables bans.
+  uint32_t ban_after_rejections{30};
+  uint32_t ban_seconds{60};
+  uint32_t ban_max_seconds{3600};
+
+  // Open connections allowed from any one IP, other than trusted proxies and
+  // `ip_allow_list`; 0 for no limit
+  uint32_t max_connections_per_ip{64};
+
+  // Drop connections that have not sent a complete request head within this
+  // long of being accepted; 0 for no limit
+  uint32_t request_header_timeout_ms{10000};
 
   // This is the base URL for your URL shortening service, after which
   // the shortened URL slug is appended. For example,
@@ -49,8 +152,47 @@ struct ReadOnlyAppConfig {
   std::filesystem::path trusted_certificates_path{
       "/etc/ssl/certs/ca-certificates.crt"};
 
+  // How requests to shorten a URL prove they are worth serving:
+  // "recaptcha", verified by `captcha_service_url`, or "proof_of_work",
+  // verified locally (see `ProofOfWorkVerifier`)
+  std::string captcha_verifier{"recaptcha"};
+
   std::string captcha_service_api_key;
 
+  // Endpoint that verifies captcha responses, e.g., a local stand-in for
+  // tests. Its certificate must be trusted by `trusted_certificates_path`.
+  std::string captcha_service_url{
+      "https://www.google.com/recaptcha/api/siteverify"};
+
+  // Give up on a captcha verification after this long, which then counts as
+  // a failure of the service
+  uint32_t captcha_timeout_ms{3000};
+
+  // Send a verification again, on another connection, if the first has not
+  // been answered within this long, and take the first answer; 0 to never
+  uint32_t captcha_hedge_after_ms{0};
+
+  // Stop asking the captcha service for `captcha_breaker_open_ms` once this
+  // many verifications in a row have failed, then try one at a time until
+  // one succeeds; 0 to always ask
+  uint32_t captcha_breaker_failures{5};
+  uint32_t captcha_breaker_open_ms{30000};
+
+  // While the captcha service fails, let URLs be created without it (still
+  // rate limited) instead of refusing with 503 Service Unavailable
+  bool captcha_fail_open{false};
+
+  // Answer a request to create a URL with 413 Payload Too Large once its body
+  // is longer than this
+  uint32_t create_max_body_bytes{16384};
+
+  // Most long URLs in one request to /api/v1/create_batch
+  uint32_t create_batch_max_urls{10000};
+
+  // Answer a request to create a URL with 503 Service Unavailable if it has
+  // not been answered this long after its headers arrived
+  uint32_t create_deadline_ms{5000};
+
   // IP addresses of reverse proxy servers allowed to transmit client
   // IP addresses in headers (i.e., 'CF-Connecting-IP' or
   // 'X-Forwarded-For')
@@ -60,6 +202,39 @@ struct ReadOnlyAppConfig {
   std::vector<folly::CIDRNetwork> cf_cidrs{};
   std::vector<std::string> allowed_reverse_proxy_cidrs{};
   std::vector<folly::CIDRNetwork> reverse_proxy_cidrs{};
+  // `cf_cidrs` and `reverse_proxy_cidrs`, compiled for lookups per request
+  CidrSet cf_networks;
+  CidrSet reverse_proxy_networks;
+
+  // Clients in these networks are never rate limited or denied, e.g., your
+  // own monitoring
+  CidrSet ip_allow_list;
+  // Clients in these networks are refused with 403 Forbidden
+  CidrSet ip_deny_list;
+
+  // Key for signing proof-of-work challenges, 64 hex digits. If empty, a
+  // random one is used, and challenges only work on this process.
+  std::string proof_of_work_secret;
+  // Leading zero bits a solution needs, rising to the maximum as a client
+  // uses up its rate limit for creating URLs
+  uint32_t proof_of_work_difficulty{16};
+  uint32_t proof_of_work_max_difficulty{22};
+  // How long a challenge can be solved for
+  uint32_t proof_of_work_ttl_seconds{120};
+
+  // Key under which `api_keys` are hashed, 64 hex digits
+  std::string api_key_secret;
+  // Keys that may create URLs at /api/v1/create without a captcha, each
+  // within a quota of its own instead of its IP's rate limit
+  std::vector<ApiKeyConfig> api_keys;
+
+  // How long resolved addresses of external services are cached
+  uint32_t dns_cache_ttl_seconds{300};
+
+  // Fixed addresses for hosts of external services, as "ip" or "ip:port",
+  // e.g., {"www.google.com": "127.0.0.1:8443"} to test against a local
+  // stand-in
+  std::map<std::string, std::string> host_overrides;
 
   // User agent the server uses when initiating requests to external services
   // (e.g., like reCAPTCHA)
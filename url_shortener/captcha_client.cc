@@ -0,0 +1,483 @@
+#include "captcha_client.h"
+
+#include <algorithm>
+#include <folly/Format.h>
+#include <folly/String.h>
+#include <folly/json.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/io/SocketOptionMap.h>
+#include <folly/io/async/AsyncSSLSocket.h>
+#include <folly/io/async/SSLOptions.h>
+#include <glog/logging.h>
+#include <list>
+#include <proxygen/lib/http/HTTPConnector.h>
+#include <proxygen/lib/http/session/HTTPTransaction.h>
+#include <stdexcept>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+constexpr std::chrono::milliseconds connect_timeout{1000};
+// how long an idle connection is kept open for the next verification
+constexpr std::chrono::seconds keepalive{60};
+
+// Whether an answer lets the user through. A hedged verification sends the
+// same response twice, and the service turns down whichever copy reaches it
+// second as a duplicate, so only an approval is taken while the other copy
+// is still out.
+auto approves(const std::string &body) -> bool {
+  try {
+    const folly::dynamic json = folly::parseJson(body);
+    const folly::dynamic *success =
+        json.isObject() ? json.get_ptr("success") : nullptr;
+    return success != nullptr && success->isBool() && success->getBool();
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+
+} // namespace
+
+// One attempt at a verification, from sending it to its answer. Deletes
+// itself once proxygen is done with it.
+class CaptchaClient::Exchange : public proxygen::HTTPTransactionHandler {
+public:
+  Exchange(CaptchaClient *client, std::shared_ptr<Pending> pending, bool hedge)
+      : client_(client), pending_(std::move(pending)), hedge_(hedge) {}
+
+  void report(folly::Try<std::string> result) {
+    if (!reported_) {
+      reported_ = true;
+      client_->on_attempt_done(*pending_, hedge_, std::move(result));
+    }
+  }
+
+  void fail(const std::string &what) {
+    report(folly::Try<std::string>{
+        folly::make_exception_wrapper<std::runtime_error>(what)});
+  }
+
+  void setTransaction(proxygen::HTTPTransaction *) noexcept override {}
+
+  void detachTransaction() noexcept override {
+    fail("captcha service transaction detached");
+    CaptchaClient *client = client_;
+    delete this;
+    // the connection may take another stream now
+    if (!client->shutting_down_) {
+      client->dispatch();
+    }
+  }
+
+  void onHeadersComplete(
+      std::unique_ptr<proxygen::HTTPMessage> msg) noexcept override {
+    status_ = msg->getStatusCode();
+  }
+
+  void onBody(std::unique_ptr<folly::IOBuf> chain) noexcept override {
+    body_.append(std::move(chain));
+  }
+
+  void onTrailers(std::unique_ptr<proxygen::HTTPHeaders>) noexcept override {}
+
+  void onEOM() noexcept override {
+    if (status_ != 200) {
+      LOG(ERROR) << "Received status code " << status_
+                 << " from captcha service";
+      fail(folly::sformat("received status code: {}", status_));
+      return;
+    }
+    if (body_.empty()) {
+      LOG(ERROR) << "Received empty body from captcha service";
+      fail("body missing");
+      return;
+    }
+    report(folly::Try<std::string>{
+        body_.move()->moveToFbString().toStdString()});
+  }
+
+  void onUpgrade(proxygen::UpgradeProtocol) noexcept override {}
+
+  void onError(const proxygen::HTTPException &err) noexcept override {
+    LOG(ERROR) << "captcha service error: " << err.describe();
+    fail(err.describe());
+  }
+
+  void onEgressPaused() noexcept override {}
+  void onEgressResumed() noexcept override {}
+
+private:
+  CaptchaClient *const client_;
+  const std::shared_ptr<Pending> pending_;
+  const bool hedge_;
+  bool reported_{false};
+  uint16_t status_{0};
+  folly::IOBufQueue body_{folly::IOBufQueue::cacheChainLength()};
+};
+
+// One attempt at opening a connection.
+class CaptchaClient::Connect : public proxygen::HTTPConnector::Callback {
+public:
+  explicit Connect(CaptchaClient *client)
+      : client_(client), connector_(this, client->timer_.get()) {}
+
+  void connectSuccess(proxygen::HTTPUpstreamSession *session) override {
+    client_->on_connected(this, session);
+  }
+
+  void connectError(const folly::AsyncSocketException &ex) override {
+    client_->on_connect_error(this, ex.what());
+  }
+
+  proxygen::HTTPConnector &connector() { return connector_; }
+
+private:
+  CaptchaClient *const client_;
+  proxygen::HTTPConnector connector_;
+};
+
+auto CaptchaClient::make_ssl_context(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config)
+    -> std::shared_ptr<folly::SSLContext> {
+  auto dst = std::make_shared<folly::SSLContext>();
+  dst->setOptions(SSL_OP_NO_COMPRESSION);
+  folly::ssl::setCipherSuites<folly::ssl::SSLCommonOptions>(*dst);
+  dst->loadTrustedCertificates(config.trusted_certificates_path.c_str());
+  dst->setVerificationOption(folly::SSLContext::SSLVerifyPeerEnum::VERIFY);
+  // to do client certs:
+  // dst->loadCertKeyPairFromFiles(cert_path, key_path);
+  dst->setAdvertisedNextProtocols(std::list<std::string>{"h2", "http/1.1"});
+  return dst;
+}
+
+CaptchaClient::CaptchaClient(
+    folly::EventBase *evb,
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *config,
+    std::shared_ptr<folly::SSLContext> ssl_context,
+    std::shared_ptr<DnsCache> dns, std::shared_ptr<CaptchaHealth> health)
+    : evb_(evb), config_(config), ssl_context_(std::move(ssl_context)),
+      dns_(std::move(dns)), health_(std::move(health)),
+      url_(config->captcha_service_url),
+      timer_(folly::HHWheelTimer::newTimer(
+          evb,
+          std::chrono::milliseconds(
+              folly::HHWheelTimer::DEFAULT_TICK_INTERVAL),
+          folly::AsyncTimeout::InternalEnum::NORMAL,
+          std::chrono::duration_cast<std::chrono::milliseconds>(keepalive))) {
+  CHECK(url_.isValid() && url_.hasHost())
+      << "Fix the configuration entry \"captcha_service_url\". Cannot parse \""
+      << config->captcha_service_url << "\"";
+  CHECK(!url_.isSecure() || ssl_context_ != nullptr)
+      << "captcha service is reached over HTTPS, but there is no TLS context";
+  request_headers_.setURL(url_.makeRelativeURL());
+  request_headers_.setMethod(proxygen::HTTPMethod::POST);
+  request_headers_.setHTTPVersion(1, 1);
+  auto &headers = request_headers_.getHeaders();
+  headers.add(proxygen::HTTPHeaderCode::HTTP_HEADER_HOST,
+              url_.getHostAndPort());
+  headers.add(proxygen::HTTPHeaderCode::HTTP_HEADER_ORIGIN, "localhost");
+  headers.add(proxygen::HTTPHeaderCode::HTTP_HEADER_ACCEPT, "application/json");
+  headers.add(proxygen::HTTPHeaderCode::HTTP_HEADER_USER_AGENT,
+              config->server_user_agent);
+  headers.add(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
+              "application/x-www-form-urlencoded");
+}
+
+CaptchaClient::~CaptchaClient() {
+  shutting_down_ = true;
+  // dropping a connection ends its streams, which would touch `sessions_`
+  auto sessions = std::move(sessions_);
+  sessions_.clear();
+  for (proxygen::HTTPUpstreamSession *session : sessions) {
+    session->setInfoCallback(nullptr);
+    session->dropConnection();
+  }
+  connecting_.clear();
+  fail_waiting("captcha client shut down");
+}
+
+auto CaptchaClient::verify(std::string_view user_response)
+    -> folly::Future<std::string> {
+  DCHECK(evb_->isInEventBaseThread());
+  const auto now = CircuitBreaker::Clock::now();
+  if (!health_->breaker().allow(now)) {
+    health_->record_short_circuit();
+    return folly::makeFuture<std::string>(
+        CaptchaServiceUnavailable{"captcha service circuit breaker is open"});
+  }
+  std::string body = folly::sformat(
+      "secret={}&response={}",
+      folly::uriEscape<std::string>(
+          folly::StringPiece{config_->captcha_service_api_key}),
+      folly::uriEscape<std::string>(
+          folly::StringPiece{user_response.data(), user_response.size()}));
+  auto pending = std::make_shared<Pending>();
+  pending->body = folly::IOBuf::fromString(std::move(body));
+  pending->started = now;
+  auto dst = pending->promise.getFuture();
+  // the timeouts belong to `pending`, which may outlive this client
+  const std::weak_ptr<bool> alive = alive_;
+  const std::weak_ptr<Pending> weak = pending;
+  pending->deadline =
+      folly::AsyncTimeout::make(*evb_, [this, alive, weak]() noexcept {
+        auto pending = weak.lock();
+        if (!alive.expired() && pending) {
+          settle(*pending, folly::Try<std::string>{
+                               folly::make_exception_wrapper<
+                                   CaptchaServiceUnavailable>(
+                                   "captcha service timed out")});
+        }
+      });
+  pending->deadline->scheduleTimeout(
+      std::chrono::milliseconds{config_->captcha_timeout_ms});
+  // raised, e.g., when the request is cancelled, from whichever thread
+  pending->promise.setInterruptHandler(
+      [this, evb = evb_, alive, weak](const folly::exception_wrapper &why) {
+        evb->runInEventBaseThread([this, alive, weak, why] {
+          auto pending = weak.lock();
+          if (!alive.expired() && pending) {
+            abandon(*pending, why);
+          }
+        });
+      });
+  if (config_->captcha_hedge_after_ms > 0) {
+    pending->hedge =
+        folly::AsyncTimeout::make(*evb_, [this, alive, weak]() noexcept {
+          auto pending = weak.lock();
+          if (!alive.expired() && pending) {
+            hedge(std::move(pending));
+          }
+        });
+    pending->hedge->scheduleTimeout(
+        std::chrono::milliseconds{config_->captcha_hedge_after_ms});
+  }
+  ++pending->attempts;
+  waiting_.push_back(Request{std::move(pending)});
+  dispatch();
+  return dst;
+}
+
+void CaptchaClient::dispatch() {
+  std::deque<Request> waiting = std::move(waiting_);
+  waiting_.clear();
+  bool need_connection = false;
+  for (Request &request : waiting) {
+    if (request.pending->promise.isFulfilled()) {
+      // settled while it waited, e.g., by its deadline
+      --request.pending->attempts;
+      continue;
+    }
+    auto it = std::find_if(
+        sessions_.begin(), sessions_.end(),
+        [avoid = request.avoid](proxygen::HTTPUpstreamSession *session) {
+          return session != avoid && session->supportsMoreTransactions();
+        });
+    if (it == sessions_.end()) {
+      need_connection = true;
+      waiting_.push_back(std::move(request));
+      continue;
+    }
+    send(**it, std::move(request));
+  }
+  if (!need_connection || !connecting_.empty()) {
+    return;
+  }
+  if (sessions_.size() < max_connections) {
+    connect();
+    return;
+  }
+  // hedges would only queue up behind the attempts they are meant to beat
+  waiting = std::move(waiting_);
+  waiting_.clear();
+  for (Request &request : waiting) {
+    if (request.avoid == nullptr) {
+      waiting_.push_back(std::move(request));
+      continue;
+    }
+    on_attempt_done(*request.pending, true,
+                    folly::Try<std::string>{
+                        folly::make_exception_wrapper<std::runtime_error>(
+                            "no other connection to hedge on")});
+  }
+}
+
+void CaptchaClient::send(proxygen::HTTPUpstreamSession &session,
+                         Request request) {
+  const bool hedge = request.avoid != nullptr;
+  auto *exchange = new Exchange{this, request.pending, hedge};
+  proxygen::HTTPTransaction *txn = session.newTransaction(exchange);
+  if (txn == nullptr) {
+    delete exchange;
+    on_attempt_done(*request.pending, hedge,
+                    folly::Try<std::string>{
+                        folly::make_exception_wrapper<std::runtime_error>(
+                            "captcha service connection refused a new "
+                            "stream")});
+    return;
+  }
+  if (!hedge) {
+    request.pending->session = &session;
+  }
+  txn->setIdleTimeout(std::chrono::milliseconds{config_->captcha_timeout_ms});
+  std::unique_ptr<folly::IOBuf> body = request.pending->body->clone();
+  proxygen::HTTPMessage headers = request_headers_;
+  headers.getHeaders().add(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_LENGTH,
+                           std::to_string(body->computeChainDataLength()));
+  txn->sendHeaders(headers);
+  txn->sendBody(std::move(body));
+  txn->sendEOM();
+}
+
+void CaptchaClient::hedge(std::shared_ptr<Pending> pending) {
+  if (pending->promise.isFulfilled() || pending->session == nullptr) {
+    // still waiting for a connection, as a hedge would
+    return;
+  }
+  health_->record_hedge();
+  ++pending->attempts;
+  const proxygen::HTTPUpstreamSession *avoid = pending->session;
+  waiting_.push_back(Request{std::move(pending), avoid});
+  dispatch();
+}
+
+void CaptchaClient::on_attempt_done(Pending &pending, bool hedge,
+                                    folly::Try<std::string> result) {
+  --pending.attempts;
+  if (pending.promise.isFulfilled()) {
+    return;
+  }
+  if (result.hasValue()) {
+    if (pending.attempts == 0 || approves(*result)) {
+      if (hedge) {
+        health_->record_hedge_won();
+      }
+      settle(pending, std::move(result));
+    } else {
+      pending.held = std::move(*result);
+    }
+    return;
+  }
+  if (pending.attempts > 0) {
+    // the other attempt may yet be answered
+    return;
+  }
+  if (pending.held.has_value()) {
+    settle(pending, folly::Try<std::string>{std::move(*pending.held)});
+    return;
+  }
+  settle(pending, std::move(result));
+}
+
+void CaptchaClient::settle(Pending &pending, folly::Try<std::string> result) {
+  if (pending.promise.isFulfilled()) {
+    return;
+  }
+  pending.deadline->cancelTimeout();
+  if (pending.hedge) {
+    pending.hedge->cancelTimeout();
+  }
+  if (!shutting_down_) {
+    const auto now = CircuitBreaker::Clock::now();
+    health_->record(result.hasValue(), now - pending.started, now);
+  }
+  pending.promise.setTry(std::move(result));
+}
+
+void CaptchaClient::abandon(Pending &pending, folly::exception_wrapper why) {
+  if (pending.promise.isFulfilled()) {
+    return;
+  }
+  pending.deadline->cancelTimeout();
+  if (pending.hedge) {
+    pending.hedge->cancelTimeout();
+  }
+  pending.promise.setException(std::move(why));
+}
+
+void CaptchaClient::connect() {
+  Connect *attempt =
+      connecting_.emplace_back(std::make_unique<Connect>(this)).get();
+  dns_->resolve(url_.getHost(), url_.getPort())
+      .via(evb_)
+      .thenTry([this, alive = std::weak_ptr<bool>{alive_},
+                attempt](folly::Try<folly::SocketAddress> &&addr) {
+        if (alive.expired()) {
+          return;
+        }
+        if (addr.hasException()) {
+          on_connect_error(attempt, addr.exception().what().toStdString());
+          return;
+        }
+        open(attempt, addr.value());
+      });
+}
+
+void CaptchaClient::open(Connect *connect, const folly::SocketAddress &addr) {
+  const folly::SocketOptionMap opts{{{SOL_SOCKET, SO_REUSEADDR}, 1}};
+  if (url_.isSecure()) {
+    connect->connector().connectSSL(evb_, addr, ssl_context_, tls_session_,
+                                    connect_timeout, opts,
+                                    folly::AsyncSocket::anyAddress(),
+                                    url_.getHost());
+  } else {
+    connect->connector().connect(evb_, addr, connect_timeout, opts);
+  }
+}
+
+void CaptchaClient::on_connected(Connect *connect,
+                                 proxygen::HTTPUpstreamSession *session) {
+  retire(connect);
+  if (auto *tls = session->getTransport()
+                      ->getUnderlyingTransport<folly::AsyncSSLSocket>()) {
+    DLOG_IF(INFO, tls->getSSLSessionReused())
+        << "resumed TLS session with captcha service";
+    // filled in once the server sends its ticket
+    tls_session_ = tls->getSSLSession();
+  }
+  session->setInfoCallback(this);
+  sessions_.push_back(session);
+  dispatch();
+}
+
+void CaptchaClient::on_connect_error(Connect *connect,
+                                     const std::string &what) {
+  retire(connect);
+  LOG(ERROR) << "Cannot connect to captcha service: " << what;
+  // a resumed session may be why
+  tls_session_.reset();
+  if (sessions_.empty()) {
+    fail_waiting(what);
+  }
+}
+
+void CaptchaClient::retire(Connect *connect) {
+  auto it = std::find_if(
+      connecting_.begin(), connecting_.end(),
+      [connect](const auto &pending) { return pending.get() == connect; });
+  if (it == connecting_.end()) {
+    return;
+  }
+  evb_->runInLoop([done = std::move(*it)] {});
+  connecting_.erase(it);
+}
+
+void CaptchaClient::fail_waiting(const std::string &what) {
+  std::deque<Request> waiting = std::move(waiting_);
+  waiting_.clear();
+  for (Request &request : waiting) {
+    on_attempt_done(
+        *request.pending, request.avoid != nullptr,
+        folly::Try<std::string>{
+            folly::make_exception_wrapper<CaptchaServiceUnavailable>(what)});
+  }
+}
+
+void CaptchaClient::onDestroy(const proxygen::HTTPSessionBase &session) {
+  std::erase(sessions_, &session);
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
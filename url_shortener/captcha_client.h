@@ -0,0 +1,150 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CAPTCHA_CLIENT_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CAPTCHA_CLIENT_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <folly/futures/Future.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/HHWheelTimer.h>
+#include <folly/io/async/SSLContext.h>
+#include <folly/ssl/SSLSession.h>
+#include <memory>
+#include <optional>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
+#include <proxygen/lib/utils/URL.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "app_config.h"
+#include "captcha_health.h"
+#include "dns_cache.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// The captcha service could not be asked, or did not answer in time.
+class CaptchaServiceUnavailable : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// Client for the captcha verification service (`captcha_service_url`), one
+// per IO thread. It keeps its connections to the service open between
+// requests and sends each verification as a new stream on one of them, so a
+// URL creation costs one request rather than a TCP and TLS handshake. Should
+// a connection have to be made again, it resumes the last TLS session.
+//
+// Connections are only opened while requests are waiting and none of the
+// open ones can take another stream, up to `max_connections`; over HTTP/1.1
+// that is one request per connection at a time.
+//
+// Every verification has `captcha_timeout_ms` to be answered. With
+// `captcha_hedge_after_ms`, one that has not been answered by then is sent
+// again on another connection, and the first answer wins. While
+// `CaptchaHealth`'s circuit breaker is open, verifications fail at once.
+class CaptchaClient : private proxygen::HTTPSessionBase::InfoCallback {
+public:
+  static constexpr std::size_t max_connections = 4;
+
+  // The TLS context for every IO thread's client, with the CA bundle at
+  // `trusted_certificates_path` loaded once.
+  static auto make_ssl_context(
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config)
+      -> std::shared_ptr<folly::SSLContext>;
+
+  // `ssl_context` may be null if the service is not reached over HTTPS.
+  CaptchaClient(
+      folly::EventBase *evb,
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *config,
+      std::shared_ptr<folly::SSLContext> ssl_context,
+      std::shared_ptr<DnsCache> dns, std::shared_ptr<CaptchaHealth> health);
+
+  // Drops the connections, failing requests in flight.
+  ~CaptchaClient() override;
+
+  CaptchaClient(const CaptchaClient &) = delete;
+  CaptchaClient &operator=(const CaptchaClient &) = delete;
+
+  // Asks the service to verify a user's captcha response. Resolves to the
+  // body of the service's answer if it is 200 OK, and fails otherwise, with
+  // `CaptchaServiceUnavailable` if it was not asked or did not answer in
+  // time. Must be called on `evb`, where the future is also completed.
+  auto verify(std::string_view user_response) -> folly::Future<std::string>;
+
+private:
+  // One verification, sent once, or twice if hedged
+  struct Pending {
+    std::unique_ptr<folly::IOBuf> body;
+    folly::Promise<std::string> promise;
+    CircuitBreaker::Clock::time_point started;
+    // of the first attempt, which a hedge avoids; only compared
+    const proxygen::HTTPUpstreamSession *session{nullptr};
+    // waiting or in flight
+    unsigned attempts{0};
+    // a rejection by one attempt while the other is still out
+    std::optional<std::string> held;
+    std::unique_ptr<folly::AsyncTimeout> deadline;
+    std::unique_ptr<folly::AsyncTimeout> hedge;
+  };
+
+  struct Request {
+    std::shared_ptr<Pending> pending;
+    // for a hedge, the connection of the first attempt
+    const proxygen::HTTPUpstreamSession *avoid{nullptr};
+  };
+
+  class Exchange;
+  class Connect;
+
+  // Sends waiting requests on connections that can take them, and opens
+  // another if none can.
+  void dispatch();
+  void send(proxygen::HTTPUpstreamSession &session, Request request);
+  void hedge(std::shared_ptr<Pending> pending);
+  void on_attempt_done(Pending &pending, bool hedge,
+                       folly::Try<std::string> result);
+  void settle(Pending &pending, folly::Try<std::string> result);
+  // Gives up on a verification its caller no longer wants, without holding
+  // it against the service. Attempts waiting for a connection are dropped.
+  void abandon(Pending &pending, folly::exception_wrapper why);
+  void connect();
+  void open(Connect *connect, const folly::SocketAddress &addr);
+  void on_connected(Connect *connect, proxygen::HTTPUpstreamSession *session);
+  void on_connect_error(Connect *connect, const std::string &what);
+  // frees a connection attempt once its callback has returned
+  void retire(Connect *connect);
+  void fail_waiting(const std::string &what);
+
+  // HTTPSessionBase::InfoCallback, for the connections of this client
+  void onDestroy(const proxygen::HTTPSessionBase &session) override;
+
+  folly::EventBase *const evb_;
+  const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *const config_;
+  const std::shared_ptr<folly::SSLContext> ssl_context_;
+  const std::shared_ptr<DnsCache> dns_;
+  const std::shared_ptr<CaptchaHealth> health_;
+  const proxygen::URL url_;
+  // same for every request, save for the body
+  proxygen::HTTPMessage request_headers_;
+  // its default timeout is how long an idle connection is kept
+  folly::HHWheelTimer::UniquePtr timer_;
+  std::vector<proxygen::HTTPUpstreamSession *> sessions_;
+  std::vector<std::unique_ptr<Connect>> connecting_;
+  std::deque<Request> waiting_;
+  std::shared_ptr<folly::ssl::SSLSession> tls_session_;
+  bool shutting_down_{false};
+  // lets lookups that finish after this client is gone know it
+  std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CAPTCHA_CLIENT_H
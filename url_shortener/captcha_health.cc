@@ -0,0 +1,165 @@
+#include "captcha_health.h"
+
+#include <glog/logging.h>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+// histogram buckets, in milliseconds
+constexpr int64_t bucket_ms = 5;
+
+auto to_ms(CircuitBreaker::Clock::duration latency) -> int64_t {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(latency)
+      .count();
+}
+
+} // namespace
+
+CircuitBreaker::CircuitBreaker(std::string name, uint32_t failures_to_open,
+                               Clock::duration open_for)
+    : name_(std::move(name)), failures_to_open_(failures_to_open),
+      open_for_(open_for) {}
+
+auto CircuitBreaker::allow(Clock::time_point now) -> bool {
+  if (failures_to_open_ == 0 ||
+      failures_.load(std::memory_order_relaxed) < failures_to_open_) {
+    return true;
+  }
+  Clock::rep probe_at = probe_at_.load(std::memory_order_relaxed);
+  if (now.time_since_epoch().count() < probe_at) {
+    return false;
+  }
+  // only one caller gets to probe
+  return probe_at_.compare_exchange_strong(
+      probe_at, (now + open_for_).time_since_epoch().count(),
+      std::memory_order_relaxed);
+}
+
+void CircuitBreaker::record_success() {
+  const uint32_t failures = failures_.exchange(0, std::memory_order_relaxed);
+  LOG_IF(INFO, failures_to_open_ != 0 && failures >= failures_to_open_)
+      << "Circuit breaker for " << name_ << " closed";
+}
+
+void CircuitBreaker::record_failure(Clock::time_point now) {
+  const uint32_t failures =
+      failures_.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (failures_to_open_ != 0 && failures == failures_to_open_) {
+    probe_at_.store((now + open_for_).time_since_epoch().count(),
+                    std::memory_order_relaxed);
+    LOG(WARNING) << "Circuit breaker for " << name_ << " opened after "
+                 << failures << " failures in a row";
+  }
+}
+
+auto CircuitBreaker::state(Clock::time_point now) const -> State {
+  if (failures_to_open_ == 0 ||
+      failures_.load(std::memory_order_relaxed) < failures_to_open_) {
+    return State::closed;
+  }
+  return now.time_since_epoch().count() <
+                 probe_at_.load(std::memory_order_relaxed)
+             ? State::open
+             : State::half_open;
+}
+
+auto to_string(CircuitBreaker::State state) -> const char * {
+  switch (state) {
+  case CircuitBreaker::State::closed:
+    return "closed";
+  case CircuitBreaker::State::open:
+    return "open";
+  case CircuitBreaker::State::half_open:
+    return "half open";
+  }
+  return "unknown";
+}
+
+CaptchaHealth::CaptchaHealth(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config)
+    : breaker_("captcha service", config.captcha_breaker_failures,
+               std::chrono::milliseconds{config.captcha_breaker_open_ms}),
+      window_(Window{
+          .answered = folly::Histogram<int64_t>(
+              bucket_ms, 0, int64_t{config.captcha_timeout_ms} + bucket_ms),
+          .failed = folly::Histogram<int64_t>(
+              bucket_ms, 0, int64_t{config.captcha_timeout_ms} + bucket_ms),
+      }) {
+  reporter_.addFunction([this] { report(); }, std::chrono::minutes{1},
+                        "captcha health");
+  reporter_.start();
+}
+
+CaptchaHealth::~CaptchaHealth() { reporter_.shutdown(); }
+
+void CaptchaHealth::record(bool answered,
+                           CircuitBreaker::Clock::duration latency,
+                           CircuitBreaker::Clock::time_point now) {
+  if (answered) {
+    breaker_.record_success();
+  } else {
+    breaker_.record_failure(now);
+  }
+  auto window = window_.lock();
+  (answered ? window->answered : window->failed).addValue(to_ms(latency));
+}
+
+void CaptchaHealth::record_short_circuit() {
+  ++window_.lock()->short_circuited;
+}
+
+void CaptchaHealth::record_hedge() { ++window_.lock()->hedged; }
+
+void CaptchaHealth::record_hedge_won() { ++window_.lock()->hedges_won; }
+
+auto CaptchaHealth::stats() const -> CaptchaStats {
+  auto window = window_.lock();
+  const auto count = [](const folly::Histogram<int64_t> &histogram) {
+    uint64_t dst = 0;
+    for (std::size_t i = 0; i < histogram.getNumBuckets(); ++i) {
+      dst += histogram.getBucketByIndex(i).count;
+    }
+    return dst;
+  };
+  return CaptchaStats{
+      .breaker = breaker_.state(CircuitBreaker::Clock::now()),
+      .answered = count(window->answered),
+      .failed = count(window->failed),
+      .short_circuited = window->short_circuited,
+      .hedged = window->hedged,
+      .hedges_won = window->hedges_won,
+      .p50_ms = window->answered.getPercentileEstimate(0.5),
+      .p90_ms = window->answered.getPercentileEstimate(0.9),
+      .p99_ms = window->answered.getPercentileEstimate(0.99),
+      .failed_p50_ms = window->failed.getPercentileEstimate(0.5),
+  };
+}
+
+void CaptchaHealth::report() {
+  const CaptchaStats stats = this->stats();
+  {
+    auto window = window_.lock();
+    window->answered.clear();
+    window->failed.clear();
+    window->short_circuited = 0;
+    window->hedged = 0;
+    window->hedges_won = 0;
+  }
+  if (stats.answered == 0 && stats.failed == 0 && stats.short_circuited == 0) {
+    return;
+  }
+  LOG(INFO) << "Captcha service last minute: breaker "
+            << to_string(stats.breaker) << ", " << stats.answered
+            << " answered (p50 " << stats.p50_ms << " ms, p90 " << stats.p90_ms
+            << " ms, p99 " << stats.p99_ms << " ms), " << stats.failed
+            << " failed (p50 " << stats.failed_p50_ms << " ms), "
+            << stats.short_circuited << " refused by the breaker, "
+            << stats.hedged << " hedged (" << stats.hedges_won
+            << " answered first)";
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
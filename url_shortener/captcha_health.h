@@ -0,0 +1,128 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CAPTCHA_HEALTH_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CAPTCHA_HEALTH_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <folly/Synchronized.h>
+#include <folly/experimental/FunctionScheduler.h>
+#include <folly/stats/Histogram.h>
+#include <mutex>
+#include <string>
+
+#include "app_config.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Stops calls to a service that keeps failing, so that callers fail at once
+// rather than each waiting out a timeout. It opens after `failures_to_open`
+// failures in a row. Once `open_for` has passed, it lets one call through to
+// probe the service, and closes as soon as a call succeeds; a probe that
+// fails, or never reports back, holds it open for another `open_for`.
+//
+// Lock-free, so that every IO thread can share one per service.
+class CircuitBreaker {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class State {
+    closed,
+    open,
+    // the next call is let through as a probe
+    half_open,
+  };
+
+  // `name` is for logs; `failures_to_open` of 0 never opens.
+  CircuitBreaker(std::string name, uint32_t failures_to_open,
+                 Clock::duration open_for);
+
+  // Whether a call may go ahead. Calls that do must report how they went.
+  auto allow(Clock::time_point now) -> bool;
+
+  void record_success();
+
+  void record_failure(Clock::time_point now);
+
+  auto state(Clock::time_point now) const -> State;
+
+private:
+  const std::string name_;
+  const uint32_t failures_to_open_;
+  const Clock::duration open_for_;
+  // in a row
+  std::atomic<uint32_t> failures_{0};
+  // in `Clock` ticks, when an open breaker next lets a probe through
+  std::atomic<Clock::rep> probe_at_{0};
+};
+
+auto to_string(CircuitBreaker::State state) -> const char *;
+
+// Verifications by the captcha service since the last report.
+struct CaptchaStats {
+  CircuitBreaker::State breaker;
+  uint64_t answered;
+  uint64_t failed;
+  // refused by the open breaker without asking the service
+  uint64_t short_circuited;
+  // verifications sent a second time, and how many of those answered first
+  uint64_t hedged;
+  uint64_t hedges_won;
+  // of answered verifications, in milliseconds
+  int64_t p50_ms;
+  int64_t p90_ms;
+  int64_t p99_ms;
+  int64_t failed_p50_ms;
+};
+
+// How the captcha service is doing, as seen by the clients of every IO
+// thread: the circuit breaker that cuts it off while it fails, and
+// histograms of how long verifications take, logged every minute.
+class CaptchaHealth {
+public:
+  explicit CaptchaHealth(
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config);
+
+  ~CaptchaHealth();
+
+  CaptchaHealth(const CaptchaHealth &) = delete;
+  CaptchaHealth &operator=(const CaptchaHealth &) = delete;
+
+  auto breaker() -> CircuitBreaker & { return breaker_; }
+
+  // A verification that got an answer from the service, or failed, after
+  // `latency`. Also reports to the breaker.
+  void record(bool answered, CircuitBreaker::Clock::duration latency,
+              CircuitBreaker::Clock::time_point now);
+
+  void record_short_circuit();
+
+  // A verification sent a second time, and then the second time answering
+  // first
+  void record_hedge();
+  void record_hedge_won();
+
+  // Since the last report
+  auto stats() const -> CaptchaStats;
+
+private:
+  struct Window {
+    folly::Histogram<int64_t> answered;
+    folly::Histogram<int64_t> failed;
+    uint64_t short_circuited{0};
+    uint64_t hedged{0};
+    uint64_t hedges_won{0};
+  };
+
+  void report();
+
+  CircuitBreaker breaker_;
+  folly::Synchronized<Window, std::mutex> window_;
+  folly::FunctionScheduler reporter_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CAPTCHA_HEALTH_H
@@ -0,0 +1,56 @@
+#include "captcha_verifier.h"
+
+#include <folly/json.h>
+#include <glog/logging.h>
+#include <stdexcept>
+#include <string>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+RecaptchaVerifier::RecaptchaVerifier(
+    folly::EventBase *evb,
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *config,
+    std::shared_ptr<folly::SSLContext> ssl_context,
+    std::shared_ptr<DnsCache> dns, std::shared_ptr<CaptchaHealth> health)
+    : client_(evb, config, std::move(ssl_context), std::move(dns),
+              std::move(health)),
+      fail_open_(config->captcha_fail_open) {}
+
+auto RecaptchaVerifier::verify(std::string_view response,
+                               std::string_view /* long_url */,
+                               const folly::IPAddress & /* client */)
+    -> folly::Future<bool> {
+  return client_.verify(response).thenTry(
+      [fail_open = fail_open_](folly::Try<std::string> &&result) {
+        std::string what;
+        if (result.hasValue()) {
+          try {
+            auto json = folly::parseJson(*result);
+            if (json.isObject() && !json["success"].isNull()) {
+              DLOG(INFO) << "parsed result from captcha service";
+              return json["success"].asBool();
+            }
+          } catch (const std::exception &) {
+          }
+          DLOG(ERROR) << "failed to parse JSON result from captcha service, "
+                         "but got this string from the captcha service: "
+                      << *result;
+          what = "json parse fail";
+        } else {
+          what = result.exception().what().toStdString();
+        }
+        if (fail_open) {
+          LOG_EVERY_N(WARNING, 100)
+              << "Creating URLs without the captcha service, which failed: "
+              << what;
+          return true;
+        }
+        throw CaptchaServiceUnavailable{what};
+      });
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
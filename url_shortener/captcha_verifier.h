@@ -0,0 +1,58 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CAPTCHA_VERIFIER_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CAPTCHA_VERIFIER_H
+
+#include <folly/IPAddress.h>
+#include <folly/futures/Future.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/SSLContext.h>
+#include <memory>
+#include <string_view>
+
+#include "app_config.h"
+#include "captcha_client.h"
+#include "captcha_health.h"
+#include "dns_cache.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Decides whether a request to shorten a URL may go ahead, by the
+// `user_captcha_response` that came with it (see `captcha_verifier` in the
+// app configuration).
+class CaptchaVerifier {
+public:
+  virtual ~CaptchaVerifier() = default;
+
+  // Whether `response` lets `client` shorten `long_url`. Called on an IO
+  // thread, where the future is also completed.
+  virtual auto verify(std::string_view response, std::string_view long_url,
+                      const folly::IPAddress &client)
+      -> folly::Future<bool> = 0;
+};
+
+// Asks reCAPTCHA, or whatever is at `captcha_service_url`. One per IO thread.
+//
+// If the service cannot be asked or gives no usable answer, the response is
+// accepted with `captcha_fail_open`, and otherwise verification fails with
+// `CaptchaServiceUnavailable`.
+class RecaptchaVerifier : public CaptchaVerifier {
+public:
+  RecaptchaVerifier(
+      folly::EventBase *evb,
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *config,
+      std::shared_ptr<folly::SSLContext> ssl_context,
+      std::shared_ptr<DnsCache> dns, std::shared_ptr<CaptchaHealth> health);
+
+  auto verify(std::string_view response, std::string_view long_url,
+              const folly::IPAddress &client) -> folly::Future<bool> override;
+
+private:
+  CaptchaClient client_;
+  const bool fail_open_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CAPTCHA_VERIFIER_H
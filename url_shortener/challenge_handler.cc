@@ -0,0 +1,42 @@
+#include "challenge_handler.h"
+
+#include <folly/dynamic.h>
+#include <folly/json.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+
+#include "ddos_protection.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+ChallengeHandler::ChallengeHandler(
+    ProofOfWorkVerifier *verifier,
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig
+        *ro_app_config)
+    : verifier_(verifier), ro_app_config_(ro_app_config) {}
+
+void ChallengeHandler::onRequest(
+    std::unique_ptr<proxygen::HTTPMessage> request) noexcept {
+  // challenges are bound to the IP that solutions must come from
+  const folly::IPAddress client =
+      resolve_client_ip(*ro_app_config_, *request)
+          .value_or(request->getClientAddress().getIPAddress());
+  ProofOfWorkChallenge challenge = verifier_->issue(client);
+  std::string body = folly::toJson(folly::dynamic::object(
+      "challenge", std::move(challenge.challenge))(
+      "difficulty", challenge.difficulty)("expires", challenge.expires));
+  proxygen::ResponseBuilder(downstream_)
+      .status(200, "OK")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
+              "application/json")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CACHE_CONTROL, "no-store")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
+              "*")
+      .body(std::move(body))
+      .sendWithEOM();
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
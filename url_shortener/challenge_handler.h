@@ -0,0 +1,48 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CHALLENGE_HANDLER_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CHALLENGE_HANDLER_H
+
+#include <memory>
+#include <proxygen/httpserver/RequestHandler.h>
+
+#include "app_config.h"
+#include "proof_of_work.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Serves `GET /api/v1/challenge`: a proof-of-work challenge for the client to
+// solve before creating a short URL, as JSON, e.g.,
+//
+//   {"challenge": "v1.16.1700000000.<nonce>.<mac>", "difficulty": 16,
+//    "expires": 1700000000}
+class ChallengeHandler : public proxygen::RequestHandler {
+public:
+  ChallengeHandler(
+      ProofOfWorkVerifier *verifier,
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig
+          *ro_app_config);
+
+  void
+  onRequest(std::unique_ptr<proxygen::HTTPMessage> request) noexcept override;
+
+  void onBody(std::unique_ptr<folly::IOBuf>) noexcept override {}
+
+  void onEOM() noexcept override {}
+
+  void onUpgrade(proxygen::UpgradeProtocol) noexcept override {}
+
+  void requestComplete() noexcept override { delete this; }
+
+  void onError(proxygen::ProxygenError) noexcept override { delete this; }
+
+private:
+  ProofOfWorkVerifier *const verifier_;
+  const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig
+      *const ro_app_config_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CHALLENGE_HANDLER_H
@@ -0,0 +1,99 @@
+#include "cidr_set.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace app_config {
+namespace {
+
+auto bit_at(const uint8_t *address, std::size_t i) -> unsigned {
+  return (address[i / 8] >> (7 - i % 8)) & 1;
+}
+
+} // namespace
+
+void CidrSet::Trie::insert(const uint8_t *address,
+                           std::size_t prefix_length) {
+  if (prefix_length < 8) {
+    // covers a run of first bytes
+    const std::size_t span = std::size_t{1} << (8 - prefix_length);
+    const std::size_t begin = address[0] & ~(span - 1);
+    for (std::size_t i = begin; i < begin + span; ++i) {
+      first_[i] = covered;
+    }
+    return;
+  }
+  uint32_t &slot = first_[address[0]];
+  if (slot == covered) {
+    return;
+  }
+  if (slot == 0) {
+    slot = nodes_.size();
+    nodes_.emplace_back();
+  }
+  uint32_t node = slot;
+  for (std::size_t i = 8; i < prefix_length; ++i) {
+    if (nodes_[node].terminal) {
+      return;
+    }
+    const unsigned bit = bit_at(address, i);
+    if (nodes_[node].child[bit] == 0) {
+      const auto child = static_cast<uint32_t>(nodes_.size());
+      // may reallocate; index again afterwards
+      nodes_.emplace_back();
+      nodes_[node].child[bit] = child;
+    }
+    node = nodes_[node].child[bit];
+  }
+  nodes_[node].terminal = true;
+}
+
+auto CidrSet::Trie::contains(const uint8_t *address,
+                             std::size_t address_bits) const -> bool {
+  uint32_t node = first_[address[0]];
+  if (node == covered) {
+    return true;
+  }
+  for (std::size_t i = 8; node != 0; ++i) {
+    if (nodes_[node].terminal) {
+      return true;
+    }
+    if (i == address_bits) {
+      return false;
+    }
+    node = nodes_[node].child[bit_at(address, i)];
+  }
+  return false;
+}
+
+CidrSet::CidrSet(const std::vector<folly::CIDRNetwork> &networks) {
+  for (const auto &network : networks) {
+    insert(network);
+  }
+}
+
+void CidrSet::insert(const folly::CIDRNetwork &network) {
+  const auto &[ip, prefix_length] = network;
+  if (ip.isV4()) {
+    v4_.insert(ip.asV4().toByteArray().data(), prefix_length);
+  } else if (ip.asV6().isIPv4Mapped() && prefix_length >= 96) {
+    v4_.insert(ip.asV6().createIPv4().toByteArray().data(),
+               prefix_length - 96);
+  } else {
+    v6_.insert(ip.asV6().toByteArray().data(), prefix_length);
+  }
+  empty_ = false;
+}
+
+auto CidrSet::contains(const folly::IPAddress &ip) const -> bool {
+  if (ip.isV4()) {
+    return v4_.contains(ip.asV4().toByteArray().data(), 32);
+  }
+  if (ip.asV6().isIPv4Mapped()) {
+    return v4_.contains(ip.asV6().createIPv4().toByteArray().data(), 32);
+  }
+  return v6_.contains(ip.asV6().toByteArray().data(), 128);
+}
+
+} // namespace app_config
+} // namespace url_shortener
+} // namespace ec_prv
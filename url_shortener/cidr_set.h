@@ -0,0 +1,67 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_CIDR_SET_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_CIDR_SET_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <folly/IPAddress.h>
+#include <vector>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace app_config {
+
+// A set of IP networks, compiled when the configuration is loaded so that
+// checking whether an address is in any of them costs a few memory reads
+// rather than a comparison per network.
+//
+// IPv4 and IPv6 networks are kept in separate binary tries, each indexed by
+// the first byte of the address in a table of 256 entries, then by one bit at
+// a time. Lookups stop at the first network that contains the address, so a
+// lookup reads at most as many nodes as the longest prefix has bits past the
+// first eight. IPv4-mapped IPv6 addresses are looked up as IPv4.
+class CidrSet {
+public:
+  CidrSet() = default;
+  explicit CidrSet(const std::vector<folly::CIDRNetwork> &networks);
+
+  void insert(const folly::CIDRNetwork &network);
+
+  auto contains(const folly::IPAddress &ip) const -> bool;
+
+  auto empty() const -> bool { return empty_; }
+
+private:
+  // A binary trie over addresses of a fixed number of bytes.
+  class Trie {
+  public:
+    void insert(const uint8_t *address, std::size_t prefix_length);
+    auto contains(const uint8_t *address, std::size_t address_bits) const
+        -> bool;
+
+  private:
+    // a network ends here; anything below it is redundant
+    static constexpr uint32_t covered = UINT32_MAX;
+
+    struct Node {
+      // indices into `nodes_`; 0 for none, since the root is never a child
+      uint32_t child[2]{0, 0};
+      bool terminal{false};
+    };
+
+    // by first byte: 0 for no network, `covered`, or the index of the node
+    // for the remaining bits
+    std::array<uint32_t, 256> first_{};
+    // index 0 is unused
+    std::vector<Node> nodes_{Node{}};
+  };
+
+  Trie v4_;
+  Trie v6_;
+  bool empty_{true};
+};
+
+} // namespace app_config
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_CIDR_SET_H
@@ -0,0 +1,135 @@
+#include "coalesced_creates.h"
+
+#include <folly/OperationCancelled.h>
+#include <folly/executors/GlobalExecutor.h>
+#include <folly/hash/Hash.h>
+#include <glog/logging.h>
+#include <utility>
+#include <variant>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+CoalescedCreates::CoalescedCreates(
+    db::ShortenedUrlsDatabase *db,
+    const ::ec_prv::url_shortener::url_shortening::UrlShorteningConfig
+        *url_shortening_svc)
+    : db_(db), url_shortening_svc_(url_shortening_svc) {}
+
+auto CoalescedCreates::shorten(const std::string &long_url,
+                               folly::CancellationToken cancelled)
+    -> folly::SemiFuture<std::string> {
+  const uint64_t digest = folly::hasher<std::string>{}(long_url);
+  std::shared_ptr<InFlightCreate> waited_on;
+  bool joined = false;
+  {
+    auto in_flight = in_flight_.lock();
+    auto [it, inserted] = in_flight->try_emplace(digest);
+    if (!inserted) {
+      if (it->second->long_url != long_url) {
+        // another URL with the same digest; not worth coalescing
+        return folly::via(folly::getGlobalCPUExecutor(),
+                          [this, long_url] { return create(long_url); })
+            .semi();
+      }
+      DLOG(INFO) << "Joining create in flight of " << long_url;
+      ++it->second->waiting;
+      joined = true;
+    } else {
+      it->second = std::make_shared<InFlightCreate>();
+      it->second->long_url = long_url;
+    }
+    waited_on = it->second;
+  }
+  // Registered outside the lock: it runs right away if the request is
+  // already cancelled. It lives as long as the request waits on the create.
+  auto stopped_waiting = std::make_unique<folly::CancellationCallback>(
+      std::move(cancelled), [this, waited_on] {
+        auto in_flight = in_flight_.lock();
+        --waited_on->waiting;
+      });
+  auto slug = waited_on->slug.getSemiFuture().deferValue(
+      [stopped_waiting = std::move(stopped_waiting)](std::string created) {
+        return created;
+      });
+  if (joined) {
+    return slug;
+  }
+  folly::getGlobalCPUExecutor()->add([this, digest, started = waited_on] {
+    {
+      auto in_flight = in_flight_.lock();
+      if (started->waiting == 0) {
+        // nobody is waiting for it any more
+        in_flight->erase(digest);
+        in_flight.unlock();
+        started->slug.setException(folly::OperationCancelled{});
+        return;
+      }
+    }
+    auto result = folly::makeTryWith(
+        [this, &started] { return create(started->long_url); });
+    // Retire the create before answering, so that requests from now on
+    // find the entry in the database rather than join a finished create.
+    in_flight_.lock()->erase(digest);
+    started->slug.setTry(std::move(result));
+  });
+  return slug;
+}
+
+auto CoalescedCreates::create(const std::string &long_url) const
+    -> std::string {
+  std::string generated_short_url;
+  // keep generating slugs until it doesn't collide with previous entries
+  uint8_t nth_try = 1;
+  constexpr uint8_t max_tries = 100; // don't hang forever
+  while (nth_try++ < max_tries) {
+    bool ok = url_shortening_svc_->generate_slug(generated_short_url,
+                                                  long_url, nth_try);
+    LOG_IF(ERROR, !ok) << "what should be a very rare error: ran out of hashes "
+                          "in creating slug for long_url=\""
+                       << long_url << "\"";
+    if (!ok) {
+      // TODO(zds): just default to creating a random string
+      return {};
+    }
+    auto got = db_->get(generated_short_url);
+    if (std::holds_alternative<db::UrlShorteningDbError>(got)) {
+      auto err = std::get_if<db::UrlShorteningDbError>(&got);
+      if (*err != db::UrlShorteningDbError::NotFound) {
+        LOG(ERROR) << "database failure";
+        return {};
+      }
+      // not found in database; this generated slug works
+    } else if (auto got_str = std::get_if<std::string>(&got);
+               *got_str == long_url) {
+      // already in database
+      // no need to re-insert it
+      return generated_short_url;
+    } else if (*got_str != "") {
+      LOG(WARNING) << "slug generated for \"" << long_url << "\": \""
+                   << generated_short_url
+                   << "\" collides with the slug for an existing entry: \""
+                   << *got_str
+                   << "\". Consider increasing size of the alphabet used (in "
+                      "the app configuration).";
+      continue;
+    }
+    // unless a batch or another create took it since it was looked up
+    auto err = db_->put_new(generated_short_url, long_url);
+    if (!err) {
+      return generated_short_url;
+    }
+    if (*err != db::UrlShorteningDbError::SlugExists) {
+      LOG(ERROR) << "rocksdb errored during insert of: long_url=\""
+                 << long_url << "\", generated_short_url=\""
+                 << generated_short_url << "\"";
+      return {};
+    }
+  }
+  return {};
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
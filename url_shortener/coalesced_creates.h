@@ -0,0 +1,72 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_COALESCED_CREATES_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_COALESCED_CREATES_H
+
+#include <cstdint>
+#include <folly/CancellationToken.h>
+#include <folly/Synchronized.h>
+#include <folly/container/F14Map.h>
+#include <folly/futures/Future.h>
+#include <folly/futures/SharedPromise.h>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "db.h"
+#include "url_shortening.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Single-flight creates of short URLs: concurrent requests to shorten the
+// same long URL, once verified, share one run of slug generation and storage
+// instead of each looking up the same slugs and racing to write the same
+// entry. The first request starts the create on the CPU pool; later ones
+// wait on its result. A create is retired as soon as it is written, so
+// requests after that find the entry in the database, as before. A create
+// whose requests have all been cancelled by the time it starts is not run at
+// all.
+//
+// Creates in flight are keyed by a digest of the long URL. Should two URLs
+// in flight at once share a digest, the second is simply not coalesced.
+class CoalescedCreates {
+public:
+  CoalescedCreates(
+      ::ec_prv::url_shortener::db::ShortenedUrlsDatabase *db,
+      const ::ec_prv::url_shortener::url_shortening::UrlShorteningConfig
+          *url_shortening_svc);
+
+  CoalescedCreates(const CoalescedCreates &) = delete;
+  CoalescedCreates &operator=(const CoalescedCreates &) = delete;
+
+  // The slug for `long_url`, stored if it is new, or empty if none could be
+  // had. Thread-safe.
+  auto shorten(const std::string &long_url,
+               folly::CancellationToken cancelled = {})
+      -> folly::SemiFuture<std::string>;
+
+private:
+  struct InFlightCreate {
+    std::string long_url;
+    folly::SharedPromise<std::string> slug;
+    // requests still waiting on it, counting the one that started it, less
+    // those cancelled since; guarded by `in_flight_`
+    uint32_t waiting{1};
+  };
+
+  // Runs on a CPU thread.
+  auto create(const std::string &long_url) const -> std::string;
+
+  ::ec_prv::url_shortener::db::ShortenedUrlsDatabase *const db_;
+  const ::ec_prv::url_shortener::url_shortening::UrlShorteningConfig
+      *const url_shortening_svc_;
+  folly::Synchronized<
+      folly::F14FastMap<uint64_t, std::shared_ptr<InFlightCreate>>,
+      std::mutex>
+      in_flight_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_COALESCED_CREATES_H
@@ -0,0 +1,194 @@
+#include "coalesced_file_reader.h"
+
+#include <folly/FileUtil.h>
+#include <folly/executors/GlobalExecutor.h>
+#include <folly/io/IOBufQueue.h>
+#include <glog/logging.h>
+#include <utility>
+#include <vector>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+constexpr std::size_t read_chunk_size = 64 * 1024;
+
+void post_chunk(std::shared_ptr<FileReadSubscription> subscription,
+                std::unique_ptr<folly::IOBuf> chunk) {
+  folly::EventBase *evb = subscription->evb();
+  evb->runInEventBaseThread(
+      [subscription = std::move(subscription),
+       chunk = std::move(chunk)]() mutable {
+        if (auto callback = subscription->callback()) {
+          callback->on_file_chunk(std::move(chunk));
+        }
+      });
+}
+
+void post_end(std::shared_ptr<FileReadSubscription> subscription) {
+  folly::EventBase *evb = subscription->evb();
+  evb->runInEventBaseThread([subscription = std::move(subscription)] {
+    if (auto callback = subscription->callback()) {
+      callback->on_file_end();
+    }
+  });
+}
+
+void post_error(std::shared_ptr<FileReadSubscription> subscription) {
+  folly::EventBase *evb = subscription->evb();
+  evb->runInEventBaseThread([subscription = std::move(subscription)] {
+    if (auto callback = subscription->callback()) {
+      callback->on_file_error();
+    }
+  });
+}
+
+} // namespace
+
+// One file being read on behalf of all of its subscribers.
+class CoalescedFileReader::InFlightRead {
+public:
+  InFlightRead(std::filesystem::path file_path,
+               std::unique_ptr<folly::File> file)
+      : file_path(std::move(file_path)), file(std::move(file)) {}
+
+  const std::filesystem::path file_path;
+  // only used by the thread reading the file
+  const std::unique_ptr<folly::File> file;
+
+  // Adds a subscriber and replays everything read so far.
+  auto subscribe(folly::EventBase *evb, FileReadCallback *callback)
+      -> std::shared_ptr<FileReadSubscription> {
+    auto subscription = std::make_shared<FileReadSubscription>(evb, callback);
+    std::lock_guard<std::mutex> guard{mutex_};
+    if (!received_.empty()) {
+      post_chunk(subscription, received_.front()->clone());
+    }
+    switch (state_) {
+    case State::Reading:
+      subscribers_.push_back(subscription);
+      break;
+    case State::Done:
+      post_end(subscription);
+      break;
+    case State::Failed:
+      post_error(subscription);
+      break;
+    }
+    return subscription;
+  }
+
+  void publish(std::unique_ptr<folly::IOBuf> chunk) {
+    std::lock_guard<std::mutex> guard{mutex_};
+    for (const auto &subscription : subscribers_) {
+      post_chunk(subscription, chunk->clone());
+    }
+    received_.append(std::move(chunk));
+  }
+
+  // Zero-copy snapshot of the complete file.
+  auto body() -> std::unique_ptr<folly::IOBuf> {
+    std::lock_guard<std::mutex> guard{mutex_};
+    return received_.empty() ? folly::IOBuf::create(0)
+                             : received_.front()->clone();
+  }
+
+  void end() {
+    std::lock_guard<std::mutex> guard{mutex_};
+    state_ = State::Done;
+    for (auto &subscription : subscribers_) {
+      post_end(std::move(subscription));
+    }
+    subscribers_.clear();
+  }
+
+  void fail() {
+    std::lock_guard<std::mutex> guard{mutex_};
+    state_ = State::Failed;
+    for (auto &subscription : subscribers_) {
+      post_error(std::move(subscription));
+    }
+    subscribers_.clear();
+    received_.reset();
+  }
+
+private:
+  enum class State { Reading, Done, Failed };
+
+  std::mutex mutex_;
+  State state_{State::Reading};
+  folly::IOBufQueue received_{folly::IOBufQueue::cacheChainLength()};
+  std::vector<std::shared_ptr<FileReadSubscription>> subscribers_;
+};
+
+CoalescedFileReader::CoalescedFileReader(std::shared_ptr<StaticFileCache> cache)
+    : cache_(std::move(cache)) {}
+
+auto CoalescedFileReader::join(const std::filesystem::path &file_path,
+                               folly::EventBase *evb,
+                               FileReadCallback *callback)
+    -> std::shared_ptr<FileReadSubscription> {
+  auto in_flight = in_flight_.lock();
+  auto it = in_flight->find(file_path.string());
+  if (it == in_flight->end()) {
+    return nullptr;
+  }
+  DLOG(INFO) << "Joining read in flight of " << file_path;
+  return it->second->subscribe(evb, callback);
+}
+
+auto CoalescedFileReader::read(const std::filesystem::path &file_path,
+                               std::unique_ptr<folly::File> file,
+                               folly::EventBase *evb,
+                               FileReadCallback *callback)
+    -> std::shared_ptr<FileReadSubscription> {
+  std::shared_ptr<InFlightRead> started;
+  std::shared_ptr<FileReadSubscription> subscription;
+  {
+    auto in_flight = in_flight_.lock();
+    auto [it, inserted] = in_flight->try_emplace(file_path.string());
+    if (!inserted) {
+      // lost the race to another request for the same file
+      return it->second->subscribe(evb, callback);
+    }
+    it->second = std::make_shared<InFlightRead>(file_path, std::move(file));
+    started = it->second;
+    subscription = started->subscribe(evb, callback);
+  }
+  folly::getGlobalCPUExecutor()->add(
+      [this, started = std::move(started)]() mutable {
+        read_to_end(std::move(started));
+      });
+  return subscription;
+}
+
+void CoalescedFileReader::read_to_end(std::shared_ptr<InFlightRead> in_flight) {
+  folly::IOBufQueue buf;
+  // TODO(zds): implement timeout on reading files?
+  for (;;) {
+    auto data = buf.preallocate(read_chunk_size, read_chunk_size);
+    auto rc = folly::readNoInt(in_flight->file->fd(), data.first, data.second);
+    if (rc < 0) {
+      VLOG(4) << "file read error: " << rc;
+      in_flight_.lock()->erase(in_flight->file_path.string());
+      in_flight->fail();
+      return;
+    } else if (rc == 0) {
+      break;
+    }
+    buf.postallocate(rc);
+    in_flight->publish(buf.move());
+  }
+  VLOG(4) << "File EOF found. Publishing " << in_flight->file_path
+          << " to the cache.";
+  // Publish to the cache before retiring the read so that new requests find
+  // the file in one place or the other.
+  cache_->insert(in_flight->file_path, in_flight->body());
+  in_flight_.lock()->erase(in_flight->file_path.string());
+  in_flight->end();
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,92 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_COALESCED_FILE_READER_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_COALESCED_FILE_READER_H
+
+#include <filesystem>
+#include <folly/File.h>
+#include <folly/Synchronized.h>
+#include <folly/container/F14Map.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventBase.h>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "static_file_cache.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Receives the contents of a file that is being read on behalf of one or more
+// requests. Callbacks always run on the EventBase thread the subscriber
+// subscribed from, in order.
+class FileReadCallback {
+public:
+  virtual ~FileReadCallback() = default;
+  virtual void on_file_chunk(std::unique_ptr<folly::IOBuf> chunk) noexcept = 0;
+  virtual void on_file_end() noexcept = 0;
+  virtual void on_file_error() noexcept = 0;
+};
+
+// A subscriber's handle on a read in flight.
+class FileReadSubscription {
+public:
+  FileReadSubscription(folly::EventBase *evb, FileReadCallback *callback)
+      : evb_(evb), callback_(callback) {}
+
+  // Stops delivery to the callback. Must be called on the subscriber's
+  // EventBase thread before the callback is destroyed.
+  void cancel() noexcept { callback_ = nullptr; }
+
+  folly::EventBase *evb() const noexcept { return evb_; }
+
+  // nullptr once cancelled
+  FileReadCallback *callback() const noexcept { return callback_; }
+
+private:
+  folly::EventBase *const evb_;
+  // only accessed on `evb_`'s thread
+  FileReadCallback *callback_;
+};
+
+// Single-flight reads of cacheable static files: concurrent requests for the
+// same uncached file share one disk read. The first request reads the file;
+// later ones subscribe to the same stream of chunks (replaying whatever was
+// read before they joined). The file is published to the cache only once it
+// has been read completely.
+//
+// Subscribers do not apply egress backpressure to the shared read. This is
+// bounded because only files the cache admits are read this way.
+class CoalescedFileReader {
+public:
+  explicit CoalescedFileReader(std::shared_ptr<StaticFileCache> cache);
+
+  // Joins a read in flight for this file, if there is one. Returns nullptr
+  // otherwise.
+  auto join(const std::filesystem::path &file_path, folly::EventBase *evb,
+            FileReadCallback *callback)
+      -> std::shared_ptr<FileReadSubscription>;
+
+  // Starts reading an opened file, or joins a read of the same file that
+  // another request started in the meantime (closing `file`).
+  auto read(const std::filesystem::path &file_path,
+            std::unique_ptr<folly::File> file, folly::EventBase *evb,
+            FileReadCallback *callback)
+      -> std::shared_ptr<FileReadSubscription>;
+
+private:
+  class InFlightRead;
+
+  void read_to_end(std::shared_ptr<InFlightRead> in_flight);
+
+  std::shared_ptr<StaticFileCache> cache_;
+  folly::Synchronized<
+      folly::F14FastMap<std::string, std::shared_ptr<InFlightRead>>,
+      std::mutex>
+      in_flight_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_COALESCED_FILE_READER_H
@@ -0,0 +1,222 @@
+#include "connection_guard.h"
+
+#include <algorithm>
+#include <folly/GLog.h>
+#include <folly/hash/Hash.h>
+#include <folly/io/async/EventBase.h>
+#include <stdexcept>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+// window within which `rejections_to_ban` rejections earn a ban
+constexpr std::chrono::seconds rejection_window{60};
+
+// for 16 shards
+auto shard_index(const IPKey &key) -> std::size_t {
+  // the high bits pick the shard, leaving the low bits to the map
+  return IPKeyHash{}(key) >> 60;
+}
+
+} // namespace
+
+BanList::BanList(uint32_t rejections_to_ban, std::chrono::seconds first_ban,
+                 std::chrono::seconds max_ban)
+    : rejections_to_ban_(rejections_to_ban),
+      first_ban_(std::chrono::duration_cast<RateLimitClock::duration>(
+          std::max(first_ban, std::chrono::seconds{1}))),
+      max_ban_(std::chrono::duration_cast<RateLimitClock::duration>(
+          std::max(max_ban, first_ban))) {
+  static_assert(num_shards == 1 << 4);
+  // the shortest ban that is as long as the longest
+  while (first_ban_ * (int64_t{1} << (max_level_ - 1)) < max_ban_) {
+    ++max_level_;
+  }
+}
+
+void BanList::rotate(Shard &shard, RateLimitClock::time_point now) const {
+  // A ban decays one level per `max_ban_` after it ends, so an entry left
+  // alone for a whole generation of this length has decayed completely.
+  const auto generation = max_ban_ * (max_level_ + 1) + rejection_window;
+  if (now - shard.rotated < generation) {
+    return;
+  }
+  if (now - shard.rotated >= 2 * generation) {
+    shard.current.clear();
+  }
+  std::swap(shard.current, shard.previous);
+  shard.current.clear();
+  shard.rotated = now;
+}
+
+auto BanList::find(Shard &shard, const IPKey &key) const -> Entry * {
+  if (auto it = shard.current.find(key); it != shard.current.end()) {
+    return &it->second;
+  }
+  auto prev = shard.previous.find(key);
+  if (prev == shard.previous.end()) {
+    return nullptr;
+  }
+  Entry *dst = &shard.current.insert_or_assign(key, prev->second).first->second;
+  shard.previous.erase(prev);
+  return dst;
+}
+
+void BanList::strike(const folly::IPAddress &ip,
+                     RateLimitClock::time_point now) {
+  if (rejections_to_ban_ == 0) {
+    return;
+  }
+  const IPKey key = IPKey::of(ip);
+  auto shard = shards_[shard_index(key)].locked.lock();
+  rotate(*shard, now);
+  Entry *entry = find(*shard, key);
+  if (entry == nullptr) {
+    entry = &shard->current.try_emplace(key).first->second;
+  }
+  if (now < entry->banned_until) {
+    // already banned; requests that still get through come via a proxy
+    return;
+  }
+  if (now - entry->window_start >= rejection_window) {
+    entry->window_start = now;
+    entry->rejections = 0;
+  }
+  if (++entry->rejections < rejections_to_ban_) {
+    return;
+  }
+  // forgive one doubling per `max_ban_` of good behaviour since the last ban
+  if (entry->level > 0) {
+    const auto decayed = (now - entry->banned_until) / max_ban_;
+    entry->level = decayed >= entry->level
+                       ? 0
+                       : static_cast<uint8_t>(entry->level - decayed);
+  }
+  entry->level = std::min<uint8_t>(entry->level + 1, max_level_);
+  const RateLimitClock::duration duration =
+      std::min<RateLimitClock::duration>(
+          first_ban_ * (int64_t{1} << (entry->level - 1)), max_ban_);
+  entry->banned_until = now + duration;
+  entry->rejections = 0;
+
+  auto until = entry->banned_until.time_since_epoch().count();
+  auto prev = banned_until_max_.load(std::memory_order_relaxed);
+  while (prev < until && !banned_until_max_.compare_exchange_weak(
+                             prev, until, std::memory_order_relaxed)) {
+  }
+  LOG(INFO) << "Banned " << ip.str() << " for "
+            << std::chrono::duration_cast<std::chrono::seconds>(duration)
+                   .count()
+            << "s";
+}
+
+auto BanList::banned(const folly::IPAddress &ip,
+                     RateLimitClock::time_point now) -> bool {
+  if (!any_banned(now)) {
+    return false;
+  }
+  const IPKey key = IPKey::of(ip);
+  auto shard = shards_[shard_index(key)].locked.lock();
+  if (auto it = shard->current.find(key); it != shard->current.end()) {
+    return now < it->second.banned_until;
+  }
+  auto prev = shard->previous.find(key);
+  return prev != shard->previous.end() && now < prev->second.banned_until;
+}
+
+ConnectionGuard::ConnectionGuard(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *config,
+    std::shared_ptr<BanList> bans)
+    : config_(config), bans_(std::move(bans)) {
+  static_assert(num_shards == 1 << 4);
+}
+
+auto ConnectionGuard::exempt(const folly::IPAddress &ip) const -> bool {
+  return config_->cf_networks.contains(ip) ||
+         config_->reverse_proxy_networks.contains(ip) ||
+         config_->ip_allow_list.contains(ip);
+}
+
+auto ConnectionGuard::counts_for(const IPKey &key) -> ConnectionCounts & {
+  return connections_[shard_index(key)].locked;
+}
+
+void ConnectionGuard::admit(const folly::SocketAddress &peer) {
+  if (!peer.isFamilyInet()) {
+    return;
+  }
+  const folly::IPAddress ip = peer.getIPAddress();
+  if (exempt(ip)) {
+    return;
+  }
+  if (bans_->banned(ip, RateLimitClock::now())) {
+    throw std::runtime_error{"client is banned"};
+  }
+  if (config_->max_connections_per_ip == 0) {
+    return;
+  }
+  // Counted here, under the same lock as the check, so that concurrent
+  // accepts from one client cannot all slip under the cap. The session of an
+  // admitted connection is created right after, and `onDestroy` releases it.
+  const IPKey key = IPKey::of(ip);
+  auto counts = counts_for(key).lock();
+  uint32_t &count = (*counts)[key];
+  if (count >= config_->max_connections_per_ip) {
+    throw std::runtime_error{"too many connections from client"};
+  }
+  ++count;
+}
+
+void ConnectionGuard::onCreate(const proxygen::HTTPSessionBase &session) {
+  if (config_->request_header_timeout_ms == 0) {
+    return;
+  }
+  // Only the session's own callbacks may touch it, and they all run on its
+  // IO thread, as does this timeout.
+  auto *mutable_session = const_cast<proxygen::HTTPSessionBase *>(&session);
+  folly::EventBase *evb = session.getEventBase();
+  auto timeout = folly::AsyncTimeout::make(
+      *evb, [this, mutable_session, evb]() noexcept {
+        auto it = header_deadlines_->find(mutable_session);
+        if (it != header_deadlines_->end()) {
+          // this callback belongs to the timeout, so free it afterwards
+          evb->runInLoop([expired = std::move(it->second)] {});
+          header_deadlines_->erase(it);
+        }
+        VLOG(2) << "Dropping connection from "
+                << mutable_session->getPeerAddress().describe()
+                << " that sent no request in time";
+        mutable_session->dropConnection("request header timeout");
+      });
+  timeout->scheduleTimeout(
+      std::chrono::milliseconds{config_->request_header_timeout_ms});
+  header_deadlines_->insert_or_assign(&session, std::move(timeout));
+}
+
+void ConnectionGuard::onIngressMessage(
+    const proxygen::HTTPSessionBase &session,
+    const proxygen::HTTPMessage & /* msg */) {
+  // A keep-alive connection's later requests are bounded by the server's
+  // idle timeout instead.
+  header_deadlines_->erase(&session);
+}
+
+void ConnectionGuard::onDestroy(const proxygen::HTTPSessionBase &session) {
+  header_deadlines_->erase(&session);
+  const folly::SocketAddress &peer = session.getPeerAddress();
+  if (config_->max_connections_per_ip == 0 || !peer.isFamilyInet() ||
+      exempt(peer.getIPAddress())) {
+    return;
+  }
+  const IPKey key = IPKey::of(peer.getIPAddress());
+  auto counts = counts_for(key).lock();
+  if (auto it = counts->find(key); it != counts->end() && --it->second == 0) {
+    counts->erase(it);
+  }
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
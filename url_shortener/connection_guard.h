@@ -0,0 +1,148 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CONNECTION_GUARD_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CONNECTION_GUARD_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <folly/IPAddress.h>
+#include <folly/SocketAddress.h>
+#include <folly/Synchronized.h>
+#include <folly/ThreadLocal.h>
+#include <folly/container/F14Map.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/lang/Align.h>
+#include <memory>
+#include <mutex>
+#include <proxygen/lib/http/session/HTTPSessionBase.h>
+
+#include "app_config.h"
+#include "ip_rate_limiter.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Clients that keep getting rate limited, banned for a while. Each ban of the
+// same client is twice as long as the last, up to a maximum, and a client
+// that stays quiet is forgiven one doubling for every maximum ban's worth of
+// time.
+//
+// Shared by all IO threads. Clients are spread over independently locked
+// shards, which forget clients whose bans have fully decayed.
+class BanList {
+public:
+  // Bans a client once it is rejected `rejections_to_ban` times within a
+  // minute. 0 disables bans.
+  BanList(uint32_t rejections_to_ban, std::chrono::seconds first_ban,
+          std::chrono::seconds max_ban);
+
+  BanList(const BanList &) = delete;
+  BanList &operator=(const BanList &) = delete;
+
+  // Records that a request from `ip` was rejected.
+  void strike(const folly::IPAddress &ip, RateLimitClock::time_point now);
+
+  auto banned(const folly::IPAddress &ip, RateLimitClock::time_point now)
+      -> bool;
+
+  // Whether any ban may still be in effect; cheap enough to check before
+  // working out who a client is.
+  auto any_banned(RateLimitClock::time_point now) const -> bool {
+    return now.time_since_epoch().count() <
+           banned_until_max_.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr std::size_t num_shards = 16;
+
+  struct Entry {
+    RateLimitClock::time_point window_start{};
+    RateLimitClock::time_point banned_until{};
+    uint32_t rejections{0};
+    // how many times the ban has doubled, plus one; 0 if never banned
+    uint8_t level{0};
+  };
+
+  struct Shard {
+    folly::F14FastMap<IPKey, Entry, IPKeyHash> current;
+    folly::F14FastMap<IPKey, Entry, IPKeyHash> previous;
+    RateLimitClock::time_point rotated{};
+  };
+
+  using LockedShard = folly::Synchronized<Shard, std::mutex>;
+
+  struct alignas(folly::hardware_destructive_interference_size) AlignedShard {
+    LockedShard locked;
+  };
+
+  // Looks up `key`, moving it to the current generation.
+  auto find(Shard &shard, const IPKey &key) const -> Entry *;
+  void rotate(Shard &shard, RateLimitClock::time_point now) const;
+
+  const uint32_t rejections_to_ban_;
+  const RateLimitClock::duration first_ban_;
+  const RateLimitClock::duration max_ban_;
+  uint8_t max_level_{1};
+  std::atomic<RateLimitClock::rep> banned_until_max_{0};
+  std::array<AlignedShard, num_shards> shards_;
+};
+
+// Admission control per connection, before any request on it is parsed:
+// - refuses connections from banned clients;
+// - caps the number of open connections per client IP;
+// - drops connections that do not send a complete request head in time, so
+//   that slow clients cannot tie up connections indefinitely.
+//
+// Connections from trusted proxies (which carry many clients) and from the
+// allow list are exempt. Install `admit` as the server's
+// `newConnectionFilter` and the guard itself as its session info callback.
+class ConnectionGuard : public proxygen::HTTPSessionBase::InfoCallback {
+public:
+  ConnectionGuard(
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *config,
+      std::shared_ptr<BanList> bans);
+
+  ConnectionGuard(const ConnectionGuard &) = delete;
+  ConnectionGuard &operator=(const ConnectionGuard &) = delete;
+
+  // Throws to have the acceptor drop the connection. An admitted connection
+  // counts against its client's cap until its session's `onDestroy`.
+  void admit(const folly::SocketAddress &peer);
+
+  void onCreate(const proxygen::HTTPSessionBase &session) override;
+  void onIngressMessage(const proxygen::HTTPSessionBase &session,
+                        const proxygen::HTTPMessage &msg) override;
+  void onDestroy(const proxygen::HTTPSessionBase &session) override;
+
+private:
+  static constexpr std::size_t num_shards = 16;
+
+  using ConnectionCounts =
+      folly::Synchronized<folly::F14FastMap<IPKey, uint32_t, IPKeyHash>,
+                          std::mutex>;
+
+  struct alignas(folly::hardware_destructive_interference_size)
+      AlignedConnectionCounts {
+    ConnectionCounts locked;
+  };
+
+  // Sessions still waiting for their first request head, on this IO thread.
+  using HeaderDeadlines =
+      folly::F14FastMap<const proxygen::HTTPSessionBase *,
+                        std::unique_ptr<folly::AsyncTimeout>>;
+
+  auto exempt(const folly::IPAddress &ip) const -> bool;
+  auto counts_for(const IPKey &key) -> ConnectionCounts &;
+
+  const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *const config_;
+  const std::shared_ptr<BanList> bans_;
+  std::array<AlignedConnectionCounts, num_shards> connections_;
+  folly::ThreadLocal<HeaderDeadlines> header_deadlines_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CONNECTION_GUARD_H
@@ -0,0 +1,435 @@
+#include "create_batch_handler.h"
+
+#include <array>
+#include <folly/Conv.h>
+#include <folly/OperationCancelled.h>
+#include <folly/String.h>
+#include <folly/Try.h>
+#include <folly/executors/GlobalExecutor.h>
+#include <folly/io/async/EventBaseManager.h>
+#include <folly/json.h>
+#include <folly/ssl/OpenSSLHash.h>
+#include <glog/logging.h>
+#include <proxygen/httpserver/ResponseBuilder.h>
+#include <proxygen/lib/http/HTTPCommonHeaders.h>
+#include <proxygen/lib/http/HTTPMethod.h>
+#include <optional>
+#include <stdexcept>
+
+#include "ddos_protection.h"
+#include "url_canonical.h"
+#include "url_shortener_handler.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+class CaptchaRejected : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// room for the JSON around a long URL on a line of NDJSON, or in an element
+// of a JSON array
+constexpr std::size_t max_line_overhead = 64;
+constexpr std::size_t max_entry_length =
+    max_long_url_length + max_line_overhead;
+
+} // namespace
+
+CreateBatchHandler::CreateBatchHandler(
+    ::ec_prv::url_shortener::db::ShortenedUrlsDatabase *db,
+    CaptchaVerifier *verifier,
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig
+        *ro_app_config,
+    const ::ec_prv::url_shortener::url_shortening::UrlShorteningConfig
+        *url_shortening_svc)
+    : db_(db), verifier_(verifier), ro_app_config_(ro_app_config),
+      url_shortening_svc_(url_shortening_svc) {}
+
+void CreateBatchHandler::onRequest(
+    std::unique_ptr<proxygen::HTTPMessage> request) noexcept {
+  evb_ = folly::EventBaseManager::get()->getEventBase();
+  auto method = request->getMethod();
+  if (method != proxygen::HTTPMethod::POST &&
+      method != proxygen::HTTPMethod::PUT) {
+    finished_ = true;
+    proxygen::ResponseBuilder(downstream_)
+        .status(405, "Method Not Allowed")
+        .sendWithEOM();
+    return;
+  }
+  user_captcha_response_ = request->getQueryParam("user_captcha_response");
+  if (user_captcha_response_.empty()) {
+    fail(400, "Bad Request", "user_captcha_response parameter missing");
+    return;
+  }
+  const std::string &content_type = request->getHeaders().getSingleOrEmpty(
+      proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE);
+  ndjson_ = content_type.starts_with("application/x-ndjson") ||
+            content_type.starts_with("application/jsonl");
+  client_ip_ = resolve_client_ip(*ro_app_config_, *request)
+                   .value_or(request->getClientAddress().getIPAddress());
+  batch_ = std::make_shared<UrlBatch>(db_, url_shortening_svc_);
+  body_digest_.hash_init(EVP_sha256());
+  // nothing is prepared, let alone settled, before the whole batch is
+  // verified
+  tail_ = verified_.getFuture();
+}
+
+void CreateBatchHandler::onBody(std::unique_ptr<folly::IOBuf> body) noexcept {
+  if (finished_) {
+    return;
+  }
+  for (folly::ByteRange range : *body) {
+    body_digest_.hash_update(range);
+    if (!ndjson_) {
+      add_json(std::string_view{reinterpret_cast<const char *>(range.data()),
+                                range.size()});
+      if (finished_) {
+        return;
+      }
+      continue;
+    }
+    body_.append(reinterpret_cast<const char *>(range.data()), range.size());
+  }
+  if (!ndjson_) {
+    return;
+  }
+  std::size_t begin = 0;
+  for (std::size_t newline; (newline = body_.find('\n', begin)) !=
+                            std::string::npos;
+       begin = newline + 1) {
+    add_line(std::string_view{body_}.substr(begin, newline - begin));
+    if (finished_) {
+      return;
+    }
+  }
+  body_.erase(0, begin);
+  if (body_.size() > max_entry_length) {
+    fail(413, "Payload Too Large", "line too long");
+  }
+}
+
+void CreateBatchHandler::onEOM() noexcept {
+  if (finished_ || client_terminated_) {
+    return;
+  }
+  if (ndjson_) {
+    add_line(body_);
+  } else if (!array_.closed) {
+    fail(400, "Bad Request", "expected a JSON array of long URLs");
+  }
+  body_.clear();
+  if (finished_) {
+    return;
+  }
+  end_chunk();
+  verify();
+  create();
+  finish();
+}
+
+void CreateBatchHandler::verify() {
+  std::array<uint8_t, 32> digest;
+  body_digest_.hash_final(
+      folly::MutableByteRange{digest.data(), digest.size()});
+  // Verified once for the whole batch, as if for one long URL: the digest of
+  // the body. A solved proof of work is then only good for this very batch,
+  // and replaying it creates nothing new.
+  verifier_
+      ->verify(user_captcha_response_,
+               folly::hexlify(folly::ByteRange{digest.data(), digest.size()}),
+               client_ip_)
+      .thenValue([](bool success) {
+        if (!success) {
+          throw CaptchaRejected{"captcha response rejected"};
+        }
+      })
+      .thenTry([verified = std::move(verified_)](
+                   folly::Try<folly::Unit> &&result) mutable {
+        verified.setTry(std::move(result));
+      });
+}
+
+void CreateBatchHandler::add_line(std::string_view line) {
+  line = folly::trimWhitespace(folly::StringPiece{line});
+  if (line.empty()) {
+    return;
+  }
+  folly::dynamic entry;
+  try {
+    entry = folly::parseJson(line);
+  } catch (const std::exception &) {
+  }
+  add_entry(entry);
+}
+
+void CreateBatchHandler::add_json(std::string_view data) {
+  // Split at the commas between the array's elements, keeping track of
+  // strings and nesting only as far as needed to tell which commas those are,
+  // and parse each element on its own.
+  for (char c : data) {
+    const bool space = c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    if (array_.closed || !array_.opened) {
+      if (space) {
+        continue;
+      }
+      if (array_.closed || c != '[') {
+        fail(400, "Bad Request", "expected a JSON array of long URLs");
+        return;
+      }
+      array_.opened = true;
+      continue;
+    }
+    if (array_.in_string) {
+      if (array_.escaped) {
+        array_.escaped = false;
+      } else if (c == '\\') {
+        array_.escaped = true;
+      } else if (c == '"') {
+        array_.in_string = false;
+      }
+    } else if (c == '"') {
+      array_.in_string = true;
+    } else if (c == '[' || c == '{') {
+      ++array_.depth;
+    } else if (array_.depth > 0 && (c == ']' || c == '}')) {
+      --array_.depth;
+    } else if (array_.depth == 0 && (c == ',' || c == ']')) {
+      array_.closed = c == ']';
+      end_element();
+      if (finished_) {
+        return;
+      }
+      continue;
+    }
+    body_ += c;
+    if (body_.size() > max_entry_length) {
+      fail(413, "Payload Too Large", "array element too long");
+      return;
+    }
+  }
+}
+
+void CreateBatchHandler::end_element() {
+  if (folly::trimWhitespace(folly::StringPiece{body_}).empty()) {
+    // only `[]` may have no element before its bracket
+    if (!array_.closed || entries_ != 0) {
+      fail(400, "Bad Request", "expected a JSON array of long URLs");
+    }
+  } else {
+    add_line(body_);
+  }
+  body_.clear();
+}
+
+void CreateBatchHandler::add_entry(const folly::dynamic &value) {
+  if (entries_ == ro_app_config_->create_batch_max_urls) {
+    fail(413, "Payload Too Large",
+         folly::to<std::string>("more than ",
+                                ro_app_config_->create_batch_max_urls,
+                                " URLs"));
+    return;
+  }
+  Entry entry{.index = entries_++};
+  const folly::dynamic *long_url =
+      value.isObject() ? value.get_ptr("long_url") : &value;
+  if (long_url == nullptr || !long_url->isString() || long_url->empty()) {
+    entry.error = "expected a long URL";
+  } else if (long_url->size() > max_long_url_length) {
+    entry.error = "long URL too long";
+  } else if (std::optional<std::string> canonical_url = canonicalize_url(
+                 long_url->getString(), max_long_url_length)) {
+    entry.long_url = std::move(*canonical_url);
+  } else {
+    entry.error = "long URL is not a valid http(s) URL";
+  }
+  chunk_.push_back(std::move(entry));
+  if (chunk_.size() == chunk_size) {
+    end_chunk();
+  }
+}
+
+void CreateBatchHandler::end_chunk() {
+  if (chunk_.empty()) {
+    return;
+  }
+  chunks_.push_back(std::move(chunk_));
+  chunk_.clear();
+}
+
+void CreateBatchHandler::create() {
+  const std::weak_ptr<bool> alive = alive_;
+  tail_ = std::move(tail_).via(evb_).thenValue([this, alive](folly::Unit) {
+    if (alive.expired()) {
+      throw folly::OperationCancelled{};
+    }
+    // Slugs are generated and looked up for many chunks at once, and
+    // settled one chunk after another.
+    folly::Future<folly::Unit> settled = folly::makeFuture();
+    for (std::vector<Entry> &entries : chunks_) {
+      settled = settle_chunk(std::move(settled), std::move(entries));
+    }
+    chunks_.clear();
+    return settled;
+  });
+}
+
+auto CreateBatchHandler::settle_chunk(folly::Future<folly::Unit> previous,
+                                      std::vector<Entry> entries)
+    -> folly::Future<folly::Unit> {
+  std::vector<std::string> long_urls;
+  for (const Entry &entry : entries) {
+    if (entry.error.empty()) {
+      long_urls.push_back(entry.long_url);
+    }
+  }
+  auto prepared = folly::via(folly::getGlobalCPUExecutor(),
+                             [batch = batch_,
+                              long_urls = std::move(long_urls)]() mutable {
+                               return batch->prepare(std::move(long_urls));
+                             });
+  const std::weak_ptr<bool> alive = alive_;
+  return std::move(previous)
+      .thenValue([prepared = std::move(prepared)](folly::Unit) mutable {
+        return std::move(prepared);
+      })
+      .via(folly::getGlobalCPUExecutor())
+      .thenValue([batch = batch_](UrlBatch::Prepared prepared) {
+        return batch->resolve(std::move(prepared));
+      })
+      .via(evb_)
+      .thenValue([this, alive, entries = std::move(entries)](
+                     std::vector<std::string> slugs) {
+        if (alive.expired()) {
+          return;
+        }
+        std::string lines;
+        auto slug = slugs.begin();
+        for (const Entry &entry : entries) {
+          folly::dynamic line = folly::dynamic::object("index", entry.index);
+          if (!entry.error.empty()) {
+            line["error"] = entry.error;
+          } else {
+            line["long_url"] = entry.long_url;
+            if (slug->empty()) {
+              line["error"] = "could not create a slug";
+            } else {
+              line["slug"] = *slug;
+            }
+            ++slug;
+          }
+          lines += folly::toJson(line);
+          lines += '\n';
+        }
+        emit(std::move(lines), false);
+      });
+}
+
+void CreateBatchHandler::finish() {
+  const std::weak_ptr<bool> alive = alive_;
+  std::move(tail_)
+      .via(folly::getGlobalCPUExecutor())
+      .thenValue([batch = batch_](folly::Unit) { return batch->commit(); })
+      .via(evb_)
+      .thenValue([this, alive](
+                     std::optional<::ec_prv::url_shortener::db::
+                                       UrlShorteningDbError> &&err) {
+        if (alive.expired()) {
+          return;
+        }
+        if (err ==
+            ::ec_prv::url_shortener::db::UrlShorteningDbError::SlugExists) {
+          fail(409, "Conflict",
+               "a slug was taken by another create meanwhile; nothing was "
+               "created");
+          return;
+        }
+        if (err) {
+          LOG(ERROR) << "rocksdb errored during insert of a batch of "
+                     << batch_->created() << " shortened URLs";
+          fail(500, "Internal Server Error", "database write failed");
+          return;
+        }
+        emit(folly::toJson(folly::dynamic::object("created",
+                                                  batch_->created())(
+                 "urls", entries_)) +
+                 '\n',
+             true);
+      })
+      .thenError([this, alive](folly::exception_wrapper &&e) {
+        if (alive.expired()) {
+          return;
+        }
+        if (e.is_compatible_with<CaptchaRejected>()) {
+          fail(400, "Bad Request", "captcha response rejected");
+        } else if (e.is_compatible_with<CaptchaServiceUnavailable>()) {
+          fail(503, "Service Unavailable", "captcha service unavailable");
+        } else {
+          LOG(ERROR) << "error in creating a batch of short URLs: "
+                     << e.what();
+          fail(500, "Internal Server Error", "internal error");
+        }
+      });
+}
+
+void CreateBatchHandler::emit(std::string lines, bool eom) {
+  if (finished_ || client_terminated_) {
+    return;
+  }
+  proxygen::ResponseBuilder response(downstream_);
+  if (!headers_sent_) {
+    headers_sent_ = true;
+    response.status(200, "OK")
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
+                "application/x-ndjson")
+        .header(
+            proxygen::HTTPHeaderCode::HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
+            "*");
+  }
+  if (!lines.empty()) {
+    response.body(std::move(lines));
+  }
+  if (eom) {
+    finished_ = true;
+    response.sendWithEOM();
+  } else {
+    response.send();
+  }
+}
+
+void CreateBatchHandler::fail(uint16_t status, const std::string &message,
+                              const std::string &reason) {
+  if (finished_ || client_terminated_) {
+    return;
+  }
+  if (headers_sent_) {
+    // too late for a status; the last line says what went wrong
+    emit(folly::toJson(folly::dynamic::object("error", reason)) + '\n', true);
+    return;
+  }
+  finished_ = true;
+  proxygen::ResponseBuilder(downstream_)
+      .status(status, message)
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
+              "*")
+      .body(reason)
+      .sendWithEOM();
+}
+
+void CreateBatchHandler::requestComplete() noexcept {
+  client_terminated_ = true;
+  delete this;
+}
+
+void CreateBatchHandler::onError(proxygen::ProxygenError err) noexcept {
+  DLOG(INFO) << "proxygen error: " << err;
+  client_terminated_ = true;
+  delete this;
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,138 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CREATE_BATCH_HANDLER_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CREATE_BATCH_HANDLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <folly/IPAddress.h>
+#include <folly/dynamic.h>
+#include <folly/futures/Future.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/ssl/OpenSSLHash.h>
+#include <memory>
+#include <proxygen/httpserver/RequestHandler.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "app_config.h"
+#include "captcha_verifier.h"
+#include "db.h"
+#include "url_batch.h"
+#include "url_shortening.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Creates short URLs for many long URLs at once, at
+// `/api/v1/create_batch?user_captcha_response=...`. The body is a JSON array,
+// or NDJSON (`Content-Type: application/x-ndjson`) with one entry per line,
+// where each entry is a long URL as a JSON string or `{"long_url": ...}`.
+//
+// The body is parsed as it arrives, a line of NDJSON or an element of the
+// array at a time, and no entry may be longer than a line may be, so a body
+// is never held whole.
+//
+// The captcha response is verified once for the whole batch, as if for one
+// long URL: the lowercase hex SHA-256 of the body, so a proof of work is
+// solved for the batch as sent and cannot be replayed for another. Only then
+// are the entries handed to `UrlBatch`, in chunks. Results stream back as
+// NDJSON, one line per entry in order,
+// `{"index": 0, "long_url": ..., "slug": ...}` or `{"index": 0, "error": ...}`.
+// New slugs are written in one write at the end, and only hold once the last
+// line, `{"created": ..., "urls": ...}`, says so; if the write fails, or a
+// slug was taken for another URL meanwhile, it is `{"error": ...}` instead.
+class CreateBatchHandler : public proxygen::RequestHandler {
+public:
+  // URLs per `UrlBatch` chunk
+  static constexpr std::size_t chunk_size = 256;
+
+  // `verifier` must be usable on this IO thread.
+  CreateBatchHandler(
+      ::ec_prv::url_shortener::db::ShortenedUrlsDatabase *db,
+      CaptchaVerifier *verifier,
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig
+          *ro_app_config,
+      const ::ec_prv::url_shortener::url_shortening::UrlShorteningConfig
+          *url_shortening_svc);
+
+  void
+  onRequest(std::unique_ptr<proxygen::HTTPMessage> request) noexcept override;
+
+  void onBody(std::unique_ptr<folly::IOBuf> body) noexcept override;
+
+  void onEOM() noexcept override;
+
+  void onUpgrade(proxygen::UpgradeProtocol proto) noexcept override {}
+
+  void requestComplete() noexcept override;
+
+  void onError(proxygen::ProxygenError err) noexcept override;
+
+private:
+  struct Entry {
+    std::size_t index;
+    std::string long_url;
+    // if the entry is not a usable long URL
+    std::string error;
+  };
+
+  // one line of NDJSON, or one element of a JSON array
+  void add_line(std::string_view line);
+  // more of a JSON array body
+  void add_json(std::string_view data);
+  void end_element();
+  void add_entry(const folly::dynamic &value);
+  void end_chunk();
+  // once the whole body is in
+  void verify();
+  void create();
+  auto settle_chunk(folly::Future<folly::Unit> previous,
+                    std::vector<Entry> entries) -> folly::Future<folly::Unit>;
+  void finish();
+  void emit(std::string lines, bool eom);
+  void fail(uint16_t status, const std::string &message,
+            const std::string &reason);
+
+  ::ec_prv::url_shortener::db::ShortenedUrlsDatabase *const db_;
+  CaptchaVerifier *const verifier_;
+  const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig
+      *const ro_app_config_;
+  const ::ec_prv::url_shortener::url_shortening::UrlShorteningConfig
+      *const url_shortening_svc_;
+  folly::EventBase *evb_{nullptr};
+  std::string user_captcha_response_;
+  folly::IPAddress client_ip_;
+  // of the body as it arrives
+  folly::ssl::OpenSSLHash::Digest body_digest_;
+  std::shared_ptr<UrlBatch> batch_;
+  folly::Promise<folly::Unit> verified_;
+  // verification, then each chunk in order
+  folly::Future<folly::Unit> tail_{folly::makeFuture()};
+  bool ndjson_{false};
+  // unparsed body: a partial line of NDJSON, or of an element of a JSON array
+  std::string body_;
+  // how far a JSON array body has been scanned
+  struct {
+    bool opened{false};
+    bool closed{false};
+    bool in_string{false};
+    bool escaped{false};
+    uint32_t depth{0};
+  } array_;
+  // entries parsed, waiting for the batch to be verified
+  std::vector<std::vector<Entry>> chunks_;
+  std::vector<Entry> chunk_;
+  std::size_t entries_{0};
+  bool headers_sent_{false};
+  bool finished_{false};
+  bool client_terminated_{false};
+  // lets continuations know whether the handler is still there
+  std::shared_ptr<bool> alive_{std::make_shared<bool>(true)};
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_CREATE_BATCH_HANDLER_H
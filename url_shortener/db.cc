@@ -10,6 +10,7 @@
 #include <glog/logging.h>
 #include <iostream>
 #include <memory>
+#include <rocksdb/write_batch.h>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -34,6 +35,19 @@ auto shortened_urls_database_path_env() -> std::filesystem::path {
             << std::filesystem::absolute(path);
   return path;
 }
+
+auto to_db_error(const rocksdb::Status &s) -> UrlShorteningDbError {
+  if (s.IsNotFound()) {
+    return UrlShorteningDbError::NotFound;
+  }
+  if (s.IsIOError()) {
+    return UrlShorteningDbError::IOError;
+  }
+  if (s.IsTryAgain()) {
+    return UrlShorteningDbError::TryAgain;
+  }
+  return UrlShorteningDbError::InternalRocksDbError;
+}
 } // namespace
 
 auto ShortenedUrlsDatabase::open(std::filesystem::path db_path)
@@ -88,6 +102,25 @@ auto ShortenedUrlsDatabase::put(std::string_view shortened_url,
   return {};
 }
 
+auto ShortenedUrlsDatabase::put_new(std::string_view shortened_url,
+                                    std::string_view full_url) noexcept
+    -> std::optional<UrlShorteningDbError> {
+  std::lock_guard<std::mutex> lock{write_mutex_};
+  std::string stored;
+  rocksdb::Status s = rocksdb_->Get(read_options_, shortened_url, &stored);
+  if (s.ok() && !stored.empty()) {
+    if (stored == full_url) {
+      // another create got there first
+      return {};
+    }
+    return UrlShorteningDbError::SlugExists;
+  }
+  if (!s.ok() && !s.IsNotFound()) {
+    return to_db_error(s);
+  }
+  return put(shortened_url, full_url);
+}
+
 auto ShortenedUrlsDatabase::get(std::string_view shortened_url) noexcept
     -> std::variant<std::string, UrlShorteningDbError> {
   DLOG(INFO) << "Getting from RocksDB database this slug: \"" << shortened_url
@@ -122,6 +155,72 @@ auto ShortenedUrlsDatabase::get_fast(std::string *buf,
   return s.ok();
 }
 
+auto ShortenedUrlsDatabase::multi_get(
+    const std::vector<std::string> &shortened_urls) noexcept
+    -> std::vector<std::variant<std::string, UrlShorteningDbError>> {
+  std::vector<rocksdb::Slice> keys;
+  keys.reserve(shortened_urls.size());
+  for (const std::string &shortened_url : shortened_urls) {
+    keys.emplace_back(shortened_url);
+  }
+  std::vector<std::string> values;
+  std::vector<rocksdb::Status> statuses =
+      rocksdb_->MultiGet(read_options_, keys, &values);
+  std::vector<std::variant<std::string, UrlShorteningDbError>> dst;
+  dst.reserve(statuses.size());
+  for (std::size_t i = 0; i < statuses.size(); ++i) {
+    if (statuses[i].ok()) {
+      dst.emplace_back(std::move(values[i]));
+    } else {
+      dst.emplace_back(to_db_error(statuses[i]));
+    }
+  }
+  return dst;
+}
+
+auto ShortenedUrlsDatabase::put_batch(
+    const std::vector<std::pair<std::string, std::string>> &entries) noexcept
+    -> std::optional<UrlShorteningDbError> {
+  std::vector<std::string> shortened_urls;
+  shortened_urls.reserve(entries.size());
+  for (const auto &entry : entries) {
+    shortened_urls.push_back(entry.first);
+  }
+  std::lock_guard<std::mutex> lock{write_mutex_};
+  std::vector<std::variant<std::string, UrlShorteningDbError>> stored =
+      multi_get(shortened_urls);
+  rocksdb::WriteBatch batch;
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    const auto &[shortened_url, full_url] = entries[i];
+    if (const auto *err = std::get_if<UrlShorteningDbError>(&stored[i])) {
+      if (*err != UrlShorteningDbError::NotFound) {
+        return *err;
+      }
+    } else if (const std::string &got = std::get<std::string>(stored[i]);
+               got == full_url) {
+      // another create got there first
+      continue;
+    } else if (!got.empty()) {
+      LOG(WARNING) << "Not writing a batch: "" << shortened_url
+                   << "" was taken for "" << got << "" meanwhile";
+      return UrlShorteningDbError::SlugExists;
+    }
+    rocksdb::Status s = batch.Put(shortened_url, full_url);
+    if (!s.ok()) {
+      LOG(ERROR) << "Cannot add \"" << shortened_url
+                 << "\" to a write batch: " << s.ToString();
+      return to_db_error(s);
+    }
+  }
+  rocksdb::Status s = rocksdb_->Write(rocksdb::WriteOptions(), &batch);
+  DLOG(INFO) << "RocksDB status after writing a batch of " << entries.size()
+             << " shortened URLs: " << s.ToString();
+  if (!s.ok()) {
+    return to_db_error(s);
+  }
+  return {};
+}
+
 } // namespace db
 } // namespace url_shortener
 } // namespace ec_prv
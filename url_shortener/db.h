@@ -10,10 +10,13 @@
 #include <filesystem>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <variant>
+#include <vector>
 
 namespace ec_prv {
 namespace url_shortener {
@@ -23,7 +26,8 @@ enum class UrlShorteningDbError {
   TryAgain,
   IOError,
   InternalRocksDbError,
-  // SlugExists, // TODO(zds): for custom urls
+  // the slug already stands for another long URL
+  SlugExists,
 };
 
 class ShortenedUrlsDatabase {
@@ -31,6 +35,9 @@ private:
   rocksdb::DB *rocksdb_;
   rocksdb::ReadOptions read_options_;
   std::filesystem::path path_;
+  // Held across the check and the write of `put_new` and `put_batch`, so
+  // that a slug found free is still free when written.
+  std::mutex write_mutex_;
   explicit ShortenedUrlsDatabase(rocksdb::DB *rocksdb,
                                  std::filesystem::path path)
       : path_(path), rocksdb_(rocksdb), read_options_(rocksdb::ReadOptions()) {}
@@ -47,6 +54,19 @@ public:
   auto get(std::string_view shortened_url) noexcept
       -> std::variant<std::string, UrlShorteningDbError>;
   auto get_fast(std::string *buf, std::string_view short_url) noexcept -> bool;
+  // Looks up many slugs in one call, answering in the same order.
+  auto multi_get(const std::vector<std::string> &shortened_urls) noexcept
+      -> std::vector<std::variant<std::string, UrlShorteningDbError>>;
+  // Puts the slug unless it already stands for another long URL, in which
+  // case it is `SlugExists`.
+  auto put_new(std::string_view shortened_url,
+               std::string_view full_url) noexcept
+      -> std::optional<UrlShorteningDbError>;
+  // Puts every (slug, long URL) pair in one atomic write, unless any of the
+  // slugs already stands for another long URL, in which case nothing is
+  // written and it is `SlugExists`.
+  auto put_batch(const std::vector<std::pair<std::string, std::string>>
+                     &entries) noexcept -> std::optional<UrlShorteningDbError>;
 };
 } // namespace db
 } // namespace url_shortener
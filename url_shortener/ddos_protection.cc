@@ -7,79 +7,64 @@
 #include <folly/Expected.h>
 #include <folly/GLog.h>
 #include <folly/IPAddress.h>
-#include <folly/container/F14Map.h>
 #include <folly/futures/Future.h>
 #include <folly/io/async/HHWheelTimer.h>
 #include <memory>
 #include <proxygen/httpserver/Filters.h>
 #include <proxygen/httpserver/RequestHandler.h>
-#include <proxygen/httpserver/RequestHandlerFactory.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
 #include <proxygen/lib/http/ProxygenErrorEnum.h>
 
 namespace ec_prv {
 namespace url_shortener {
 namespace web {
+namespace {
 
-IPAccessCountService::IPAccessCountService(std::chrono::seconds ttl)
-    : ttl_(ttl) {}
-
-void IPAccessCountService::log_access(const folly::IPAddress &ip) noexcept {
-  auto [it, ok] = ip_access_count_.try_emplace(ip, 1);
-  if (!ok) {
-    it->second = it->second + 1;
-  }
-  time_last_added_ = std::chrono::system_clock::now();
-  check_recycle();
-  DLOG(INFO) << "rate limiter: logged IP " << ip.str()
-             << " count=" << it->second;
-}
-uint32_t IPAccessCountService::hits_per_minute(
-    const folly::IPAddress &ip) const noexcept {
-  if (time_last_added_ < time_last_recycled_) {
-    return 0;
-  }
-  auto iter = ip_access_count_.find(ip);
-  if (iter == ip_access_count_.end()) {
-    return 0;
-  }
-  auto hits = iter->second;
-  if (hits == 0) {
-    return 0;
-  }
-  auto over_seconds = std::chrono::duration_cast<std::chrono::seconds>(
-                          time_last_added_ - time_last_recycled_)
-                          .count();
-  if (over_seconds == 0) {
-    return 0;
+// Check if this message was proxied by a trusted server which forwards the
+// client's IP in the 'X-Forwarded-For' header.
+bool can_trust_x_forwarded_for(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config,
+    const proxygen::HTTPMessage &headers) {
+  const folly::IPAddress &this_ip = headers.getClientAddress().getIPAddress();
+  if (config.reverse_proxy_networks.contains(this_ip)) {
+    return true;
   }
-  return hits / ((over_seconds / 60) > 0 ? over_seconds / 60 : 1);
-}
-void IPAccessCountService::recycle() noexcept {
-  ip_access_count_.clear();
-  time_last_recycled_ = std::chrono::system_clock::now();
+  DLOG(WARNING) << "Cannot trust potential reverse proxy server: "
+                << this_ip.str();
+  return false;
 }
-void IPAccessCountService::check_recycle() noexcept {
-  auto age = std::chrono::duration_cast<std::chrono::seconds>(
-      std::chrono::system_clock::now() - time_last_recycled_);
-  if (age > ttl_) {
-    recycle();
+
+// Check if this message was indeed proxied by Cloudflare.
+bool can_trust_cf_connecting_ip(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config,
+    const proxygen::HTTPMessage &headers) {
+  const folly::IPAddress &this_ip = headers.getClientAddress().getIPAddress();
+  if (config.cf_networks.contains(this_ip)) {
+    DLOG(INFO) << "Found a Cloudflare IP that we can trust: "
+               << this_ip.str();
+    return true;
   }
+  DLOG(WARNING) << "Cannot trust potential Cloudflare server: "
+                << this_ip.str();
+  return false;
 }
 
-RateLimitFilter::RateLimitFilter(proxygen::RequestHandler *upstream)
-    : proxygen::Filter(upstream) {}
+} // namespace
+
+RejectFilter::RejectFilter(proxygen::RequestHandler *upstream,
+                           uint16_t status, const char *reason)
+    : proxygen::Filter(upstream), status_(status), reason_(reason) {}
 
-void RateLimitFilter::onRequest(
+void RejectFilter::onRequest(
     std::unique_ptr<proxygen::HTTPMessage> msg) noexcept {
   upstream_->onError(proxygen::ProxygenError::kErrorUnknown);
   upstream_ = nullptr;
   proxygen::ResponseBuilder(downstream_)
-      .status(429, "Too Many Requests")
+      .status(status_, reason_)
       .sendWithEOM();
 }
 
-void RateLimitFilter::onError(proxygen::ProxygenError err) noexcept {
+void RejectFilter::onError(proxygen::ProxygenError err) noexcept {
   if (upstream_) {
     upstream_->onError(err);
     upstream_ = nullptr;
@@ -87,119 +72,103 @@ void RateLimitFilter::onError(proxygen::ProxygenError err) noexcept {
   delete this;
 }
 
-void RateLimitFilter::requestComplete() noexcept {
+void RejectFilter::requestComplete() noexcept {
   DLOG_IF(ERROR, upstream_) << "upstream_ should be null here";
   delete this;
 }
 
-// Check if this message was proxied by a trusted server which forwards the
-// client's IP in the 'X-Forwarded-For' header.
-bool AntiAbuseProtection::can_trust_x_forwarded_for(
-    const proxygen::HTTPMessage *headers) const {
-  const folly::IPAddress &this_ip = headers->getClientAddress().getIPAddress();
-  for (const auto &cidr : ro_app_config_->reverse_proxy_cidrs) {
-    if (this_ip.inSubnet(cidr.first, cidr.second)) {
-      return true;
+AntiAbuseProtection::AntiAbuseProtection(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *ro_app_config,
+    std::shared_ptr<RateLimitPolicies> rate_limits,
+    std::shared_ptr<BanList> bans)
+    : ro_app_config_(ro_app_config), rate_limits_(std::move(rate_limits)),
+      bans_(std::move(bans)) {}
+
+std::optional<folly::IPAddress> resolve_client_ip(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config,
+    const proxygen::HTTPMessage &msg) {
+  folly::IPAddress client_ip = msg.getClientAddress().getIPAddress();
+  DLOG(INFO) << "determining whether the following IP: " << client_ip.str()
+             << " is really the client's real IP";
+  // if this service is behind Cloudflare, the real client's IP will be behind
+  // a header 'CF-Connecting-IP'
+  if (msg.getHeaders().exists("CF-Connecting-IP")) {
+    if (!can_trust_cf_connecting_ip(config, msg)) {
+      VLOG(1) << "Found potential malicious, non-Cloudflare client ("
+              << client_ip.str() << ") injecting a CF-Connecting-IP header";
+      return std::nullopt;
     }
-  }
-  DLOG(WARNING) << "Cannot trust potential reverse proxy server: "
-                << this_ip.str();
-  return false;
-}
-
-// Check if this message was indeed proxied by Cloudflare.
-bool AntiAbuseProtection::can_trust_cf_connecting_ip(
-    const proxygen::HTTPMessage *headers) const {
-  const folly::IPAddress &this_ip = headers->getClientAddress().getIPAddress();
-  for (const auto &cidr : ro_app_config_->cf_cidrs) {
-    if (this_ip.inSubnet(cidr.first, cidr.second)) {
-      DLOG(INFO) << "Found a Cloudflare IP that we can trust: "
-                 << this_ip.str();
-      return true;
+    auto cloudflare_connecting_ip =
+        msg.getHeaders().getSingleOrEmpty("CF-Connecting-IP");
+    auto r = folly::IPAddress::tryFromString(cloudflare_connecting_ip);
+    if (!r) {
+      VLOG(2) << "Could not parse IP in header CF-Connecting-IP: "
+              << cloudflare_connecting_ip;
+      return std::nullopt;
+    }
+    client_ip = *r;
+  } else if (msg.getHeaders().exists("X-Forwarded-For")) {
+    if (!can_trust_x_forwarded_for(config, msg)) {
+      VLOG(1) << "Found potential malicious client pretending to be a proxy";
+      return std::nullopt;
+    }
+    auto x_forwarded_for =
+        msg.getHeaders().getSingleOrEmpty("X-Forwarded-For");
+    DLOG_IF(ERROR, !x_forwarded_for.empty())
+        << "headers implementation error";
+    auto r = folly::IPAddress::tryFromString(x_forwarded_for);
+    if (!r) {
+      VLOG(2) << "Could not parse IP in header X-Forwarded-For: "
+              << x_forwarded_for;
+      return std::nullopt;
     }
+    client_ip = *r;
   }
-  DLOG(WARNING) << "Cannot trust potential Cloudflare server: "
-                << this_ip.str();
-  return false;
-}
-
-AntiAbuseProtection::AntiAbuseProtection(
-    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *ro_app_config)
-    : ro_app_config_(ro_app_config) {}
-
-void AntiAbuseProtection::onServerStart(folly::EventBase *evb) noexcept {
-  ip_access_count_svc_ = new IPAccessCountService{
-      std::chrono::seconds{ro_app_config_->ip_rate_limiter_seconds_ttl}};
-}
-
-void AntiAbuseProtection::onServerStop() noexcept {
-  CHECK(ip_access_count_svc_ != nullptr) << "lifetime error";
-  delete ip_access_count_svc_;
+  DLOG(INFO) << "resolved client IP as: " << client_ip.str();
+  return client_ip;
 }
 
 proxygen::RequestHandler *
-AntiAbuseProtection::onRequest(proxygen::RequestHandler *rh,
-                               proxygen::HTTPMessage *msg) noexcept {
+AntiAbuseProtection::protect(RouteClass route, const ApiKey *api_key,
+                             proxygen::RequestHandler *rh,
+                             const proxygen::HTTPMessage &msg) noexcept {
   // Should this route be protected?
-  auto method = msg->getMethod();
-  std::string_view path{msg->getPathAsStringPiece().begin(),
-                        msg->getPathAsStringPiece().end()};
-  if (method == proxygen::HTTPMethod::POST ||
-      method == proxygen::HTTPMethod::PUT ||
-      method == proxygen::HTTPMethod::DELETE || path.starts_with("/api/")) {
-    DLOG(INFO) << "in rate limit filter";
-
-    folly::IPAddress client_ip = msg->getClientAddress().getIPAddress();
-    DLOG(INFO) << "determining whether the following IP: " << client_ip.str()
-               << " is really the client's real IP";
-    // if this service is behind Cloudflare, the real client's IP will be behind
-    // a header 'CF-Connecting-IP'
-    if (msg->getHeaders().exists("CF-Connecting-IP")) {
-      if (!can_trust_cf_connecting_ip(msg)) {
-        VLOG(1) << "Found potential malicious, non-Cloudflare client ("
-                << client_ip.str() << ") injecting a CF-Connecting-IP header";
-        return new RateLimitFilter{rh};
-      }
-      auto cloudflare_connecting_ip =
-          msg->getHeaders().getSingleOrEmpty("CF-Connecting-IP");
-      auto r = folly::IPAddress::tryFromString(cloudflare_connecting_ip);
-      if (!r) {
-        VLOG(2) << "Could not parse IP in header CF-Connecting-IP: "
-                << cloudflare_connecting_ip;
-        return new RateLimitFilter{rh};
-      }
-      client_ip = *r;
-    } else if (msg->getHeaders().exists("X-Forwarded-For")) {
-      if (!can_trust_x_forwarded_for(msg)) {
-        VLOG(1) << "Found potential malicious client pretending to be a proxy";
-        return new RateLimitFilter{rh};
-      }
-      auto x_forwarded_for =
-          msg->getHeaders().getSingleOrEmpty("X-Forwarded-For");
-      DLOG_IF(ERROR, !x_forwarded_for.empty())
-          << "headers implementation error";
-      auto r = folly::IPAddress::tryFromString(x_forwarded_for);
-      if (!r) {
-        VLOG(2) << "Could not parse IP in header X-Forwarded-For: "
-                << x_forwarded_for;
-        return new RateLimitFilter{rh};
-      }
-      client_ip = *r;
-    }
-    DLOG(INFO) << "resolved client IP as: " << client_ip.str();
-    ip_access_count_svc_->log_access(client_ip);
-    // Check rate limiting policy from app configuration
-    DLOG(INFO) << "running at "
-               << ip_access_count_svc_->hits_per_minute(client_ip)
-               << " hits per minute, and the max configured is "
-               << ro_app_config_->rate_limit_per_minute;
-    if (ip_access_count_svc_->hits_per_minute(client_ip) >
-        ro_app_config_->rate_limit_per_minute) {
-      return new RateLimitFilter{rh};
-    }
-    // otherwise fall through to next `RequestHandler`
-    // upstream_->onRequest(std::move(msg));
+  const bool limited = rate_limits_->limits(route);
+  const auto now = RateLimitClock::now();
+  if (!limited && ro_app_config_->ip_deny_list.empty() &&
+      !bans_->any_banned(now)) {
+    return rh;
+  }
+  std::optional<folly::IPAddress> client_ip =
+      resolve_client_ip(*ro_app_config_, msg);
+  if (!client_ip) {
+    return new RejectFilter{rh, 429, "Too Many Requests"};
+  }
+  if (ro_app_config_->ip_allow_list.contains(*client_ip)) {
+    return rh;
+  }
+  if (ro_app_config_->ip_deny_list.contains(*client_ip)) {
+    VLOG(2) << "Denied " << client_ip->str();
+    return new RejectFilter{rh, 403, "Forbidden"};
+  }
+  // Banned clients that connect directly are refused at accept time; this
+  // catches those behind a trusted proxy.
+  if (bans_->banned(*client_ip, now)) {
+    return new RejectFilter{rh, 429, "Too Many Requests"};
+  }
+  // A request with a verified API key counts against the key's quota instead.
+  // One with a token that is no key is limited, and struck, like any other
+  // create before `MakeUrlRequestHandler` answers it with 401.
+  if (api_key != nullptr) {
+    return rh;
+  }
+  if (limited && !rate_limits_->admit(route, *client_ip, now)) {
+    VLOG(2) << client_ip->str() << " is over its rate limit for route \""
+            << to_string(route) << "\"";
+    bans_->strike(*client_ip, now);
+    return new RejectFilter{rh, 429, "Too Many Requests"};
   }
+  // otherwise fall through to next `RequestHandler`
   return rh;
 }
 
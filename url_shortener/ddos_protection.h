@@ -7,42 +7,31 @@
 #include <folly/Expected.h>
 #include <folly/GLog.h>
 #include <folly/IPAddress.h>
-#include <folly/container/F14Map.h>
 #include <folly/futures/Future.h>
 #include <folly/io/async/HHWheelTimer.h>
 #include <memory>
+#include <optional>
 #include <proxygen/httpserver/Filters.h>
 #include <proxygen/httpserver/RequestHandler.h>
-#include <proxygen/httpserver/RequestHandlerFactory.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
 
+#include "api_keys.h"
 #include "app_config.h"
+#include "connection_guard.h"
+#include "rate_limit_policy.h"
+#include "route_class.h"
 
 namespace ec_prv {
 namespace url_shortener {
 namespace web {
 
-class IPAccessCountService {
+// Answers a request with an error status instead of passing it on, e.g.,
+// 429 Too Many Requests.
+class RejectFilter : public proxygen::Filter {
 public:
-  explicit IPAccessCountService(std::chrono::seconds ttl);
-
-  void log_access(const folly::IPAddress &ip) noexcept;
-  uint32_t hits_per_minute(const folly::IPAddress &ip) const noexcept;
-
-private:
-  void recycle() noexcept;
-  void check_recycle() noexcept;
-  folly::F14FastMap<folly::IPAddress, uint32_t> ip_access_count_;
-  std::chrono::time_point<std::chrono::system_clock> time_last_recycled_{
-      std::chrono::system_clock::now()};
-  std::chrono::time_point<std::chrono::system_clock> time_last_added_{
-      std::chrono::system_clock::time_point::min()};
-  std::chrono::seconds ttl_;
-};
-
-class RateLimitFilter : public proxygen::Filter {
-public:
-  explicit RateLimitFilter(proxygen::RequestHandler *upstream);
+  // `reason` must be a string literal.
+  RejectFilter(proxygen::RequestHandler *upstream, uint16_t status,
+               const char *reason);
 
   void onRequest(std::unique_ptr<proxygen::HTTPMessage> msg) noexcept override;
   void requestComplete() noexcept override;
@@ -52,34 +41,46 @@ public:
   void onBody(std::unique_ptr<folly::IOBuf>) noexcept override {}
   void onEgressPaused() noexcept override {}
   void onEgressResumed() noexcept override {}
+
+private:
+  const uint16_t status_;
+  const char *const reason_;
 };
 
-class AntiAbuseProtection : public proxygen::RequestHandlerFactory {
+// The real client's IP, taken from a trusted proxy's header if there is one.
+// Empty if the message carries such a header but cannot be trusted.
+std::optional<folly::IPAddress> resolve_client_ip(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config,
+    const proxygen::HTTPMessage &msg);
+
+// Decides whether a request may go on to the handler made for it, by the
+// deny and allow lists, bans and the rate limit of its route class.
+class AntiAbuseProtection {
 public:
-  explicit AntiAbuseProtection(
+  // `rate_limits` and `bans` are shared by all IO threads. Clients that keep
+  // going over their limits are added to `bans`.
+  AntiAbuseProtection(
       const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig
-          *ro_app_config);
+          *ro_app_config,
+      std::shared_ptr<RateLimitPolicies> rate_limits,
+      std::shared_ptr<BanList> bans);
 
-  void onServerStart(folly::EventBase *evb) noexcept override;
-  void onServerStop() noexcept override;
-  proxygen::RequestHandler *
-  onRequest(proxygen::RequestHandler *rh,
-            proxygen::HTTPMessage *msg) noexcept override;
+  // `rh`, the handler for `msg`, or a filter in front of it that answers with
+  // an error instead. `route` is the class `msg` was routed by, and `api_key`
+  // the key it was verified to be made with, if any: such a request counts
+  // against the key's quota rather than its IP's.
+  proxygen::RequestHandler *protect(RouteClass route, const ApiKey *api_key,
+                                    proxygen::RequestHandler *rh,
+                                    const proxygen::HTTPMessage &msg) noexcept;
 
 private:
-  // Check if this message was proxied by a trusted server which forwards the
-  // client's IP in the 'X-Forwarded-For' header.
-  bool can_trust_x_forwarded_for(const proxygen::HTTPMessage *) const;
-
-  // Check if this message was indeed proxied by Cloudflare.
-  bool can_trust_cf_connecting_ip(const proxygen::HTTPMessage *) const;
-
-  IPAccessCountService *ip_access_count_svc_{nullptr};
   const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig
       *const ro_app_config_;
+  const std::shared_ptr<RateLimitPolicies> rate_limits_;
+  const std::shared_ptr<BanList> bans_;
 };
 
 } // namespace web
 } // namespace url_shortener
 } // namespace ec_prv
-#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_DDOS_PROTECTION_Hi
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_DDOS_PROTECTION_H
@@ -0,0 +1,122 @@
+#include "dns_cache.h"
+
+#include <algorithm>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
+#include <glog/logging.h>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+constexpr std::size_t num_resolver_threads = 2;
+// how long an address is kept after a refresh of it fails, before trying
+// again
+constexpr std::chrono::seconds stale_grace{30};
+
+auto key_of(const std::string &host, uint16_t port) -> std::string {
+  return host + ':' + std::to_string(port);
+}
+
+} // namespace
+
+DnsCache::DnsCache(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config)
+    : ttl_(std::max<uint32_t>(config.dns_cache_ttl_seconds, 1)),
+      resolvers_(num_resolver_threads,
+                 std::make_shared<folly::NamedThreadFactory>("DnsResolver")) {
+  for (const auto &[host, target] : config.host_overrides) {
+    if (auto ip = folly::IPAddress::tryFromString(target)) {
+      overrides_.emplace(host, Override{*ip, std::nullopt});
+      continue;
+    }
+    folly::SocketAddress addr;
+    try {
+      addr.setFromIpPort(target);
+    } catch (const std::exception &e) {
+      LOG(FATAL) << "Fix the configuration entry \"host_overrides\". Cannot "
+                    "parse \""
+                 << target << "\" for host " << host << ": " << e.what();
+    }
+    overrides_.emplace(host, Override{addr.getIPAddress(), addr.getPort()});
+  }
+  for (const auto &[host, target] : overrides_) {
+    LOG(INFO) << "Resolving " << host << " to " << target.ip.str();
+  }
+}
+
+auto DnsCache::resolve(const std::string &host, uint16_t port)
+    -> folly::SemiFuture<folly::SocketAddress> {
+  if (auto it = overrides_.find(host); it != overrides_.end()) {
+    return folly::makeSemiFuture(folly::SocketAddress{
+        it->second.ip, it->second.port.value_or(port)});
+  }
+  if (auto ip = folly::IPAddress::tryFromString(host)) {
+    return folly::makeSemiFuture(folly::SocketAddress{*ip, port});
+  }
+  std::string key = key_of(host, port);
+  const auto now = Clock::now();
+  auto entries = entries_.lock();
+  Entry &entry = (*entries)[key];
+  if (entry.address && now < entry.expires) {
+    folly::SocketAddress dst = *entry.address;
+    if (now >= entry.refresh_at && !entry.lookup) {
+      entry.lookup =
+          std::make_shared<folly::SharedPromise<folly::SocketAddress>>();
+      entries.unlock();
+      look_up(std::move(key), host, port);
+    }
+    return folly::makeSemiFuture(std::move(dst));
+  }
+  if (entry.lookup) {
+    return entry.lookup->getSemiFuture();
+  }
+  entry.lookup = std::make_shared<folly::SharedPromise<folly::SocketAddress>>();
+  auto dst = entry.lookup->getSemiFuture();
+  entries.unlock();
+  look_up(std::move(key), host, port);
+  return dst;
+}
+
+void DnsCache::look_up(std::string key, std::string host, uint16_t port) {
+  folly::via(folly::getKeepAliveToken(resolvers_),
+             [host, port] {
+               folly::SocketAddress dst;
+               // blocks this resolver thread only
+               dst.setFromHostPort(host, port);
+               return dst;
+             })
+      .thenTry([this, key = std::move(key),
+                host](folly::Try<folly::SocketAddress> &&result) {
+        const auto now = Clock::now();
+        std::shared_ptr<folly::SharedPromise<folly::SocketAddress>> lookup;
+        {
+          auto entries = entries_.lock();
+          Entry &entry = (*entries)[key];
+          lookup = std::move(entry.lookup);
+          entry.lookup.reset();
+          if (result.hasValue()) {
+            entry.address = result.value();
+            entry.refresh_at = now + ttl_ / 2;
+            entry.expires = now + ttl_;
+          } else if (entry.address) {
+            LOG(WARNING) << "Cannot refresh address of " << host << " ("
+                         << result.exception().what() << "), keeping "
+                         << entry.address->describe();
+            entry.refresh_at = now + stale_grace;
+            entry.expires = now + 2 * stale_grace;
+            result = folly::Try<folly::SocketAddress>{*entry.address};
+          } else {
+            LOG(ERROR) << "Cannot resolve " << host << ": "
+                       << result.exception().what();
+          }
+        }
+        if (lookup) {
+          lookup->setTry(std::move(result));
+        }
+      });
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
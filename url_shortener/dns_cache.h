@@ -0,0 +1,80 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_DNS_CACHE_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_DNS_CACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <folly/IPAddress.h>
+#include <folly/SocketAddress.h>
+#include <folly/Synchronized.h>
+#include <folly/container/F14Map.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/futures/Future.h>
+#include <folly/futures/SharedPromise.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "app_config.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Resolves the hosts of outbound requests without blocking an IO thread.
+// Lookups go through `getaddrinfo` on threads of their own, and their
+// results are cached for `dns_cache_ttl_seconds` (`getaddrinfo` does not say
+// how long a record may be kept). An entry past half its TTL is still used,
+// but refreshed in the background, so hosts in steady use never wait for a
+// lookup. If a refresh fails, the last address is kept for a while longer.
+//
+// `host_overrides` pins hosts to fixed addresses instead, e.g., a local
+// stand-in for an external service.
+//
+// Shared by all IO threads.
+class DnsCache {
+public:
+  explicit DnsCache(
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config);
+
+  DnsCache(const DnsCache &) = delete;
+  DnsCache &operator=(const DnsCache &) = delete;
+
+  // Ready at once for IP literals, overrides and cached hosts. Concurrent
+  // lookups of the same host share one `getaddrinfo` call.
+  auto resolve(const std::string &host, uint16_t port)
+      -> folly::SemiFuture<folly::SocketAddress>;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Override {
+    folly::IPAddress ip;
+    // the requested port if empty
+    std::optional<uint16_t> port;
+  };
+
+  struct Entry {
+    std::optional<folly::SocketAddress> address;
+    Clock::time_point refresh_at{};
+    Clock::time_point expires{};
+    // set while a lookup is in flight
+    std::shared_ptr<folly::SharedPromise<folly::SocketAddress>> lookup;
+  };
+
+  // Starts a lookup for `key`; `entry.lookup` must be set.
+  void look_up(std::string key, std::string host, uint16_t port);
+
+  const std::chrono::seconds ttl_;
+  folly::F14FastMap<std::string, Override> overrides_;
+  folly::Synchronized<folly::F14NodeMap<std::string, Entry>, std::mutex>
+      entries_;
+  // `getaddrinfo` blocks, so it gets threads of its own rather than tying up
+  // the CPU executor
+  folly::CPUThreadPoolExecutor resolvers_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_DNS_CACHE_H
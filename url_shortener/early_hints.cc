@@ -0,0 +1,212 @@
+#include "early_hints.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+auto ascii_lower(char c) -> char {
+  return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+auto iequals(std::string_view a, std::string_view b) -> bool {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return ascii_lower(x) == ascii_lower(y);
+         });
+}
+
+auto is_space(char c) -> bool {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+// Whether a whitespace-separated list (like `rel`) contains a token.
+auto has_token(std::string_view list, std::string_view token) -> bool {
+  std::size_t i = 0;
+  while (i < list.size()) {
+    while (i < list.size() && is_space(list[i])) {
+      ++i;
+    }
+    std::size_t j = i;
+    while (j < list.size() && !is_space(list[j])) {
+      ++j;
+    }
+    if (j > i && iequals(list.substr(i, j - i), token)) {
+      return true;
+    }
+    i = j;
+  }
+  return false;
+}
+
+struct Attribute {
+  std::string_view name;
+  std::string_view value;
+  bool present{false};
+};
+
+// A start tag, with the few attributes this scanner cares about.
+struct Tag {
+  std::string_view name;
+  Attribute rel, as, href, src, crossorigin, nomodule;
+};
+
+// Parses the start tag at `html[pos]` (just past the '<'). Returns the
+// position after its closing '>', or npos if it is unterminated.
+auto parse_tag(std::string_view html, std::size_t pos, Tag &tag)
+    -> std::size_t {
+  std::size_t i = pos;
+  while (i < html.size() && !is_space(html[i]) && html[i] != '>' &&
+         html[i] != '/') {
+    ++i;
+  }
+  tag.name = html.substr(pos, i - pos);
+  while (i < html.size()) {
+    while (i < html.size() && (is_space(html[i]) || html[i] == '/')) {
+      ++i;
+    }
+    if (i >= html.size()) {
+      break;
+    }
+    if (html[i] == '>') {
+      return i + 1;
+    }
+    std::size_t name_begin = i;
+    while (i < html.size() && !is_space(html[i]) && html[i] != '=' &&
+           html[i] != '>' && html[i] != '/') {
+      ++i;
+    }
+    Attribute attr{html.substr(name_begin, i - name_begin), {}, true};
+    if (i < html.size() && html[i] == '=') {
+      ++i;
+      if (i < html.size() && (html[i] == '"' || html[i] == '\'')) {
+        char quote = html[i++];
+        std::size_t end = html.find(quote, i);
+        if (end == std::string_view::npos) {
+          return std::string_view::npos;
+        }
+        attr.value = html.substr(i, end - i);
+        i = end + 1;
+      } else {
+        std::size_t value_begin = i;
+        while (i < html.size() && !is_space(html[i]) && html[i] != '>') {
+          ++i;
+        }
+        attr.value = html.substr(value_begin, i - value_begin);
+      }
+    }
+    if (iequals(attr.name, "rel")) {
+      tag.rel = attr;
+    } else if (iequals(attr.name, "as")) {
+      tag.as = attr;
+    } else if (iequals(attr.name, "href")) {
+      tag.href = attr;
+    } else if (iequals(attr.name, "src")) {
+      tag.src = attr;
+    } else if (iequals(attr.name, "crossorigin")) {
+      tag.crossorigin = attr;
+    } else if (iequals(attr.name, "nomodule")) {
+      tag.nomodule = attr;
+    }
+  }
+  return std::string_view::npos;
+}
+
+auto same_origin_path(std::string_view url) -> bool {
+  return url.starts_with('/') && !url.starts_with("//");
+}
+
+} // namespace
+
+auto critical_subresources(std::string_view html)
+    -> std::vector<CriticalSubresource> {
+  std::vector<CriticalSubresource> dst;
+  auto add = [&dst](std::string_view path, std::string_view as,
+                    bool crossorigin) {
+    if (!same_origin_path(path) || dst.size() >= max_critical_subresources) {
+      return;
+    }
+    // drop the fragment; the query is part of the resource
+    path = path.substr(0, path.find('#'));
+    if (std::any_of(dst.begin(), dst.end(),
+                    [path](const CriticalSubresource &seen) {
+                      return seen.path == path;
+                    })) {
+      return;
+    }
+    dst.push_back({std::string{path}, std::string{as}, crossorigin});
+  };
+  std::size_t i = 0;
+  while ((i = html.find('<', i)) != std::string_view::npos) {
+    ++i;
+    if (html.substr(i).starts_with("!--")) {
+      auto end = html.find("-->", i);
+      if (end == std::string_view::npos) {
+        break;
+      }
+      i = end + 3;
+      continue;
+    }
+    if (i < html.size() && html[i] == '/') {
+      // end tag: only </head> matters
+      if (iequals(html.substr(i + 1, 4), "head")) {
+        break;
+      }
+      continue;
+    }
+    Tag tag;
+    std::size_t next = parse_tag(html, i, tag);
+    if (next == std::string_view::npos) {
+      break;
+    }
+    i = next;
+    if (iequals(tag.name, "link") && tag.href.present) {
+      if (has_token(tag.rel.value, "stylesheet")) {
+        add(tag.href.value, "style", false);
+      } else if (has_token(tag.rel.value, "preload") && tag.as.present) {
+        // fonts are always fetched in CORS mode, and a preload only matches
+        // a later fetch in the same mode
+        add(tag.href.value, tag.as.value,
+            tag.crossorigin.present || iequals(tag.as.value, "font"));
+      }
+    } else if (iequals(tag.name, "script")) {
+      // nomodule scripts are only for browsers too old to use Early Hints
+      if (tag.src.present && !tag.nomodule.present) {
+        add(tag.src.value, "script", tag.crossorigin.present);
+      }
+      // skip over inline script contents, which may contain '<'
+      auto end = html.find("</script", i);
+      if (end == std::string_view::npos) {
+        break;
+      }
+      i = end + 1;
+    }
+  }
+  return dst;
+}
+
+auto preload_link_header(const std::vector<CriticalSubresource> &subresources)
+    -> std::string {
+  std::string dst;
+  for (const auto &subresource : subresources) {
+    if (!dst.empty()) {
+      dst += ", ";
+    }
+    dst += '<';
+    dst += subresource.path;
+    dst += ">; rel=preload; as=";
+    dst += subresource.as;
+    if (subresource.crossorigin) {
+      dst += "; crossorigin";
+    }
+  }
+  return dst;
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
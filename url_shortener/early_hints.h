@@ -0,0 +1,40 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_EARLY_HINTS_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_EARLY_HINTS_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Hinting more than this per page crowds out the page itself.
+static constexpr std::size_t max_critical_subresources = 16;
+
+// A stylesheet, script, or font a page needs before it can render.
+struct CriticalSubresource {
+  // same-origin absolute path, e.g., "/_next/static/css/a1b2.css"
+  std::string path;
+  // request destination for `Link: rel=preload`, e.g., "style"
+  std::string as;
+  bool crossorigin{false};
+};
+
+// Scans the <head> of an HTML page for its stylesheets, scripts and preloads,
+// in document order and without duplicates. Only same-origin paths are
+// returned; anything from another origin is the page's business. This is a
+// tag scanner for the well-formed output of Next.js, not an HTML parser.
+auto critical_subresources(std::string_view html)
+    -> std::vector<CriticalSubresource>;
+
+// Value of a `Link` header preloading `subresources`, for 103 Early Hints
+// and the final response.
+auto preload_link_header(const std::vector<CriticalSubresource> &subresources)
+    -> std::string;
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_EARLY_HINTS_H
@@ -0,0 +1,35 @@
+#include "frontend_bundle.h"
+
+#include <cstdint>
+
+#ifdef EC_PRV_FRONTEND_BUNDLE_FILE
+// Links the bundle into read-only data, so it is mapped along with the rest
+// of the executable.
+__asm__(".section .rodata\n"
+        ".balign 64\n"
+        ".global ec_prv_frontend_bundle_begin\n"
+        "ec_prv_frontend_bundle_begin:\n"
+        ".incbin \"" EC_PRV_FRONTEND_BUNDLE_FILE "\"\n"
+        ".global ec_prv_frontend_bundle_end\n"
+        "ec_prv_frontend_bundle_end:\n"
+        ".previous\n");
+
+extern "C" const uint8_t ec_prv_frontend_bundle_begin[];
+extern "C" const uint8_t ec_prv_frontend_bundle_end[];
+#endif
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+auto embedded_frontend_bundle() -> folly::ByteRange {
+#ifdef EC_PRV_FRONTEND_BUNDLE_FILE
+  return {ec_prv_frontend_bundle_begin, ec_prv_frontend_bundle_end};
+#else
+  return {};
+#endif
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,24 @@
+#include "file_window.h"
+
+#include <folly/FileUtil.h>
+#include <glog/logging.h>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+auto read_file_window(int fd, std::size_t offset, std::size_t length)
+    -> std::unique_ptr<folly::IOBuf> {
+  auto buf = folly::IOBuf::create(length);
+  auto rc = folly::preadFull(fd, buf->writableData(), length, offset);
+  if (rc < 0 || static_cast<std::size_t>(rc) != length) {
+    VLOG(4) << "file read error: " << rc;
+    return nullptr;
+  }
+  buf->append(rc);
+  return buf;
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
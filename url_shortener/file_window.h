@@ -0,0 +1,30 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_FILE_WINDOW_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_FILE_WINDOW_H
+
+#include <cstddef>
+#include <folly/io/IOBuf.h>
+#include <memory>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Bounds for the adaptive size of the windows in which large files are
+// streamed. Handlers grow the window while the client keeps up and shrink it
+// when egress is paused.
+static constexpr std::size_t min_file_window_size = 64 * 1024;
+static constexpr std::size_t max_file_window_size = 1024 * 1024;
+
+// Positioned read of [offset, offset + length) of a file into a new buffer.
+// Returns nullptr on error or early EOF, e.g., if the file was truncated
+// while it was being served. Large files are read rather than mapped so that
+// a file replaced in place, say during a deploy, fails the one response
+// instead of raising SIGBUS in the whole server. May block on disk I/O, so
+// call this off the event loop.
+auto read_file_window(int fd, std::size_t offset, std::size_t length)
+    -> std::unique_ptr<folly::IOBuf>;
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_FILE_WINDOW_H
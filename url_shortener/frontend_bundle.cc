@@ -0,0 +1,280 @@
+#include "frontend_bundle.h"
+#include "early_hints.h"
+#include "http_caching.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <folly/FileUtil.h>
+#include <glog/logging.h>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+static_assert(std::endian::native == std::endian::little,
+              "frontend bundles are only built and read on little-endian "
+              "hosts");
+
+// Next.js puts content-hashed build output under "_next/static/".
+constexpr std::string_view nextjs_hashed_assets_prefix = "_next/static/";
+
+auto cache_control_for(std::string_view path) -> std::string_view {
+  return path.starts_with(nextjs_hashed_assets_prefix)
+             ? cache_control_immutable
+             : cache_control_revalidate;
+}
+
+auto align_up(std::size_t n) -> std::size_t {
+  return (n + frontend_bundle_alignment - 1) & ~(frontend_bundle_alignment - 1);
+}
+
+// [offset, offset + length) lies within a buffer of `size` bytes
+auto in_bounds(uint64_t offset, uint64_t length, std::size_t size) -> bool {
+  return offset <= size && length <= size - offset;
+}
+
+[[noreturn]] void throw_invalid(const char *what) {
+  throw std::runtime_error{std::string{"invalid frontend bundle: "} + what};
+}
+
+} // namespace
+
+auto FrontendBundle::open(
+    const std::filesystem::path &bundle_path,
+    const ::ec_prv::mime_type::ContentTypes &content_types)
+    -> std::unique_ptr<FrontendBundle> {
+  std::unique_ptr<FrontendBundle> dst{new FrontendBundle{}};
+  dst->mapping_ = std::make_unique<folly::MemoryMapping>(bundle_path.c_str());
+  dst->data_ = dst->mapping_->range();
+  dst->index(content_types);
+  LOG(INFO) << "Mapped frontend bundle " << bundle_path << " ("
+            << dst->entries_.size() << " files, " << dst->data_.size()
+            << " bytes)";
+  return dst;
+}
+
+auto FrontendBundle::from_memory(
+    folly::ByteRange bundle,
+    const ::ec_prv::mime_type::ContentTypes &content_types)
+    -> std::unique_ptr<FrontendBundle> {
+  std::unique_ptr<FrontendBundle> dst{new FrontendBundle{}};
+  dst->data_ = bundle;
+  dst->index(content_types);
+  return dst;
+}
+
+auto FrontendBundle::from_directory(
+    const std::filesystem::path &doc_root,
+    const ::ec_prv::mime_type::ContentTypes &content_types)
+    -> std::unique_ptr<FrontendBundle> {
+  std::unique_ptr<FrontendBundle> dst{new FrontendBundle{}};
+  dst->owned_ = pack_frontend_bundle(doc_root);
+  dst->data_ = folly::ByteRange{folly::StringPiece{dst->owned_}};
+  dst->index(content_types);
+  return dst;
+}
+
+void FrontendBundle::index(
+    const ::ec_prv::mime_type::ContentTypes &content_types) {
+  FrontendBundleHeader header;
+  if (data_.size() < sizeof(header)) {
+    throw_invalid("truncated header");
+  }
+  std::memcpy(&header, data_.data(), sizeof(header));
+  if (std::memcmp(header.magic, frontend_bundle_magic, sizeof(header.magic)) !=
+      0) {
+    throw_invalid("bad magic number");
+  }
+  if (header.version != frontend_bundle_version) {
+    throw_invalid("unsupported version");
+  }
+  if (reinterpret_cast<std::uintptr_t>(data_.data()) %
+          alignof(FrontendBundleEntry) !=
+      0) {
+    throw_invalid("misaligned");
+  }
+  if (!in_bounds(sizeof(header),
+                 uint64_t{header.entry_count} * sizeof(FrontendBundleEntry),
+                 data_.size())) {
+    throw_invalid("truncated index");
+  }
+  const auto *first = reinterpret_cast<const FrontendBundleEntry *>(
+      data_.data() + sizeof(header));
+  entries_ = {first, first + header.entry_count};
+  for (std::size_t i = 0; i < entries_.size(); ++i) {
+    const auto &entry = entries_[i];
+    if (!in_bounds(entry.path_offset, entry.path_length, data_.size()) ||
+        !in_bounds(entry.body_offset, entry.body_length, data_.size()) ||
+        entry.etag_length > sizeof(entry.etag)) {
+      throw_invalid("entry out of bounds");
+    }
+    if (i > 0 && !(path_of(entries_[i - 1]) < path_of(entry))) {
+      throw_invalid("index is not sorted");
+    }
+  }
+  metadata_.clear();
+  metadata_.reserve(entries_.size());
+  for (const auto &entry : entries_) {
+    metadata_.push_back(Metadata{
+        .content_type = std::string{content_types.of(path_of(entry))},
+        .content_length = std::to_string(entry.body_length),
+    });
+  }
+  for (std::size_t i = 0; i < entries_.size(); ++i) {
+    if (metadata_[i].content_type.starts_with("text/html")) {
+      scan_page(entries_[i], metadata_[i]);
+    }
+  }
+}
+
+void FrontendBundle::scan_page(const FrontendBundleEntry &entry,
+                               Metadata &metadata) const {
+  std::vector<CriticalSubresource> subresources = critical_subresources(
+      {reinterpret_cast<const char *>(data_.data() + entry.body_offset),
+       entry.body_length});
+  // A hint for something this server does not have is a wasted request,
+  // probably a 404; leave it to the page.
+  std::erase_if(subresources, [this](const CriticalSubresource &subresource) {
+    std::string_view path = subresource.path;
+    return find_entry(path.substr(1, path.find('?') - 1)) == nullptr;
+  });
+  if (subresources.empty()) {
+    return;
+  }
+  metadata.preload_links = preload_link_header(subresources);
+  for (auto &subresource : subresources) {
+    metadata.critical_subresources.push_back(std::move(subresource.path));
+  }
+  VLOG(1) << "Preloading for \"" << path_of(entry)
+          << "\": " << metadata.preload_links;
+}
+
+auto FrontendBundle::path_of(const FrontendBundleEntry &entry) const
+    -> std::string_view {
+  return {reinterpret_cast<const char *>(data_.data() + entry.path_offset),
+          entry.path_length};
+}
+
+auto FrontendBundle::find_entry(std::string_view path) const
+    -> const FrontendBundleEntry * {
+  auto it = std::lower_bound(
+      entries_.begin(), entries_.end(), path,
+      [this](const FrontendBundleEntry &entry, std::string_view p) {
+        return path_of(entry) < p;
+      });
+  if (it == entries_.end() || path_of(*it) != path) {
+    return nullptr;
+  }
+  return it;
+}
+
+auto FrontendBundle::find(std::string_view path) const
+    -> std::optional<FrontendAsset> {
+  const FrontendBundleEntry *it = find_entry(path);
+  if (it == nullptr) {
+    return std::nullopt;
+  }
+  const Metadata &metadata = metadata_[it - entries_.begin()];
+  return FrontendAsset{
+      .path = path_of(*it),
+      .body = data_.subpiece(it->body_offset, it->body_length),
+      .content_type = metadata.content_type,
+      .content_length = metadata.content_length,
+      .etag = std::string_view{it->etag, it->etag_length},
+      .cache_control = cache_control_for(path),
+      .preload_links = metadata.preload_links,
+      .critical_subresources = {metadata.critical_subresources.data(),
+                                metadata.critical_subresources.size()},
+  };
+}
+
+auto FrontendBundle::find_url(std::string_view url_path) const
+    -> std::optional<FrontendAsset> {
+  if (url_path.empty() || url_path.front() != '/') {
+    return std::nullopt;
+  }
+  if (url_path.back() == '/') {
+    return find(std::string{url_path.substr(1)} + "index.html");
+  }
+  return find(url_path.substr(1));
+}
+
+auto pack_frontend_bundle(const std::filesystem::path &doc_root)
+    -> std::string {
+  struct PackedFile {
+    std::string path;
+    std::string body;
+  };
+  std::vector<PackedFile> files;
+  for (const std::filesystem::directory_entry &dir_entry :
+       std::filesystem::recursive_directory_iterator{doc_root}) {
+    if (!dir_entry.is_regular_file()) {
+      continue;
+    }
+    PackedFile file;
+    file.path =
+        std::filesystem::relative(dir_entry.path(), doc_root).generic_string();
+    if (!folly::readFile(dir_entry.path().c_str(), file.body)) {
+      throw std::system_error{errno, std::generic_category(),
+                              "cannot read " + dir_entry.path().string()};
+    }
+    DLOG(INFO) << "Packing \"" << file.path << "\" (" << file.body.size()
+               << " bytes)";
+    files.push_back(std::move(file));
+  }
+  if (files.size() > std::numeric_limits<uint32_t>::max()) {
+    throw std::length_error{"too many files for a frontend bundle"};
+  }
+  std::sort(files.begin(), files.end(),
+            [](const PackedFile &a, const PackedFile &b) {
+              return a.path < b.path;
+            });
+
+  // lay out the index, then the paths, then the contents
+  std::vector<FrontendBundleEntry> entries(files.size());
+  std::size_t offset = sizeof(FrontendBundleHeader) +
+                       entries.size() * sizeof(FrontendBundleEntry);
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    entries[i].path_offset = offset;
+    entries[i].path_length = files[i].path.size();
+    offset += files[i].path.size();
+  }
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    offset = align_up(offset);
+    entries[i].body_offset = offset;
+    entries[i].body_length = files[i].body.size();
+    offset += files[i].body.size();
+    const std::string etag = strong_etag(folly::ByteRange{
+        folly::StringPiece{files[i].body}});
+    CHECK_LE(etag.size(), sizeof(entries[i].etag));
+    entries[i].etag_length = etag.size();
+    std::memcpy(entries[i].etag, etag.data(), etag.size());
+  }
+
+  std::string dst(offset, '\0');
+  FrontendBundleHeader header;
+  std::memcpy(header.magic, frontend_bundle_magic, sizeof(header.magic));
+  header.version = frontend_bundle_version;
+  header.entry_count = entries.size();
+  std::memcpy(dst.data(), &header, sizeof(header));
+  std::memcpy(dst.data() + sizeof(header), entries.data(),
+              entries.size() * sizeof(FrontendBundleEntry));
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    std::memcpy(dst.data() + entries[i].path_offset, files[i].path.data(),
+                files[i].path.size());
+    std::memcpy(dst.data() + entries[i].body_offset, files[i].body.data(),
+                files[i].body.size());
+  }
+  return dst;
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,152 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_FRONTEND_BUNDLE_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_FRONTEND_BUNDLE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <folly/Range.h>
+#include <folly/system/MemoryMapping.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mime_type/mime_type.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// A frontend bundle is the whole static export of the Next.js frontend packed
+// into one file, built by `pack_frontend`. Its layout, in host byte order:
+//
+//   FrontendBundleHeader
+//   FrontendBundleEntry[entry_count], sorted by path
+//   paths of all files, back to back
+//   contents of all files, each aligned to `frontend_bundle_alignment`
+//
+// Offsets are from the start of the bundle. Serving straight out of a mapping
+// of it costs nothing at startup, and the pages are shared by every process
+// that maps the same file.
+
+static constexpr char frontend_bundle_magic[8] = {'P', 'R', 'V', 'E',
+                                                  'C', 'F', 'E', 'B'};
+static constexpr uint32_t frontend_bundle_version = 1;
+static constexpr std::size_t frontend_bundle_alignment = 64;
+
+struct FrontendBundleHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_count;
+};
+
+struct FrontendBundleEntry {
+  uint64_t path_offset;
+  uint64_t body_offset;
+  uint64_t body_length;
+  uint32_t path_length;
+  uint16_t etag_length;
+  // strong entity tag of the contents, quotes included
+  char etag[34];
+};
+
+static_assert(sizeof(FrontendBundleHeader) == 16);
+static_assert(sizeof(FrontendBundleEntry) == 64);
+
+// A file of the frontend, viewed in place in the bundle, along with its
+// response metadata, all precomputed when the bundle is loaded.
+struct FrontendAsset {
+  // relative to the root of the export, e.g., "_next/static/css/x.css"
+  std::string_view path;
+  folly::ByteRange body;
+  std::string_view content_type;
+  // decimal length of `body`
+  std::string_view content_length;
+  std::string_view etag;
+  std::string_view cache_control;
+  // For HTML pages, the value of a `Link` header preloading the stylesheets,
+  // scripts and fonts in their <head>, or empty
+  std::string_view preload_links;
+  // For HTML pages, the URL paths of those subresources that are in the
+  // bundle, e.g., "/_next/static/css/x.css"
+  folly::Range<const std::string *> critical_subresources;
+};
+
+class FrontendBundle {
+public:
+  // Maps a bundle file. Throws if it cannot be mapped or is not a valid
+  // bundle.
+  static auto open(const std::filesystem::path &bundle_path,
+                   const ::ec_prv::mime_type::ContentTypes &content_types)
+      -> std::unique_ptr<FrontendBundle>;
+
+  // Uses a bundle that is already in memory and outlives the returned object,
+  // i.e., the one embedded in this binary. Throws if it is not a valid bundle.
+  static auto
+  from_memory(folly::ByteRange bundle,
+              const ::ec_prv::mime_type::ContentTypes &content_types)
+      -> std::unique_ptr<FrontendBundle>;
+
+  // Packs and then uses a directory. For development; production servers
+  // should map a bundle built ahead of time.
+  static auto
+  from_directory(const std::filesystem::path &doc_root,
+                 const ::ec_prv::mime_type::ContentTypes &content_types)
+      -> std::unique_ptr<FrontendBundle>;
+
+  // Looks up a file by its path relative to the root of the export. Binary
+  // search; does not allocate.
+  auto find(std::string_view path) const -> std::optional<FrontendAsset>;
+
+  // Looks up the file served at a URL path, e.g., "about/index.html" for
+  // "/about/".
+  auto find_url(std::string_view url_path) const
+      -> std::optional<FrontendAsset>;
+
+  auto size() const -> std::size_t { return entries_.size(); }
+
+private:
+  // Response metadata that is not stored in the bundle, since it depends on
+  // the server's configuration.
+  struct Metadata {
+    std::string content_type;
+    std::string content_length;
+    std::string preload_links;
+    std::vector<std::string> critical_subresources;
+  };
+
+  FrontendBundle() = default;
+
+  // Checks the header, and that every entry lies within `data_` and the
+  // entries are sorted, then computes `metadata_`. Of the file contents, only
+  // the HTML pages are read, once, to find their critical subresources.
+  void index(const ::ec_prv::mime_type::ContentTypes &content_types);
+
+  void scan_page(const FrontendBundleEntry &entry, Metadata &metadata) const;
+
+  auto path_of(const FrontendBundleEntry &entry) const -> std::string_view;
+
+  auto find_entry(std::string_view path) const -> const FrontendBundleEntry *;
+
+  std::unique_ptr<folly::MemoryMapping> mapping_;
+  // only for bundles packed at startup
+  std::string owned_;
+  folly::ByteRange data_;
+  folly::Range<const FrontendBundleEntry *> entries_;
+  // parallel to `entries_`
+  std::vector<Metadata> metadata_;
+};
+
+// Packs the regular files under `doc_root` into a bundle. Throws
+// `std::system_error` if a file cannot be read.
+auto pack_frontend_bundle(const std::filesystem::path &doc_root)
+    -> std::string;
+
+// The bundle linked into this binary (see the `EC_PRV_EMBED_FRONTEND_BUNDLE`
+// CMake option), or an empty range if there is none.
+auto embedded_frontend_bundle() -> folly::ByteRange;
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_FRONTEND_BUNDLE_H
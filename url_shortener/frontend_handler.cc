@@ -1,108 +1,152 @@
 #include "frontend_handler.h"
-#include <filesystem>
+#include "http_caching.h"
 #include <folly/GLog.h>
 #include <folly/io/IOBuf.h>
 #include <optional>
+#include <proxygen/httpserver/PushHandler.h>
 #include <proxygen/httpserver/RequestHandler.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
-#include <stdint.h>
-#include <stdlib.h>
 #include <string>
-#include <sys/stat.h>
+#include <utility>
 
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
 namespace {
 
-auto pop_front_dir(const std::filesystem::path &p) -> std::string {
-  auto path_it = p.begin();
-  ++path_it;
-  std::filesystem::path stripped_path;
-  for (; path_it != p.end(); ++path_it) {
-    stripped_path /= *path_it;
+// Owns a pushed response until proxygen is done with it.
+class FrontendPushHandler : public proxygen::PushHandler {
+public:
+  explicit FrontendPushHandler(
+      std::shared_ptr<const FrontendBundle> frontend_bundle)
+      : frontend_bundle_(std::move(frontend_bundle)) {}
+
+  void requestComplete() noexcept override { delete this; }
+
+  void onError(proxygen::ProxygenError err) noexcept override {
+    DLOG(ERROR) << err;
+    delete this;
   }
-  return stripped_path.string();
-}
 
-} // namespace
+private:
+  // the pushed body is a view into the bundle
+  const std::shared_ptr<const FrontendBundle> frontend_bundle_;
+};
 
-namespace ec_prv {
-namespace url_shortener {
-namespace web {
+} // namespace
 
-std::unique_ptr<folly::F14NodeMap<std::string, std::vector<uint8_t>>>
-build_frontend_dir_cache(const std::filesystem::path &frontend_doc_root) {
-  using cache_t = folly::F14NodeMap<std::string, std::vector<uint8_t>>;
-  std::unique_ptr<cache_t> dst{new cache_t{}};
-  DLOG(INFO) << "building frontend dir cache";
-  for (const std::filesystem::directory_entry &dir_entry :
-       std::filesystem::recursive_directory_iterator{frontend_doc_root}) {
-    if (std::filesystem::is_regular_file(dir_entry.path())) {
-      DLOG(INFO) << "in recursive directory crawl, visting file: "
-                 << dir_entry.path();
-      // read full file into memory
-      auto abspath = std::filesystem::absolute(dir_entry.path());
-      struct stat statbuf;
-      stat(abspath.c_str(), &statbuf);
-      DLOG(INFO) << "Reading \"" << abspath.c_str() << "\" (" << statbuf.st_size
-                 << " bytes) into memory";
-      std::vector<uint8_t> bytes(statbuf.st_size, 0U);
-      std::unique_ptr<FILE, decltype(&fclose)> fh{fopen(abspath.c_str(), "rb"),
-                                                  &fclose};
-      fread(bytes.data(), statbuf.st_size, sizeof(uint8_t), fh.get());
-      auto file_identifier =
-          std::filesystem::relative(abspath, frontend_doc_root).string();
-      DLOG(INFO) << "Storing frontend file in cache as \"" << file_identifier
-                 << "\"";
-      dst->emplace(file_identifier, std::move(bytes));
-    }
+FrontendHandler *
+FrontendHandler::lookup(
+    std::shared_ptr<const FrontendBundle> bundle, std::string_view path,
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *app_state) {
+  std::optional<FrontendAsset> asset = bundle->find_url(path);
+  if (!asset) {
+    return nullptr;
   }
-  return std::move(dst);
+  DLOG(INFO) << "found frontend file " << path;
+  return new FrontendHandler(std::move(bundle), *asset, app_state);
 }
 
-FrontendHandler *FrontendHandler::lookup(
-    const folly::F14NodeMap<std::string, std::vector<uint8_t>> *const c,
-    std::string_view path) {
-  if (path.front() != '/') {
-    return nullptr;
-  }
-  folly::F14NodeMap<std::string, std::vector<uint8_t>>::const_iterator
-      cache_req;
-  if (path.back() == '/') {
-    cache_req = c->find(std::string{path.substr(1)} + "index.html");
-  } else {
-    cache_req = c->find(path.substr(1));
+FrontendHandler::FrontendHandler(
+    std::shared_ptr<const FrontendBundle> frontend_bundle,
+    const FrontendAsset &prefound_data,
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *app_state)
+    : frontend_bundle_(std::move(frontend_bundle)), app_state_(app_state),
+      prefound_data_(prefound_data) {}
+
+auto FrontendHandler::push_critical_subresources(
+    const proxygen::HTTPMessage &request) -> bool {
+  const std::string &host = request.getHeaders().getSingleOrEmpty(
+      proxygen::HTTPHeaderCode::HTTP_HEADER_HOST);
+  if (host.empty()) {
+    return false;
   }
-  if (cache_req == c->end()) {
-    return nullptr;
+  bool pushed = false;
+  for (const std::string &url : prefound_data_->critical_subresources) {
+    std::string_view path = url;
+    std::optional<FrontendAsset> asset =
+        frontend_bundle_->find(path.substr(1, path.find('?') - 1));
+    if (!asset) {
+      continue;
+    }
+    auto *push_handler = new FrontendPushHandler(frontend_bundle_);
+    proxygen::ResponseHandler *push_downstream =
+        downstream_->newPushedResponse(push_handler);
+    if (push_downstream == nullptr) {
+      // not HTTP/2, or the client disabled push or ran out of streams
+      delete push_handler;
+      break;
+    }
+    proxygen::ResponseBuilder(push_downstream).promise(url, host).send();
+    proxygen::ResponseBuilder(push_downstream)
+        .status(200, "OK")
+        .body(folly::IOBuf::wrapBuffer(asset->body))
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
+                asset->content_type)
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_LENGTH,
+                asset->content_length)
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ETAG, asset->etag)
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CACHE_CONTROL,
+                asset->cache_control)
+        .sendWithEOM();
+    pushed = true;
   }
-  DLOG(INFO) << "found frontend file " << path;
-  const std::vector<uint8_t> *data = &cache_req->second;
-  CHECK(data != nullptr);
-  const std::string *cached_filename = &cache_req->first;
-  const auto mime_type = ::ec_prv::mime_type::infer_mime_type(
-      std::string_view{cached_filename->begin(), cached_filename->end()});
-  return new FrontendHandler(c, data, mime_type);
+  return pushed;
 }
 
-FrontendHandler::FrontendHandler(
-    const folly::F14NodeMap<std::string, std::vector<uint8_t>>
-        *const frontend_dir_cache,
-    const std::vector<uint8_t> *const prefound_data,
-    ::ec_prv::mime_type::MimeType mime_type)
-    : frontend_dir_cache_(frontend_dir_cache), prefound_data_(prefound_data),
-      mime_type_(mime_type) {}
+void FrontendHandler::send_early_hints() {
+  proxygen::ResponseBuilder(downstream_)
+      .status(103, "Early Hints")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_LINK,
+              prefound_data_->preload_links)
+      .send();
+}
 
 void FrontendHandler::onRequest(
     std::unique_ptr<proxygen::HTTPMessage> request) noexcept {
   // assuming everything was checked upstream through a shortcut routine
   // `lookup`
-  if (prefound_data_ != nullptr) {
-    auto mime_type_str = ::ec_prv::mime_type::string(mime_type_);
-    proxygen::ResponseBuilder(downstream_)
-        .status(200, "OK")
-        .body(folly::IOBuf::wrapBuffer(prefound_data_->data(),
-                                       prefound_data_->size()))
+  if (prefound_data_) {
+    // the client already has the current version
+    if (if_none_match(request->getHeaders().getSingleOrEmpty(
+                          proxygen::HTTPHeaderCode::HTTP_HEADER_IF_NONE_MATCH),
+                      prefound_data_->etag)) {
+      proxygen::ResponseBuilder(downstream_)
+          .status(304, "Not Modified")
+          .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ETAG,
+                  prefound_data_->etag)
+          .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CACHE_CONTROL,
+                  prefound_data_->cache_control)
+          .sendWithEOM();
+      return;
+    }
+    if (!prefound_data_->preload_links.empty()) {
+      // Hint before the page goes out, so the browser can fetch what the
+      // page needs while it is still receiving the page. Clients older than
+      // HTTP/1.1 do not expect informational responses.
+      bool pushed = app_state_->frontend_server_push &&
+                    push_critical_subresources(*request);
+      if (!pushed && app_state_->frontend_early_hints &&
+          request->getHTTPVersion() >= std::pair<uint8_t, uint8_t>{1, 1}) {
+        send_early_hints();
+      }
+    }
+    proxygen::ResponseBuilder response(downstream_);
+    response.status(200, "OK");
+    if (!prefound_data_->preload_links.empty()) {
+      // also for CDNs, which turn it into Early Hints of their own
+      response.header(proxygen::HTTPHeaderCode::HTTP_HEADER_LINK,
+                      prefound_data_->preload_links);
+    }
+    response.body(folly::IOBuf::wrapBuffer(prefound_data_->body))
         .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
-                mime_type_str)
+                prefound_data_->content_type)
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_LENGTH,
+                prefound_data_->content_length)
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ETAG,
+                prefound_data_->etag)
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CACHE_CONTROL,
+                prefound_data_->cache_control)
         .sendWithEOM();
     return;
   } else {
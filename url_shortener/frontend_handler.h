@@ -1,32 +1,22 @@
 #ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_FRONTEND_HANDLER_H
 #define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_FRONTEND_HANDLER_H
 
-#include "mime_type/mime_type.h"
-#include <filesystem>
-#include <folly/File.h>
+#include "app_config.h"
+#include "frontend_bundle.h"
 #include <folly/Memory.h>
 #include <folly/Range.h>
-#include <folly/container/F14Map.h>
 #include <folly/io/IOBuf.h>
-#include <folly/io/IOBufQueue.h>
 #include <memory>
+#include <optional>
 #include <proxygen/httpserver/RequestHandler.h>
 #include <proxygen/httpserver/ResponseHandler.h>
-#include <stdint.h>
 #include <string>
 #include <string_view>
-#include <vector>
 
 namespace ec_prv {
 namespace url_shortener {
 namespace web {
 
-// Put the entire directory of the frontend in memory for fast GET access.
-std::unique_ptr<folly::F14NodeMap<std::string, std::vector<uint8_t>>>
-build_frontend_dir_cache(const std::filesystem::path &frontend_doc_root);
-
-// TODO(zds): serve files with appropriate mime type
-
 // Specifically designed to serve the static HTML/JS/CSS assets of the
 // frontend for this web service. Specifically designed for serving Next.js
 // static exports:
@@ -34,9 +24,8 @@ build_frontend_dir_cache(const std::filesystem::path &frontend_doc_root);
 class FrontendHandler : public proxygen::RequestHandler {
 public:
   explicit FrontendHandler(
-      const folly::F14NodeMap<std::string, std::vector<uint8_t>>
-          *const frontend_dir_cache)
-      : frontend_dir_cache_(frontend_dir_cache) {}
+      std::shared_ptr<const FrontendBundle> frontend_bundle)
+      : frontend_bundle_(std::move(frontend_bundle)) {}
 
   void
   onRequest(std::unique_ptr<proxygen::HTTPMessage> request) noexcept override;
@@ -56,23 +45,34 @@ public:
   void onEgressResumed() noexcept override;
 
   static FrontendHandler *
-  lookup(const folly::F14NodeMap<std::string, std::vector<uint8_t>> *const c,
-         std::string_view path);
+  lookup(std::shared_ptr<const FrontendBundle> bundle, std::string_view path,
+         const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig
+             *app_state);
 
 private:
-  const folly::F14NodeMap<std::string, std::vector<uint8_t>>
-      *const frontend_dir_cache_;
+  // Keeps the bundle this request started with alive even if the frontend is
+  // reloaded before the response is sent.
+  const std::shared_ptr<const FrontendBundle> frontend_bundle_;
+
+  const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *app_state_{
+      nullptr};
 
   // shortcut where we do half the work upstream
   explicit FrontendHandler(
-      const folly::F14NodeMap<std::string, std::vector<uint8_t>>
-          *const frontend_dir_cache,
-      const std::vector<uint8_t> *const prefound_data,
-      ::ec_prv::mime_type::MimeType mime_type);
+      std::shared_ptr<const FrontendBundle> frontend_bundle,
+      const FrontendAsset &prefound_data,
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *app_state);
+
+  // Pushes the critical subresources of the page over HTTP/2. Returns false
+  // if the client does not accept pushes (or the connection is not HTTP/2).
+  auto push_critical_subresources(const proxygen::HTTPMessage &request)
+      -> bool;
 
-  const std::vector<uint8_t> *const prefound_data_{nullptr};
+  // Sends `103 Early Hints` with the preload links of the page.
+  void send_early_hints();
 
-  ::ec_prv::mime_type::MimeType mime_type_;
+  // views into `frontend_bundle_`
+  const std::optional<FrontendAsset> prefound_data_;
 };
 } // namespace web
 } // namespace url_shortener
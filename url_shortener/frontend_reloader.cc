@@ -0,0 +1,194 @@
+#include "frontend_reloader.h"
+
+#include <cerrno>
+#include <csignal>
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/io/async/EventHandler.h>
+#include <glog/logging.h>
+#include <pthread.h>
+#include <string>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <system_error>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+auto reload_signal_mask() -> sigset_t {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGHUP);
+  return mask;
+}
+
+// Without a trailing separator, so that its parent is the directory it is
+// in and its file name is what events on that directory are named by.
+auto normalize_watched_path(const std::filesystem::path &path)
+    -> std::filesystem::path {
+  std::filesystem::path dst = path.lexically_normal();
+  if (!dst.has_filename() && dst.has_relative_path()) {
+    dst = dst.parent_path();
+  }
+  return dst;
+}
+
+} // namespace
+
+// Calls back whenever a file descriptor (which it owns) is readable.
+class FrontendReloader::ReadableFd : public folly::EventHandler {
+public:
+  ReadableFd(folly::EventBase *evb, int fd,
+             void (FrontendReloader::*callback)(int fd) noexcept,
+             FrontendReloader *reloader)
+      : folly::EventHandler(evb, folly::NetworkSocket::fromFd(fd)),
+        file_(fd, true), callback_(callback), reloader_(reloader) {
+    registerHandler(READ | PERSIST);
+  }
+
+  ~ReadableFd() override { unregisterHandler(); }
+
+  void handlerReady(uint16_t /* events */) noexcept override {
+    (reloader_->*callback_)(file_.fd());
+  }
+
+  auto fd() const -> int { return file_.fd(); }
+
+private:
+  folly::File file_;
+  void (FrontendReloader::*const callback_)(int fd) noexcept;
+  FrontendReloader *const reloader_;
+};
+
+void FrontendReloader::block_reload_signal() {
+  sigset_t mask = reload_signal_mask();
+  int rc = pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+  if (rc != 0) {
+    throw std::system_error{rc, std::generic_category(),
+                            "cannot block SIGHUP"};
+  }
+}
+
+FrontendReloader::FrontendReloader(Loader load,
+                                   std::filesystem::path watched_path)
+    : load_(std::move(load)),
+      watched_path_(normalize_watched_path(watched_path)),
+      current_(std::shared_ptr<const FrontendBundle>{load_()}),
+      thread_("FrontendReload") {
+  thread_.getEventBase()->runInEventBaseThreadAndWait([this] {
+    folly::EventBase *evb = thread_.getEventBase();
+    debounce_ = folly::AsyncTimeout::make(
+        *evb, [this]() noexcept { reload_now(); });
+
+    sigset_t mask = reload_signal_mask();
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd < 0) {
+      PLOG(ERROR) << "cannot reload the frontend on SIGHUP";
+    } else {
+      signal_fd_ = std::make_unique<ReadableFd>(
+          evb, sfd, &FrontendReloader::on_signal, this);
+    }
+
+    if (watched_path_.empty()) {
+      return;
+    }
+    int ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ifd < 0) {
+      PLOG(ERROR) << "cannot watch " << watched_path_ << " for changes";
+      return;
+    }
+    inotify_fd_ = std::make_unique<ReadableFd>(
+        evb, ifd, &FrontendReloader::on_inotify, this);
+    watch_paths();
+  });
+}
+
+FrontendReloader::~FrontendReloader() {
+  thread_.getEventBase()->runInEventBaseThreadAndWait([this] {
+    debounce_.reset();
+    signal_fd_.reset();
+    inotify_fd_.reset();
+  });
+}
+
+void FrontendReloader::reload() {
+  thread_.getEventBase()->runInEventBaseThread([this] { reload_now(); });
+}
+
+void FrontendReloader::reload_now() noexcept {
+  try {
+    std::shared_ptr<const FrontendBundle> next{load_()};
+    const auto num_files = next->size();
+    // handlers still holding the previous bundle keep it alive
+    current_.store(std::move(next), std::memory_order_release);
+    LOG(INFO) << "Reloaded frontend (" << num_files << " files)";
+  } catch (const std::exception &err) {
+    LOG(ERROR) << "Failed to reload frontend; still serving the previous one: "
+               << err.what();
+  }
+  // a directory replaced by a rename is a new inode to watch
+  watch_paths();
+}
+
+void FrontendReloader::watch_paths() {
+  if (!inotify_fd_) {
+    return;
+  }
+  // Watch the parent to see the bundle (or export directory) being replaced,
+  // and an export directory itself to see files in it change. Not recursive:
+  // a Next.js deploy always rewrites the top-level HTML too.
+  auto parent = watched_path_.parent_path();
+  parent_watch_ = inotify_add_watch(inotify_fd_->fd(),
+                                    parent.empty() ? "." : parent.c_str(),
+                                    IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+  if (parent_watch_ < 0) {
+    PLOG(ERROR) << "cannot watch " << parent;
+  }
+  std::error_code ec;
+  if (std::filesystem::is_directory(watched_path_, ec) &&
+      inotify_add_watch(inotify_fd_->fd(), watched_path_.c_str(),
+                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE |
+                            IN_MOVED_FROM) < 0) {
+    PLOG(ERROR) << "cannot watch " << watched_path_;
+  }
+}
+
+void FrontendReloader::on_signal(int fd) noexcept {
+  signalfd_siginfo info;
+  bool received = false;
+  while (folly::readNoInt(fd, &info, sizeof(info)) == sizeof(info)) {
+    received = true;
+  }
+  if (received) {
+    LOG(INFO) << "SIGHUP received; reloading frontend";
+    reload_now();
+  }
+}
+
+void FrontendReloader::on_inotify(int fd) noexcept {
+  alignas(inotify_event) char buf[4096];
+  const std::string watched_name = watched_path_.filename().string();
+  bool changed = false;
+  ssize_t n;
+  while ((n = folly::readNoInt(fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + n;) {
+      const auto *event = reinterpret_cast<const inotify_event *>(p);
+      // events on the parent only matter if they name the watched path
+      if (event->wd != parent_watch_ ||
+          (event->len > 0 && watched_name == event->name)) {
+        changed = true;
+      }
+      p += sizeof(inotify_event) + event->len;
+    }
+  }
+  if (changed) {
+    VLOG(2) << watched_path_ << " changed; reloading frontend soon";
+    debounce_->scheduleTimeout(frontend_reload_debounce);
+  }
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
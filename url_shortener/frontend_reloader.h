@@ -0,0 +1,80 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_FRONTEND_RELOADER_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_FRONTEND_RELOADER_H
+
+#include <chrono>
+#include <filesystem>
+#include <folly/concurrency/AtomicSharedPtr.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <functional>
+#include <memory>
+
+#include "frontend_bundle.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// A deploy writes many files; wait for it to settle before reloading.
+static constexpr std::chrono::milliseconds frontend_reload_debounce{250};
+
+// Publishes the current frontend bundle to request handlers and swaps in a
+// new one, without a restart, on SIGHUP or when the bundle file (or export
+// directory) changes.
+//
+// New bundles are loaded on a thread of their own and published atomically.
+// Handlers hold a reference to the bundle they started with, so its memory
+// stays valid until the last of them finishes, however many reloads happen
+// in between. Deploy bundle files by renaming them into place (as
+// `pack_frontend` does), never by overwriting: a mapping of a truncated file
+// faults.
+class FrontendReloader {
+public:
+  using Loader = std::function<std::unique_ptr<FrontendBundle>()>;
+
+  // Blocks SIGHUP so that it is only received through the reloader. Call this
+  // first thing in `main`, before any thread starts: threads inherit the
+  // mask, and any thread that does not block SIGHUP may be killed by it.
+  static void block_reload_signal();
+
+  // Loads the first bundle, throwing if that fails. Later failures to reload
+  // are logged and keep the current bundle. If `watched_path` is not empty,
+  // changes to it trigger a reload too.
+  FrontendReloader(Loader load, std::filesystem::path watched_path);
+
+  ~FrontendReloader();
+
+  FrontendReloader(const FrontendReloader &) = delete;
+  FrontendReloader &operator=(const FrontendReloader &) = delete;
+
+  auto current() const -> std::shared_ptr<const FrontendBundle> {
+    return current_.load(std::memory_order_acquire);
+  }
+
+  // Reloads in the background. Safe to call from any thread.
+  void reload();
+
+private:
+  class ReadableFd;
+
+  void reload_now() noexcept;
+  void watch_paths();
+  void on_signal(int fd) noexcept;
+  void on_inotify(int fd) noexcept;
+
+  const Loader load_;
+  const std::filesystem::path watched_path_;
+  folly::atomic_shared_ptr<const FrontendBundle> current_;
+  folly::ScopedEventBaseThread thread_;
+  // everything below is only touched on `thread_`
+  std::unique_ptr<ReadableFd> signal_fd_;
+  std::unique_ptr<ReadableFd> inotify_fd_;
+  // watch descriptor of the parent of `watched_path_`
+  int parent_watch_{-1};
+  std::unique_ptr<folly::AsyncTimeout> debounce_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_FRONTEND_RELOADER_H
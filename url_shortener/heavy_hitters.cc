@@ -0,0 +1,202 @@
+#include "heavy_hitters.h"
+
+#include <algorithm>
+#include <folly/GLog.h>
+#include <folly/hash/Hash.h>
+#include <limits>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+auto HeavyHitterLimiter::KeyHash::operator()(const Key &key) const noexcept
+    -> std::size_t {
+  return folly::hash::hash_combine(IPKeyHash{}(key.ip), key.prefix_length);
+}
+
+HeavyHitterLimiter::HeavyHitterLimiter(uint32_t per_address,
+                                       uint32_t per_network,
+                                       std::chrono::seconds window,
+                                       std::size_t max_bytes,
+                                       std::size_t top_k)
+    : per_address_(per_address), per_network_(per_network),
+      window_(std::chrono::duration_cast<RateLimitClock::duration>(window)),
+      width_(std::max<std::size_t>(
+          64, max_bytes / (num_shards * 2 * depth * sizeof(uint32_t)))),
+      top_k_((top_k + num_shards - 1) / num_shards) {
+  for (auto &shard : shards_) {
+    auto locked = shard.locked.lock();
+    locked->current.assign(depth * width_, 0);
+    locked->previous.assign(depth * width_, 0);
+  }
+}
+
+auto HeavyHitterLimiter::network_of(const IPKey &address) -> Key {
+  // IPv4-mapped, i.e., ::ffff:a.b.c.d
+  if (address.hi == 0 && (address.lo >> 32) == 0xffff) {
+    return {{address.hi, address.lo & ~uint64_t{0xff}}, 96 + 24};
+  }
+  return {{address.hi, 0}, 64};
+}
+
+auto HeavyHitterLimiter::admit(const folly::IPAddress &ip,
+                               RateLimitClock::time_point now) -> bool {
+  const IPKey address = IPKey::of(ip);
+  // count both either way, so that the network sees every request
+  bool address_ok = count({address, 128}, now) <= per_address_;
+  bool network_ok = count(network_of(address), now) <= per_network_;
+  return address_ok && network_ok;
+}
+
+auto HeavyHitterLimiter::count(const Key &key, RateLimitClock::time_point now)
+    -> uint32_t {
+  const std::size_t hash = KeyHash{}(key);
+  // the top bits pick the shard; the rest pick a counter in each row
+  static_assert(num_shards == 1 << 4);
+  auto shard = shards_[hash >> 60].locked.lock();
+  rotate(*shard, now);
+
+  const uint32_t h1 = static_cast<uint32_t>(hash);
+  const uint32_t h2 = static_cast<uint32_t>(hash >> 28) | 1;
+  std::array<std::size_t, depth> slots;
+  uint32_t current = std::numeric_limits<uint32_t>::max();
+  uint32_t previous = std::numeric_limits<uint32_t>::max();
+  for (std::size_t row = 0; row < depth; ++row) {
+    slots[row] = row * width_ + (h1 + row * h2) % width_;
+    current = std::min(current, shard->current[slots[row]]);
+    previous = std::min(previous, shard->previous[slots[row]]);
+  }
+  if (current < std::numeric_limits<uint32_t>::max()) {
+    ++current;
+  }
+  // conservative update: only raise the counters that are below the new
+  // estimate, which keeps collisions from inflating other keys' counts
+  for (std::size_t slot : slots) {
+    if (shard->current[slot] < current) {
+      shard->nonzero += shard->current[slot] == 0;
+      shard->current[slot] = current;
+    }
+  }
+  update_top(*shard, key, current);
+
+  // weigh the last window by how much of it still overlaps the sliding one
+  const double elapsed =
+      std::chrono::duration<double>(now - shard->window_start) /
+      std::chrono::duration<double>(window_);
+  return current + static_cast<uint32_t>(previous *
+                                         std::max(0.0, 1.0 - elapsed));
+}
+
+void HeavyHitterLimiter::rotate(Shard &shard,
+                                RateLimitClock::time_point now) const {
+  if (now - shard.window_start < window_) {
+    return;
+  }
+  if (now - shard.window_start >= 2 * window_) {
+    // nothing from the last window overlaps the sliding one
+    std::fill(shard.previous.begin(), shard.previous.end(), 0);
+  } else {
+    std::swap(shard.current, shard.previous);
+  }
+  std::fill(shard.current.begin(), shard.current.end(), 0);
+  shard.nonzero = 0;
+  shard.last_top = std::move(shard.top);
+  shard.top.clear();
+  shard.top_index.clear();
+  shard.window_start = now;
+}
+
+void HeavyHitterLimiter::update_top(Shard &shard, const Key &key,
+                                    uint32_t count) const {
+  if (top_k_ == 0) {
+    return;
+  }
+  if (auto it = shard.top_index.find(key); it != shard.top_index.end()) {
+    // counts only grow, which moves an entry away from the top of a min-heap
+    shard.top[it->second].count = count;
+    sift_down(shard, it->second);
+    return;
+  }
+  if (shard.top.size() < top_k_) {
+    shard.top.push_back({key, count});
+    shard.top_index[key] = shard.top.size() - 1;
+    sift_up(shard, shard.top.size() - 1);
+    return;
+  }
+  // space-saving: a new key displaces the lightest one if it is heavier
+  if (count <= shard.top.front().count) {
+    return;
+  }
+  shard.top_index.erase(shard.top.front().key);
+  shard.top.front() = {key, count};
+  shard.top_index[key] = 0;
+  sift_down(shard, 0);
+}
+
+void HeavyHitterLimiter::sift_up(Shard &shard, std::size_t i) const {
+  while (i > 0) {
+    std::size_t parent = (i - 1) / 2;
+    if (shard.top[parent].count <= shard.top[i].count) {
+      break;
+    }
+    std::swap(shard.top[parent], shard.top[i]);
+    shard.top_index[shard.top[parent].key] = parent;
+    shard.top_index[shard.top[i].key] = i;
+    i = parent;
+  }
+}
+
+void HeavyHitterLimiter::sift_down(Shard &shard, std::size_t i) const {
+  for (;;) {
+    std::size_t lightest = i;
+    for (std::size_t child : {2 * i + 1, 2 * i + 2}) {
+      if (child < shard.top.size() &&
+          shard.top[child].count < shard.top[lightest].count) {
+        lightest = child;
+      }
+    }
+    if (lightest == i) {
+      return;
+    }
+    std::swap(shard.top[lightest], shard.top[i]);
+    shard.top_index[shard.top[lightest].key] = lightest;
+    shard.top_index[shard.top[i].key] = i;
+    i = lightest;
+  }
+}
+
+auto HeavyHitterLimiter::stats() const -> HeavyHitterStats {
+  HeavyHitterStats dst;
+  std::size_t nonzero = 0;
+  std::vector<TopEntry> top;
+  for (const auto &shard : shards_) {
+    auto locked = shard.locked.lock();
+    nonzero += locked->nonzero;
+    top.insert(top.end(), locked->last_top.begin(), locked->last_top.end());
+  }
+  dst.saturation =
+      static_cast<double>(nonzero) / (num_shards * depth * width_);
+  std::sort(top.begin(), top.end(), [](const TopEntry &a, const TopEntry &b) {
+    return a.count > b.count;
+  });
+  for (const TopEntry &entry : top) {
+    folly::ByteArray16 bytes;
+    for (std::size_t i = 0; i < 8; ++i) {
+      bytes[i] = static_cast<uint8_t>(entry.key.ip.hi >> (56 - 8 * i));
+      bytes[i + 8] = static_cast<uint8_t>(entry.key.ip.lo >> (56 - 8 * i));
+    }
+    folly::IPAddressV6 v6{bytes};
+    folly::CIDRNetwork network =
+        v6.isIPv4Mapped()
+            ? folly::CIDRNetwork{v6.createIPv4(),
+                                 static_cast<uint8_t>(
+                                     entry.key.prefix_length - 96)}
+            : folly::CIDRNetwork{v6, entry.key.prefix_length};
+    dst.top.push_back({network, entry.count});
+  }
+  return dst;
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
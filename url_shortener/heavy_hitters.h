@@ -0,0 +1,134 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_HEAVY_HITTERS_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_HEAVY_HITTERS_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <folly/IPAddress.h>
+#include <folly/Synchronized.h>
+#include <folly/container/F14Map.h>
+#include <folly/lang/Align.h>
+#include <mutex>
+#include <vector>
+
+#include "ip_rate_limiter.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// An address or network sending a lot of requests.
+struct HeavyHitter {
+  folly::CIDRNetwork network;
+  // estimated requests over the last window
+  uint64_t requests{0};
+};
+
+struct HeavyHitterStats {
+  // fraction of sketch counters in use; the higher, the more estimates are
+  // inflated by collisions, and the more innocent clients get limited
+  double saturation{0.0};
+  // heaviest first
+  std::vector<HeavyHitter> top;
+};
+
+// Limits requests per address, and per /64 (IPv6) or /24 (IPv4) network, in a
+// fixed amount of memory however many addresses requests come from. For
+// floods from more addresses than `IPRateLimiter` could keep track of.
+//
+// Requests are counted over a sliding window in a count-min sketch, whose
+// estimates are never below the true count, but may be above it once many
+// addresses share its counters. Every request counts, including those over
+// the limit, so a client has to back off for a while before it gets through
+// again. The heaviest addresses and networks of each window are tracked with
+// the space-saving algorithm, fed by the sketch, for reporting.
+//
+// Shared by all IO threads. Addresses and networks are spread over
+// independently locked shards, each with a sketch of its own.
+class HeavyHitterLimiter {
+public:
+  HeavyHitterLimiter(uint32_t per_address, uint32_t per_network,
+                     std::chrono::seconds window, std::size_t max_bytes,
+                     std::size_t top_k);
+
+  HeavyHitterLimiter(const HeavyHitterLimiter &) = delete;
+  HeavyHitterLimiter &operator=(const HeavyHitterLimiter &) = delete;
+
+  // Counts a request from `ip` made at `now` and returns whether neither it
+  // nor its network is over the limit.
+  auto admit(const folly::IPAddress &ip, RateLimitClock::time_point now)
+      -> bool;
+
+  // Saturation of the current windows and the heavy hitters of the last
+  // complete ones.
+  auto stats() const -> HeavyHitterStats;
+
+private:
+  static constexpr std::size_t num_shards = 16;
+  // rows of each sketch; each halves the chance of an estimate being far off
+  static constexpr std::size_t depth = 4;
+
+  // an address, or a network as its masked address and prefix length (of the
+  // IPv4-mapped address, for IPv4)
+  struct Key {
+    IPKey ip;
+    uint8_t prefix_length{128};
+
+    auto operator==(const Key &) const -> bool = default;
+  };
+
+  struct KeyHash {
+    auto operator()(const Key &key) const noexcept -> std::size_t;
+  };
+
+  struct TopEntry {
+    Key key;
+    uint32_t count{0};
+  };
+
+  struct Shard {
+    // `depth` rows of `width_` counters each, for this and the last window
+    std::vector<uint32_t> current;
+    std::vector<uint32_t> previous;
+    std::size_t nonzero{0};
+    RateLimitClock::time_point window_start{};
+    // min-heap by count, and the position of each key in it
+    std::vector<TopEntry> top;
+    folly::F14FastMap<Key, std::size_t, KeyHash> top_index;
+    // `top` as of the end of the last window
+    std::vector<TopEntry> last_top;
+  };
+
+  using LockedShard = folly::Synchronized<Shard, std::mutex>;
+
+  struct alignas(folly::hardware_destructive_interference_size) AlignedShard {
+    LockedShard locked;
+  };
+
+  // the /64 or, for IPv4, /24 an address is in
+  static auto network_of(const IPKey &address) -> Key;
+
+  // Counts a request for `key` and returns its estimated count over the
+  // sliding window.
+  auto count(const Key &key, RateLimitClock::time_point now) -> uint32_t;
+
+  void rotate(Shard &shard, RateLimitClock::time_point now) const;
+  void update_top(Shard &shard, const Key &key, uint32_t count) const;
+  void sift_up(Shard &shard, std::size_t i) const;
+  void sift_down(Shard &shard, std::size_t i) const;
+
+  const uint32_t per_address_;
+  const uint32_t per_network_;
+  const RateLimitClock::duration window_;
+  // counters per row of each sketch
+  const std::size_t width_;
+  // heavy hitters tracked per shard
+  const std::size_t top_k_;
+  std::array<AlignedShard, num_shards> shards_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_HEAVY_HITTERS_H
@@ -0,0 +1,89 @@
+#include "http_caching.h"
+
+#include <folly/Format.h>
+#include <highwayhash/highwayhash.h>
+#include <string>
+#include <string_view>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+// Entity tags only need to change when content changes, so unlike slug
+// generation, the key need not be secret.
+alignas(32) const highwayhash::HHKey etag_key = {
+    0x70727600657461ULL, 0x67732d6b657900ULL, 0x0123456789abcdefULL,
+    0xfedcba9876543210ULL};
+
+auto format_etag(const highwayhash::HHResult128 &digest) -> std::string {
+  return folly::sformat("\"{:016x}{:016x}\"", digest[0], digest[1]);
+}
+
+// Strips a weak validator prefix, since `If-None-Match` uses the weak
+// comparison function (RFC 9110, Section 13.1.2).
+auto opaque_tag(std::string_view tag) -> std::string_view {
+  if (tag.starts_with("W/")) {
+    tag.remove_prefix(2);
+  }
+  return tag;
+}
+
+} // namespace
+
+auto strong_etag(folly::ByteRange content) -> std::string {
+  highwayhash::HHResult128 digest;
+  highwayhash::HHStateT<HH_TARGET_PREFERRED> state(etag_key);
+  highwayhash::HighwayHashT(&state,
+                            reinterpret_cast<const char *>(content.data()),
+                            content.size(), &digest);
+  return format_etag(digest);
+}
+
+auto strong_etag(const folly::IOBuf &content) -> std::string {
+  highwayhash::HighwayHashCatT<HH_TARGET_PREFERRED> cat(etag_key);
+  for (const folly::ByteRange segment : content) {
+    cat.Append(reinterpret_cast<const char *>(segment.data()),
+               segment.size());
+  }
+  highwayhash::HHResult128 digest;
+  cat.Finalize(&digest);
+  return format_etag(digest);
+}
+
+auto if_none_match(std::string_view header_value, std::string_view etag)
+    -> bool {
+  if (etag.empty()) {
+    return false;
+  }
+  while (!header_value.empty()) {
+    auto comma = header_value.find(',');
+    std::string_view candidate = header_value.substr(0, comma);
+    header_value.remove_prefix(
+        comma == std::string_view::npos ? header_value.size() : comma + 1);
+    auto b = candidate.find_first_not_of(" \t");
+    if (b == std::string_view::npos) {
+      continue;
+    }
+    candidate = candidate.substr(b, candidate.find_last_not_of(" \t") - b + 1);
+    if (candidate == "*" || opaque_tag(candidate) == opaque_tag(etag)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+auto if_range(std::string_view header_value, std::string_view etag) -> bool {
+  auto b = header_value.find_first_not_of(" \t");
+  if (b == std::string_view::npos) {
+    return true;
+  }
+  header_value =
+      header_value.substr(b, header_value.find_last_not_of(" \t") - b + 1);
+  // strong comparison (RFC 9110, Section 13.1.5): weak tags never match
+  return !etag.empty() && !etag.starts_with("W/") && header_value == etag;
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
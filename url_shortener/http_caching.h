@@ -0,0 +1,45 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_HTTP_CACHING_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_HTTP_CACHING_H
+
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+#include <string>
+#include <string_view>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// `Cache-Control` for content-addressed assets, i.e., Next.js's hashed
+// filenames under "_next/static/". Their contents never change for a given
+// URL, so browsers and CDNs never have to revalidate them.
+static constexpr std::string_view cache_control_immutable =
+    "public, max-age=31536000, immutable";
+
+// `Cache-Control` for everything else: caches may store the response but must
+// revalidate it (cheaply, with `If-None-Match`) before each reuse.
+static constexpr std::string_view cache_control_revalidate = "no-cache";
+
+// Computes a strong entity tag (quotes included) from a HighwayHash digest of
+// the full contents of an asset.
+auto strong_etag(folly::ByteRange content) -> std::string;
+
+// Same as above, but over an IOBuf chain.
+auto strong_etag(const folly::IOBuf &content) -> std::string;
+
+// Checks an `If-None-Match` request header against the current entity tag of
+// a resource. Returns true if the client's copy is current, i.e., the server
+// should respond with 304 Not Modified.
+auto if_none_match(std::string_view header_value, std::string_view etag)
+    -> bool;
+
+// Checks an `If-Range` request header against the current entity tag of a
+// resource. Returns true if a `Range` in the same request should be honored:
+// there is no `If-Range`, or it names the current representation by its
+// strong entity tag. Dates never match, since no `Last-Modified` is sent.
+auto if_range(std::string_view header_value, std::string_view etag) -> bool;
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_HTTP_CACHING_H
@@ -0,0 +1,169 @@
+#include "http_range.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+auto trim_ows(std::string_view s) -> std::string_view {
+  auto b = s.find_first_not_of(" \t");
+  if (b == std::string_view::npos) {
+    return {};
+  }
+  return s.substr(b, s.find_last_not_of(" \t") - b + 1);
+}
+
+// Positions too large to represent are clamped; they are past the end of any
+// file anyway.
+auto parse_position(std::string_view s) -> std::optional<std::uint64_t> {
+  if (s.empty() ||
+      s.find_first_not_of("0123456789") != std::string_view::npos) {
+    return std::nullopt;
+  }
+  std::uint64_t n = 0;
+  auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), n);
+  if (ec == std::errc::result_out_of_range) {
+    return std::numeric_limits<std::uint64_t>::max();
+  }
+  return n;
+}
+
+} // namespace
+
+auto parse_range_header(std::string_view value, std::size_t size)
+    -> std::optional<std::vector<ContentRange>> {
+  constexpr std::string_view bytes_unit = "bytes=";
+  value = trim_ows(value);
+  if (!value.starts_with(bytes_unit)) {
+    return std::nullopt;
+  }
+  value.remove_prefix(bytes_unit.size());
+
+  std::vector<ContentRange> ranges;
+  std::size_t num_specs = 0;
+  while (!value.empty()) {
+    auto comma = value.find(',');
+    std::string_view spec = trim_ows(value.substr(0, comma));
+    value.remove_prefix(comma == std::string_view::npos ? value.size()
+                                                        : comma + 1);
+    if (spec.empty()) {
+      continue;
+    }
+    if (++num_specs > max_ranges_per_request) {
+      return std::nullopt;
+    }
+    auto dash = spec.find('-');
+    if (dash == std::string_view::npos) {
+      return std::nullopt;
+    }
+    std::string_view first_pos = spec.substr(0, dash);
+    std::string_view last_pos = spec.substr(dash + 1);
+    if (first_pos.empty()) {
+      // suffix range: the last N bytes
+      auto suffix_length = parse_position(last_pos);
+      if (!suffix_length) {
+        return std::nullopt;
+      }
+      if (*suffix_length == 0 || size == 0) {
+        continue; // unsatisfiable
+      }
+      std::size_t length = std::min<std::uint64_t>(*suffix_length, size);
+      ranges.push_back({size - length, length});
+      continue;
+    }
+    auto first = parse_position(first_pos);
+    if (!first) {
+      return std::nullopt;
+    }
+    std::uint64_t last = size == 0 ? 0 : size - 1;
+    if (!last_pos.empty()) {
+      auto requested_last = parse_position(last_pos);
+      if (!requested_last || *requested_last < *first) {
+        return std::nullopt;
+      }
+      last = std::min(last, *requested_last);
+    }
+    if (*first >= size) {
+      continue; // unsatisfiable
+    }
+    ranges.push_back({static_cast<std::size_t>(*first),
+                      static_cast<std::size_t>(last - *first + 1)});
+  }
+  if (num_specs == 0) {
+    return std::nullopt;
+  }
+
+  std::sort(ranges.begin(), ranges.end(),
+            [](const ContentRange &a, const ContentRange &b) {
+              return a.offset < b.offset;
+            });
+  std::vector<ContentRange> merged;
+  for (const auto &range : ranges) {
+    if (!merged.empty() &&
+        range.offset <= merged.back().offset + merged.back().length) {
+      auto end = std::max(merged.back().offset + merged.back().length,
+                          range.offset + range.length);
+      merged.back().length = end - merged.back().offset;
+    } else {
+      merged.push_back(range);
+    }
+  }
+  return merged;
+}
+
+auto content_range(const ContentRange &range, std::size_t size)
+    -> std::string {
+  return "bytes " + std::to_string(range.offset) + "-" +
+         std::to_string(range.offset + range.length - 1) + "/" +
+         std::to_string(size);
+}
+
+auto unsatisfied_content_range(std::size_t size) -> std::string {
+  return "bytes */" + std::to_string(size);
+}
+
+auto multipart_byteranges_content_type(std::string_view boundary)
+    -> std::string {
+  return "multipart/byteranges; boundary=" + std::string{boundary};
+}
+
+auto multipart_part_header(std::string_view boundary,
+                           std::string_view content_type,
+                           const ContentRange &range, std::size_t size)
+    -> std::string {
+  std::string dst = "\r\n--" + std::string{boundary};
+  if (!content_type.empty()) {
+    dst += "\r\nContent-Type: ";
+    dst += content_type;
+  }
+  dst += "\r\nContent-Range: " + content_range(range, size) + "\r\n\r\n";
+  return dst;
+}
+
+auto multipart_closing_delimiter(std::string_view boundary) -> std::string {
+  return "\r\n--" + std::string{boundary} + "--\r\n";
+}
+
+auto multipart_length(std::string_view boundary,
+                      std::string_view content_type,
+                      const std::vector<ContentRange> &ranges,
+                      std::size_t size) -> std::size_t {
+  std::size_t length = multipart_closing_delimiter(boundary).size();
+  for (const auto &range : ranges) {
+    length +=
+        multipart_part_header(boundary, content_type, range, size).size() +
+        range.length;
+  }
+  return length;
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,62 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_HTTP_RANGE_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_HTTP_RANGE_H
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// More ranges than this in one request is abuse, not a media player seeking.
+static constexpr std::size_t max_ranges_per_request = 16;
+
+// A satisfiable byte range of a representation.
+struct ContentRange {
+  std::size_t offset;
+  std::size_t length;
+};
+
+// Parses a `Range` request header for a representation of `size` bytes.
+// Returns nullopt if the header should be ignored (missing, malformed, not in
+// bytes, or too many ranges), in which case the full representation is sent.
+// Returns an empty vector if no range is satisfiable (416). Otherwise,
+// returns the satisfiable ranges, sorted, with overlapping and adjacent
+// ranges merged.
+auto parse_range_header(std::string_view value, std::size_t size)
+    -> std::optional<std::vector<ContentRange>>;
+
+// Value of the `Content-Range` header for a 206 response.
+auto content_range(const ContentRange &range, std::size_t size) -> std::string;
+
+// Value of the `Content-Range` header for a 416 response.
+auto unsatisfied_content_range(std::size_t size) -> std::string;
+
+// For responses with more than one range, the body is a multipart/byteranges
+// payload: each range is preceded by a part header, and the payload ends with
+// a closing delimiter. Part headers carry the `Content-Type` of the full
+// representation, unless it is empty.
+
+auto multipart_byteranges_content_type(std::string_view boundary)
+    -> std::string;
+
+auto multipart_part_header(std::string_view boundary,
+                           std::string_view content_type,
+                           const ContentRange &range, std::size_t size)
+    -> std::string;
+
+auto multipart_closing_delimiter(std::string_view boundary) -> std::string;
+
+// Total length of a multipart/byteranges payload, for `Content-Length`.
+auto multipart_length(std::string_view boundary,
+                      std::string_view content_type,
+                      const std::vector<ContentRange> &ranges,
+                      std::size_t size) -> std::size_t;
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_HTTP_RANGE_H
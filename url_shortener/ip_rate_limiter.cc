@@ -0,0 +1,135 @@
+#include "ip_rate_limiter.h"
+
+#include <algorithm>
+#include <folly/GLog.h>
+#include <folly/hash/Hash.h>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+auto IPKey::of(const folly::IPAddress &ip) noexcept -> IPKey {
+  const folly::IPAddressV6 v6 =
+      ip.isV4() ? ip.asV4().createIPv6() : ip.asV6();
+  const folly::ByteArray16 bytes = v6.toByteArray();
+  IPKey dst;
+  for (std::size_t i = 0; i < 8; ++i) {
+    dst.hi = (dst.hi << 8) | bytes[i];
+    dst.lo = (dst.lo << 8) | bytes[i + 8];
+  }
+  return dst;
+}
+
+auto IPKeyHash::operator()(const IPKey &key) const noexcept -> std::size_t {
+  return folly::hash::hash_128_to_64(key.hi, key.lo);
+}
+
+IPRateLimiter::IPRateLimiter(uint32_t rate, std::chrono::seconds period,
+                             uint32_t burst)
+    : emission_interval_(
+          std::chrono::duration_cast<RateLimitClock::duration>(period) /
+          std::max<uint32_t>(rate, 1)),
+      burst_tolerance_(emission_interval_ *
+                       (std::max<uint32_t>(burst, 1) - 1)) {
+  CHECK_GT(rate, 0u) << "a rate limit of 0 would reject every request";
+}
+
+auto IPRateLimiter::shard_for(const IPKey &key) -> LockedShard & {
+  static_assert(num_shards == 1 << 6);
+  // the high bits pick the shard, leaving the low bits to the map
+  return shards_[IPKeyHash{}(key) >> 58].locked;
+}
+
+void IPRateLimiter::rotate(Shard &shard,
+                           RateLimitClock::time_point now) const {
+  // An entry last touched in the previous generation was set to at most
+  // `burst_tolerance_ + emission_interval_` past its last request, so one
+  // full generation of that length later it has certainly expired.
+  const auto generation = burst_tolerance_ + emission_interval_;
+  if (now - shard.rotated < generation) {
+    return;
+  }
+  if (now - shard.rotated >= 2 * generation) {
+    // idle long enough that both generations have expired
+    shard.current.clear();
+  }
+  std::swap(shard.current, shard.previous);
+  // keeps its capacity for the next generation
+  shard.current.clear();
+  shard.rotated = now;
+}
+
+auto IPRateLimiter::arrival_time(Shard &shard, const IPKey &key,
+                                 RateLimitClock::time_point now) const
+    -> RateLimitClock::time_point {
+  if (auto it = shard.current.find(key); it != shard.current.end()) {
+    return std::max(it->second, now);
+  }
+  if (auto prev = shard.previous.find(key); prev != shard.previous.end()) {
+    const RateLimitClock::time_point tat = std::max(prev->second, now);
+    shard.previous.erase(prev);
+    shard.current.insert_or_assign(key, tat);
+    return tat;
+  }
+  return now;
+}
+
+auto IPRateLimiter::admit(const folly::IPAddress &ip,
+                          RateLimitClock::time_point now) -> bool {
+  const IPKey key = IPKey::of(ip);
+  auto shard = shard_for(key).lock();
+  rotate(*shard, now);
+
+  const RateLimitClock::time_point tat = arrival_time(*shard, key, now);
+  if (tat - now > burst_tolerance_) {
+    shard->current.insert_or_assign(key, tat);
+    return false;
+  }
+  shard->current.insert_or_assign(key, tat + emission_interval_);
+  return true;
+}
+
+auto IPRateLimiter::would_admit(const folly::IPAddress &ip,
+                                RateLimitClock::time_point now) -> bool {
+  const IPKey key = IPKey::of(ip);
+  auto shard = shard_for(key).lock();
+  rotate(*shard, now);
+  return arrival_time(*shard, key, now) - now <= burst_tolerance_;
+}
+
+auto IPRateLimiter::usage(const folly::IPAddress &ip,
+                          RateLimitClock::time_point now) -> double {
+  const IPKey key = IPKey::of(ip);
+  auto shard = shard_for(key).lock();
+  rotate(*shard, now);
+  const auto ahead = arrival_time(*shard, key, now) - now;
+  return std::clamp(
+      std::chrono::duration<double>(ahead) /
+          std::chrono::duration<double>(burst_tolerance_ + emission_interval_),
+      0.0, 1.0);
+}
+
+void IPRateLimiter::charge(const folly::IPAddress &ip,
+                           RateLimitClock::time_point now, uint32_t cost) {
+  const IPKey key = IPKey::of(ip);
+  auto shard = shard_for(key).lock();
+  rotate(*shard, now);
+  // capped as for `admit`, which `rotate` relies on
+  const RateLimitClock::time_point tat = std::min(
+      arrival_time(*shard, key, now) + emission_interval_ * cost,
+      now + burst_tolerance_ + emission_interval_);
+  shard->current.insert_or_assign(key, tat);
+}
+
+auto IPRateLimiter::size() const -> std::size_t {
+  std::size_t dst = 0;
+  for (const auto &shard : shards_) {
+    auto locked = shard.locked.lock();
+    dst += locked->current.size() + locked->previous.size();
+  }
+  return dst;
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
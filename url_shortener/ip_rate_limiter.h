@@ -0,0 +1,121 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_IP_RATE_LIMITER_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_IP_RATE_LIMITER_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <folly/IPAddress.h>
+#include <folly/Synchronized.h>
+#include <folly/chrono/Clock.h>
+#include <folly/container/F14Map.h>
+#include <folly/lang/Align.h>
+#include <mutex>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Rate limiting only needs to know roughly when a request came in. Reading
+// this clock is a load from the vDSO rather than a syscall.
+using RateLimitClock = folly::chrono::coarse_steady_clock;
+
+// An IP address as two integers, IPv4 addresses mapped into IPv6, so that
+// hashing and comparing it is cheap.
+struct IPKey {
+  uint64_t hi{0};
+  uint64_t lo{0};
+
+  static auto of(const folly::IPAddress &ip) noexcept -> IPKey;
+
+  auto operator==(const IPKey &) const -> bool = default;
+};
+
+struct IPKeyHash {
+  auto operator()(const IPKey &key) const noexcept -> std::size_t;
+};
+
+// Limits how often each IP may make a request, with the generic cell rate
+// algorithm: every IP may make `burst` requests at once, and then one every
+// `period / rate`, without the cliff of a fixed window. Each IP costs one
+// timestamp, its theoretical arrival time, which is all the state GCRA needs.
+//
+// Shared by all IO threads. IPs are spread over independently locked shards.
+// An IP that has been idle long enough to have its whole burst back is the
+// same as an IP never seen, so each shard drops such entries as it goes by
+// keeping two generations: entries are moved to the current one whenever
+// they are touched, and the previous one, whose entries have all expired, is
+// dropped at each rotation.
+class IPRateLimiter {
+public:
+  IPRateLimiter(uint32_t rate, std::chrono::seconds period, uint32_t burst);
+
+  IPRateLimiter(const IPRateLimiter &) = delete;
+  IPRateLimiter &operator=(const IPRateLimiter &) = delete;
+
+  // Counts a request from `ip` made at `now` and returns whether it is within
+  // the limit. Requests over the limit are not counted, so a client that backs
+  // off gets through again.
+  auto admit(const folly::IPAddress &ip, RateLimitClock::time_point now)
+      -> bool;
+
+  // Whether a request from `ip` at `now` would be within the limit, without
+  // counting it.
+  auto would_admit(const folly::IPAddress &ip, RateLimitClock::time_point now)
+      -> bool;
+
+  // How much of its burst `ip` has used at `now`, from 0 (all of it left) to
+  // 1 (none). Does not count a request.
+  auto usage(const folly::IPAddress &ip, RateLimitClock::time_point now)
+      -> double;
+
+  // Counts `cost` requests from `ip` at `now`, whether or not they are within
+  // the limit, for when what a request costs is only known once it has been
+  // served. An IP is never charged more than one request past its burst, so
+  // that it can always get through again after one `period / rate`.
+  void charge(const folly::IPAddress &ip, RateLimitClock::time_point now,
+              uint32_t cost);
+
+  // Number of IPs being tracked, for monitoring. Not a snapshot.
+  auto size() const -> std::size_t;
+
+private:
+  static constexpr std::size_t num_shards = 64;
+
+  struct Shard {
+    // theoretical arrival time of the next request from each IP
+    folly::F14FastMap<IPKey, RateLimitClock::time_point, IPKeyHash> current;
+    folly::F14FastMap<IPKey, RateLimitClock::time_point, IPKeyHash> previous;
+    RateLimitClock::time_point rotated{};
+  };
+
+  using LockedShard = folly::Synchronized<Shard, std::mutex>;
+
+  // keeps shards that are locked by different threads off each other's cache
+  // lines
+  struct alignas(folly::hardware_destructive_interference_size) AlignedShard {
+    LockedShard locked;
+  };
+
+  auto shard_for(const IPKey &key) -> LockedShard &;
+
+  // The theoretical arrival time of the next request from `key`, moved to
+  // the current generation if it was in the previous one.
+  auto arrival_time(Shard &shard, const IPKey &key,
+                    RateLimitClock::time_point now) const
+      -> RateLimitClock::time_point;
+
+  // Drops the previous generation if every entry in it has expired.
+  void rotate(Shard &shard, RateLimitClock::time_point now) const;
+
+  // time between requests at the sustained rate
+  const RateLimitClock::duration emission_interval_;
+  // how far ahead of `now` an IP's theoretical arrival time may be
+  const RateLimitClock::duration burst_tolerance_;
+  std::array<AlignedShard, num_shards> shards_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_IP_RATE_LIMITER_H
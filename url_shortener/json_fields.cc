@@ -0,0 +1,401 @@
+#include "json_fields.h"
+
+#include <algorithm>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+auto is_whitespace(char c) -> bool {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+auto hex_digit(char c) -> int {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+auto is_digit(char c) -> bool { return c >= '0' && c <= '9'; }
+
+} // namespace
+
+JsonFieldExtractor::JsonFieldExtractor(
+    std::initializer_list<std::string_view> fields,
+    std::size_t max_value_length)
+    : fields_(fields.begin(), fields.end()),
+      max_value_length_(max_value_length), values_(fields.size()) {
+  for (const std::string &field : fields_) {
+    max_key_length_ = std::max(max_key_length_, field.size());
+  }
+}
+
+auto JsonFieldExtractor::feed(std::string_view bytes) -> Status {
+  if (status_ == Status::invalid || status_ == Status::too_long) {
+    return status_;
+  }
+  for (char c : bytes) {
+    const Status status = step(c);
+    if (status == Status::invalid || status == Status::too_long) {
+      status_ = status;
+      return status_;
+    }
+  }
+  status_ = state_ == State::after_object ? Status::done : Status::more;
+  return status_;
+}
+
+auto JsonFieldExtractor::finish() -> Status {
+  if (status_ == Status::invalid || status_ == Status::too_long) {
+    return status_;
+  }
+  return state_ == State::after_object ? Status::done : Status::invalid;
+}
+
+auto JsonFieldExtractor::step(char c) -> Status {
+  bool closed = false;
+  switch (state_) {
+  case State::before_object:
+    if (is_whitespace(c)) {
+      return Status::more;
+    }
+    if (c == '{') {
+      nesting_.push_back('{');
+      state_ = State::before_key;
+      return Status::more;
+    }
+    return Status::invalid;
+  case State::before_key:
+    if (c == '}') {
+      return end_value(c);
+    }
+    [[fallthrough]];
+  case State::before_next_key:
+    if (is_whitespace(c)) {
+      return Status::more;
+    }
+    if (c == '"') {
+      key_.clear();
+      key_too_long_ = false;
+      state_ = State::key;
+      return Status::more;
+    }
+    return Status::invalid;
+  case State::key: {
+    // only members of the top-level object may be kept
+    const bool top_level = nesting_.size() == 1;
+    if (!string_char(c, top_level && !key_too_long_ ? &key_ : nullptr,
+                     closed)) {
+      return Status::invalid;
+    }
+    if (key_.size() > max_key_length_) {
+      // cannot be one to keep
+      key_too_long_ = true;
+      key_.clear();
+    }
+    if (closed) {
+      field_ = !top_level || key_too_long_
+                   ? fields_.size()
+                   : static_cast<std::size_t>(
+                         std::find(fields_.begin(), fields_.end(), key_) -
+                         fields_.begin());
+      state_ = State::after_key;
+    }
+    return Status::more;
+  }
+  case State::after_key:
+    if (is_whitespace(c)) {
+      return Status::more;
+    }
+    if (c == ':') {
+      state_ = State::before_value;
+      return Status::more;
+    }
+    return Status::invalid;
+  case State::before_element:
+    if (c == ']') {
+      return end_value(c);
+    }
+    [[fallthrough]];
+  case State::before_value:
+    if (is_whitespace(c)) {
+      return Status::more;
+    }
+    return start_value(c);
+  case State::string_value: {
+    const bool kept = field_ < fields_.size();
+    if (!string_char(c, kept ? &value_ : nullptr, closed)) {
+      return Status::invalid;
+    }
+    if (value_.size() > max_value_length_) {
+      return Status::too_long;
+    }
+    if (closed) {
+      if (kept) {
+        values_[field_] = std::move(value_);
+      }
+      value_.clear();
+      state_ = State::after_value;
+    }
+    return Status::more;
+  }
+  case State::literal:
+    if (c != literal_.front()) {
+      return Status::invalid;
+    }
+    literal_.remove_prefix(1);
+    if (literal_.empty()) {
+      state_ = State::after_value;
+    }
+    return Status::more;
+  case State::number_sign:
+    if (c == '0') {
+      state_ = State::number_zero;
+    } else if (is_digit(c)) {
+      state_ = State::number_int;
+    } else {
+      return Status::invalid;
+    }
+    return Status::more;
+  case State::number_int:
+    if (is_digit(c)) {
+      return Status::more;
+    }
+    [[fallthrough]];
+  case State::number_zero:
+    if (c == '.') {
+      state_ = State::number_point;
+      return Status::more;
+    }
+    [[fallthrough]];
+  case State::number_fraction:
+    if (state_ == State::number_fraction && is_digit(c)) {
+      return Status::more;
+    }
+    if (c == 'e' || c == 'E') {
+      state_ = State::number_exponent;
+      return Status::more;
+    }
+    return end_value(c);
+  case State::number_point:
+    if (!is_digit(c)) {
+      return Status::invalid;
+    }
+    state_ = State::number_fraction;
+    return Status::more;
+  case State::number_exponent:
+    if (c == '+' || c == '-') {
+      state_ = State::number_exponent_sign;
+      return Status::more;
+    }
+    [[fallthrough]];
+  case State::number_exponent_sign:
+    if (!is_digit(c)) {
+      return Status::invalid;
+    }
+    state_ = State::number_exponent_digits;
+    return Status::more;
+  case State::number_exponent_digits:
+    if (is_digit(c)) {
+      return Status::more;
+    }
+    return end_value(c);
+  case State::after_value:
+    if (is_whitespace(c)) {
+      return Status::more;
+    }
+    if (c == ',') {
+      state_ = nesting_.back() == '{' ? State::before_next_key
+                                      : State::before_value;
+      return Status::more;
+    }
+    if (c == '}' || c == ']') {
+      return end_value(c);
+    }
+    return Status::invalid;
+  case State::after_object:
+    return is_whitespace(c) ? Status::done : Status::invalid;
+  }
+  return Status::invalid;
+}
+
+auto JsonFieldExtractor::start_value(char c) -> Status {
+  switch (c) {
+  case '"':
+    value_.clear();
+    state_ = State::string_value;
+    return Status::more;
+  case '{':
+  case '[':
+    if (nesting_.size() == max_depth) {
+      return Status::invalid;
+    }
+    nesting_.push_back(c);
+    state_ = c == '{' ? State::before_key : State::before_element;
+    return Status::more;
+  case 't':
+    literal_ = "rue";
+    state_ = State::literal;
+    return Status::more;
+  case 'f':
+    literal_ = "alse";
+    state_ = State::literal;
+    return Status::more;
+  case 'n':
+    literal_ = "ull";
+    state_ = State::literal;
+    return Status::more;
+  case '-':
+    state_ = State::number_sign;
+    return Status::more;
+  case '0':
+    state_ = State::number_zero;
+    return Status::more;
+  default:
+    if (is_digit(c)) {
+      state_ = State::number_int;
+      return Status::more;
+    }
+    return Status::invalid;
+  }
+}
+
+auto JsonFieldExtractor::end_value(char c) -> Status {
+  // whatever ended the value is the next thing in the container
+  if (c == '}' || c == ']') {
+    if (nesting_.back() != (c == '}' ? '{' : '[')) {
+      return Status::invalid;
+    }
+    nesting_.pop_back();
+    if (nesting_.empty()) {
+      state_ = State::after_object;
+      return Status::done;
+    }
+    state_ = State::after_value;
+    return Status::more;
+  }
+  state_ = State::after_value;
+  return step(c);
+}
+
+auto JsonFieldExtractor::string_char(char c, std::string *dst, bool &closed)
+    -> bool {
+  closed = false;
+  if (unicode_digits_ > 0) {
+    const int digit = hex_digit(c);
+    if (digit < 0) {
+      return false;
+    }
+    unicode_ = unicode_ << 4 | static_cast<uint32_t>(digit);
+    if (--unicode_digits_ > 0) {
+      return true;
+    }
+    if (high_surrogate_ != 0) {
+      if (unicode_ < 0xDC00 || unicode_ > 0xDFFF) {
+        return false;
+      }
+      append(dst, 0x10000 + ((high_surrogate_ - 0xD800) << 10) +
+                      (unicode_ - 0xDC00));
+      high_surrogate_ = 0;
+    } else if (unicode_ >= 0xD800 && unicode_ <= 0xDBFF) {
+      high_surrogate_ = unicode_;
+    } else if (unicode_ >= 0xDC00 && unicode_ <= 0xDFFF) {
+      return false;
+    } else {
+      append(dst, unicode_);
+    }
+    return true;
+  }
+  if (escaped_) {
+    escaped_ = false;
+    if (c == 'u') {
+      unicode_digits_ = 4;
+      unicode_ = 0;
+      return true;
+    }
+    if (high_surrogate_ != 0) {
+      return false;
+    }
+    char unescaped;
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+      unescaped = c;
+      break;
+    case 'b':
+      unescaped = '\b';
+      break;
+    case 'f':
+      unescaped = '\f';
+      break;
+    case 'n':
+      unescaped = '\n';
+      break;
+    case 'r':
+      unescaped = '\r';
+      break;
+    case 't':
+      unescaped = '\t';
+      break;
+    default:
+      return false;
+    }
+    if (dst != nullptr) {
+      dst->push_back(unescaped);
+    }
+    return true;
+  }
+  if (c == '\\') {
+    escaped_ = true;
+    return true;
+  }
+  if (high_surrogate_ != 0) {
+    // only the `\u` escape of its low half may follow a high surrogate
+    return false;
+  }
+  if (c == '"') {
+    closed = true;
+    return true;
+  }
+  if (static_cast<unsigned char>(c) < 0x20) {
+    return false;
+  }
+  if (dst != nullptr) {
+    dst->push_back(c);
+  }
+  return true;
+}
+
+void JsonFieldExtractor::append(std::string *dst, uint32_t code_point) {
+  if (dst == nullptr) {
+    return;
+  }
+  if (code_point < 0x80) {
+    dst->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    dst->push_back(static_cast<char>(0xC0 | code_point >> 6));
+    dst->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    dst->push_back(static_cast<char>(0xE0 | code_point >> 12));
+    dst->push_back(static_cast<char>(0x80 | (code_point >> 6 & 0x3F)));
+    dst->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    dst->push_back(static_cast<char>(0xF0 | code_point >> 18));
+    dst->push_back(static_cast<char>(0x80 | (code_point >> 12 & 0x3F)));
+    dst->push_back(static_cast<char>(0x80 | (code_point >> 6 & 0x3F)));
+    dst->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,124 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_JSON_FIELDS_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_JSON_FIELDS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Pulls a few string members out of a JSON object as it arrives, e.g.,
+// `long_url` and `user_captcha_response` of a create request, without
+// building a `folly::dynamic` of it. Every other member is skipped over,
+// whatever its value, and nothing of it is kept; only members of the
+// top-level object count. The whole document is validated all the same.
+// Memory is bounded by the values kept, each at most `max_value_length` bytes
+// once unescaped, and by `max_depth`.
+class JsonFieldExtractor {
+public:
+  // Most objects and arrays a value may be nested in, counting the top-level
+  // object; deeper documents are invalid.
+  static constexpr std::size_t max_depth = 64;
+
+  enum class Status {
+    // the object is not closed yet
+    more,
+    // the object is closed, with nothing but whitespace after it
+    done,
+    invalid,
+    // a value to keep is longer than `max_value_length`
+    too_long,
+  };
+
+  JsonFieldExtractor(std::initializer_list<std::string_view> fields,
+                     std::size_t max_value_length);
+
+  // Parses the next part of the document. Once it returns anything but
+  // `more` or `done`, it returns the same from then on.
+  auto feed(std::string_view bytes) -> Status;
+
+  // At the end of the document; `done` if the object was closed.
+  auto finish() -> Status;
+
+  // The value of the member named `fields[i]`, if it was a string. The last
+  // one wins if a name repeats.
+  auto value(std::size_t i) const -> const std::optional<std::string> & {
+    return values_[i];
+  }
+
+private:
+  enum class State : uint8_t {
+    before_object,
+    // after `{`, where `}` may follow
+    before_key,
+    // after a comma, where `}` may not follow
+    before_next_key,
+    key,
+    after_key,
+    // after `[`, where `]` may follow
+    before_element,
+    // after `:`, or after a comma in an array
+    before_value,
+    string_value,
+    // true, false or null, with `literal_` still to come
+    literal,
+    // after the minus sign of a number
+    number_sign,
+    // after a leading zero, which no digit may follow
+    number_zero,
+    number_int,
+    // after the decimal point
+    number_point,
+    number_fraction,
+    // after `e` or `E`
+    number_exponent,
+    // after the sign of the exponent
+    number_exponent_sign,
+    number_exponent_digits,
+    after_value,
+    after_object,
+  };
+
+  auto step(char c) -> Status;
+  auto start_value(char c) -> Status;
+  // at the end of a value, or of an empty object or array, `c` being the
+  // character after it
+  auto end_value(char c) -> Status;
+  // the character of a string at `c`, unescaping as it goes; false if invalid
+  auto string_char(char c, std::string *dst, bool &closed) -> bool;
+  void append(std::string *dst, uint32_t code_point);
+
+  const std::vector<std::string> fields_;
+  const std::size_t max_value_length_;
+  // of `fields_`; longer keys are not kept
+  std::size_t max_key_length_{0};
+  std::vector<std::optional<std::string>> values_;
+  Status status_{Status::more};
+  State state_{State::before_object};
+  // of the member being read, if it is kept; else `fields_.size()`
+  std::size_t field_{0};
+  std::string key_;
+  bool key_too_long_{false};
+  std::string value_;
+  // `{` or `[` for each object and array the parser is in
+  std::string nesting_;
+  std::string_view literal_;
+  // within a string
+  bool escaped_{false};
+  // hex digits of a `\u` escape still to come, and the code unit so far
+  uint8_t unicode_digits_{0};
+  uint32_t unicode_{0};
+  // a UTF-16 high surrogate waiting for its low half
+  uint32_t high_surrogate_{0};
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_JSON_FIELDS_H
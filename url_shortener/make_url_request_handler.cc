@@ -1,264 +1,173 @@
 #include "make_url_request_handler.h"
 
 #include <chrono>
+#include <folly/Conv.h>
 #include <folly/Format.h>
 #include <folly/Range.h>
 #include <folly/String.h>
 #include <folly/Try.h>
+#include <folly/coro/Task.h>
+#include <folly/coro/WithCancellation.h>
 #include <folly/executors/GlobalExecutor.h>
 #include <folly/executors/ThreadedExecutor.h>
 #include <folly/futures/Future.h>
-#include <folly/io/SocketOptionMap.h>
 #include <folly/io/async/EventBaseManager.h>
-#include <folly/io/async/SSLContext.h>
-#include <folly/io/async/SSLOptions.h>
-#include <folly/json.h>
 #include <glog/logging.h>
 #include <iostream>
+#include <optional>
 #include <proxygen/httpserver/RequestHandler.h>
 #include <proxygen/httpserver/ResponseBuilder.h>
 #include <proxygen/lib/http/HTTPCommonHeaders.h>
 #include <proxygen/lib/http/HTTPMethod.h>
-#include <proxygen/lib/http/session/HTTPUpstreamSession.h>
-#include <proxygen/lib/utils/URL.h>
 #include <variant>
 
-#include "url_shortener/db.h"
-#include "url_shortening.h"
+#include "ddos_protection.h"
+#include "url_canonical.h"
+#include "url_shortener_handler.h"
 
 namespace ec_prv {
 namespace url_shortener {
 namespace web {
 
 MakeUrlRequestHandler::MakeUrlRequestHandler(
-    db::ShortenedUrlsDatabase *db, folly::HHWheelTimer *timer,
-    const app_config::ReadOnlyAppConfig *const ro_app_config,
-    const ::ec_prv::url_shortener::url_shortening::UrlShorteningConfig
-        *const url_shortening_svc)
-    : db_(db), ro_app_config_(ro_app_config), txn_handler_(*this),
-      connector_(this, timer), url_shortening_svc_(url_shortening_svc) {
+    CoalescedCreates *creates, CaptchaVerifier *verifier,
+    ApiKeyring *api_keys, ApiKey *api_key,
+    const app_config::ReadOnlyAppConfig *const ro_app_config)
+    : creates_(creates), verifier_(verifier), api_keys_(api_keys),
+      api_key_(api_key), ro_app_config_(ro_app_config),
+      fields_({"user_captcha_response", "long_url"},
+              ro_app_config->create_max_body_bytes) {
   DLOG(INFO) << "created new request handler for make url";
 }
 
-auto MakeUrlRequestHandler::query_captcha_service(
-    const std::string &captcha_user_response) -> folly::Future<std::string> {
-  // connect
-  folly::SocketAddress addr;
-  proxygen::URL external_service_url{
-      "https://www.google.com/recaptcha/api/siteverify"};
-  // proxygen::URL external_service_url{"https://api.ipify.org/?format=json"};
-  // TODO(zds): this is a synchronous DNS lookup! bad in an event loop!
-  addr.setFromHostPort(external_service_url.getHost(),
-                       external_service_url.getPort());
-  request_headers_to_captcha_service_ =
-      std::make_unique<proxygen::HTTPMessage>();
-  request_headers_to_captcha_service_->setURL(external_service_url.getPath());
-  request_headers_to_captcha_service_->setQueryString(
-      external_service_url.getQuery());
-  request_headers_to_captcha_service_->setMethod(proxygen::HTTPMethod::POST);
-  request_headers_to_captcha_service_->getHeaders().add(
-      proxygen::HTTPHeaderCode::HTTP_HEADER_ORIGIN,
-      /*ro_app_config_->url_shortener_service_base_url*/ "localhost");
-  request_headers_to_captcha_service_->getHeaders().add(
-      proxygen::HTTPHeaderCode::HTTP_HEADER_HOST,
-      external_service_url.getHost());
-  request_headers_to_captcha_service_->getHeaders().add(
-      proxygen::HTTPHeaderCode::HTTP_HEADER_ACCEPT, "application/json");
-  request_headers_to_captcha_service_->getHeaders().add(
-      proxygen::HTTPHeaderCode::HTTP_HEADER_USER_AGENT,
-      ro_app_config_->server_user_agent);
-  request_headers_to_captcha_service_->getHeaders().add(
-      proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
-      "application/x-www-form-urlencoded");
-  request_headers_to_captcha_service_->setHTTPVersion(1, 1);
-
-  auto secret_encoded = folly::uriEscape<std::string>(
-      folly::StringPiece{ro_app_config_->captcha_service_api_key});
-  auto response_encoded =
-      folly::uriEscape<std::string>(folly::StringPiece{captcha_user_response});
-  std::string captcha_service_request_body =
-      folly::sformat("secret={}&response={}", secret_encoded, response_encoded);
-  DLOG(INFO) << "recaptcha request body: " << captcha_service_request_body;
-  request_body_to_captcha_service_ = folly::IOBuf::copyBuffer(
-      captcha_service_request_body.data(), captcha_service_request_body.size());
-  request_headers_to_captcha_service_->getHeaders().add(
-      proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_LENGTH,
-      std::to_string(captcha_service_request_body.size()));
-
-  auto evb = folly::EventBaseManager::get()->getEventBase();
-  // TODO(zds): use a connection pool here
-  const folly::SocketOptionMap opts{{{SOL_SOCKET, SO_REUSEADDR}, 1}};
-  if (external_service_url.isSecure()) {
-    ssl_context_ = std::make_shared<folly::SSLContext>();
-    ssl_context_->setOptions(SSL_OP_NO_COMPRESSION);
-    folly::ssl::setCipherSuites<folly::ssl::SSLCommonOptions>(
-        *ssl_context_.get());
-    ssl_context_->loadTrustedCertificates(
-        ro_app_config_->trusted_certificates_path.c_str());
-    // to do client certs:
-    // ssl_context_->loadCertKeyPairFromFiles(cert_path, key_path);
-    std::list<std::string> next_proto_list;
-    // TODO(zds): do not split this string at runtime
-    folly::splitTo<std::string>(
-        ',', "h2,h2-14,spdy/3.1,spdy/3,http/1.1",
-        std::inserter(next_proto_list, next_proto_list.begin()));
-    ssl_context_->setAdvertisedNextProtocols(next_proto_list);
-    downstream_->pauseIngress();
-    connector_.connectSSL(
-        evb, addr, ssl_context_, nullptr, std::chrono::milliseconds(1000), opts,
-        folly::AsyncSocket::anyAddress(), external_service_url.getHost());
-  } else {
-    downstream_->pauseIngress();
-    connector_.connect(evb, addr, std::chrono::milliseconds(1000), opts);
-  }
-  auto f = captcha_service_result_promise_.getFuture();
-  return f;
-}
-
-void MakeUrlRequestHandler::connectSuccess(
-    proxygen::HTTPUpstreamSession *session) {
-  txn_ = session->newTransaction(&txn_handler_);
-  DLOG(INFO) << "Sending http client request to: "
-             << request_headers_to_captcha_service_->getURL();
-  CHECK(request_headers_to_captcha_service_)
-      << "request headers to captcha service cannot be null";
-  txn_->sendHeaders(*request_headers_to_captcha_service_);
-  request_headers_to_captcha_service_->dumpMessage(google::INFO);
-  if (request_body_to_captcha_service_) {
-    txn_->sendBody(std::move(request_body_to_captcha_service_));
-  }
-  txn_->sendEOM();
-  downstream_->resumeIngress();
-}
-
-void MakeUrlRequestHandler::connectError(
-    const folly::AsyncSocketException &ex) {
-  DLOG(INFO) << "connectError: " << ex;
-  // captcha_service_result_promise_.setException(std::runtime_error{"connectError"});
-  if (client_terminated_) {
-    downstream_->sendAbort();
-  } else {
-    proxygen::ResponseBuilder(downstream_)
-        .status(503, "Bad Gateway")
-        .sendWithEOM();
-    return;
-  }
-}
-
-void MakeUrlRequestHandler::on_captcha_service_detach_transaction() noexcept {
-  DLOG(INFO) << "captcha service detached";
-  txn_ = nullptr;
-  check_for_shutdown();
-}
-
-void MakeUrlRequestHandler::on_captcha_service_EOM(
-    std::unique_ptr<proxygen::HTTPMessage> headers,
-    std::unique_ptr<folly::IOBuf> body) {
-  CHECK(headers) << "headers cannot be null";
-  DLOG(INFO) << "received status code from captcha service: "
-             << headers->getStatusCode();
-  if (headers->getStatusCode() != 200) {
-    LOG(ERROR) << "Received status code " << headers->getStatusCode()
-               << " from captcha service: " << headers->getStatusMessage();
-    captcha_service_result_promise_.setException(std::runtime_error{
-        folly::sformat("received status code: {}", headers->getStatusCode())});
-    return;
-  }
-  if (!body) {
-    LOG(ERROR) << "Received empty body from captcha service";
-    captcha_service_result_promise_.setException(
-        std::runtime_error{"body missing"});
-    return;
-  }
-  auto response_body = body->coalesce();
-  std::string_view response_text{
-      reinterpret_cast<const char *>(response_body.data()),
-      response_body.size()};
-  DLOG(INFO) << "Got from captcha service: " << response_text;
-  captcha_service_result_promise_.setValue(std::string(response_text));
-}
-
-void MakeUrlRequestHandler::on_captcha_service_error(
-    const proxygen::HTTPException &err) noexcept {
-  LOG(ERROR) << "captcha service error: " << err.describe();
-  captcha_service_result_promise_.setException(
-      std::runtime_error{err.describe()});
-}
-
 void MakeUrlRequestHandler::onRequest(
     std::unique_ptr<proxygen::HTTPMessage> request) noexcept {
   DLOG(INFO) << "make url request: onRequest";
   headers_ = std::move(request);
+  client_ip_ = resolve_client_ip(*ro_app_config_, *headers_)
+                   .value_or(headers_->getClientAddress().getIPAddress());
   auto method = headers_->getMethod();
   if (method != proxygen::HTTPMethod::POST &&
       method != proxygen::HTTPMethod::PUT) {
+    responded_ = true;
     proxygen::ResponseBuilder(downstream_)
         .status(405, "Method Not Allowed")
         .sendWithEOM();
     return;
   }
+  const std::string &content_length = headers_->getHeaders().getSingleOrEmpty(
+      proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_LENGTH);
+  if (!content_length.empty() &&
+      folly::tryTo<uint64_t>(content_length).value_or(0) >
+          ro_app_config_->create_max_body_bytes) {
+    send_too_large();
+    return;
+  }
+  if (api_keys_ != nullptr && !api_key_token(*headers_).empty()) {
+    if (api_key_ == nullptr) {
+      VLOG(2) << client_ip_.str() << " sent an unknown API key";
+      responded_ = true;
+      proxygen::ResponseBuilder(downstream_)
+          .status(401, "Unauthorized")
+          .header(proxygen::HTTPHeaderCode::HTTP_HEADER_WWW_AUTHENTICATE,
+                  "Bearer")
+          .sendWithEOM();
+      return;
+    }
+    if (!api_keys_->admit(*api_key_, RateLimitClock::now())) {
+      VLOG(2) << "API key " << api_key_->name << " is over its quota";
+      responded_ = true;
+      proxygen::ResponseBuilder(downstream_)
+          .status(429, "Too Many Requests")
+          .header(proxygen::HTTPHeaderCode::HTTP_HEADER_RETRY_AFTER,
+                  folly::to<std::string>(
+                      std::chrono::ceil<std::chrono::seconds>(
+                          api_key_->emission_interval)
+                          .count()))
+          .sendWithEOM();
+      return;
+    }
+  }
+  if (ro_app_config_->create_deadline_ms > 0) {
+    deadline_ = folly::AsyncTimeout::make(
+        *folly::EventBaseManager::get()->getEventBase(),
+        [this]() noexcept { on_deadline(); });
+    deadline_->scheduleTimeout(
+        std::chrono::milliseconds{ro_app_config_->create_deadline_ms});
+  }
+}
+
+void MakeUrlRequestHandler::on_deadline() noexcept {
+  if (responded_ || client_terminated_) {
+    return;
+  }
+  // this callback belongs to the timeout, which the handler frees with itself
+  // once the response is sent
+  folly::EventBaseManager::get()->getEventBase()->runInLoop(
+      [expired = std::move(deadline_)] {});
+  LOG_EVERY_N(WARNING, 100) << "Request to create a URL from "
+                            << client_ip_.str() << " missed its deadline of "
+                            << ro_app_config_->create_deadline_ms << " ms";
+  // nothing more to answer, so nothing more to verify or store
+  cancellation_.requestCancellation();
+  send_unavailable();
+}
+
+void MakeUrlRequestHandler::send_unavailable() noexcept {
+  responded_ = true;
+  proxygen::ResponseBuilder(downstream_)
+      .status(503, "Service Unavailable")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
+              "*")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_RETRY_AFTER, "5")
+      .sendWithEOM();
+}
+
+void MakeUrlRequestHandler::send_too_large() noexcept {
+  responded_ = true;
+  // the rest of the body is not read; the connection goes with it
+  downstream_->pauseIngress();
+  proxygen::ResponseBuilder(downstream_)
+      .status(413, "Payload Too Large")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
+              "*")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONNECTION, "close")
+      .sendWithEOM();
+}
+
+void MakeUrlRequestHandler::send_bad_request() noexcept {
+  responded_ = true;
+  proxygen::ResponseBuilder(downstream_)
+      .status(400, "Bad Request")
+      .sendWithEOM();
 }
 
 void MakeUrlRequestHandler::onBody(
     std::unique_ptr<folly::IOBuf> body) noexcept {
   DLOG(INFO) << "receive body";
-  if (body_) {
-    body_->appendToChain(std::move(body));
-  } else {
-    body_ = std::move(body);
+  if (responded_ || client_terminated_) {
+    return;
   }
-}
-
-auto MakeUrlRequestHandler::do_shorten_url(const std::string &long_url)
-    -> std::string {
-  std::string generated_short_url;
-  // keep generating slugs until it doesn't collide with previous entries
-  uint8_t nth_try = 1;
-  constexpr uint8_t max_tries = 100; // don't hang forever
-  while (nth_try++ < max_tries) {
-    bool ok = url_shortening_svc_->generate_slug(generated_short_url, long_url,
-                                                 nth_try);
-    LOG_IF(ERROR, !ok) << "what should be a very rare error: ran out of hashes "
-                          "in creating slug for long_url=\""
-                       << long_url << "\"";
-    if (!ok) {
-      // TODO(zds): just default to creating a random string
-      return {};
-    }
-    auto got = db_->get(generated_short_url);
-    if (std::holds_alternative<db::UrlShorteningDbError>(got)) {
-      auto err = std::get_if<db::UrlShorteningDbError>(&got);
-      if (*err == db::UrlShorteningDbError::NotFound) {
-        // not found in database; this generated slug works
-        break;
-      } else {
-        LOG(ERROR) << "database failure";
-        return {};
-      }
-    }
-    auto got_str = std::get_if<std::string>(&got);
-    if (*got_str == "") {
-      // not found in database; this generated slug works
+  body_bytes_ += body->computeChainDataLength();
+  if (body_bytes_ > ro_app_config_->create_max_body_bytes) {
+    send_too_large();
+    return;
+  }
+  for (const folly::ByteRange range : *body) {
+    switch (fields_.feed({reinterpret_cast<const char *>(range.data()),
+                          range.size()})) {
+    case JsonFieldExtractor::Status::invalid:
+      DLOG(INFO) << "body is not a JSON object";
+      downstream_->pauseIngress();
+      send_bad_request();
+      return;
+    case JsonFieldExtractor::Status::too_long:
+      send_too_large();
+      return;
+    default:
       break;
-    } else if (*got_str == long_url) {
-      // already in database
-      // no need to re-insert it
-      return generated_short_url;
     }
-    LOG(WARNING) << "slug generated for \"" << long_url << "\": \""
-                 << generated_short_url
-                 << "\" collides with the slug for an existing entry: \""
-                 << *got_str
-                 << "\". Consider increasing size of the alphabet used (in the "
-                    "app configuration).";
-  }
-  auto err = db_->put(generated_short_url, long_url);
-  if (err) {
-    LOG(ERROR) << "rocksdb errored during insert of: long_url=\"" << long_url
-               << "\", generated_short_url=\"" << generated_short_url << "\"";
-    return {};
   }
-  return generated_short_url;
 }
 
 void MakeUrlRequestHandler::onEOM() noexcept {
@@ -266,11 +175,13 @@ void MakeUrlRequestHandler::onEOM() noexcept {
     DLOG(ERROR) << "client terminated; no need to create requested URL";
     return;
   }
+  if (responded_) {
+    return;
+  }
   if (!headers_) {
     DLOG(ERROR) << "Missing headers; should not happen";
-    proxygen::ResponseBuilder(downstream_)
-        .status(400, "Bad Request")
-        .sendWithEOM();
+    send_bad_request();
+    return;
   }
   DLOG(INFO) << "make url request handler EOM";
   // // parse input
@@ -278,108 +189,127 @@ void MakeUrlRequestHandler::onEOM() noexcept {
   //     headers_->getQueryParam("user_captcha_response");
   // std::string long_url = headers_->getQueryParam("long_url");
 
-  // parse input from request JSON
-  DLOG_IF(WARNING, !body_) << "Body missing";
-  std::string user_captcha_response, long_url;
-  if (body_) {
-    auto body_bytes = body_->coalesce();
-    std::string_view body_str{reinterpret_cast<const char *>(body_bytes.data()),
-                              body_bytes.size()};
-    auto body_json = folly::parseJson(body_str);
-    if (body_json.isObject() && !body_json["user_captcha_response"].isNull() &&
-        !body_json["long_url"].isNull()) {
-      user_captcha_response = body_json["user_captcha_response"].asString();
-      long_url = body_json["long_url"].asString();
-    }
-  } else {
-    proxygen::ResponseBuilder(downstream_)
-        .status(400, "Bad Request")
-        .sendWithEOM();
+  // input from request JSON, parsed as it arrived
+  if (fields_.finish() != JsonFieldExtractor::Status::done) {
+    DLOG(INFO) << "body missing or not a JSON object";
+    send_bad_request();
     return;
   }
-  if (user_captcha_response.length() == 0) {
+  std::string user_captcha_response = fields_.value(0).value_or("");
+  std::string long_url = fields_.value(1).value_or("");
+  if (user_captcha_response.length() == 0 && api_key_ == nullptr) {
     DLOG(INFO) << "`user_captcha_response` parameter missing";
-    proxygen::ResponseBuilder(downstream_)
-        .status(400, "Bad Request")
-        .sendWithEOM();
+    send_bad_request();
     return;
   }
   if (long_url.length() == 0) {
     DLOG(INFO) << "`long_url` parameter missing";
+    send_bad_request();
+    return;
+  }
+  // stored as canonicalized, but verified as sent, which is what a proof of
+  // work is over
+  std::optional<std::string> canonical_url =
+      canonicalize_url(long_url, max_long_url_length);
+  if (!canonical_url) {
+    DLOG(INFO) << "`long_url` is not a valid http(s) URL";
+    send_bad_request();
+    return;
+  }
+  folly::coro::co_withCancellation(
+      cancellation_.getToken(),
+      create(std::move(user_captcha_response), std::move(long_url),
+             std::move(*canonical_url)))
+      .scheduleOn(folly::EventBaseManager::get()->getEventBase())
+      .start();
+}
+
+auto MakeUrlRequestHandler::create(std::string user_captcha_response,
+                                   std::string long_url,
+                                   std::string canonical_url)
+    -> folly::coro::Task<void> {
+  // Cancelled on this thread before the handler is deleted, and resumed on
+  // this thread, so the handler is there whenever the token says it is not
+  // cancelled.
+  const folly::CancellationToken &cancelled =
+      co_await folly::coro::co_current_cancellation_token;
+  if (cancelled.isCancellationRequested()) {
+    // gone before the create got to start
+    co_return;
+  }
+  CoalescedCreates *const creates = creates_;
+  ApiKey *const api_key = api_key_;
+  // a key stands in for the captcha, so its requests go straight to storage
+  folly::Try<bool> verified{true};
+  if (api_key == nullptr) {
+    verified = co_await folly::coro::co_awaitTry(
+        verifier_->verify(user_captcha_response, long_url, client_ip_).semi());
+  }
+  if (cancelled.isCancellationRequested()) {
+    co_return;
+  }
+  if (verified.hasException()) {
+    DLOG(ERROR) << "error in captcha service: "
+                << verified.exception().what();
+    if (verified.exception().is_compatible_with<CaptchaServiceUnavailable>()) {
+      send_unavailable();
+      co_return;
+    }
+    responded_ = true;
+    proxygen::ResponseBuilder(downstream_)
+        .status(500, "Internal Server Error")
+        .header(
+            proxygen::HTTPHeaderCode::HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
+            "*")
+        .sendWithEOM();
+    co_return;
+  }
+  std::string short_url;
+  if (*verified) {
+    // shared with any other request for the same URL in flight
+    folly::Try<std::string> created = co_await folly::coro::co_awaitTry(
+        creates->shorten(canonical_url, cancelled));
+    if (created.hasValue()) {
+      short_url = std::move(*created);
+    }
+  }
+  if (api_key != nullptr && !short_url.empty()) {
+    api_key->record_created();
+  }
+  if (cancelled.isCancellationRequested() || responded_) {
+    co_return;
+  }
+  responded_ = true;
+  if (short_url.empty()) {
+    DLOG(INFO) << "did not create new short url";
     proxygen::ResponseBuilder(downstream_)
         .status(400, "Bad Request")
+        .header(
+            proxygen::HTTPHeaderCode::HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
+            "*")
+        .sendWithEOM();
+  } else {
+    DLOG(INFO) << "created short url slug: " << short_url;
+    proxygen::ResponseBuilder(downstream_)
+        .status(200, "OK")
+        .header(
+            proxygen::HTTPHeaderCode::HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
+            "*")
+        .body(std::move(short_url))
         .sendWithEOM();
-    return;
   }
-  folly::EventBase *evb = folly::EventBaseManager::get()->getEventBase();
-  // Make sure not to close the connection (deleting `this`) while we still need
-  // `this` in this promise/future
-  query_captcha_service(user_captcha_response)
-      .thenValue([](std::string result) {
-        DLOG(INFO) << "in promise thenValue";
-        auto json = folly::parseJson(result);
-        DLOG(INFO) << "parsed json in future";
-        if (json.isObject() && !json["success"].isNull()) {
-          DLOG(INFO) << "parsed result from captcha service";
-          return json["success"].asBool();
-        } else {
-          DLOG(ERROR) << "failed to parse JSON result from captcha service, "
-                         "but got this string from the captcha service: "
-                      << result;
-          throw std::runtime_error{"json parse fail"};
-        }
-        return false;
-      })
-      .via(folly::getGlobalCPUExecutor())
-      .thenValue([this, long_url](bool success) mutable {
-        if (success) {
-          return do_shorten_url(long_url);
-        }
-        return std::string{};
-      })
-      .via(evb)
-      .thenValue([this](std::string &&short_url) mutable {
-        if (short_url.empty()) {
-          DLOG(INFO) << "did not create new short url";
-          proxygen::ResponseBuilder(downstream_)
-              .status(400, "Bad Request")
-              .header(proxygen::HTTPHeaderCode::
-                          HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
-                      "*")
-              .sendWithEOM();
-        } else {
-          DLOG(INFO) << "created short url slug: " << short_url;
-          proxygen::ResponseBuilder(downstream_)
-              .status(200, "OK")
-              .header(proxygen::HTTPHeaderCode::
-                          HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
-                      "*")
-              .body(std::move(short_url))
-              .sendWithEOM();
-        }
-      })
-      .thenError([this](folly::exception_wrapper &&e) mutable {
-        DLOG(ERROR) << "error in captcha service: "
-                    << e.get_exception()->what();
-        proxygen::ResponseBuilder(downstream_)
-            .status(500, "Internal Server Error")
-            .header(proxygen::HTTPHeaderCode::
-                        HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
-                    "*")
-            .sendWithEOM();
-      });
 }
 
 void MakeUrlRequestHandler::requestComplete() noexcept {
   client_terminated_ = true;
+  cancellation_.requestCancellation();
   delete this;
 }
 
 void MakeUrlRequestHandler::onError(proxygen::ProxygenError err) noexcept {
   DLOG(INFO) << "proxygen error: " << err;
   client_terminated_ = true;
-  captcha_service_result_promise_.setException(
-      std::runtime_error{"proxygenError"});
+  cancellation_.requestCancellation();
   delete this;
 }
 
@@ -0,0 +1,32 @@
+// Packs the static export of the Next.js frontend into a single bundle file
+// for `web_server` to map (see `FrontendBundle`).
+//
+//   pack_frontend --input=frontend/nextjs-dist --output=frontend.bundle
+
+#include <folly/FileUtil.h>
+#include <folly/init/Init.h>
+#include <folly/portability/GFlags.h>
+#include <glog/logging.h>
+#include <string>
+
+#include "frontend_bundle.h"
+
+DEFINE_string(input, "", "Directory of the Next.js static export");
+DEFINE_string(output, "", "Path of the bundle file to write");
+
+int main(int argc, char *argv[]) {
+  folly::Init _folly_init{&argc, &argv, true};
+  CHECK(!FLAGS_input.empty()) << "--input is required";
+  CHECK(!FLAGS_output.empty()) << "--output is required";
+
+  const std::string bundle =
+      ::ec_prv::url_shortener::web::pack_frontend_bundle(FLAGS_input);
+  // refuse to write anything the server would reject
+  const auto packed = ::ec_prv::url_shortener::web::FrontendBundle::from_memory(
+      folly::ByteRange{folly::StringPiece{bundle}},
+      ::ec_prv::mime_type::ContentTypes{});
+  folly::writeFileAtomic(FLAGS_output, bundle);
+  LOG(INFO) << "Packed " << packed->size() << " files from " << FLAGS_input
+            << " into " << FLAGS_output << " (" << bundle.size() << " bytes)";
+  return 0;
+}
@@ -0,0 +1,184 @@
+#include "proof_of_work.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <folly/Random.h>
+#include <folly/String.h>
+#include <folly/ssl/OpenSSLHash.h>
+#include <glog/logging.h>
+#include <openssl/crypto.h>
+#include <vector>
+
+#include "ip_rate_limiter.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+constexpr std::string_view challenge_version = "v1";
+// bytes of the HMAC kept in a challenge
+constexpr std::size_t mac_bytes = 16;
+// longer responses cannot be well-formed, so are not worth hashing
+constexpr std::size_t max_response_length = 256;
+
+auto unix_now() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+template <typename T> auto parse_number(std::string_view src, T &dst) -> bool {
+  auto [end, ec] = std::from_chars(src.data(), src.data() + src.size(), dst);
+  return ec == std::errc{} && end == src.data() + src.size() && !src.empty();
+}
+
+auto leading_zero_bits(const std::array<uint8_t, 32> &digest) -> uint32_t {
+  uint32_t dst = 0;
+  for (uint8_t byte : digest) {
+    if (byte != 0) {
+      return dst + std::countl_zero(byte);
+    }
+    dst += 8;
+  }
+  return dst;
+}
+
+} // namespace
+
+ProofOfWorkVerifier::ProofOfWorkVerifier(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config,
+    std::shared_ptr<RateLimitPolicies> rate_limits)
+    : min_difficulty_(std::min<uint32_t>(config.proof_of_work_difficulty, 64)),
+      max_difficulty_(std::clamp<uint32_t>(config.proof_of_work_max_difficulty,
+                                           min_difficulty_, 64)),
+      ttl_(std::max<uint32_t>(config.proof_of_work_ttl_seconds, 1)),
+      rate_limits_(std::move(rate_limits)) {
+  if (config.proof_of_work_secret.empty()) {
+    LOG(WARNING) << "No proof_of_work_secret configured; challenges will not "
+                    "survive a restart or be accepted by other servers";
+    folly::Random::secureRandom(key_.data(), key_.size());
+    return;
+  }
+  std::string key;
+  CHECK(folly::unhexlify(config.proof_of_work_secret, key) &&
+        key.size() == key_.size())
+      << "Fix the configuration entry \"proof_of_work_secret\". Expected 64 "
+         "hex digits; generate it with `openssl rand -hex 32`";
+  std::memcpy(key_.data(), key.data(), key_.size());
+}
+
+auto ProofOfWorkVerifier::sign(std::string_view fields,
+                               const folly::IPAddress &client) const
+    -> std::string {
+  // the same key for an IPv4 address whether or not it arrived mapped
+  const IPKey ip = IPKey::of(client);
+  std::array<uint8_t, 16> ip_bytes;
+  for (std::size_t i = 0; i < 8; ++i) {
+    ip_bytes[i] = ip.hi >> (56 - 8 * i);
+    ip_bytes[i + 8] = ip.lo >> (56 - 8 * i);
+  }
+  std::string message{fields};
+  message += '|';
+  message.append(reinterpret_cast<const char *>(ip_bytes.data()),
+                 ip_bytes.size());
+  std::array<uint8_t, 32> mac;
+  folly::ssl::OpenSSLHash::hmac_sha256(
+      folly::MutableByteRange{mac.data(), mac.size()},
+      folly::ByteRange{key_.data(), key_.size()},
+      folly::ByteRange{folly::StringPiece{message}});
+  return folly::hexlify(folly::ByteRange{mac.data(), mac_bytes});
+}
+
+auto ProofOfWorkVerifier::issue(const folly::IPAddress &client)
+    -> ProofOfWorkChallenge {
+  uint32_t difficulty = min_difficulty_;
+  if (rate_limits_ && max_difficulty_ > min_difficulty_) {
+    const double usage =
+        rate_limits_->usage(RouteClass::create, client, RateLimitClock::now());
+    difficulty += static_cast<uint32_t>(
+        std::lround(usage * (max_difficulty_ - min_difficulty_)));
+  }
+  std::array<uint8_t, 12> nonce;
+  folly::Random::secureRandom(nonce.data(), nonce.size());
+  const int64_t expires = unix_now() + ttl_.count();
+  std::string fields = std::string{challenge_version} + '.' +
+                       std::to_string(difficulty) + '.' +
+                       std::to_string(expires) + '.' +
+                       folly::hexlify(folly::ByteRange{nonce.data(),
+                                                       nonce.size()});
+  std::string mac = sign(fields, client);
+  return ProofOfWorkChallenge{
+      .challenge = fields + '.' + mac,
+      .difficulty = difficulty,
+      .expires = expires,
+  };
+}
+
+auto ProofOfWorkVerifier::check(std::string_view response,
+                                std::string_view long_url,
+                                const folly::IPAddress &client,
+                                int64_t now) const -> bool {
+  if (response.size() > max_response_length) {
+    return false;
+  }
+  // <version>.<difficulty>.<expires>.<nonce>.<mac>:<counter>
+  const auto colon = response.find(':');
+  const auto mac_dot = response.rfind('.', colon);
+  if (colon == std::string_view::npos || mac_dot == std::string_view::npos) {
+    return false;
+  }
+  const std::string_view fields = response.substr(0, mac_dot);
+  const std::string_view mac =
+      response.substr(mac_dot + 1, colon - mac_dot - 1);
+  std::vector<std::string_view> parts;
+  for (std::size_t begin = 0;;) {
+    const auto dot = fields.find('.', begin);
+    parts.push_back(fields.substr(begin, dot - begin));
+    if (dot == std::string_view::npos) {
+      break;
+    }
+    begin = dot + 1;
+  }
+  uint32_t difficulty = 0;
+  int64_t expires = 0;
+  uint64_t counter = 0;
+  if (parts.size() != 4 || parts[0] != challenge_version ||
+      !parse_number(parts[1], difficulty) ||
+      !parse_number(parts[2], expires) ||
+      !parse_number(response.substr(colon + 1), counter)) {
+    return false;
+  }
+  if (now > expires) {
+    VLOG(2) << "proof of work challenge expired";
+    return false;
+  }
+  const std::string expected = sign(fields, client);
+  if (mac.size() != expected.size() ||
+      CRYPTO_memcmp(mac.data(), expected.data(), expected.size()) != 0) {
+    VLOG(2) << "proof of work challenge was not issued to " << client.str();
+    return false;
+  }
+  std::string solution{response};
+  solution += ':';
+  solution += long_url;
+  std::array<uint8_t, 32> digest;
+  folly::ssl::OpenSSLHash::sha256(
+      folly::MutableByteRange{digest.data(), digest.size()},
+      folly::ByteRange{folly::StringPiece{solution}});
+  return leading_zero_bits(digest) >= difficulty;
+}
+
+auto ProofOfWorkVerifier::verify(std::string_view response,
+                                 std::string_view long_url,
+                                 const folly::IPAddress &client)
+    -> folly::Future<bool> {
+  return folly::makeFuture(check(response, long_url, client, unix_now()));
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,80 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_PROOF_OF_WORK_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_PROOF_OF_WORK_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <folly/IPAddress.h>
+#include <folly/futures/Future.h>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "app_config.h"
+#include "captcha_verifier.h"
+#include "rate_limit_policy.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// A challenge for a client to solve before it may shorten a URL.
+struct ProofOfWorkChallenge {
+  std::string challenge;
+  // leading zero bits the solution's hash needs
+  uint32_t difficulty;
+  // Unix time after which solutions are refused
+  int64_t expires;
+};
+
+// Verifies proofs of work instead of asking an external service, so that a
+// create costs a couple of hashes rather than a round trip.
+//
+// A challenge is "v1.<difficulty>.<expires>.<nonce>.<mac>", where <mac> is an
+// HMAC of the rest and of the client's IP under a key only this server
+// knows, so nothing needs to be kept per challenge. The client solves it by
+// finding a <counter> such that
+//
+//   SHA-256(<challenge> ":" <counter> ":" <long URL>)
+//
+// starts with <difficulty> zero bits, and sends "<challenge>:<counter>" as its
+// `user_captcha_response`. A solution is only good for the URL it was found
+// for, and replaying it shortens that URL to the slug it already has. For a
+// batch, the long URL is the digest of its body (see `CreateBatchHandler`).
+//
+// Clients who are using up their rate limit for creating URLs get harder
+// challenges, up to `proof_of_work_max_difficulty` bits.
+class ProofOfWorkVerifier : public CaptchaVerifier {
+public:
+  // Uses `proof_of_work_secret` as the key, or a random one if it is not
+  // set. `rate_limits` may be null.
+  ProofOfWorkVerifier(
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config,
+      std::shared_ptr<RateLimitPolicies> rate_limits);
+
+  auto issue(const folly::IPAddress &client) -> ProofOfWorkChallenge;
+
+  // Ready at once.
+  auto verify(std::string_view response, std::string_view long_url,
+              const folly::IPAddress &client) -> folly::Future<bool> override;
+
+  // `now` in Unix time.
+  auto check(std::string_view response, std::string_view long_url,
+             const folly::IPAddress &client, int64_t now) const -> bool;
+
+private:
+  // hex HMAC of a challenge's other fields for a client
+  auto sign(std::string_view fields, const folly::IPAddress &client) const
+      -> std::string;
+
+  std::array<uint8_t, 32> key_;
+  const uint32_t min_difficulty_;
+  const uint32_t max_difficulty_;
+  const std::chrono::seconds ttl_;
+  const std::shared_ptr<RateLimitPolicies> rate_limits_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_PROOF_OF_WORK_H
@@ -0,0 +1,124 @@
+#include "rate_limit_policy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <folly/GLog.h>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+RateLimitPolicies::RateLimitPolicies(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config) {
+  std::vector<::ec_prv::url_shortener::app_config::RateLimitPolicyConfig>
+      policies = config.rate_limits;
+  if (policies.empty()) {
+    policies.push_back({.route = "create",
+                        .per_minute = config.rate_limit_per_minute,
+                        .burst = config.rate_limit_burst});
+  }
+  const auto num_limited =
+      std::count_if(policies.begin(), policies.end(),
+                    [](const auto &policy) { return policy.per_minute > 0; });
+  for (const auto &policy : policies) {
+    auto route = route_class_from_string(policy.route);
+    CHECK(route.has_value())
+        << "Fix the configuration entry \"rate_limits\". Unknown route \""
+        << policy.route
+        << "\"; expected one of frontend, static, create, redirect, "
+           "challenge, other";
+    std::unique_ptr<IPRateLimiter> limiter;
+    std::unique_ptr<HeavyHitterLimiter> sketch;
+    if (policy.per_minute > 0 && config.rate_limit_sketch) {
+      sketch = std::make_unique<HeavyHitterLimiter>(
+          policy.per_minute,
+          policy.per_minute * config.rate_limit_network_multiplier,
+          std::chrono::minutes{1}, config.rate_limit_sketch_bytes / num_limited,
+          config.rate_limit_top_k);
+    } else if (policy.per_minute > 0) {
+      limiter = std::make_unique<IPRateLimiter>(
+          policy.per_minute, std::chrono::minutes{1},
+          policy.burst != 0 ? policy.burst : policy.per_minute);
+    }
+    std::string name = policy.route;
+    if (!policy.cidrs.empty()) {
+      name += " (for some networks)";
+    }
+    LOG(INFO) << "Rate limiting route " << name << " to "
+              << (policy.per_minute > 0 ? std::to_string(policy.per_minute)
+                                        : std::string{"unlimited"})
+              << " requests per minute";
+    by_route_[static_cast<std::size_t>(*route)].push_back(
+        Policy{std::move(name),
+               ::ec_prv::url_shortener::app_config::CidrSet{policy.cidrs},
+               std::move(limiter), std::move(sketch)});
+  }
+  for (auto &route_policies : by_route_) {
+    std::stable_partition(
+        route_policies.begin(), route_policies.end(),
+        [](const Policy &policy) { return !policy.networks.empty(); });
+  }
+  if (config.rate_limit_sketch) {
+    reporter_.addFunction([this] { log_heavy_hitters(); },
+                          std::chrono::minutes{1}, "heavy hitters");
+    reporter_.start();
+  }
+}
+
+RateLimitPolicies::~RateLimitPolicies() { reporter_.shutdown(); }
+
+void RateLimitPolicies::log_heavy_hitters() const {
+  for (const auto &route_policies : by_route_) {
+    for (const Policy &policy : route_policies) {
+      if (!policy.sketch) {
+        continue;
+      }
+      HeavyHitterStats stats = policy.sketch->stats();
+      LOG_IF(WARNING, stats.saturation > 0.5)
+          << "Rate limit sketch for route " << policy.name << " is "
+          << static_cast<int>(stats.saturation * 100)
+          << "% full; raise rate_limit_sketch_bytes to limit fewer innocent "
+             "clients";
+      if (stats.top.empty()) {
+        continue;
+      }
+      std::string top;
+      for (const HeavyHitter &hitter : stats.top) {
+        top += folly::IPAddress::networkToString(hitter.network);
+        top += '=';
+        top += std::to_string(hitter.requests);
+        top += ' ';
+      }
+      LOG(INFO) << "Heaviest clients of route " << policy.name
+                << " last minute (saturation "
+                << static_cast<int>(stats.saturation * 100) << "%): " << top;
+    }
+  }
+}
+
+auto RateLimitPolicies::admit(RouteClass route, const folly::IPAddress &ip,
+                              RateLimitClock::time_point now) -> bool {
+  for (Policy &policy : by_route_[static_cast<std::size_t>(route)]) {
+    if (policy.networks.empty() || policy.networks.contains(ip)) {
+      if (policy.sketch) {
+        return policy.sketch->admit(ip, now);
+      }
+      return policy.limiter == nullptr || policy.limiter->admit(ip, now);
+    }
+  }
+  return true;
+}
+
+auto RateLimitPolicies::usage(RouteClass route, const folly::IPAddress &ip,
+                              RateLimitClock::time_point now) -> double {
+  for (Policy &policy : by_route_[static_cast<std::size_t>(route)]) {
+    if (policy.networks.empty() || policy.networks.contains(ip)) {
+      return policy.limiter != nullptr ? policy.limiter->usage(ip, now) : 0.0;
+    }
+  }
+  return 0.0;
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
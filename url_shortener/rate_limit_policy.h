@@ -0,0 +1,80 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_RATE_LIMIT_POLICY_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_RATE_LIMIT_POLICY_H
+
+#include <array>
+#include <folly/IPAddress.h>
+#include <folly/experimental/FunctionScheduler.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "app_config.h"
+#include "heavy_hitters.h"
+#include "ip_rate_limiter.h"
+#include "route_class.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// The rate limits configured per route class (see `rate_limits` in the app
+// configuration). Each policy limits every IP it applies to with a token
+// bucket of its own; a policy scoped to CIDRs takes precedence over the
+// route's default for clients in them. Routes without a policy are not
+// limited.
+//
+// With `rate_limit_sketch`, policies count requests in fixed memory instead
+// (see `HeavyHitterLimiter`), and the heaviest clients of each are logged
+// every minute.
+class RateLimitPolicies {
+public:
+  // Falls back to limiting only URL creation, at `rate_limit_per_minute`, if
+  // no policies are configured. Fails a CHECK on an unknown route class.
+  explicit RateLimitPolicies(
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig &config);
+
+  ~RateLimitPolicies();
+
+  RateLimitPolicies(const RateLimitPolicies &) = delete;
+  RateLimitPolicies &operator=(const RateLimitPolicies &) = delete;
+
+  // Whether any policy applies to the route. If not, there is no need to
+  // work out who the client is.
+  auto limits(RouteClass route) const -> bool {
+    return !by_route_[static_cast<std::size_t>(route)].empty();
+  }
+
+  // Counts a request from `ip` to the route against the first policy that
+  // applies to it, and returns whether it is within that policy's limit.
+  auto admit(RouteClass route, const folly::IPAddress &ip,
+             RateLimitClock::time_point now) -> bool;
+
+  // How close `ip` is to the limit of the first policy for the route that
+  // applies to it, from 0 to 1, without counting a request; 0 if it is not
+  // limited. Only known for per-IP limits, not with `rate_limit_sketch`.
+  auto usage(RouteClass route, const folly::IPAddress &ip,
+             RateLimitClock::time_point now) -> double;
+
+private:
+  struct Policy {
+    // for logs
+    std::string name;
+    // empty for the route's default
+    ::ec_prv::url_shortener::app_config::CidrSet networks;
+    // at most one of these; neither for no limit
+    std::unique_ptr<IPRateLimiter> limiter;
+    std::unique_ptr<HeavyHitterLimiter> sketch;
+  };
+
+  void log_heavy_hitters() const;
+
+  // CIDR-scoped policies first, in configuration order
+  std::array<std::vector<Policy>, num_route_classes> by_route_;
+  // only runs with `rate_limit_sketch`
+  folly::FunctionScheduler reporter_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_RATE_LIMIT_POLICY_H
@@ -0,0 +1,40 @@
+#include "redirect_costs.h"
+
+#include <folly/GLog.h>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+RedirectCosts::RedirectCosts(
+    const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *config,
+    std::shared_ptr<BanList> bans)
+    : config_(config), bans_(std::move(bans)),
+      budget_(config->redirect_cost_per_minute, std::chrono::minutes{1},
+              config->redirect_cost_burst != 0
+                  ? config->redirect_cost_burst
+                  : config->redirect_cost_per_minute) {}
+
+auto RedirectCosts::admit(const folly::IPAddress &ip,
+                          RateLimitClock::time_point now) -> bool {
+  if (config_->ip_allow_list.contains(ip) || budget_.would_admit(ip, now)) {
+    return true;
+  }
+  VLOG(2) << ip.str() << " has spent its budget for redirect lookups";
+  bans_->strike(ip, now);
+  return false;
+}
+
+void RedirectCosts::charge(const folly::IPAddress &ip,
+                           RateLimitClock::time_point now, bool found) {
+  if (config_->ip_allow_list.contains(ip)) {
+    return;
+  }
+  budget_.charge(ip, now,
+                 found ? config_->redirect_hit_cost
+                       : config_->redirect_miss_cost);
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
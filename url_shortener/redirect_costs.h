@@ -0,0 +1,50 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_REDIRECT_COSTS_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_REDIRECT_COSTS_H
+
+#include <cstdint>
+#include <folly/IPAddress.h>
+#include <memory>
+
+#include "app_config.h"
+#include "connection_guard.h"
+#include "ip_rate_limiter.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Budgets each client's redirect lookups by what they cost: a lookup of a
+// slug that does not exist costs `redirect_miss_cost`, one that does
+// `redirect_hit_cost`. Bots guessing slugs mostly miss, so they run out long
+// before anyone following real links does, and are then turned away before
+// their lookups reach the database.
+//
+// Shared by all IO threads.
+class RedirectCosts {
+public:
+  // `bans` is struck whenever a client is turned away.
+  RedirectCosts(
+      const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *config,
+      std::shared_ptr<BanList> bans);
+
+  RedirectCosts(const RedirectCosts &) = delete;
+  RedirectCosts &operator=(const RedirectCosts &) = delete;
+
+  // Whether `ip` has budget left for another lookup. Does not charge it.
+  auto admit(const folly::IPAddress &ip, RateLimitClock::time_point now)
+      -> bool;
+
+  // Charges `ip` for a lookup, by whether the slug was found.
+  void charge(const folly::IPAddress &ip, RateLimitClock::time_point now,
+              bool found);
+
+private:
+  const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig *const config_;
+  const std::shared_ptr<BanList> bans_;
+  IPRateLimiter budget_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_REDIRECT_COSTS_H
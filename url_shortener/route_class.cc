@@ -0,0 +1,69 @@
+#include "route_class.h"
+#include "url_shortening.h"
+
+#include <array>
+#include <utility>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+constexpr std::array<std::string_view, num_route_classes> route_class_names = {
+    "frontend", "static", "create", "redirect", "challenge", "other"};
+
+} // namespace
+
+auto to_string(RouteClass route) -> std::string_view {
+  return route_class_names[static_cast<std::size_t>(route)];
+}
+
+auto route_class_from_string(std::string_view name)
+    -> std::optional<RouteClass> {
+  for (std::size_t i = 0; i < route_class_names.size(); ++i) {
+    if (route_class_names[i] == name) {
+      return static_cast<RouteClass>(i);
+    }
+  }
+  return std::nullopt;
+}
+
+RouteClassifier::RouteClassifier(const FrontendReloader *frontend_reloader,
+                                 std::string static_file_prefix)
+    : frontend_reloader_(frontend_reloader),
+      static_file_prefix_(std::move(static_file_prefix)) {}
+
+auto RouteClassifier::classify(const proxygen::HTTPMessage &msg) const
+    -> RouteClass {
+  std::string_view path{msg.getPathAsStringPiece().begin(),
+                        msg.getPathAsStringPiece().end()};
+  auto method = msg.getMethod();
+  if (frontend_reloader_->current()->find_url(path)) {
+    return RouteClass::frontend;
+  }
+  if (path.starts_with(static_file_prefix_) &&
+      method == proxygen::HTTPMethod::GET) {
+    return RouteClass::static_file;
+  }
+  if (path.starts_with("/api/")) {
+    if ((path == "/api/v1/create" || path == "/api/v1/create_batch") &&
+        (method == proxygen::HTTPMethod::POST ||
+         method == proxygen::HTTPMethod::PUT)) {
+      return RouteClass::create;
+    }
+    if (path == "/api/v1/challenge" && method == proxygen::HTTPMethod::GET) {
+      return RouteClass::challenge;
+    }
+    return RouteClass::other;
+  }
+  if (method == proxygen::HTTPMethod::GET &&
+      !::ec_prv::url_shortener::url_shortening::parse_out_request_str(path)
+           .empty()) {
+    return RouteClass::redirect;
+  }
+  return RouteClass::other;
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
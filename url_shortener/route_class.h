@@ -0,0 +1,59 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_ROUTE_CLASS_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_ROUTE_CLASS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <string>
+#include <string_view>
+
+#include "frontend_reloader.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// What a request is for, as far as routing and rate limiting are concerned.
+enum class RouteClass : uint8_t {
+  // a file of the frontend
+  frontend,
+  // a file under the static file doc root
+  static_file,
+  // shortening a URL, or a batch of them
+  create,
+  // following a shortened URL
+  redirect,
+  // getting a proof-of-work challenge to solve before creating
+  challenge,
+  // anything else, which gets a 404
+  other,
+};
+
+static constexpr std::size_t num_route_classes = 6;
+
+// The name of a route class in configuration, e.g., "static".
+auto to_string(RouteClass route) -> std::string_view;
+
+auto route_class_from_string(std::string_view name)
+    -> std::optional<RouteClass>;
+
+// Decides which handler a request goes to. The handler factory classifies
+// each request once and hands the class to `AntiAbuseProtection` too, so that
+// requests are limited by the route that will actually serve them.
+class RouteClassifier {
+public:
+  RouteClassifier(const FrontendReloader *frontend_reloader,
+                  std::string static_file_prefix);
+
+  auto classify(const proxygen::HTTPMessage &msg) const -> RouteClass;
+
+private:
+  const FrontendReloader *const frontend_reloader_;
+  const std::string static_file_prefix_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_ROUTE_CLASS_H
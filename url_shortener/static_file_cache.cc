@@ -0,0 +1,81 @@
+#include "static_file_cache.h"
+#include "http_caching.h"
+
+#include <algorithm>
+#include <functional>
+#include <glog/logging.h>
+#include <string>
+#include <utility>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+StaticFileCache::StaticFileCache(
+    std::size_t max_bytes, std::size_t max_file_bytes,
+    std::shared_ptr<const ::ec_prv::mime_type::ContentTypes> content_types)
+    : max_shard_bytes_(max_bytes / num_shards),
+      // a single file may not take more than its shard's share of the budget
+      max_file_bytes_(std::min(max_file_bytes, max_bytes / num_shards)),
+      content_types_(std::move(content_types)) {}
+
+auto StaticFileCache::shard_for(const std::string &key) -> LockedShard & {
+  return shards_[std::hash<std::string>{}(key) % num_shards];
+}
+
+auto StaticFileCache::get(const std::filesystem::path &file_path)
+    -> std::shared_ptr<const StaticFileCacheEntry> {
+  const std::string key = file_path.string();
+  auto shard = shard_for(key).lock();
+  // `find` also marks the entry as most recently used
+  auto it = shard->lru.find(key);
+  if (it == shard->lru.end()) {
+    return nullptr;
+  }
+  return it->second;
+}
+
+auto StaticFileCache::insert(const std::filesystem::path &file_path,
+                             std::unique_ptr<folly::IOBuf> body)
+    -> std::shared_ptr<const StaticFileCacheEntry> {
+  const std::size_t size =
+      body ? body->computeChainDataLength() : std::size_t{0};
+  if (!admits(size)) {
+    DLOG(INFO) << "Not caching " << file_path << " (" << size << " bytes)";
+    return nullptr;
+  }
+  auto entry = std::make_shared<StaticFileCacheEntry>();
+  if (body) {
+    // one contiguous buffer makes later hashing and slicing cheap
+    body->coalesce();
+    entry->body = std::move(body);
+  } else {
+    entry->body = folly::IOBuf::create(0);
+  }
+  entry->etag = strong_etag(*entry->body);
+  entry->content_type = content_types_->of(file_path.native());
+  entry->content_length = std::to_string(size);
+  entry->size = size;
+
+  const std::string key = file_path.string();
+  auto shard = shard_for(key).lock();
+  if (shard->lru.exists(key)) {
+    shard->bytes -= shard->lru.peek(key)->size;
+  }
+  shard->bytes += size;
+  shard->lru.set(key, entry);
+  while (shard->bytes > max_shard_bytes_ && shard->lru.size() > 1) {
+    shard->lru.prune(
+        1, [&shard](std::string evicted_key,
+                    std::shared_ptr<const StaticFileCacheEntry> &&evicted) {
+          DLOG(INFO) << "Evicting " << evicted_key
+                     << " from the static file cache";
+          shard->bytes -= evicted->size;
+        });
+  }
+  return entry;
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,87 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_STATIC_FILE_CACHE_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_STATIC_FILE_CACHE_H
+
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <folly/Synchronized.h>
+#include <folly/container/EvictingCacheMap.h>
+#include <folly/io/IOBuf.h>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "mime_type/mime_type.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// A fully read static file. Entries are immutable once published to the
+// cache, so the body can be handed out as zero-copy clones that share its
+// refcounted buffer and stay valid after the entry is evicted.
+struct StaticFileCacheEntry {
+  std::unique_ptr<folly::IOBuf> body;
+  // strong entity tag of `body`
+  std::string etag;
+  std::string content_type;
+  // decimal `size`, ready for the response header
+  std::string content_length;
+  std::size_t size{0};
+};
+
+// Cache static files in memory to serve them quickly. Shared by all IO
+// threads: entries are spread over independently locked shards, each of which
+// evicts its least recently used files once it goes over its share of the
+// byte budget.
+class StaticFileCache {
+public:
+  explicit StaticFileCache(
+      std::size_t max_bytes, std::size_t max_file_bytes,
+      std::shared_ptr<const ::ec_prv::mime_type::ContentTypes> content_types);
+
+  StaticFileCache(const StaticFileCache &) = delete;
+  StaticFileCache &operator=(const StaticFileCache &) = delete;
+
+  // Returns nullptr on a cache miss.
+  auto get(const std::filesystem::path &file_path)
+      -> std::shared_ptr<const StaticFileCacheEntry>;
+
+  // Publishes the complete contents of a file. Returns the published entry,
+  // or nullptr if the file is too large to be cached.
+  auto insert(const std::filesystem::path &file_path,
+              std::unique_ptr<folly::IOBuf> body)
+      -> std::shared_ptr<const StaticFileCacheEntry>;
+
+  // Whether a file of this size is worth caching at all. Larger files bypass
+  // the cache and are streamed from disk on every request.
+  auto admits(std::size_t file_size) const noexcept -> bool {
+    return file_size <= max_file_bytes_;
+  }
+
+private:
+  static constexpr std::size_t num_shards = 16;
+
+  struct Shard {
+    // unbounded by count; the byte budget is enforced in `insert`
+    folly::EvictingCacheMap<std::string,
+                            std::shared_ptr<const StaticFileCacheEntry>>
+        lru{0};
+    std::size_t bytes{0};
+  };
+
+  using LockedShard = folly::Synchronized<Shard, std::mutex>;
+
+  auto shard_for(const std::string &key) -> LockedShard &;
+
+  const std::size_t max_shard_bytes_;
+  const std::size_t max_file_bytes_;
+  const std::shared_ptr<const ::ec_prv::mime_type::ContentTypes>
+      content_types_;
+  std::array<LockedShard, num_shards> shards_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_STATIC_FILE_CACHE_H
@@ -1,7 +1,13 @@
 #include "static_handler.h"
+#include "file_window.h"
+#include "http_caching.h"
+#include "http_range.h"
 
 #include <algorithm>
+#include <fcntl.h>
 #include <folly/FileUtil.h>
+#include <folly/Format.h>
+#include <folly/Random.h>
 #include <folly/Range.h>
 #include <folly/executors/GlobalExecutor.h>
 #include <folly/io/async/EventBaseManager.h>
@@ -10,6 +16,7 @@
 #include <proxygen/httpserver/ResponseBuilder.h>
 #include <string>
 #include <string_view>
+#include <sys/stat.h>
 #include <vector>
 
 namespace ec_prv {
@@ -36,27 +43,43 @@ auto file_is_under_dir(const std::filesystem::path &this_file,
   }
   return parent_it == is_under_this_dir.end();
 }
+
+auto make_multipart_boundary() -> std::string {
+  return folly::sformat("prv-ec-{:016x}", folly::Random::rand64());
+}
+
+// Zero-copy view of a range of a cached file.
+auto slice(const folly::IOBuf &body, const ContentRange &range)
+    -> std::unique_ptr<folly::IOBuf> {
+  // cache entries are a single buffer
+  auto dst = body.cloneOne();
+  dst->trimStart(range.offset);
+  dst->trimEnd(dst->length() - range.length);
+  return dst;
+}
 } // namespace
 
-StaticHandler::StaticHandler(std::weak_ptr<StaticFileCache> cache,
-                             const std::filesystem::path &doc_root)
-    : cache_(cache), doc_root_(doc_root) {}
+StaticHandler::StaticHandler(
+    std::weak_ptr<StaticFileCache> cache, CoalescedFileReader *coalesced_reader,
+    const ::ec_prv::mime_type::ContentTypes *content_types,
+    const std::filesystem::path &doc_root, std::string_view url_prefix)
+    : doc_root_(doc_root), url_prefix_(url_prefix), cache_(cache),
+      coalesced_reader_(coalesced_reader), content_types_(content_types) {}
 
 auto StaticHandler::expected_file_path(
-    const proxygen::HTTPMessage *request,
+    const proxygen::HTTPMessage *request, std::string_view url_prefix,
     const std::filesystem::path &doc_root) noexcept -> std::filesystem::path {
-  // remove "/static/" prefix from request path
+  // remove the prefix, e.g., "/static/", from request path
   // auto req_path = request->getPathAsStringPiece();
   auto req_path = request->getPath();
-  auto p = req_path.rfind(static_files_url_prefix, 0);
-  // "/static/" is not found as a prefix or at all
+  auto p = req_path.rfind(url_prefix, 0);
+  // the prefix is not found as a prefix or at all
   if (p != 0) {
     return {};
   }
   std::filesystem::path dst =
-      doc_root /
-      std::filesystem::path{req_path.begin() + static_files_url_prefix.size(),
-                            req_path.end()};
+      doc_root / std::filesystem::path{req_path.begin() + url_prefix.size(),
+                                       req_path.end()};
   DLOG(INFO) << "Resolving URL request \"" << request->getPath()
              << "\" as file path \"" << dst.string() << "\"";
   return dst;
@@ -79,24 +102,73 @@ void StaticHandler::onRequest(
   // specified doc root. Otherwise, request is in error or malicious.
   CHECK(request.get() != nullptr);
   auto file_path_should_be =
-      StaticHandler::expected_file_path(request.get(), doc_root_);
+      StaticHandler::expected_file_path(request.get(), url_prefix_, doc_root_);
   if (!file_is_under_dir(file_path_should_be, doc_root_)) {
     DLOG(INFO) << "potential malicious input";
     sendBadRequestError("malicious input detected in request for static asset");
     return;
   }
+  const auto &headers = request->getHeaders();
+  const std::string &range_header =
+      headers.getSingleOrEmpty(proxygen::HTTPHeaderCode::HTTP_HEADER_RANGE);
+  const std::string &if_range_header =
+      headers.getSingleOrEmpty(proxygen::HTTPHeaderCode::HTTP_HEADER_IF_RANGE);
   // cache lookup here; early exit possible
   auto this_cache = cache_.lock();
-  if (this_cache->exists(file_path_should_be)) {
+  if (auto cached = this_cache ? this_cache->get(file_path_should_be)
+                               : nullptr) {
     DLOG(INFO) << "Found " << file_path_should_be
                << " in the cache. Exiting early!";
-    auto cached_file = this_cache->get(file_path_should_be);
+    if (if_none_match(headers.getSingleOrEmpty(
+                          proxygen::HTTPHeaderCode::HTTP_HEADER_IF_NONE_MATCH),
+                      cached->etag)) {
+      proxygen::ResponseBuilder(downstream_)
+          .status(304, "Not Modified")
+          .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ETAG, cached->etag)
+          .sendWithEOM();
+      return;
+    }
+    if (!range_header.empty() && if_range(if_range_header, cached->etag)) {
+      if (auto ranges = parse_range_header(range_header, cached->size)) {
+        if (ranges->empty()) {
+          send_range_not_satisfiable(cached->size);
+        } else {
+          send_cached_ranges(*cached, *ranges);
+        }
+        return;
+      }
+    }
     proxygen::ResponseBuilder(downstream_)
         .status(200, "OK")
-        .body(std::move(cached_file))
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
+                cached->content_type)
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_LENGTH,
+                cached->content_length)
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ACCEPT_RANGES, "bytes")
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ETAG, cached->etag)
+        .body(cached->body->clone())
         .sendWithEOM();
     return;
   }
+  content_type_ = content_types_->of(file_path_should_be.native());
+  // Without a cache entry there is no entity tag to check an `If-Range`
+  // against, so such requests get the full file.
+  const bool wants_ranges = !range_header.empty() && if_range_header.empty();
+  folly::EventBase *evb = folly::EventBaseManager::get()->getEventBase();
+  // another request may already be reading this file
+  if (!wants_ranges) {
+    subscription_ = coalesced_reader_->join(file_path_should_be, evb, this);
+    if (subscription_) {
+      proxygen::ResponseBuilder(downstream_)
+          .status(200, "OK")
+          .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
+                  content_type_)
+          .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ACCEPT_RANGES,
+                  "bytes")
+          .send();
+      return;
+    }
+  }
   try {
     file_ = std::make_unique<folly::File>(file_path_should_be);
   } catch (const std::system_error &err) {
@@ -105,51 +177,199 @@ void StaticHandler::onRequest(
         .sendWithEOM();
     return;
   }
+  struct stat file_stat;
+  if (fstat(file_->fd(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+    file_.reset();
+    proxygen::ResponseBuilder(downstream_)
+        .status(404, "Not Found")
+        .sendWithEOM();
+    return;
+  }
   requested_file_path_ = file_path_should_be;
-  proxygen::ResponseBuilder(downstream_).status(200, "OK").send();
+  file_size_ = file_stat.st_size;
+  if (auto ranges = wants_ranges ? parse_range_header(range_header, file_size_)
+                                 : std::nullopt) {
+    if (ranges->empty()) {
+      file_.reset();
+      send_range_not_satisfiable(file_size_);
+      return;
+    }
+    // positioned reads of just the requested ranges; not worth caching
+    ranges_ = std::move(*ranges);
+    proxygen::ResponseBuilder response(downstream_);
+    response.status(206, "Partial Content")
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ACCEPT_RANGES, "bytes");
+    if (ranges_.size() == 1) {
+      response
+          .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
+                  content_type_)
+          .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_RANGE,
+                  content_range(ranges_.front(), file_size_))
+          .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_LENGTH,
+                  ranges_.front().length);
+    } else {
+      boundary_ = make_multipart_boundary();
+      response
+          .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
+                  multipart_byteranges_content_type(boundary_))
+          .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_LENGTH,
+                  multipart_length(boundary_, content_type_, ranges_,
+                                   file_size_));
+    }
+    response.send();
+    stream_file(evb);
+    return;
+  }
+  proxygen::ResponseBuilder(downstream_)
+      .status(200, "OK")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
+              content_type_)
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ACCEPT_RANGES, "bytes")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_LENGTH,
+              file_size_)
+      .send();
+  if (this_cache && this_cache->admits(file_size_)) {
+    // read once on behalf of every concurrent request for this file, then
+    // publish it to the cache
+    subscription_ = coalesced_reader_->read(file_path_should_be,
+                                            std::move(file_), evb, this);
+    return;
+  }
+  // Too large to cache: stream it in windows read with pread.
+  if (file_size_ == 0) {
+    file_.reset();
+    proxygen::ResponseBuilder(downstream_).sendWithEOM();
+    return;
+  }
+  ranges_ = {{0, file_size_}};
+  stream_file(evb);
+}
+
+void StaticHandler::send_cached_ranges(
+    const StaticFileCacheEntry &cached,
+    const std::vector<ContentRange> &ranges) {
+  proxygen::ResponseBuilder response(downstream_);
+  response.status(206, "Partial Content")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ACCEPT_RANGES, "bytes")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_ETAG, cached.etag);
+  if (ranges.size() == 1) {
+    response
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
+                cached.content_type)
+        .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_RANGE,
+                content_range(ranges.front(), cached.size))
+        .body(slice(*cached.body, ranges.front()))
+        .sendWithEOM();
+    return;
+  }
+  auto boundary = make_multipart_boundary();
+  folly::IOBufQueue body{folly::IOBufQueue::cacheChainLength()};
+  for (const auto &range : ranges) {
+    body.append(folly::IOBuf::copyBuffer(
+        multipart_part_header(boundary, cached.content_type, range,
+                              cached.size)));
+    body.append(slice(*cached.body, range));
+  }
+  body.append(folly::IOBuf::copyBuffer(multipart_closing_delimiter(boundary)));
+  response
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_TYPE,
+              multipart_byteranges_content_type(boundary))
+      .body(body.move())
+      .sendWithEOM();
+}
+
+void StaticHandler::send_range_not_satisfiable(std::size_t size) {
+  proxygen::ResponseBuilder(downstream_)
+      .status(416, "Range Not Satisfiable")
+      .header(proxygen::HTTPHeaderCode::HTTP_HEADER_CONTENT_RANGE,
+              unsatisfied_content_range(size))
+      .sendWithEOM();
+}
+
+void StaticHandler::stream_file(folly::EventBase *evb) {
+  if (ranges_.size() == 1) {
+    posix_fadvise(file_->fd(), 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+  begin_next_range();
+  schedule_read_file(evb);
+}
+
+bool StaticHandler::begin_next_range() {
+  if (next_range_ == ranges_.size()) {
+    return false;
+  }
+  const auto &range = ranges_[next_range_++];
+  offset_ = range.offset;
+  end_ = range.offset + range.length;
+  if (!boundary_.empty()) {
+    proxygen::ResponseBuilder(downstream_)
+        .body(folly::IOBuf::copyBuffer(
+            multipart_part_header(boundary_, content_type_, range,
+                                  file_size_)))
+        .send();
+  }
+  return true;
+}
+
+void StaticHandler::on_file_chunk(
+    std::unique_ptr<folly::IOBuf> chunk) noexcept {
+  proxygen::ResponseBuilder(downstream_).body(std::move(chunk)).send();
+}
+
+void StaticHandler::on_file_end() noexcept {
+  VLOG(4) << "Coalesced read done. Sending HTTP response.";
+  subscription_.reset();
+  proxygen::ResponseBuilder(downstream_).sendWithEOM();
+}
+
+void StaticHandler::on_file_error() noexcept {
+  subscription_.reset();
+  downstream_->sendAbort();
+}
+
+void StaticHandler::schedule_read_file(folly::EventBase *evb) {
   read_file_scheduled_ = true;
   folly::getGlobalCPUExecutor()->add(
-      std::bind(&StaticHandler::read_file, this,
-                folly::EventBaseManager::get()->getEventBase()));
+      [this, evb, offset = offset_,
+       length = std::min(window_size_, end_ - offset_)] {
+        read_file(evb, offset, length);
+      });
 }
 
-void StaticHandler::read_file(folly::EventBase *evb) {
-  folly::IOBufQueue buf;
+void StaticHandler::read_file(folly::EventBase *evb, std::size_t offset,
+                              std::size_t length) {
   // TODO(zds): implement timeout on reading files?
-  while (file_ && !paused_) {
-    auto data = buf.preallocate(4000, 4000);
-    auto rc = folly::readNoInt(file_->fd(), data.first, data.second);
-    if (rc < 0) {
-      VLOG(4) << "file read error: " << rc;
-      file_.reset();
-      evb->runInEventBaseThread([this] { downstream_->sendAbort(); });
-      break;
-    } else if (rc == 0) {
-      // found file EOM
-      // done
+  // One hop back to the EventBase per window, not per small chunk.
+  auto window = read_file_window(file_->fd(), offset, length);
+  evb->runInEventBaseThread([this, evb, window = std::move(window)]() mutable {
+    read_file_scheduled_ = false;
+    if (check_for_completion()) {
+      return;
+    }
+    if (!window) {
       file_.reset();
+      downstream_->sendAbort();
+      return;
+    }
+    offset_ += window->length();
+    proxygen::ResponseBuilder(downstream_).body(std::move(window)).send();
+    if (offset_ >= end_ && !begin_next_range()) {
       VLOG(4) << "File EOF found. Sending HTTP response.";
-      evb->runInEventBaseThread(
-          [this] { proxygen::ResponseBuilder(downstream_).sendWithEOM(); });
-    } else {
-      buf.postallocate(rc);
-      evb->runInEventBaseThread([this, body = buf.move()]() mutable {
-        // saving file body to cache
-        CHECK(!requested_file_path_.empty());
-        auto this_cache = cache_.lock();
-        this_cache->append_data(requested_file_path_, body->coalesce());
-        ;
-        // stream response
-        proxygen::ResponseBuilder(downstream_).body(std::move(body)).send();
-      });
+      file_.reset();
+      proxygen::ResponseBuilder response(downstream_);
+      if (!boundary_.empty()) {
+        response.body(
+            folly::IOBuf::copyBuffer(multipart_closing_delimiter(boundary_)));
+      }
+      response.sendWithEOM();
+      return;
     }
-  }
-  // notify the thread processing a HTTP request that reading file is done
-  evb->runInEventBaseThread([this] {
-    read_file_scheduled_ = false;
-    if (!check_for_completion() && !paused_) {
-      VLOG(4) << "Resuming deferred read_file";
-      onEgressResumed();
+    if (!paused_) {
+      // the client keeps up, so take bigger steps
+      window_size_ = std::min(window_size_ * 2, max_file_window_size);
+      schedule_read_file(evb);
+    } else {
+      VLOG(4) << "deferred scheduling of StaticHandler::read_file";
     }
   });
 }
@@ -157,18 +377,15 @@ void StaticHandler::read_file(folly::EventBase *evb) {
 void StaticHandler::onEgressPaused() noexcept {
   VLOG(4) << "StaticHandler paused";
   paused_ = true;
+  window_size_ = std::max(window_size_ / 2, min_file_window_size);
 }
 
 void StaticHandler::onEgressResumed() noexcept {
   VLOG(4) << "StaticHandler resumed";
   paused_ = false;
-  if (read_file_scheduled_ == false && file_) {
+  if (!read_file_scheduled_ && file_ && offset_ < end_) {
     // still need to read file
-    folly::getGlobalCPUExecutor()->add(
-        std::bind(&StaticHandler::read_file, this,
-                  folly::EventBaseManager::get()->getEventBase()));
-  } else {
-    VLOG(4) << "deferred scheduling of StaticHandler::read_file";
+    schedule_read_file(folly::EventBaseManager::get()->getEventBase());
   }
 }
 
@@ -201,6 +418,10 @@ void StaticHandler::onError(proxygen::ProxygenError e) noexcept {
 bool StaticHandler::check_for_completion() {
   if (finished_ && !read_file_scheduled_) {
     VLOG(4) << "deleting StaticHandler";
+    if (subscription_) {
+      // the shared read carries on for other requests
+      subscription_->cancel();
+    }
     delete this;
     return true;
   }
@@ -215,67 +436,6 @@ void StaticHandler::sendBadRequestError(const std::string &what) noexcept {
   proxygen::ResponseBuilder(downstream_).status(400, what).sendWithEOM();
 }
 
-auto StaticFileCache::get_copy(const std::filesystem::path &file_path) const
-    -> std::vector<unsigned char> {
-  auto it = cache_.find(file_path.string());
-  if (it == cache_.end()) {
-    return {};
-  }
-  return it->second;
-}
-
-auto StaticFileCache::exists(const std::filesystem::path &file_path) const
-    -> bool {
-  return cache_.contains(file_path.string());
-}
-
-auto StaticFileCache::append_data(const std::filesystem::path &file_path,
-                                  folly::ByteRange buf) -> void {
-  auto it = cache_.find(file_path.string());
-  if (it == cache_.end()) {
-    DLOG(INFO) << "Attempt to stream file data into the cache for a file that "
-                  "is not in the cache. "
-               << "It should be in the cache for this function to be called, "
-                  "so something is wrong.";
-    std::vector<unsigned char> data;
-    data.reserve(buf.size());
-    data.insert(data.end(), buf.begin(), buf.end());
-    cache_.emplace(std::piecewise_construct,
-                   std::forward_as_tuple(file_path.string()),
-                   std::forward_as_tuple(std::move(data)));
-    return;
-  }
-  std::vector<unsigned char> &data = it->second;
-  data.insert(data.end(), buf.begin(), buf.end());
-}
-
-auto StaticFileCache::set(const std::filesystem::path &file_path,
-                          std::string_view body) -> void {
-  std::vector<unsigned char> data;
-  data.reserve(body.size());
-  for (auto ch : body) {
-    data.push_back(static_cast<unsigned char>(ch));
-  }
-  auto res = cache_.emplace(std::piecewise_construct,
-                            std::forward_as_tuple(file_path.string()),
-                            std::forward_as_tuple(std::move(data)));
-  if (!res.second) {
-    DLOG(INFO) << "no insertion happend when inserting into static file cache "
-                  "the path \""
-               << file_path << "\" with body: \"" << body << "\"";
-  }
-}
-
-auto StaticFileCache::get(const std::filesystem::path &file_path) const
-    -> std::unique_ptr<folly::IOBuf> {
-  auto it = cache_.find(file_path.string());
-  if (it == cache_.end()) {
-    return {};
-  }
-  const std::vector<unsigned char> &underlying = it->second;
-  return folly::IOBuf::wrapBuffer(underlying.data(), underlying.size());
-}
-
 } // namespace web
 } // namespace url_shortener
 } // namespace ec_prv
@@ -15,38 +15,27 @@
 #include <string_view>
 #include <vector>
 
+#include "coalesced_file_reader.h"
+#include "file_window.h"
+#include "http_range.h"
+#include "mime_type/mime_type.h"
+#include "static_file_cache.h"
+
 namespace ec_prv {
 namespace url_shortener {
 namespace web {
 static constexpr int max_file_path_length = 1000;
-static constexpr std::string_view static_files_url_prefix = "/static/";
 
-// Cache static files in memory to serve them quickly.
-class StaticFileCache {
-public:
-  // TODO(zds): reject files from cache if they are too large
-  // TODO(zds): test this with non-textual, binary data files
-
-  auto exists(const std::filesystem::path &) const -> bool;
-  auto get_copy(const std::filesystem::path &) const
-      -> std::vector<unsigned char>;
-  auto get(const std::filesystem::path &) const
-      -> std::unique_ptr<folly::IOBuf>;
-  auto set(const std::filesystem::path &file_path, std::string_view body)
-      -> void;
-  auto append_data(const std::filesystem::path &file_path, folly::ByteRange buf)
-      -> void;
-
-private:
-  folly::F14NodeMap<std::string, std::vector<unsigned char>> cache_;
-};
-
-// TODO(zds): serve files with appropriate mime type
-
-class StaticHandler : public proxygen::RequestHandler {
+// Serves the files under `doc_root` at the URLs under `url_prefix`, e.g.,
+// "/static/".
+class StaticHandler : public proxygen::RequestHandler,
+                      public FileReadCallback {
 public:
   explicit StaticHandler(std::weak_ptr<StaticFileCache> cache,
-                         const std::filesystem::path &doc_root);
+                         CoalescedFileReader *coalesced_reader,
+                         const ::ec_prv::mime_type::ContentTypes *content_types,
+                         const std::filesystem::path &doc_root,
+                         std::string_view url_prefix);
 
   void
   onRequest(std::unique_ptr<proxygen::HTTPMessage> request) noexcept override;
@@ -65,24 +54,59 @@ public:
 
   void onEgressResumed() noexcept override;
 
+  // FileReadCallback methods, for cacheable files read by `CoalescedFileReader`
+
+  void on_file_chunk(std::unique_ptr<folly::IOBuf> chunk) noexcept override;
+
+  void on_file_end() noexcept override;
+
+  void on_file_error() noexcept override;
+
   static auto expected_file_path(const proxygen::HTTPMessage *request,
+                                 std::string_view url_prefix,
                                  const std::filesystem::path &doc_root) noexcept
       -> std::filesystem::path;
 
 private:
-  void read_file(folly::EventBase *evb);
+  void send_cached_ranges(const StaticFileCacheEntry &cached,
+                          const std::vector<ContentRange> &ranges);
+  void send_range_not_satisfiable(std::size_t size);
+  void stream_file(folly::EventBase *evb);
+  bool begin_next_range();
+  void schedule_read_file(folly::EventBase *evb);
+  void read_file(folly::EventBase *evb, std::size_t offset,
+                 std::size_t length);
   bool check_for_completion();
   void sendBadRequestError(const std::string &what) noexcept;
   void sendError(const std::string &what) noexcept;
 
-  std::filesystem::path
-      requested_file_path_; // this is for inserting file bodies into cache
+  std::filesystem::path requested_file_path_;
+  // media type of `requested_file_path_`, for responses not from the cache
+  std::string_view content_type_;
+  // only set for files too large to cache and for ranges of uncached files,
+  // which this handler streams itself in windows of adaptive size
   std::unique_ptr<folly::File> file_;
+  std::size_t file_size_{0};
+  // byte ranges of `file_` still to send, in order; the whole file unless the
+  // request had a `Range` header
+  std::vector<ContentRange> ranges_;
+  std::size_t next_range_{0};
+  // separates the parts of a multipart/byteranges response; empty otherwise
+  std::string boundary_;
+  // position in the range being sent
+  std::size_t offset_{0};
+  std::size_t end_{0};
+  std::size_t window_size_{min_file_window_size};
+  // set while receiving a cacheable file from `coalesced_reader_`
+  std::shared_ptr<FileReadSubscription> subscription_;
   bool read_file_scheduled_{false};
-  std::atomic<bool> paused_{false};
+  bool paused_{false};
   bool finished_{false};
   const std::filesystem::path &doc_root_;
+  const std::string_view url_prefix_;
   std::weak_ptr<StaticFileCache> cache_;
+  CoalescedFileReader *const coalesced_reader_;
+  const ::ec_prv::mime_type::ContentTypes *const content_types_;
 };
 } // namespace web
 } // namespace url_shortener
@@ -0,0 +1,101 @@
+#include "url_batch.h"
+
+#include <glog/logging.h>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+// numbered as `CoalescedCreates` numbers them, so that a URL gets the
+// same slug either way
+constexpr uint8_t first_try = 2;
+constexpr uint8_t last_try = 100;
+
+} // namespace
+
+UrlBatch::UrlBatch(
+    db::ShortenedUrlsDatabase *db,
+    const ::ec_prv::url_shortener::url_shortening::UrlShorteningConfig
+        *url_shortening_svc)
+    : db_(db), url_shortening_svc_(url_shortening_svc) {}
+
+auto UrlBatch::prepare(std::vector<std::string> long_urls) const -> Prepared {
+  Prepared dst;
+  dst.slugs.resize(long_urls.size());
+  for (std::size_t i = 0; i < long_urls.size(); ++i) {
+    if (!url_shortening_svc_->generate_slug(dst.slugs[i], long_urls[i],
+                                            first_try)) {
+      dst.slugs[i].clear();
+    }
+  }
+  dst.stored = db_->multi_get(dst.slugs);
+  dst.long_urls = std::move(long_urls);
+  return dst;
+}
+
+auto UrlBatch::resolve(Prepared prepared) -> std::vector<std::string> {
+  std::vector<std::string> dst;
+  dst.reserve(prepared.long_urls.size());
+  for (std::size_t i = 0; i < prepared.long_urls.size(); ++i) {
+    dst.push_back(settle(prepared.long_urls[i], std::move(prepared.slugs[i]),
+                         std::move(prepared.stored[i])));
+  }
+  return dst;
+}
+
+auto UrlBatch::settle(
+    const std::string &long_url, std::string slug,
+    std::variant<std::string, db::UrlShorteningDbError> stored) -> std::string {
+  for (uint8_t nth_try = first_try;;) {
+    if (slug.empty()) {
+      LOG(ERROR) << "what should be a very rare error: ran out of hashes in "
+                    "creating slug for long_url=\""
+                 << long_url << "\"";
+      return {};
+    }
+    const auto *got_str = std::get_if<std::string>(&stored);
+    const auto *err = std::get_if<db::UrlShorteningDbError>(&stored);
+    if (auto it = taken_.find(slug); it != taken_.end()) {
+      if (it->second == long_url) {
+        // twice in this batch
+        return slug;
+      }
+    } else if (got_str != nullptr && *got_str == long_url) {
+      // already in database
+      taken_.emplace(slug, long_url);
+      return slug;
+    } else if ((got_str != nullptr && got_str->empty()) ||
+               (err != nullptr && *err == db::UrlShorteningDbError::NotFound)) {
+      taken_.emplace(slug, long_url);
+      entries_.emplace_back(slug, long_url);
+      return slug;
+    } else if (err != nullptr) {
+      LOG(ERROR) << "database failure";
+      return {};
+    } else {
+      LOG(WARNING) << "slug generated for \"" << long_url << "\": \"" << slug
+                   << "\" collides with the slug for an existing entry: \""
+                   << *got_str
+                   << "\". Consider increasing size of the alphabet used (in "
+                      "the app configuration).";
+    }
+    if (nth_try++ == last_try ||
+        !url_shortening_svc_->generate_slug(slug, long_url, nth_try)) {
+      slug.clear();
+      continue;
+    }
+    stored = db_->get(slug);
+  }
+}
+
+auto UrlBatch::commit() -> std::optional<db::UrlShorteningDbError> {
+  if (entries_.empty()) {
+    return {};
+  }
+  return db_->put_batch(entries_);
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
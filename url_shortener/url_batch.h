@@ -0,0 +1,75 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_URL_BATCH_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_URL_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <folly/container/F14Map.h>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "db.h"
+#include "url_shortening.h"
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// Slugs for a batch of long URLs, all written to the database at once.
+//
+// URLs come in chunks, in order. `prepare` generates the slugs of a chunk and
+// looks them up in one read; it may run for many chunks at once on different
+// threads. `resolve` then settles them, one chunk at a time and in order,
+// against the database and the rest of the batch, the way a single create
+// does: a slug already standing for the same URL is reused, and one standing
+// for another URL means trying the next.
+class UrlBatch {
+public:
+  struct Prepared {
+    std::vector<std::string> long_urls;
+    // first choices, or empty if a URL ran out of hashes
+    std::vector<std::string> slugs;
+    std::vector<std::variant<std::string, db::UrlShorteningDbError>> stored;
+  };
+
+  UrlBatch(db::ShortenedUrlsDatabase *db,
+           const ::ec_prv::url_shortener::url_shortening::UrlShorteningConfig
+               *url_shortening_svc);
+
+  UrlBatch(const UrlBatch &) = delete;
+  UrlBatch &operator=(const UrlBatch &) = delete;
+
+  // Thread-safe
+  auto prepare(std::vector<std::string> long_urls) const -> Prepared;
+
+  // The slug of each URL, in order, or empty if none could be had. Not
+  // thread-safe.
+  auto resolve(Prepared prepared) -> std::vector<std::string>;
+
+  // Writes the slugs that are new, in one write, or none if any was taken
+  // for another URL since it was settled (`SlugExists`)
+  auto commit() -> std::optional<db::UrlShorteningDbError>;
+
+  // slugs to be written by `commit`
+  auto created() const -> std::size_t { return entries_.size(); }
+
+private:
+  auto settle(const std::string &long_url, std::string slug,
+              std::variant<std::string, db::UrlShorteningDbError> stored)
+      -> std::string;
+
+  db::ShortenedUrlsDatabase *const db_;
+  const ::ec_prv::url_shortener::url_shortening::UrlShorteningConfig
+      *const url_shortening_svc_;
+  // slugs settled in this batch, to the long URLs they stand for
+  folly::F14FastMap<std::string, std::string> taken_;
+  // (slug, long URL) pairs not yet in the database
+  std::vector<std::pair<std::string, std::string>> entries_;
+};
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_URL_BATCH_H
@@ -0,0 +1,296 @@
+#include "url_canonical.h"
+
+#include <array>
+#include <cstdint>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+namespace {
+
+// Classes of the bytes each part of a URL may hold as they are, besides
+// percent-encodings
+enum : uint8_t {
+  unreserved = 1 << 0,
+  sub_delim = 1 << 1,
+  hex = 1 << 2,
+  // ":" and "@"
+  pchar_extra = 1 << 3,
+  // "/" and "?"
+  query_extra = 1 << 4,
+};
+
+constexpr auto make_classes() -> std::array<uint8_t, 256> {
+  std::array<uint8_t, 256> dst{};
+  for (int c = 0; c < 256; ++c) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9')) {
+      dst[c] |= unreserved;
+    }
+    if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+        (c >= 'A' && c <= 'F')) {
+      dst[c] |= hex;
+    }
+  }
+  for (char c : std::string_view{"-._~"}) {
+    dst[static_cast<uint8_t>(c)] |= unreserved;
+  }
+  for (char c : std::string_view{"!$&'()*+,;="}) {
+    dst[static_cast<uint8_t>(c)] |= sub_delim;
+  }
+  for (char c : std::string_view{":@"}) {
+    dst[static_cast<uint8_t>(c)] |= pchar_extra;
+  }
+  for (char c : std::string_view{"/?"}) {
+    dst[static_cast<uint8_t>(c)] |= query_extra;
+  }
+  return dst;
+}
+
+constexpr std::array<uint8_t, 256> classes = make_classes();
+
+// userinfo, with ":"; "@" ends it, so is never in it
+constexpr uint8_t userinfo_allowed = unreserved | sub_delim | pchar_extra;
+constexpr uint8_t reg_name_allowed = unreserved | sub_delim;
+// path, query and fragment: "?" and "#" end the parts they cannot be in
+constexpr uint8_t tail_allowed =
+    unreserved | sub_delim | pchar_extra | query_extra;
+
+auto is(char c, uint8_t mask) -> bool {
+  return (classes[static_cast<uint8_t>(c)] & mask) != 0;
+}
+
+auto to_lower(char c) -> char {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+auto to_upper(char c) -> char {
+  return c >= 'a' && c <= 'z' ? static_cast<char>(c - ('a' - 'A')) : c;
+}
+
+auto hex_value(char c) -> int {
+  if (c <= '9') {
+    return c - '0';
+  }
+  return to_lower(c) - 'a' + 10;
+}
+
+// Whether there are no controls, spaces or DEL, which no part of a URL may
+// hold, even percent-encoded by us: they are where URLs pasted with
+// surrounding text end. This is most of what it takes to reject garbage, so
+// it goes 16 bytes at a time where it can.
+auto no_controls_or_spaces(std::string_view s) -> bool {
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i space = _mm_set1_epi8(0x20);
+  const __m128i del = _mm_set1_epi8(0x7f);
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= s.size(); i += 16) {
+    const __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + i));
+    // compared as signed, so bytes past 0x7f are below zero
+    const __m128i printable = _mm_or_si128(_mm_cmpgt_epi8(bytes, space),
+                                           _mm_cmplt_epi8(bytes, zero));
+    if (_mm_movemask_epi8(printable) != 0xffff ||
+        _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, del)) != 0) {
+      return false;
+    }
+  }
+#endif
+  for (; i < s.size(); ++i) {
+    const auto c = static_cast<uint8_t>(s[i]);
+    if (c <= 0x20 || c == 0x7f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Appends `part` to `dst` if it holds only `allowed` bytes and
+// percent-encodings, normalizing the latter. With `encode`, other bytes are
+// percent-encoded instead, as browsers do, e.g., UTF-8 or "[" and "|" in a
+// query.
+auto append_part(std::string &dst, std::string_view part, uint8_t allowed,
+                 bool lowercase, bool encode) -> bool {
+  static constexpr char hex_digits[] = "0123456789ABCDEF";
+  for (std::size_t i = 0; i < part.size(); ++i) {
+    char c = part[i];
+    if (c == '%') {
+      if (part.size() - i < 3 || !is(part[i + 1], hex) ||
+          !is(part[i + 2], hex)) {
+        return false;
+      }
+      const auto decoded = static_cast<char>(hex_value(part[i + 1]) * 16 +
+                                             hex_value(part[i + 2]));
+      if (is(decoded, unreserved)) {
+        dst.push_back(lowercase ? to_lower(decoded) : decoded);
+      } else {
+        dst.push_back('%');
+        dst.push_back(to_upper(part[i + 1]));
+        dst.push_back(to_upper(part[i + 2]));
+      }
+      i += 2;
+    } else if (is(c, allowed)) {
+      dst.push_back(lowercase ? to_lower(c) : c);
+    } else if (encode) {
+      const auto byte = static_cast<uint8_t>(c);
+      dst.push_back('%');
+      dst.push_back(hex_digits[byte >> 4]);
+      dst.push_back(hex_digits[byte & 0xf]);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Appends an IPv6 or IPv4 address in brackets, lowercased. IPvFuture
+// literals are not accepted.
+auto append_ip_literal(std::string &dst, std::string_view literal) -> bool {
+  if (literal.size() < 3 || literal.back() != ']' ||
+      literal.find(':') == std::string_view::npos) {
+    return false;
+  }
+  dst.push_back('[');
+  for (char c : literal.substr(1, literal.size() - 2)) {
+    if (!is(c, hex) && c != ':' && c != '.') {
+      return false;
+    }
+    dst.push_back(to_lower(c));
+  }
+  dst.push_back(']');
+  return true;
+}
+
+} // namespace
+
+auto canonicalize_url(std::string_view url, std::size_t max_length)
+    -> std::optional<std::string> {
+  if (url.size() > max_length || !no_controls_or_spaces(url)) {
+    return std::nullopt;
+  }
+  std::string dst;
+  dst.reserve(url.size() + 1);
+
+  // scheme
+  const std::size_t colon = url.find(':');
+  if (colon == std::string_view::npos) {
+    return std::nullopt;
+  }
+  for (char c : url.substr(0, colon)) {
+    dst.push_back(to_lower(c));
+  }
+  uint32_t default_port;
+  if (dst == "http") {
+    default_port = 80;
+  } else if (dst == "https") {
+    default_port = 443;
+  } else {
+    return std::nullopt;
+  }
+  std::string_view rest = url.substr(colon + 1);
+  if (rest.substr(0, 2) != "//") {
+    return std::nullopt;
+  }
+  dst += "://";
+  rest.remove_prefix(2);
+
+  // authority
+  const std::size_t authority_end = rest.find_first_of("/?#");
+  std::string_view authority = rest.substr(0, authority_end);
+  rest = authority_end == std::string_view::npos
+             ? std::string_view{}
+             : rest.substr(authority_end);
+  if (const std::size_t at = authority.find('@');
+      at != std::string_view::npos) {
+    if (!append_part(dst, authority.substr(0, at), userinfo_allowed, false,
+                     false)) {
+      return std::nullopt;
+    }
+    dst.push_back('@');
+    authority.remove_prefix(at + 1);
+  }
+  std::string_view host;
+  std::string_view port;
+  if (!authority.empty() && authority.front() == '[') {
+    const std::size_t close = authority.find(']');
+    if (close == std::string_view::npos) {
+      return std::nullopt;
+    }
+    host = authority.substr(0, close + 1);
+    authority.remove_prefix(close + 1);
+    if (!authority.empty() && authority.front() != ':') {
+      return std::nullopt;
+    }
+    if (!append_ip_literal(dst, host)) {
+      return std::nullopt;
+    }
+  } else {
+    host = authority.substr(0, authority.find(':'));
+    authority.remove_prefix(host.size());
+    if (host.empty() ||
+        !append_part(dst, host, reg_name_allowed, true, false)) {
+      return std::nullopt;
+    }
+  }
+  if (!authority.empty()) {
+    port = authority.substr(1);
+  }
+  if (!port.empty()) {
+    uint32_t value = 0;
+    for (char c : port) {
+      if (c < '0' || c > '9') {
+        return std::nullopt;
+      }
+      value = value * 10 + (c - '0');
+      if (value > 65535) {
+        return std::nullopt;
+      }
+    }
+    if (value != default_port) {
+      dst.push_back(':');
+      dst += std::to_string(value);
+    }
+  }
+
+  // path, query and fragment
+  const std::size_t path_end = rest.find_first_of("?#");
+  const std::string_view path = rest.substr(0, path_end);
+  if (path.empty()) {
+    dst.push_back('/');
+  } else if (!append_part(dst, path, tail_allowed, false, true)) {
+    return std::nullopt;
+  }
+  rest.remove_prefix(path.size());
+  if (!rest.empty() && rest.front() == '?') {
+    const std::string_view query = rest.substr(1, rest.find('#') - 1);
+    if (!query.empty()) {
+      dst.push_back('?');
+      if (!append_part(dst, query, tail_allowed, false, true)) {
+        return std::nullopt;
+      }
+    }
+    rest.remove_prefix(query.size() + 1);
+  }
+  if (!rest.empty()) {
+    // a fragment
+    const std::string_view fragment = rest.substr(1);
+    if (!fragment.empty()) {
+      dst.push_back('#');
+      if (!append_part(dst, fragment, tail_allowed, false, true)) {
+        return std::nullopt;
+      }
+    }
+  }
+  if (dst.size() > max_length) {
+    return std::nullopt;
+  }
+  return dst;
+}
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
@@ -0,0 +1,34 @@
+#ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_URL_CANONICAL_H
+#define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_URL_CANONICAL_H
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace ec_prv {
+namespace url_shortener {
+namespace web {
+
+// The long URL of a create request in canonical form, or none if it is not
+// an absolute http or https URI (RFC 3986) of at most `max_length` bytes,
+// before or after. As browsers do, bytes a path, query or fragment may not
+// hold as they are, e.g., UTF-8, are percent-encoded rather than refused;
+// only controls, whitespace and malformed percent-encodings are, there.
+// Forms of a URL that differ only as RFC 3986 section 6 allows are shortened
+// alike:
+//   - the scheme and host are lowercased
+//   - a port that is empty or the scheme's default is dropped, as are leading
+//     zeros of any other
+//   - an empty path becomes "/"
+//   - an empty query or fragment is dropped, with its "?" or "#"
+//   - percent-encodings of unreserved characters are decoded, and the hex
+//     digits of the rest uppercased
+// Nothing else is changed; in particular, dot segments are left alone.
+auto canonicalize_url(std::string_view url, std::size_t max_length)
+    -> std::optional<std::string>;
+
+} // namespace web
+} // namespace url_shortener
+} // namespace ec_prv
+#endif // _INCLUDE_EC_PRV_URL_SHORTENER_WEB_URL_CANONICAL_H
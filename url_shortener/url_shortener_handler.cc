@@ -11,6 +11,7 @@
 #include <proxygen/httpserver/ResponseBuilder.h>
 #include <string>
 
+#include "ddos_protection.h"
 #include "url_shortening.h"
 
 namespace ec_prv {
@@ -27,9 +28,10 @@ using namespace ::ec_prv::url_shortener;
 
 UrlRedirectHandler::UrlRedirectHandler(
     std::string &&short_url, db::ShortenedUrlsDatabase *db,
-    const app_config::ReadOnlyAppConfig *const ro_app_config)
-    : db_(db), ro_app_config_(ro_app_config), short_url_(std::move(short_url)) {
-}
+    const app_config::ReadOnlyAppConfig *const ro_app_config,
+    RedirectCosts *costs)
+    : db_(db), ro_app_config_(ro_app_config), costs_(costs),
+      short_url_(std::move(short_url)) {}
 
 void UrlRedirectHandler::onRequest(
     std::unique_ptr<proxygen::HTTPMessage> req) noexcept {
@@ -52,6 +54,16 @@ void UrlRedirectHandler::onRequest(
         .sendWithEOM();
     return;
   }
+  if (costs_ != nullptr) {
+    // turn away clients out of budget before their lookups leave this thread
+    client_ip_ = resolve_client_ip(*ro_app_config_, *req);
+    if (!client_ip_ || !costs_->admit(*client_ip_, RateLimitClock::now())) {
+      proxygen::ResponseBuilder(downstream_)
+          .status(429, "Too Many Requests")
+          .sendWithEOM();
+      return;
+    }
+  }
   folly::EventBase *evb = folly::EventBaseManager::get()->getEventBase();
   buf_.reserve(max_long_url_length);
   auto f = folly::via(folly::getGlobalCPUExecutor(), [this]() mutable {
@@ -59,6 +71,9 @@ void UrlRedirectHandler::onRequest(
     return ok;
   });
   std::move(f).via(evb).thenTry([this](folly::Try<bool> result) mutable {
+    if (costs_ != nullptr && result.hasValue()) {
+      costs_->charge(*client_ip_, RateLimitClock::now(), result.value());
+    }
     if (result.hasValue() && result.value()) {
       proxygen::ResponseBuilder(downstream_)
           .status(301, "Moved Permanently")
@@ -1,12 +1,15 @@
 #ifndef _INCLUDE_EC_PRV_URL_SHORTENER_WEB_URL_REDIRECT_HANDLER_H
 #define _INCLUDE_EC_PRV_URL_SHORTENER_WEB_URL_REDIRECT_HANDLER_H
 
+#include <folly/IPAddress.h>
 #include <folly/Memory.h>
+#include <optional>
 #include <proxygen/httpserver/RequestHandler.h>
 #include <string>
 
 #include "app_config.h"
 #include "db.h"
+#include "redirect_costs.h"
 
 namespace ec_prv {
 namespace url_shortener {
@@ -17,13 +20,17 @@ static constexpr size_t max_long_url_length = 1000;
 // `UrlRedirectHandler` is an optimized request handler for serving
 // the URL redirection service. Looks up a stored mapping of short
 // slugs to long URLs, then serves a 301 HTTP response.
+//
+// If given `costs`, each client is charged for its lookups, and clients out
+// of budget get a 429 without a lookup.
 class UrlRedirectHandler : public proxygen::RequestHandler {
 public:
   explicit UrlRedirectHandler(
       std::string &&short_url,
       ::ec_prv::url_shortener::db::ShortenedUrlsDatabase *db,
       const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig
-          *const ro_app_config);
+          *const ro_app_config,
+      RedirectCosts *costs = nullptr);
 
   void
   onRequest(std::unique_ptr<proxygen::HTTPMessage> request) noexcept override;
@@ -42,6 +49,9 @@ private:
   ::ec_prv::url_shortener::db::ShortenedUrlsDatabase *const db_;
   const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig
       *const ro_app_config_;
+  RedirectCosts *const costs_;
+  // only resolved if there are `costs_` to charge
+  std::optional<folly::IPAddress> client_ip_;
 
   std::string buf_;
   std::string short_url_;
@@ -16,12 +16,25 @@
 #include <string>
 
 #include "app_config.h"
+#include "mime_type/mime_type.h"
 #include "url_shortening.h"
 
 // request handlers
+#include "api_keys.h"
+#include "captcha_health.h"
+#include "captcha_verifier.h"
+#include "challenge_handler.h"
+#include "coalesced_creates.h"
+#include "connection_guard.h"
+#include "create_batch_handler.h"
+#include "dns_cache.h"
 #include "ddos_protection.h"
 #include "frontend_handler.h"
+#include "frontend_reloader.h"
 #include "make_url_request_handler.h"
+#include "proof_of_work.h"
+#include "redirect_costs.h"
+#include "route_class.h"
 #include "static_handler.h"
 #include "url_shortener_handler.h"
 
@@ -55,73 +68,157 @@ public:
       const ::ec_prv::url_shortener::url_shortening::UrlShorteningConfig
           *const url_shortening_svc,
       std::shared_ptr<::ec_prv::url_shortener::db::ShortenedUrlsDatabase> db,
-      const folly::F14NodeMap<std::string, std::vector<uint8_t>>
-          *const frontend_dir_cache)
+      std::shared_ptr<::ec_prv::url_shortener::web::CoalescedCreates> creates,
+      const ::ec_prv::url_shortener::web::FrontendReloader
+          *const frontend_reloader,
+      const ::ec_prv::url_shortener::web::RouteClassifier
+          *const route_classifier,
+      ::ec_prv::url_shortener::web::AntiAbuseProtection *const anti_abuse,
+      std::shared_ptr<::ec_prv::url_shortener::web::StaticFileCache>
+          static_file_cache,
+      std::shared_ptr<::ec_prv::url_shortener::web::CoalescedFileReader>
+          coalesced_file_reader,
+      std::shared_ptr<const ::ec_prv::mime_type::ContentTypes> content_types,
+      std::shared_ptr<::ec_prv::url_shortener::web::RedirectCosts>
+          redirect_costs,
+      std::shared_ptr<folly::SSLContext> captcha_ssl_context,
+      std::shared_ptr<::ec_prv::url_shortener::web::DnsCache> dns,
+      std::shared_ptr<::ec_prv::url_shortener::web::CaptchaHealth>
+          captcha_health,
+      std::shared_ptr<::ec_prv::url_shortener::web::ProofOfWorkVerifier>
+          proof_of_work,
+      std::shared_ptr<::ec_prv::url_shortener::web::ApiKeyring> api_keys)
       : app_state_(app_state), url_shortening_svc_(url_shortening_svc), db_(db),
-        frontend_dir_cache_(frontend_dir_cache) {}
+        creates_(std::move(creates)),
+        frontend_reloader_(frontend_reloader),
+        route_classifier_(route_classifier), anti_abuse_(anti_abuse),
+        static_file_cache_(std::move(static_file_cache)),
+        coalesced_file_reader_(std::move(coalesced_file_reader)),
+        content_types_(std::move(content_types)),
+        redirect_costs_(std::move(redirect_costs)),
+        captcha_ssl_context_(std::move(captcha_ssl_context)),
+        dns_(std::move(dns)), captcha_health_(std::move(captcha_health)),
+        proof_of_work_(std::move(proof_of_work)),
+        api_keys_(std::move(api_keys)) {}
+  // called on each IO thread
   void onServerStart(folly::EventBase *evb) noexcept override {
-    static_file_cache_.reset(
-        new ::ec_prv::url_shortener::web::StaticFileCache{});
-    timer_ = folly::HHWheelTimer::newTimer(
-        evb,
-        std::chrono::milliseconds(folly::HHWheelTimer::DEFAULT_TICK_INTERVAL),
-        folly::AsyncTimeout::InternalEnum::NORMAL,
-        std::chrono::milliseconds(5000));
-  }
-  void onServerStop() noexcept override {
-    static_file_cache_.reset();
-    timer_.reset();
+    if (!proof_of_work_) {
+      recaptcha_.reset(new ::ec_prv::url_shortener::web::RecaptchaVerifier(
+          evb, app_state_, captcha_ssl_context_, dns_, captcha_health_));
+    }
   }
+  void onServerStop() noexcept override { recaptcha_.reset(); }
   proxygen::RequestHandler *
   onRequest(proxygen::RequestHandler *request_handler,
             proxygen::HTTPMessage *msg) noexcept override {
-    std::string_view path{msg->getPathAsStringPiece().begin(),
-                          msg->getPathAsStringPiece().end()};
-    auto method = msg->getMethod();
-    ::ec_prv::url_shortener::web::FrontendHandler *maybe_frontend =
-        ::ec_prv::url_shortener::web::FrontendHandler::lookup(
-            frontend_dir_cache_, path);
-    if (maybe_frontend != nullptr) {
-      return maybe_frontend;
+    // classified once, for both the handler and the anti-abuse checks
+    const ::ec_prv::url_shortener::web::RouteClass route =
+        route_classifier_->classify(*msg);
+    // likewise, a create's API key is checked once
+    ::ec_prv::url_shortener::web::ApiKey *api_key = nullptr;
+    if (route == ::ec_prv::url_shortener::web::RouteClass::create &&
+        api_keys_) {
+      if (const std::string_view token =
+              ::ec_prv::url_shortener::web::api_key_token(*msg);
+          !token.empty()) {
+        api_key = api_keys_->find(token);
+      }
+    }
+    return anti_abuse_->protect(route, api_key,
+                                make_handler(route, api_key, *msg), *msg);
+  }
+
+private:
+  auto make_handler(::ec_prv::url_shortener::web::RouteClass route,
+                    ::ec_prv::url_shortener::web::ApiKey *api_key,
+                    const proxygen::HTTPMessage &msg)
+      -> proxygen::RequestHandler * {
+    std::string_view path{msg.getPathAsStringPiece().begin(),
+                          msg.getPathAsStringPiece().end()};
+    switch (route) {
+    case ::ec_prv::url_shortener::web::RouteClass::frontend: {
+      // the frontend may have been reloaded since it was classified
+      auto *frontend = ::ec_prv::url_shortener::web::FrontendHandler::lookup(
+          frontend_reloader_->current(), path, app_state_);
+      if (frontend != nullptr) {
+        return frontend;
+      }
+      break;
     }
-    if (path.starts_with("/static/") && method == proxygen::HTTPMethod::GET) {
+    case ::ec_prv::url_shortener::web::RouteClass::static_file:
       // serve static files
       DLOG(INFO) << "Route \"static\" found. Serving static files.";
       return new ::ec_prv::url_shortener::web::StaticHandler(
-          static_file_cache_, app_state_->static_file_doc_root);
-    } else if (path.starts_with("/api/")) {
-      DLOG(INFO) << "Route \"/api/*\" found.";
-      if (path == "/api/v1/create" && (method == proxygen::HTTPMethod::POST ||
-                                       method == proxygen::HTTPMethod::PUT)) {
-        return new ::ec_prv::url_shortener::web::MakeUrlRequestHandler(
-            db_.get(), timer_.get(), app_state_, url_shortening_svc_);
-      } else {
-        return new NotFoundHandler{};
+          static_file_cache_, coalesced_file_reader_.get(),
+          content_types_.get(), app_state_->static_file_doc_root,
+          app_state_->static_file_request_path_prefix);
+    case ::ec_prv::url_shortener::web::RouteClass::create:
+      if (path == "/api/v1/create_batch") {
+        return new ::ec_prv::url_shortener::web::CreateBatchHandler(
+            db_.get(), verifier(), app_state_, url_shortening_svc_);
+      }
+      return new ::ec_prv::url_shortener::web::MakeUrlRequestHandler(
+          creates_.get(), verifier(), api_keys_.get(), api_key, app_state_);
+    case ::ec_prv::url_shortener::web::RouteClass::challenge:
+      if (proof_of_work_) {
+        return new ::ec_prv::url_shortener::web::ChallengeHandler(
+            proof_of_work_.get(), app_state_);
       }
-    } else if (std::string_view parsed =
-                   ec_prv::url_shortener::url_shortening::parse_out_request_str(
-                       path);
-               parsed.length() > 0 && method == proxygen::HTTPMethod::GET) {
+      break;
+    case ::ec_prv::url_shortener::web::RouteClass::redirect:
       return new ::ec_prv::url_shortener::web::UrlRedirectHandler(
-          std::string{parsed}, db_.get(), app_state_);
+          std::string{
+              ec_prv::url_shortener::url_shortening::parse_out_request_str(
+                  path)},
+          db_.get(), app_state_, redirect_costs_.get());
+    case ::ec_prv::url_shortener::web::RouteClass::other:
+      break;
     }
     return new NotFoundHandler();
   }
 
-private:
   const ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig
       *app_state_; // TODO: make this a folly::ThreadLocalPtr
   const ::ec_prv::url_shortener::url_shortening::UrlShorteningConfig
       *const url_shortening_svc_;
   std::shared_ptr<::ec_prv::url_shortener::db::ShortenedUrlsDatabase>
       db_; // TODO(zds): make access to rocksdb threadsafe
-  // folly::ThreadLocalPtr<::ec_prv::url_shortener::web::StaticFileCache>
-  // static_file_cache_{nullptr};
+  // shared by all IO threads, so that creates of one URL on different threads
+  // coalesce too
+  std::shared_ptr<::ec_prv::url_shortener::web::CoalescedCreates> creates_;
+  const ::ec_prv::url_shortener::web::FrontendReloader
+      *const frontend_reloader_;
+  const ::ec_prv::url_shortener::web::RouteClassifier *const route_classifier_;
+  ::ec_prv::url_shortener::web::AntiAbuseProtection *const anti_abuse_;
+  // shared by all IO threads; see `StaticFileCache` for synchronization
   std::shared_ptr<::ec_prv::url_shortener::web::StaticFileCache>
       static_file_cache_{nullptr};
-  folly::HHWheelTimer::UniquePtr timer_;
-  const folly::F14NodeMap<std::string, std::vector<uint8_t>>
-      *const frontend_dir_cache_;
+  std::shared_ptr<::ec_prv::url_shortener::web::CoalescedFileReader>
+      coalesced_file_reader_;
+  std::shared_ptr<const ::ec_prv::mime_type::ContentTypes> content_types_;
+  // null if redirect lookups are not limited
+  std::shared_ptr<::ec_prv::url_shortener::web::RedirectCosts> redirect_costs_;
+  std::shared_ptr<folly::SSLContext> captcha_ssl_context_;
+  // for every outbound connection
+  std::shared_ptr<::ec_prv::url_shortener::web::DnsCache> dns_;
+  // shared by every IO thread's captcha client; null with proof of work
+  std::shared_ptr<::ec_prv::url_shortener::web::CaptchaHealth> captcha_health_;
+  // null unless creates are verified by proof of work
+  std::shared_ptr<::ec_prv::url_shortener::web::ProofOfWorkVerifier>
+      proof_of_work_;
+  // otherwise, one per IO thread, keeping its own connections to the captcha
+  // service
+  folly::ThreadLocalPtr<::ec_prv::url_shortener::web::RecaptchaVerifier>
+      recaptcha_;
+  // null unless `api_keys` are configured
+  std::shared_ptr<::ec_prv::url_shortener::web::ApiKeyring> api_keys_;
+
+  auto verifier() -> ::ec_prv::url_shortener::web::CaptchaVerifier * {
+    if (proof_of_work_) {
+      return proof_of_work_.get();
+    }
+    return recaptcha_.get();
+  }
 };
 
 } // namespace
@@ -134,6 +231,8 @@ int main(int argc, char *argv[]) {
   LOG(INFO) << "Starting up url shortener...";
 
   folly::Init _folly_init{&argc, &argv, false};
+  // before RocksDB, proxygen, or the executors start any threads
+  ::ec_prv::url_shortener::web::FrontendReloader::block_reload_signal();
 
   std::unique_ptr<::ec_prv::url_shortener::app_config::ReadOnlyAppConfig,
                   ::ec_prv::url_shortener::app_config::ReadOnlyAppConfig::
@@ -176,12 +275,111 @@ int main(int argc, char *argv[]) {
   std::shared_ptr<::ec_prv::url_shortener::db::ShortenedUrlsDatabase> db =
       ::ec_prv::url_shortener::db::ShortenedUrlsDatabase::open(
           ro_app_state->urls_db_path);
+  // concurrent creates of the same URL share one slug generation and write
+  auto creates =
+      std::make_shared<::ec_prv::url_shortener::web::CoalescedCreates>(
+          db.get(), url_shortening_svc.get());
 
-  // build cache of frontend directory files
-  std::unique_ptr<folly::F14NodeMap<std::string, std::vector<uint8_t>>>
-      frontend_dir_cache =
-          ::ec_prv::url_shortener::web::build_frontend_dir_cache(
-              ro_app_state->frontend_doc_root);
+  // media types are resolved once per file, when its response metadata is
+  // computed, rather than per request
+  auto content_types =
+      std::make_shared<const ::ec_prv::mime_type::ContentTypes>(
+          ro_app_state->mime_types);
+
+  // Map the packed frontend; prefer a bundle file, so that it can be updated
+  // without relinking, then one linked into this binary. Reloaded on SIGHUP
+  // and whenever the bundle file or export directory changes.
+  CHECK(!ro_app_state->frontend_bundle_path.empty() ||
+        !::ec_prv::url_shortener::web::embedded_frontend_bundle().empty() ||
+        !ro_app_state->frontend_doc_root.empty())
+      << "Configure either \"frontend_bundle_path\" or "
+         "\"frontend_doc_root\"";
+  auto load_frontend = [app_state = ro_app_state.get(), content_types]()
+      -> std::unique_ptr<::ec_prv::url_shortener::web::FrontendBundle> {
+    if (!app_state->frontend_bundle_path.empty()) {
+      return ::ec_prv::url_shortener::web::FrontendBundle::open(
+          app_state->frontend_bundle_path, *content_types);
+    }
+    if (auto embedded =
+            ::ec_prv::url_shortener::web::embedded_frontend_bundle();
+        !embedded.empty()) {
+      return ::ec_prv::url_shortener::web::FrontendBundle::from_memory(
+          embedded, *content_types);
+    }
+    LOG(WARNING) << "Packing frontend from " << app_state->frontend_doc_root
+                 << " at startup. Build the \"frontend_bundle\" target and "
+                    "set \"frontend_bundle_path\" in production.";
+    return ::ec_prv::url_shortener::web::FrontendBundle::from_directory(
+        app_state->frontend_doc_root, *content_types);
+  };
+  std::filesystem::path watched_frontend_path;
+  if (ro_app_state->frontend_watch) {
+    if (!ro_app_state->frontend_bundle_path.empty()) {
+      watched_frontend_path = ro_app_state->frontend_bundle_path;
+    } else if (::ec_prv::url_shortener::web::embedded_frontend_bundle()
+                   .empty()) {
+      watched_frontend_path = ro_app_state->frontend_doc_root;
+    }
+  }
+  ::ec_prv::url_shortener::web::FrontendReloader frontend_reloader{
+      load_frontend, watched_frontend_path};
+
+  auto static_file_cache =
+      std::make_shared<::ec_prv::url_shortener::web::StaticFileCache>(
+          ro_app_state->static_file_cache_max_bytes,
+          ro_app_state->static_file_cache_max_file_bytes, content_types);
+  auto coalesced_file_reader =
+      std::make_shared<::ec_prv::url_shortener::web::CoalescedFileReader>(
+          static_file_cache);
+
+  ::ec_prv::url_shortener::web::RouteClassifier route_classifier{
+      &frontend_reloader, ro_app_state->static_file_request_path_prefix};
+  // one set of limiters for all IO threads, so that an IP's budget does not
+  // depend on which thread its connection landed on
+  auto rate_limits =
+      std::make_shared<::ec_prv::url_shortener::web::RateLimitPolicies>(
+          *ro_app_state);
+  // filled by the rate limiters, checked before a connection is even read
+  auto bans = std::make_shared<::ec_prv::url_shortener::web::BanList>(
+      ro_app_state->ban_after_rejections,
+      std::chrono::seconds{ro_app_state->ban_seconds},
+      std::chrono::seconds{ro_app_state->ban_max_seconds});
+  ::ec_prv::url_shortener::web::AntiAbuseProtection anti_abuse{
+      ro_app_state.get(), rate_limits, bans};
+  ::ec_prv::url_shortener::web::ConnectionGuard connection_guard{
+      ro_app_state.get(), bans};
+  std::shared_ptr<::ec_prv::url_shortener::web::RedirectCosts> redirect_costs;
+  if (ro_app_state->redirect_cost_per_minute > 0) {
+    redirect_costs =
+        std::make_shared<::ec_prv::url_shortener::web::RedirectCosts>(
+            ro_app_state.get(), bans);
+  }
+
+  std::shared_ptr<::ec_prv::url_shortener::web::ProofOfWorkVerifier>
+      proof_of_work;
+  std::shared_ptr<::ec_prv::url_shortener::web::CaptchaHealth> captcha_health;
+  if (ro_app_state->captcha_verifier == "proof_of_work") {
+    proof_of_work =
+        std::make_shared<::ec_prv::url_shortener::web::ProofOfWorkVerifier>(
+            *ro_app_state, rate_limits);
+  } else {
+    CHECK_EQ(ro_app_state->captcha_verifier, "recaptcha")
+        << "Fix the configuration entry \"captcha_verifier\"";
+    captcha_health =
+        std::make_shared<::ec_prv::url_shortener::web::CaptchaHealth>(
+            *ro_app_state);
+  }
+  std::shared_ptr<::ec_prv::url_shortener::web::ApiKeyring> api_keys;
+  if (!ro_app_state->api_keys.empty()) {
+    api_keys = std::make_shared<::ec_prv::url_shortener::web::ApiKeyring>(
+        *ro_app_state);
+  }
+  // loaded once and shared by every IO thread's captcha client
+  auto captcha_ssl_context =
+      ::ec_prv::url_shortener::web::CaptchaClient::make_ssl_context(
+          *ro_app_state);
+  auto dns = std::make_shared<::ec_prv::url_shortener::web::DnsCache>(
+      *ro_app_state);
 
   proxygen::HTTPServerOptions options;
   options.threads = static_cast<size_t>(FLAGS_threads);
@@ -190,19 +388,33 @@ int main(int argc, char *argv[]) {
   options.enableContentCompression = false;
   options.handlerFactories =
       proxygen::RequestHandlerChain()
-          .addThen<::ec_prv::url_shortener::web::AntiAbuseProtection>(
-              ro_app_state.get())
           .addThen<MyRequestHandlerFactory>(ro_app_state.get(),
                                             url_shortening_svc.get(), db,
-                                            frontend_dir_cache.get())
+                                            creates,
+                                            &frontend_reloader,
+                                            &route_classifier, &anti_abuse,
+                                            static_file_cache,
+                                            coalesced_file_reader,
+                                            content_types, redirect_costs,
+                                            captcha_ssl_context, dns,
+                                            captcha_health, proof_of_work,
+                                            api_keys)
           .build();
   // Increase the default flow control to 1MB/10MB
   options.initialReceiveWindow = uint32_t(1 << 20);
   options.receiveStreamWindowSize = uint32_t(1 << 20);
   options.receiveSessionWindowSize = 10 * (1 << 20);
   options.h2cEnabled = true;
+  // runs as each connection is accepted, before anything is read from it
+  options.newConnectionFilter = [&connection_guard](
+                                    const auto * /* sock */,
+                                    const folly::SocketAddress *address,
+                                    const auto &...) {
+    connection_guard.admit(*address);
+  };
 
   proxygen::HTTPServer server(std::move(options));
+  server.setSessionInfoCallback(&connection_guard);
   server.bind(IPs);
 
   // Start HTTPServer mainloop in a separate thread